@@ -423,15 +423,337 @@ gswat_debuggable_get_stack (GSwatDebuggable* object)
   return ret;
 }
 
+/* Like gswat_debuggable_get_stack, but without blocking. callback is
+ * called from the main loop once the stack is available, and should
+ * call gswat_debuggable_get_stack_finish to get it. */
 void
-gswat_debuggable_frame_free (GSwatDebuggableFrame *frame)
+gswat_debuggable_get_stack_async (GSwatDebuggable *object,
+				  GCancellable *cancellable,
+				  GAsyncReadyCallback callback,
+				  gpointer user_data)
 {
-  GList *tmp;
+  GSwatDebuggableIface *debuggable;
+
+  g_return_if_fail (GSWAT_IS_DEBUGGABLE (object));
+  debuggable = GSWAT_DEBUGGABLE_GET_IFACE (object);
+
+  debuggable->get_stack_async (object, cancellable, callback, user_data);
+}
+
+/* Returns the stack, which should be freed with
+ * gswat_debuggable_stack_free. As with gswat_debuggable_get_stack
+ * this is NULL without an error if the target isn't interrupted. */
+GQueue *
+gswat_debuggable_get_stack_finish (GSwatDebuggable *object,
+				   GAsyncResult *result,
+				   GError **error)
+{
+  GSwatDebuggableIface *debuggable;
+
+  g_return_val_if_fail (GSWAT_IS_DEBUGGABLE (object), NULL);
+  g_return_val_if_fail (G_IS_ASYNC_RESULT (result), NULL);
+  debuggable = GSWAT_DEBUGGABLE_GET_IFACE (object);
+
+  return debuggable->get_stack_finish (object, result, error);
+}
+
+/* Returns count frames of the stack, from level first down, or
+ * fewer if the stack isn't that deep. A stack can be very deep, so
+ * this lets a view fetch just the frames it is showing. The frames
+ * should be freed with gswat_debuggable_stack_free. */
+GQueue *
+gswat_debuggable_get_stack_range (GSwatDebuggable *object,
+				  guint first,
+				  guint count)
+{
+  GSwatDebuggableIface *debuggable;
+  GQueue *ret;
+
+  g_return_val_if_fail (GSWAT_IS_DEBUGGABLE (object), NULL);
+  debuggable = GSWAT_DEBUGGABLE_GET_IFACE (object);
+
+  g_object_ref (object);
+  if (gswat_debuggable_get_state (object) != GSWAT_DEBUGGABLE_INTERRUPTED)
+    ret = NULL;
+  else if (debuggable->get_stack_range)
+    ret = debuggable->get_stack_range (object, first, count);
+  else
+    {
+      GSwatDebuggableFrame *frame;
+
+      /* Cut the range out of the whole stack */
+      ret = debuggable->get_stack (object);
+      while (ret && (frame = g_queue_peek_head (ret))
+	     && frame->level < first)
+	gswat_debuggable_frame_free (g_queue_pop_head (ret));
+      while (ret && ret->length > count)
+	gswat_debuggable_frame_free (g_queue_pop_tail (ret));
+    }
+  g_object_unref (object);
+
+  return ret;
+}
+
+/* Returns how many frames deep the stack is, which may be more than
+ * have been fetched so far */
+guint
+gswat_debuggable_get_stack_depth (GSwatDebuggable *object)
+{
+  GSwatDebuggableIface *debuggable;
+  guint ret = 0;
+
+  g_return_val_if_fail (GSWAT_IS_DEBUGGABLE (object), 0);
+  debuggable = GSWAT_DEBUGGABLE_GET_IFACE (object);
+
+  g_object_ref (object);
+  if (gswat_debuggable_get_state (object) != GSWAT_DEBUGGABLE_INTERRUPTED)
+    ret = 0;
+  else if (debuggable->get_stack_depth)
+    ret = debuggable->get_stack_depth (object);
+  else
+    {
+      GQueue *stack = debuggable->get_stack (object);
+
+      if (stack)
+	ret = stack->length;
+      gswat_debuggable_stack_free (stack);
+    }
+  g_object_unref (object);
+
+  return ret;
+}
+
+/* Returns a reference on a snapshot of the stack, which should be
+ * released with gswat_stack_snapshot_unref. Unlike
+ * gswat_debuggable_get_stack, this doesn't copy the stack; the
+ * snapshot is made once per stop and shared by everyone who asks for
+ * it. It doesn't wait for a deep stack to be fetched, so it may only
+ * have the frames at the top; gswat_stack_snapshot_get_depth says
+ * how deep the stack is, and gswat_debuggable_get_stack_range gets
+ * the frames further down. */
+GSwatStackSnapshot *
+gswat_debuggable_get_stack_snapshot (GSwatDebuggable *object)
+{
+  GSwatDebuggableIface *debuggable;
+  GSwatStackSnapshot *ret = NULL;
+
+  g_return_val_if_fail (GSWAT_IS_DEBUGGABLE (object), NULL);
+  debuggable = GSWAT_DEBUGGABLE_GET_IFACE (object);
+
+  g_object_ref (object);
+  if (gswat_debuggable_get_state (object) != GSWAT_DEBUGGABLE_INTERRUPTED)
+    ret = NULL;
+  else if (debuggable->get_stack_snapshot)
+    ret = debuggable->get_stack_snapshot (object);
+  else
+    {
+      GQueue *stack = debuggable->get_stack (object);
+
+      if (stack)
+	ret = gswat_stack_snapshot_new (stack, stack->length);
+      gswat_debuggable_stack_free (stack);
+    }
+  g_object_unref (object);
+
+  return ret;
+}
+
+/* A snapshot is never changed once it's made, so it can be shared
+ * rather than copied. The frames are kept in one array, their
+ * arguments and the links of the argument lists in two more, and
+ * the strings in a string chunk where a function or file name that
+ * recurs down the stack is only stored once. */
+struct _GSwatStackSnapshot {
+    gint ref_count;
+    guint depth;
+    guint n_frames;
+    GSwatDebuggableFrame *frames;
+    GSwatDebuggableFrameArgument *arguments;
+    GList *argument_links;
+    GStringChunk *strings;
+};
+
+static gchar *
+snapshot_insert_string (GSwatStackSnapshot *snapshot, const gchar *string)
+{
+  if (!string)
+    return NULL;
+
+  return g_string_chunk_insert_const (snapshot->strings, string);
+}
+
+/* Makes a snapshot of the frames in stack, which is depth frames
+ * deep, though it may only have the frames at the top of it. */
+GSwatStackSnapshot *
+gswat_stack_snapshot_new (GQueue *stack, guint depth)
+{
+  GSwatStackSnapshot *snapshot;
+  GList *tmp, *tmp2;
+  guint n_arguments = 0;
+  guint i, j;
+
+  g_return_val_if_fail (stack != NULL, NULL);
+
+  for (tmp=stack->head; tmp!=NULL; tmp=tmp->next)
+    {
+      GSwatDebuggableFrame *frame = tmp->data;
 
+      n_arguments += g_list_length (frame->arguments);
+    }
+
+  snapshot = g_new0 (GSwatStackSnapshot, 1);
+  snapshot->ref_count = 1;
+  snapshot->depth = MAX (depth, stack->length);
+  snapshot->n_frames = stack->length;
+  snapshot->frames = g_new (GSwatDebuggableFrame, stack->length);
+  snapshot->arguments = g_new (GSwatDebuggableFrameArgument, n_arguments);
+  snapshot->argument_links = g_new0 (GList, n_arguments);
+  snapshot->strings = g_string_chunk_new (1024);
+
+  for (tmp=stack->head, i=0, j=0; tmp!=NULL; tmp=tmp->next, i++)
+    {
+      GSwatDebuggableFrame *frame = tmp->data;
+      GSwatDebuggableFrame *copy = &snapshot->frames[i];
+      GList *prev = NULL;
+
+      copy->level = frame->level;
+      copy->address = frame->address;
+      copy->function = snapshot_insert_string (snapshot, frame->function);
+      copy->source_uri = snapshot_insert_string (snapshot, frame->source_uri);
+      copy->line = frame->line;
+      copy->arguments = NULL;
+
+      for (tmp2=frame->arguments; tmp2!=NULL; tmp2=tmp2->next, j++)
+	{
+	  GSwatDebuggableFrameArgument *arg = tmp2->data;
+	  GList *link = &snapshot->argument_links[j];
+
+	  snapshot->arguments[j].name =
+	    snapshot_insert_string (snapshot, arg->name);
+	  snapshot->arguments[j].value =
+	    snapshot_insert_string (snapshot, arg->value);
+
+	  link->data = &snapshot->arguments[j];
+	  link->prev = prev;
+	  if (prev)
+	    prev->next = link;
+	  else
+	    copy->arguments = link;
+	  prev = link;
+	}
+    }
+
+  return snapshot;
+}
+
+GSwatStackSnapshot *
+gswat_stack_snapshot_ref (GSwatStackSnapshot *snapshot)
+{
+  g_return_val_if_fail (snapshot != NULL, NULL);
+
+  g_atomic_int_inc (&snapshot->ref_count);
+  return snapshot;
+}
+
+void
+gswat_stack_snapshot_unref (GSwatStackSnapshot *snapshot)
+{
+  g_return_if_fail (snapshot != NULL);
+
+  if (!g_atomic_int_dec_and_test (&snapshot->ref_count))
+    return;
+
+  g_free (snapshot->frames);
+  g_free (snapshot->arguments);
+  g_free (snapshot->argument_links);
+  g_string_chunk_free (snapshot->strings);
+  g_free (snapshot);
+}
+
+/* The number of frames in the snapshot, which is fewer than its
+ * depth if only the top of a deep stack had been fetched */
+guint
+gswat_stack_snapshot_get_n_frames (GSwatStackSnapshot *snapshot)
+{
+  g_return_val_if_fail (snapshot != NULL, 0);
+
+  return snapshot->n_frames;
+}
+
+guint
+gswat_stack_snapshot_get_depth (GSwatStackSnapshot *snapshot)
+{
+  g_return_val_if_fail (snapshot != NULL, 0);
+
+  return snapshot->depth;
+}
+
+/* Returns the frame at the given level, or NULL if the snapshot
+ * doesn't have it. The frame belongs to the snapshot and mustn't be
+ * changed or freed; that includes its list of arguments. */
+const GSwatDebuggableFrame *
+gswat_stack_snapshot_get_frame (GSwatStackSnapshot *snapshot, guint level)
+{
+  g_return_val_if_fail (snapshot != NULL, NULL);
+
+  if (level >= snapshot->n_frames)
+    return NULL;
+
+  return &snapshot->frames[level];
+}
+
+void
+gswat_debuggable_frame_free (GSwatDebuggableFrame *frame)
+{
   g_free (frame->function);
   g_free (frame->source_uri);
+  gswat_debuggable_free_frame_arguments (frame->arguments);
+
+  g_free (frame);
+}
 
-  for (tmp=frame->arguments; tmp!=NULL; tmp=tmp->next)
+/* The arguments of the frames in a stack may only have simple values,
+ * or be cut short, depending on the session. This returns a list of
+ * all the arguments of the frame at the given level with their full
+ * values, which should be freed with
+ * gswat_debuggable_free_frame_arguments. */
+GList *
+gswat_debuggable_get_frame_arguments (GSwatDebuggable *object, guint level)
+{
+  GSwatDebuggableIface *debuggable;
+  GList *ret = NULL;
+
+  g_return_val_if_fail (GSWAT_IS_DEBUGGABLE (object), NULL);
+  debuggable = GSWAT_DEBUGGABLE_GET_IFACE (object);
+
+  g_object_ref (object);
+  if (gswat_debuggable_get_state (object) != GSWAT_DEBUGGABLE_INTERRUPTED)
+    ret = NULL;
+  else if (debuggable->get_frame_arguments)
+    ret = debuggable->get_frame_arguments (object, level);
+  else
+    {
+      GQueue *frames = gswat_debuggable_get_stack_range (object, level, 1);
+      GSwatDebuggableFrame *frame;
+
+      if (frames && (frame = g_queue_peek_head (frames)))
+	{
+	  ret = frame->arguments;
+	  frame->arguments = NULL;
+	}
+      gswat_debuggable_stack_free (frames);
+    }
+  g_object_unref (object);
+
+  return ret;
+}
+
+void
+gswat_debuggable_free_frame_arguments (GList *arguments)
+{
+  GList *tmp;
+
+  for (tmp=arguments; tmp!=NULL; tmp=tmp->next)
     {
       GSwatDebuggableFrameArgument *arg =
 	(GSwatDebuggableFrameArgument *)tmp->data;
@@ -440,9 +762,7 @@ gswat_debuggable_frame_free (GSwatDebuggableFrame *frame)
       g_free (arg->value);
       g_free (arg);
     }
-  g_list_free (frame->arguments);
-
-  g_free (frame);
+  g_list_free (arguments);
 }
 
 void
@@ -519,6 +839,39 @@ gswat_debuggable_get_locals_list (GSwatDebuggable* object)
   return ret;
 }
 
+/* Like gswat_debuggable_get_locals_list, but without blocking.
+ * callback is called from the main loop once the list is available,
+ * and should call gswat_debuggable_get_locals_list_finish to get it. */
+void
+gswat_debuggable_get_locals_list_async (GSwatDebuggable *object,
+					GCancellable *cancellable,
+					GAsyncReadyCallback callback,
+					gpointer user_data)
+{
+  GSwatDebuggableIface *debuggable;
+
+  g_return_if_fail (GSWAT_IS_DEBUGGABLE (object));
+  debuggable = GSWAT_DEBUGGABLE_GET_IFACE (object);
+
+  debuggable->get_locals_list_async (object, cancellable, callback, user_data);
+}
+
+/* Returns a list of referenced GSwatVariableObjects, as
+ * gswat_debuggable_get_locals_list does */
+GList *
+gswat_debuggable_get_locals_list_finish (GSwatDebuggable *object,
+					 GAsyncResult *result,
+					 GError **error)
+{
+  GSwatDebuggableIface *debuggable;
+
+  g_return_val_if_fail (GSWAT_IS_DEBUGGABLE (object), NULL);
+  g_return_val_if_fail (G_IS_ASYNC_RESULT (result), NULL);
+  debuggable = GSWAT_DEBUGGABLE_GET_IFACE (object);
+
+  return debuggable->get_locals_list_finish (object, result, error);
+}
+
 guint
 gswat_debuggable_get_frame (GSwatDebuggable* object)
 {
@@ -23,6 +23,7 @@
 #define GSWAT_DEBUGGABLE_H
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -43,11 +44,13 @@ G_BEGIN_DECLS
 #define GSWAT_DEBUGGABLE_ERROR (gswat_debuggable_error_quark ())
 
 enum {
-    GSWAT_DEBUGGABLE_ERROR_TARGET_CONNECT_FAILED
+    GSWAT_DEBUGGABLE_ERROR_TARGET_CONNECT_FAILED,
+    GSWAT_DEBUGGABLE_ERROR_QUERY_FAILED
 };
 
 typedef struct _GSwatDebuggableIface GSwatDebuggableIface;
 typedef struct _GSwatDebuggable GSwatDebuggable; /* dummy typedef */
+typedef struct _GSwatStackSnapshot GSwatStackSnapshot;
 
 struct _GSwatDebuggableIface
 {
@@ -79,6 +82,26 @@ struct _GSwatDebuggableIface
                            const GList *paths);
   char *(*get_uri_for_file)(GSwatDebuggable *object,
                             const char *file);
+  void (*get_stack_async)(GSwatDebuggable *object,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data);
+  GQueue *(*get_stack_finish)(GSwatDebuggable *object,
+                              GAsyncResult *result,
+                              GError **error);
+  void (*get_locals_list_async)(GSwatDebuggable *object,
+                                GCancellable *cancellable,
+                                GAsyncReadyCallback callback,
+                                gpointer user_data);
+  GList *(*get_locals_list_finish)(GSwatDebuggable *object,
+                                   GAsyncResult *result,
+                                   GError **error);
+  GQueue *(*get_stack_range)(GSwatDebuggable *object,
+                             guint first,
+                             guint count);
+  guint (*get_stack_depth)(GSwatDebuggable *object);
+  GSwatStackSnapshot *(*get_stack_snapshot)(GSwatDebuggable *object);
+  GList *(*get_frame_arguments)(GSwatDebuggable *object, guint level);
 };
 
 typedef enum {
@@ -127,11 +150,40 @@ void gswat_debuggable_step (GSwatDebuggable* object);
 void gswat_debuggable_interrupt (GSwatDebuggable* object);
 void gswat_debuggable_restart (GSwatDebuggable* object);
 GQueue *gswat_debuggable_get_stack (GSwatDebuggable* object);
+void gswat_debuggable_get_stack_async (GSwatDebuggable *object,
+                                       GCancellable *cancellable,
+                                       GAsyncReadyCallback callback,
+                                       gpointer user_data);
+GQueue *gswat_debuggable_get_stack_finish (GSwatDebuggable *object,
+                                           GAsyncResult *result,
+                                           GError **error);
+GQueue *gswat_debuggable_get_stack_range (GSwatDebuggable *object,
+                                          guint first,
+                                          guint count);
+guint gswat_debuggable_get_stack_depth (GSwatDebuggable *object);
+GSwatStackSnapshot *gswat_debuggable_get_stack_snapshot (GSwatDebuggable *object);
+GSwatStackSnapshot *gswat_stack_snapshot_new (GQueue *stack, guint depth);
+GSwatStackSnapshot *gswat_stack_snapshot_ref (GSwatStackSnapshot *snapshot);
+void gswat_stack_snapshot_unref (GSwatStackSnapshot *snapshot);
+guint gswat_stack_snapshot_get_n_frames (GSwatStackSnapshot *snapshot);
+guint gswat_stack_snapshot_get_depth (GSwatStackSnapshot *snapshot);
+const GSwatDebuggableFrame *gswat_stack_snapshot_get_frame (GSwatStackSnapshot *snapshot,
+                                                            guint level);
 void gswat_debuggable_stack_free (GQueue *stack);
 void gswat_debuggable_frame_free (GSwatDebuggableFrame *frame);
+GList *gswat_debuggable_get_frame_arguments (GSwatDebuggable *object,
+                                             guint level);
+void gswat_debuggable_free_frame_arguments (GList *arguments);
 GList *gswat_debuggable_get_breakpoints (GSwatDebuggable* object);
 void gswat_debuggable_free_breakpoints (GList *breakpoints);
 GList *gswat_debuggable_get_locals_list (GSwatDebuggable* object);
+void gswat_debuggable_get_locals_list_async (GSwatDebuggable *object,
+                                             GCancellable *cancellable,
+                                             GAsyncReadyCallback callback,
+                                             gpointer user_data);
+GList *gswat_debuggable_get_locals_list_finish (GSwatDebuggable *object,
+                                                GAsyncResult *result,
+                                                GError **error);
 guint gswat_debuggable_get_frame (GSwatDebuggable* object);
 void gswat_debuggable_set_frame (GSwatDebuggable* object, guint frame);
 GList *gswat_debuggable_get_search_paths (GSwatDebuggable *object);
@@ -30,6 +30,7 @@
 #include <signal.h>
 #include <ctype.h>
 #include <poll.h>
+#include <errno.h>
 #include <gio/gio.h>
 #include <glib/gi18n-lib.h>
 
@@ -40,6 +41,8 @@
 #include "gswat-variable-object.h"
 #include "gswat-gdb-debugger.h"
 #include "gswat-gdb-variable-object.h"
+#include "gswat-gdb-mi-decoders.h"
+#include "gswat-source-index.h"
 #include "gswat-debug.h"
 
 #define GSWAT_GDB_DEBUGGER_GET_PRIVATE(object) \
@@ -50,6 +53,20 @@
 #define GDBMI_DONE_CALLBACK(X)   ( (GDBMIDoneCallback) (X))
 
 #define DEFAULT_GDB_IO_TIMEOUT  (15000)
+#define DEFAULT_MI_COMMAND_TIMEOUT  (0)
+#define DEFAULT_MAX_COMMANDS_IN_FLIGHT  (16)
+
+/* How many frames an incremental stack update fetches first */
+#define STACK_WINDOW  (8)
+/* How many frames have to line up with the previous stack before
+ * an incremental stack update takes over the frames below them */
+#define STACK_MATCH_FRAMES  (2)
+/* How many frames a stack update fetches at most; any below that
+ * are fetched as they are asked for */
+#define STACK_PAGE  (64)
+/* The deepest we count the stack; a runaway recursion is shown as
+ * being this many frames deep */
+#define STACK_DEPTH_LIMIT  (10000)
 
 
 enum {
@@ -72,29 +89,84 @@ enum {
 typedef struct {
     gboolean in_use;
     GList *names;
-    gulong list_arguments_token;
-    gulong list_locals_token;
     gboolean list_arguments_done;
 }LocalsUpdateMachine;
 
+/* The tail end of a locals update; waiting for gdb to update the
+ * variable objects of the existing locals and create those for any
+ * new ones */
+typedef struct {
+    GSwatGdbDebugger *self;
+    GList *names;
+    /* The names without a variable object yet */
+    GList *new_names;
+    GList *new_locals;
+    guint interrupt_count;
+}LocalsCreateState;
+
 typedef struct {
     gboolean in_use;
     GQueue *new_stack;
-    gulong list_frames_token;
-    gulong list_args_token;
     gboolean list_frames_done;
+    /* An update fetches the stack a window of frames at a time,
+     * from the top, up to STACK_PAGE frames. An incremental one
+     * stops early if the frames it gets line up with the outer
+     * frames of the previous stack. */
+    gboolean incremental;
+    gboolean depth_known;
+    guint depth;
+    guint window_size;
+    guint window_start;
+    guint window_end;
+    /* Set once the previous stack's outer frames have been taken
+     * over, while their arguments are fetched again */
+    gboolean refreshing_arguments;
 }StackUpdateMachine;
 
+/* A gswat_debuggable_get_stack_async or get_locals_list_async
+ * call waiting for the corresponding update to finish */
+typedef struct {
+    GList **waiters;
+    GSimpleAsyncResult *result;
+    GCancellable *cancellable;
+    gulong cancelled_id;
+}GdbAsyncWaiter;
+
+typedef struct _GSwatGdbMIHandler GSwatGdbMIHandler;
+typedef struct _GdbPendingRecord GdbPendingRecord;
+
+/* A single producer, single consumer queue of records. The I/O
+ * thread pushes onto the tail and the main thread pops from the
+ * head, and since each end is only touched by one thread it doesn't
+ * need a lock. The head always points at a dummy node, the last one
+ * popped, so the two ends never share a node that is being changed. */
+typedef struct _GdbIOQueueNode {
+    struct _GdbIOQueueNode *volatile next;
+    GdbPendingRecord *record;
+}GdbIOQueueNode;
+
+typedef struct {
+    GdbIOQueueNode *head;
+    GdbIOQueueNode *tail;
+}GdbIOQueue;
+
 struct _GSwatGdbDebuggerPrivate
 {
   GSwatSession            *session;
 
   GSwatDebuggableState    state;
 
+  /* The terminal the program being debugged is connected to, so its
+   * output doesn't get mixed up with gdb's. This is NULL if there
+   * wasn't a pseudo terminal for it, in which case it shares gdb's. */
+  GSwatInferiorStream     *inferior_stream;
+
   /* Every time the debugger stops, then this
    * is incremented. This is used to validate
    * variable objects. */
   guint                   interrupt_count;
+  /* Like interrupt_count, but not bumped when the frame changes */
+  guint                   stop_count;
 
 
   /* A small state machine for tracking the
@@ -108,14 +180,32 @@ struct _GSwatGdbDebuggerPrivate
   /* When the stack is invalidated, then we have
    * to send a request to GDB for the data */
   gboolean                stack_valid;
+  /* How deep the stack is. Only the frames at the top are
+   * fetched when the stack is updated, so there may be fewer
+   * than this in stack, with more fetched on demand. */
+  guint                   stack_depth;
+  /* The stack as it was at the last stop, kept while the
+   * stack is invalid so an incremental update can take any
+   * outer frames that haven't changed from it */
+  GQueue                  *previous_stack;
+  guint                   previous_depth;
+  /* Shared with anyone who asks for a snapshot of the stack */
+  GSwatStackSnapshot      *stack_snapshot;
+  /* The arguments of the frames, with their full values, that
+   * have been asked for since the last stop, by level */
+  GHashTable              *full_arguments;
+  gboolean                incremental_stack;
   /* The currently active frame level */
   guint                   frame_level;
+  /* GdbAsyncWaiters for the stack update to finish */
+  GList                   *stack_waiters;
 
   gchar                   *current_source_uri;
   gint                    current_line;
 
   /* Where to look for source code */
   GList                   *paths;
+  GSwatSourceIndex        *source_index;
 
   GList                   *breakpoints;
   /* gchar                   *source_uri; */
@@ -133,13 +223,15 @@ struct _GSwatGdbDebuggerPrivate
   /* When the locals are invalidated, then we have
    * to send a request to GDB for the data */
   gboolean                locals_valid;
+  /* GdbAsyncWaiters for the locals update to finish */
+  GList                   *locals_waiters;
 
 
   /* Our GDB conection state */
   gboolean        gdb_connected;
+  gint	    gdb_in_fd;
   gint	    gdb_out_fd;
   gint	    gdb_err_fd;
-  GIOChannel      *gdb_in;
   GIOChannel      *gdb_out;
   GIOChannel      *gdb_err;
   guint           gdb_out_event;
@@ -151,11 +243,84 @@ struct _GSwatGdbDebuggerPrivate
    * use with GDB MI requests */
   unsigned long   gdb_sequence;
 
-  /* GDB records are read in one line at a time and
-   * entered into the gdb_pending queue. */
+  /* gdb's stdout is drained with large non-blocking reads into
+   * this buffer. Every complete line is split out into the
+   * gdb_pending queue straight away, so between reads it only holds
+   * the start of an incomplete line. */
+  gchar           *gdb_out_buffer;
+  gsize           gdb_out_buffer_size;
+  gsize           gdb_out_buffer_len;
+  /* The charset gdb reads and writes in, or NULL if that's UTF-8.
+   * With raw_io gdb is asked to use UTF-8 whatever the locale, and
+   * its pipes carry bytes that are never converted. */
+  gchar           *gdb_charset;
+  gboolean        raw_io;
+
+  /* Commands are formatted into this buffer and written to gdb in
+   * one go, either straight away or, while we are corked, when the
+   * last gswat_gdb_debugger_uncork() is called. */
+  GString         *gdb_in_buffer;
+  guint           gdb_cork_count;
+
+  /* GDB records waiting to be processed */
   GQueue          *gdb_pending;
 
-  GSList          *mi_handlers;
+  /* With threaded I/O, gdb's stdout is read, split and parsed in
+   * gdb_io_thread, which hands the records over in gdb_io_queue. It
+   * writes a byte to the gdb_io_wakeup pipe, which we watch instead
+   * of gdb's stdout, when it queues records and gdb_io_wakeup_pending
+   * isn't already set. A byte written to gdb_io_stop tells it to
+   * exit. Once the thread is done it queues a record without any
+   * text, and gdb_io_error says why. */
+  gboolean        threaded_io;
+  GThread         *gdb_io_thread;
+  GdbIOQueue      gdb_io_queue;
+  gint            gdb_io_wakeup[2];
+  gint            gdb_io_stop[2];
+  GIOChannel      *gdb_io_wakeup_channel;
+  volatile gint   gdb_io_wakeup_pending;
+  gboolean        gdb_io_thread_done;
+  GError          *gdb_io_error;
+
+  /* The handlers for commands we are waiting on a result for. This
+   * is a ring indexed by token, and since tokens are handed out in
+   * sequence it is densely populated by the commands in flight,
+   * from mi_handlers_oldest up to gdb_sequence. */
+  GSwatGdbMIHandler *mi_handlers;
+  guint           mi_handlers_size;
+  gulong          mi_handlers_oldest;
+  guint           n_mi_handlers;
+
+  /* Commands that gdb hasn't answered this many milliseconds after
+   * being sent are expired, or 0 to wait forever */
+  guint           mi_command_timeout;
+  GTimer          *mi_handler_clock;
+  /* The tokens of the commands sent with a deadline, in the order
+   * they were sent */
+  GQueue          mi_deadlines;
+  /* The tokens of the commands that expired, so we can tell if gdb
+   * answers them after all */
+  GHashTable      *expired_tokens;
+
+  /* The command scheduler. While max_in_flight commands (if not 0)
+   * are waiting on gdb, any new commands below interactive priority
+   * are held back in held_commands; a queue of GdbHeldCommands per
+   * priority. As results come in they are sent on, highest priority
+   * first. */
+  guint           max_in_flight;
+  guint           n_in_flight;
+  GQueue          held_commands[GSWAT_GDB_COMMAND_PRIORITY_COUNT];
+  GSwatGdbCommandStats command_stats;
+
+  /* The futures for read-only queries sent since the debugger last
+   * stopped or changed frame, keyed by command. The epoch is the
+   * interrupt_count they were sent under. */
+  GHashTable      *mi_queries;
+  guint           mi_queries_epoch;
+
+  /* Set while the refreshes for an earlier stop are being cancelled,
+   * since another refresh is about to replace them */
+  gboolean        cancelling_stale;
 
   /* When we add an entry to gdb_pending we queue
    * an idle handler for processing the commands
@@ -167,19 +332,89 @@ struct _GSwatGdbDebuggerPrivate
   GPid            target_pid;
 };
 
-typedef struct {
+/* FIXME: this should be removed and records should be added
+ * to the pending queue using GSwatGdbMIRecord structs.
+ */
+struct _GdbPendingRecord {
+    gulong token;
+    /* The record without its token or newline. This is NULL for a
+     * result that has been handed to its future, which is only
+     * queued so it's dispatched in order */
+    gchar *text;
+    /* With threaded I/O, result records are parsed by the I/O thread */
+    GDBMIValue *val;
+};
+
+struct _GSwatGdbMIHandler {
+    /* The token of the command this slot is for, or 0 if the slot
+     * is free. Slots get reused as tokens wrap around the ring so
+     * this acts as the slot's generation; it is checked on every
+     * lookup so a late result for an expired command can't reach
+     * whichever handler has reused its slot. */
     gulong token;
     GSwatGdbMIRecordCallback result_callback;
     gpointer data;
-}GSwatGdbMIHandler;
+    /* For commands sent with gswat_gdb_debugger_send_mi_command_future */
+    GSwatGdbMIFuture *future;
+    /* When the command expires, in seconds on the mi_handler_clock.
+     * Commands don't expire while they are being held back. */
+    gdouble deadline;
+    GSwatGdbCommandPriority priority;
+    /* Whether the command has been sent and not yet answered */
+    gboolean in_flight;
+    /* The interrupt_count when the command was sent */
+    guint epoch;
+    /* The stop_count when the command was sent */
+    guint stop_epoch;
+    /* The result doesn't depend on the selected frame, so changing
+     * frame doesn't make the command stale */
+    gboolean frame_independent;
+    /* Sent with gswat_gdb_debugger_send_mi_query */
+    gboolean query;
+    /* Nobody wants the result any more; it's dropped unparsed */
+    gboolean discard;
+    /* For commands without a result callback, the result record
+     * once it has arrived, until it's picked up by
+     * gswat_gdb_debugger_get_mi_result_record */
+    GdbPendingRecord *result;
+};
+
+#define MI_HANDLERS_MIN_SIZE 64
 
-/* FIXME: this should be removed and records should be added
- * to the pending queue using GSwatGdbMIRecord structs.
- */
 typedef struct {
     gulong token;
-    GString *record_str;
-}GdbPendingRecord;
+    gchar *command;
+    /* When it was held back, on the mi_handler_clock */
+    gdouble held_since;
+}GdbHeldCommand;
+
+typedef struct {
+    GSwatGdbMIRecordCallback callback;
+    gpointer data;
+}GSwatGdbMIFutureCallback;
+
+struct _GSwatGdbMIFuture {
+    gint ref_count;
+    /* A weak pointer, so it's NULL once the debugger is gone */
+    GSwatGdbDebugger *debugger;
+    gulong token;
+    /* Set as soon as the result has been read from gdb, which may be
+     * a while before it is dispatched */
+    GSwatGdbMIRecord *record;
+    /* Set once the result has been dispatched and the callbacks
+     * have been called */
+    gboolean dispatched;
+    GList *callbacks;
+    /* For futures made by gswat_gdb_mi_future_all () */
+    GPtrArray *children;
+    guint n_children_pending;
+    GSwatGdbMIRecordType children_type;
+};
+
+/* The initial size of the gdb_out_buffer, and how much space we
+ * want available before each read */
+#define GDB_OUT_BUFFER_SIZE 65536
+#define GDB_OUT_MIN_READ 4096
 
 
 /* Function definitions */
@@ -213,29 +448,50 @@ static void de_queue_idle_process_gdb_pending (GSwatGdbDebugger *self);
 static gboolean gdb_stderr_watcher (GIOChannel* io,
 				    GIOCondition cond,
 				    gpointer data);
-static gboolean read_next_gdb_line (GSwatGdbDebugger* self, GError **error);
+static gboolean read_gdb_output (GSwatGdbDebugger* self,
+				 gboolean wait,
+				 GError **error);
 static void free_pending_record (GdbPendingRecord *pending_record);
+static gpointer gdb_io_thread (gpointer data);
+static GSwatGdbMIRecord *mi_record_take (GdbPendingRecord *pending_record);
+static void process_gdb_mi_future_result (GSwatGdbDebugger *self,
+					  gulong token);
+static GSwatGdbMIRecord *mi_record_new (GSwatGdbMIRecordType type,
+					const gchar *text);
+static gboolean start_gdb_io_thread (GSwatGdbDebugger *self, GError **error);
+static void stop_gdb_io_thread (GSwatGdbDebugger *self);
+static void gdb_io_queue_push (GdbIOQueue *queue, GdbPendingRecord *record);
 static void queue_pending_record (GSwatGdbDebugger *self,
-				  gulong token,
-				  GString *record_str);
+				  GdbPendingRecord *pending_record);
+static GSwatGdbMIHandler *lookup_mi_handler (GSwatGdbDebugger *self,
+					     gulong token);
+static void send_held_mi_commands (GSwatGdbDebugger *self, gboolean force);
+static void drop_held_mi_commands (GSwatGdbDebugger *self);
+static void mi_command_answered (GSwatGdbDebugger *self,
+				 GSwatGdbMIHandler *handler);
+static void remove_mi_handler (GSwatGdbDebugger *self,
+			       GSwatGdbMIHandler *handler);
+static void expire_mi_handlers (GSwatGdbDebugger *self);
+static void cancel_all_mi_handlers (GSwatGdbDebugger *self);
+static void cancel_stale_mi_commands (GSwatGdbDebugger *self);
 static gboolean idle_process_gdb_pending (gpointer data);
 static void process_gdb_pending (GSwatGdbDebugger *self);
 static void process_gdb_output_record (GSwatGdbDebugger *self,
 				       GdbPendingRecord *record);
 
-static GSwatGdbMIRecordType gdb_mi_get_result_record_type (GString *record_str);
 static void process_gdb_mi_result_record (GSwatGdbDebugger *self,
-					  gulong token,
-					  GString *record_str);
+					  GdbPendingRecord *pending_record);
 static void process_gdb_mi_oob_record (GSwatGdbDebugger *self,
 				       gulong token,
-				       GString *record_str);
+				       gchar *text);
 static void process_gdb_mi_oob_stopped_record (GSwatGdbDebugger *self,
 					       GSwatGdbMIRecord *record);
 static void process_gdb_mi_stream_record (GSwatGdbDebugger *self,
 					  gulong token,
-					  GString *record_str);
+					  gchar *text);
 static void synchronous_update_stack (GSwatGdbDebugger *self);
+static void synchronous_fetch_stack_range (GSwatGdbDebugger *self,
+					   guint high);
 static void kick_asynchronous_locals_update (GSwatGdbDebugger *self);
 static void
 async_locals_update_list_args_mi_callback (GSwatGdbDebugger *self,
@@ -245,6 +501,17 @@ static void async_locals_update_list_locals_mi_callback (GSwatGdbDebugger *self,
 							 const GSwatGdbMIRecord *record,
 							 void *data);
 static void update_locals_list_from_name_list (GSwatGdbDebugger *self, GList *names);
+static void locals_updated_mi_callback (GSwatGdbDebugger *self,
+					const GSwatGdbMIRecord *record,
+					void *data);
+static void create_new_locals (GSwatGdbDebugger *self,
+			       LocalsCreateState *state);
+static void locals_created_mi_callback (GSwatGdbDebugger *self,
+					const GSwatGdbMIRecord *record,
+					void *data);
+static void finish_locals_update (GSwatGdbDebugger *self,
+				  LocalsCreateState *state);
+static void complete_locals_waiters (GSwatGdbDebugger *self);
 static void kick_asynchronous_stack_update (GSwatGdbDebugger *self);
 static void async_stack_update_list_frames_mi_callback (GSwatGdbDebugger *self,
 							const GSwatGdbMIRecord *record,
@@ -252,6 +519,38 @@ static void async_stack_update_list_frames_mi_callback (GSwatGdbDebugger *self,
 static void async_stack_update_list_args_mi_callback (GSwatGdbDebugger *self,
 						      const GSwatGdbMIRecord *record,
 						      void *data);
+static void send_stack_list_queries (GSwatGdbDebugger *self,
+				     StackUpdateMachine *stack_machine,
+				     guint low,
+				     guint high);
+static void send_stack_args_query (GSwatGdbDebugger *self,
+				   StackUpdateMachine *stack_machine,
+				   guint low,
+				   guint high);
+static void async_stack_update_depth_mi_callback (GSwatGdbDebugger *self,
+						  const GSwatGdbMIRecord *record,
+						  void *data);
+static gboolean add_stack_args (GSwatGdbDebugger *self,
+				const GSwatGdbMIRecord *record,
+				StackUpdateMachine *stack_machine);
+static gboolean continue_stack_update (GSwatGdbDebugger *self,
+				       StackUpdateMachine *stack_machine);
+static GSwatGdbMIFuture *send_stack_depth_query (GSwatGdbDebugger *self,
+						 GSwatGdbCommandPriority priority);
+static void kick_stack_fill (GSwatGdbDebugger *self);
+static gint stack_arguments_print_values (GSwatGdbDebugger *self);
+static void limit_argument_values (GSwatGdbDebugger *self, GQueue *stack);
+static void send_print_elements (GSwatGdbDebugger *self, guint max_length);
+static void on_max_argument_value_length_changed (GObject *object,
+						  GParamSpec *property,
+						  gpointer data);
+static void fill_stack_for_waiters (GSwatGdbDebugger *self);
+static void fetch_stack_range_async (GSwatGdbDebugger *self,
+				     guint high,
+				     GSwatGdbCommandPriority priority);
+static void install_new_stack (GSwatGdbDebugger *self,
+			       StackUpdateMachine *stack_machine);
+static void complete_stack_waiters (GSwatGdbDebugger *self);
 static void on_local_variable_object_invalidated (GObject *object,
 						  GParamSpec *property,
 						  gpointer data);
@@ -280,8 +579,31 @@ static gchar *gswat_gdb_debugger_get_source_uri (GSwatDebuggable* object);
 static gint gswat_gdb_debugger_get_source_line (GSwatDebuggable* object);
 static guint gswat_gdb_debugger_get_state (GSwatDebuggable* object);
 static GQueue *gswat_gdb_debugger_get_stack (GSwatDebuggable* object);
+static void gswat_gdb_debugger_get_stack_async (GSwatDebuggable *object,
+						GCancellable *cancellable,
+						GAsyncReadyCallback callback,
+						gpointer user_data);
+static GQueue *gswat_gdb_debugger_get_stack_finish (GSwatDebuggable *object,
+						    GAsyncResult *result,
+						    GError **error);
+static GQueue *gswat_gdb_debugger_get_stack_range (GSwatDebuggable *object,
+						   guint first,
+						   guint count);
+static guint gswat_gdb_debugger_get_stack_depth (GSwatDebuggable *object);
+static GSwatStackSnapshot *gswat_gdb_debugger_get_stack_snapshot (GSwatDebuggable *object);
+static GList *gswat_gdb_debugger_get_frame_arguments (GSwatDebuggable *object,
+						      guint level);
+static GSwatStackSnapshot *publish_stack_snapshot (GSwatGdbDebugger *self);
+static void drop_stack_snapshot (GSwatGdbDebugger *self);
 static GList *gswat_gdb_debugger_get_breakpoints (GSwatDebuggable* object);
 static GList *gswat_gdb_debugger_get_locals_list (GSwatDebuggable* object);
+static void gswat_gdb_debugger_get_locals_list_async (GSwatDebuggable *object,
+						      GCancellable *cancellable,
+						      GAsyncReadyCallback callback,
+						      gpointer user_data);
+static GList *gswat_gdb_debugger_get_locals_list_finish (GSwatDebuggable *object,
+							 GAsyncResult *result,
+							 GError **error);
 static void synchronous_update_locals_list (GSwatGdbDebugger *self);
 static guint gdb_debugger_get_frame (GSwatDebuggable* object);
 static void gdb_debugger_set_frame (GSwatDebuggable* object, guint frame);
@@ -499,6 +821,14 @@ gswat_gdb_debugger_debuggable_interface_init (gpointer interface,
   debuggable->get_stack = gswat_gdb_debugger_get_stack;
   debuggable->get_breakpoints = gswat_gdb_debugger_get_breakpoints;
   debuggable->get_locals_list = gswat_gdb_debugger_get_locals_list;
+  debuggable->get_stack_async = gswat_gdb_debugger_get_stack_async;
+  debuggable->get_stack_finish = gswat_gdb_debugger_get_stack_finish;
+  debuggable->get_locals_list_async = gswat_gdb_debugger_get_locals_list_async;
+  debuggable->get_locals_list_finish = gswat_gdb_debugger_get_locals_list_finish;
+  debuggable->get_stack_range = gswat_gdb_debugger_get_stack_range;
+  debuggable->get_stack_depth = gswat_gdb_debugger_get_stack_depth;
+  debuggable->get_stack_snapshot = gswat_gdb_debugger_get_stack_snapshot;
+  debuggable->get_frame_arguments = gswat_gdb_debugger_get_frame_arguments;
   debuggable->get_frame = gdb_debugger_get_frame;
   debuggable->set_frame = gdb_debugger_set_frame;
   debuggable->get_search_paths = gswat_gdb_debugger_get_search_paths;
@@ -509,6 +839,8 @@ gswat_gdb_debugger_debuggable_interface_init (gpointer interface,
 static void
 gswat_gdb_debugger_init (GSwatGdbDebugger *self)
 {
+  gint i;
+
   self->priv = GSWAT_GDB_DEBUGGER_GET_PRIVATE (self);
 
   self->priv->gdb_pending = g_queue_new ();
@@ -517,6 +849,29 @@ gswat_gdb_debugger_init (GSwatGdbDebugger *self)
 
   self->priv->gdb_sequence = 1;
 
+  self->priv->mi_handlers = g_new0 (GSwatGdbMIHandler, MI_HANDLERS_MIN_SIZE);
+  self->priv->mi_handlers_size = MI_HANDLERS_MIN_SIZE;
+  self->priv->mi_handlers_oldest = self->priv->gdb_sequence;
+  self->priv->mi_command_timeout = DEFAULT_MI_COMMAND_TIMEOUT;
+  self->priv->mi_handler_clock = g_timer_new ();
+  g_queue_init (&self->priv->mi_deadlines);
+  self->priv->expired_tokens = g_hash_table_new (NULL, NULL);
+  self->priv->max_in_flight = DEFAULT_MAX_COMMANDS_IN_FLIGHT;
+  self->priv->incremental_stack = TRUE;
+  for (i = 0; i < GSWAT_GDB_COMMAND_PRIORITY_COUNT; i++)
+    g_queue_init (&self->priv->held_commands[i]);
+  self->priv->mi_queries =
+    g_hash_table_new_full (g_str_hash,
+			   g_str_equal,
+			   g_free,
+			   (GDestroyNotify)gswat_gdb_mi_future_unref);
+  self->priv->full_arguments =
+    g_hash_table_new_full (g_direct_hash,
+			   g_direct_equal,
+			   NULL,
+			   (GDestroyNotify)gswat_debuggable_free_frame_arguments);
+  self->priv->source_index = gswat_source_index_new ();
+
   self->priv->gdb_io_timeout = DEFAULT_GDB_IO_TIMEOUT;
 }
 
@@ -531,6 +886,10 @@ gswat_gdb_debugger_new (GSwatSession *session)
 
   g_object_ref (session);
   debugger->priv->session = session;
+  g_signal_connect (session,
+		    "notify::max-argument-value-length",
+		    G_CALLBACK (on_max_argument_value_length_changed),
+		    debugger);
 
   return debugger;
 }
@@ -542,6 +901,19 @@ gswat_gdb_debugger_finalize (GObject *object)
 
   gswat_gdb_debugger_disconnect (GSWAT_DEBUGGABLE (self));
 
+  g_free (self->priv->mi_handlers);
+  g_timer_destroy (self->priv->mi_handler_clock);
+  g_hash_table_destroy (self->priv->mi_queries);
+  g_hash_table_destroy (self->priv->expired_tokens);
+  g_hash_table_destroy (self->priv->full_arguments);
+  g_object_unref (self->priv->source_index);
+
+  if (self->priv->inferior_stream)
+    g_object_unref (self->priv->inferior_stream);
+
+  g_signal_handlers_disconnect_by_func (self->priv->session,
+					on_max_argument_value_length_changed,
+					self);
   g_object_unref (self->priv->session);
   self->priv->session=NULL;
 
@@ -593,20 +965,41 @@ gswat_gdb_debugger_connect (GSwatDebuggable* object, GError **error)
 	  return FALSE;
       }
 
+      self->priv->gdb_in_fd = fd_in;
       self->priv->gdb_out_fd = fd_out;
       self->priv->gdb_err_fd = fd_err;
+      self->priv->gdb_in_buffer = g_string_sized_new (4096);
+      self->priv->gdb_cork_count = 0;
+
+      /* We drain gdb's stdout ourselves, reading until the pipe is
+       * empty, so it mustn't block */
+      fcntl (fd_out, F_SETFL, fcntl (fd_out, F_GETFL) | O_NONBLOCK);
+      self->priv->gdb_out_buffer = g_malloc (GDB_OUT_BUFFER_SIZE);
+      self->priv->gdb_out_buffer_size = GDB_OUT_BUFFER_SIZE;
+      self->priv->gdb_out_buffer_len = 0;
 
       /* everything went fine */
-      self->priv->gdb_in  = g_io_channel_unix_new (fd_in);
       self->priv->gdb_out = g_io_channel_unix_new (fd_out);
       self->priv->gdb_err = g_io_channel_unix_new (fd_err);
 
       /* what is the current locale charset? */
-      g_get_charset (&charset);
+      if (!g_get_charset (&charset) && !self->priv->raw_io)
+	self->priv->gdb_charset = g_strdup (charset);
+
+      g_io_channel_set_encoding (self->priv->gdb_err,
+				 self->priv->raw_io ? NULL : charset,
+				 NULL);
 
-      g_io_channel_set_encoding (self->priv->gdb_in, charset, NULL);
-      g_io_channel_set_encoding (self->priv->gdb_out, charset, NULL);
-      g_io_channel_set_encoding (self->priv->gdb_err, charset, NULL);
+      /* The I/O thread converts what it reads using gdb_charset, so
+       * that has to be set up before it starts */
+      if (self->priv->threaded_io
+	  && !start_gdb_io_thread (self, &tmp_error))
+	{
+	  g_warning ("%s: %s",
+		     _ ("Could not start a thread to read GDB's output"),
+		     tmp_error->message);
+	  g_clear_error (&tmp_error);
+	}
 
       if (gswat_debug_flags & GSWAT_DEBUG_GDB_TRACE)
 	{
@@ -618,8 +1011,11 @@ gswat_gdb_debugger_connect (GSwatDebuggable* object, GError **error)
 	  gswat_log (trace_header);
 	}
 
+      /* With threaded I/O we are woken up by the I/O thread instead */
       self->priv->gdb_out_event =
-	g_io_add_watch (self->priv->gdb_out,
+	g_io_add_watch (self->priv->gdb_io_thread
+			? self->priv->gdb_io_wakeup_channel
+			: self->priv->gdb_out,
 			G_IO_IN,
 			(GIOFunc)gdb_stdout_watcher,
 			self);
@@ -633,6 +1029,30 @@ gswat_gdb_debugger_connect (GSwatDebuggable* object, GError **error)
        * e.g. use gswat_gdb_debugger_send_mi_command */
       self->priv->gdb_connected = TRUE;
 
+      /* gdb would otherwise print strings in the locale's charset */
+      if (self->priv->raw_io && !g_get_charset (NULL))
+	gswat_gdb_debugger_send_mi_command (self,
+					    "-gdb-set host-charset UTF-8",
+					    gswat_gdb_debugger_nop_mi_callback,
+					    NULL);
+
+      send_print_elements (self,
+			   gswat_session_get_max_argument_value_length (
+			     self->priv->session));
+
+      /* Any output from the previous connection is dropped with the
+       * old stream */
+      if (self->priv->inferior_stream)
+	g_object_unref (self->priv->inferior_stream);
+      self->priv->inferior_stream = gswat_inferior_stream_new (&tmp_error);
+      if (!self->priv->inferior_stream)
+	{
+	  g_warning ("%s: %s",
+		     _ ("Could not create a terminal for the program"),
+		     tmp_error->message);
+	  g_clear_error (&tmp_error);
+	}
+
 
       /* assume this session is for debugging a local file */
       if (!spawn_local_process (self, &tmp_error))
@@ -672,7 +1092,7 @@ gswat_gdb_debugger_disconnect (GSwatDebuggable* object)
 {
   GSwatGdbDebugger *self;
   GList *tmp;
-  GString *current_line;
+  GdbPendingRecord *pending_record;
 
   g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
   self = GSWAT_GDB_DEBUGGER (object);
@@ -709,10 +1129,18 @@ gswat_gdb_debugger_disconnect (GSwatDebuggable* object)
   g_source_remove (self->priv->gdb_out_event);
   g_source_remove (self->priv->gdb_err_event);
 
-  if (self->priv->gdb_in)
+  if (self->priv->gdb_io_thread)
+    stop_gdb_io_thread (self);
+
+  /* What the program wrote can still be read after it's gone */
+  if (self->priv->inferior_stream)
+    gswat_inferior_stream_close (self->priv->inferior_stream);
+
+  if (self->priv->gdb_in_buffer)
     {
-      g_io_channel_unref (self->priv->gdb_in);
-      self->priv->gdb_in = NULL;
+      close (self->priv->gdb_in_fd);
+      g_string_free (self->priv->gdb_in_buffer, TRUE);
+      self->priv->gdb_in_buffer = NULL;
     }
 
   if (self->priv->gdb_out)
@@ -727,16 +1155,40 @@ gswat_gdb_debugger_disconnect (GSwatDebuggable* object)
       self->priv->gdb_err = NULL;
     }
 
-  while ( (current_line = g_queue_pop_head (self->priv->gdb_pending)))
+  while ( (pending_record = g_queue_pop_head (self->priv->gdb_pending)))
     {
-      g_string_free (current_line, TRUE);
+      free_pending_record (pending_record);
     }
 
+  /* Nothing we are still waiting on will arrive now */
+  cancel_all_mi_handlers (self);
+  g_queue_clear (&self->priv->mi_deadlines);
+  g_hash_table_remove_all (self->priv->expired_tokens);
+
+  /* Their handlers are gone, so all that's left is the commands */
+  drop_held_mi_commands (self);
+  g_hash_table_remove_all (self->priv->mi_queries);
+
+  complete_stack_waiters (self);
+  complete_locals_waiters (self);
+
+  g_free (self->priv->gdb_out_buffer);
+  self->priv->gdb_out_buffer = NULL;
+  self->priv->gdb_out_buffer_size = 0;
+  self->priv->gdb_out_buffer_len = 0;
+  g_free (self->priv->gdb_charset);
+  self->priv->gdb_charset = NULL;
+
   if (self->priv->stack)
     {
       gswat_debuggable_stack_free (self->priv->stack);
       self->priv->stack = NULL;
     }
+  self->priv->stack_depth = 0;
+  drop_stack_snapshot (self);
+  g_hash_table_remove_all (self->priv->full_arguments);
+  gswat_debuggable_stack_free (self->priv->previous_stack);
+  self->priv->previous_stack = NULL;
 
   if (self->priv->breakpoints)
     {
@@ -751,6 +1203,22 @@ gswat_gdb_debugger_disconnect (GSwatDebuggable* object)
   g_object_notify (G_OBJECT (self), "state");
 }
 
+/* Records are parsed lazily, and dumping one forces all of it to be
+ * built, so we only do that when MI debugging has been enabled. */
+static void
+debug_dump_mi_value (const GDBMIValue *val)
+{
+  GString *string;
+
+  if (!(gswat_debug_flags & GSWAT_DEBUG_GDBMI))
+    return;
+
+  string = g_string_new ("");
+  gdbmi_value_dump (string, val, 0);
+  GSWAT_DEBUG (GDBMI, "%s", string->str);
+  g_string_free (string, TRUE);
+}
+
 void
 gswat_gdb_debugger_nop_mi_callback (GSwatGdbDebugger *self,
 				    const GSwatGdbMIRecord *record,
@@ -758,12 +1226,7 @@ gswat_gdb_debugger_nop_mi_callback (GSwatGdbDebugger *self,
 {
   GSWAT_DEBUG (MISC, "NOP result callback:");
   if (record->val)
-    {
-      GString *string = g_string_new ("");
-      gdbmi_value_dump (string, record->val, 0);
-      g_message ("%s", string->str);
-      g_string_free (string, TRUE);
-    }
+    debug_dump_mi_value (record->val);
 }
 
 static gboolean
@@ -788,6 +1251,18 @@ spawn_local_process (GSwatGdbDebugger *self, GError **error)
   g_free (gdb_command);
   g_strfreev (argv);
 
+  if (self->priv->inferior_stream)
+    {
+      gdb_command =
+	g_strdup_printf ("-inferior-tty-set %s",
+			 gswat_inferior_stream_get_tty_name (self->priv->inferior_stream));
+      gswat_gdb_debugger_send_mi_command (self,
+					  gdb_command,
+					  gswat_gdb_debugger_nop_mi_callback,
+					  NULL);
+      g_free (gdb_command);
+    }
+
   gswat_gdb_debugger_request_function_breakpoint (GSWAT_DEBUGGABLE (self),
 						  "main");
 
@@ -807,7 +1282,9 @@ gdb_stdout_watcher (GIOChannel* io, GIOCondition cond, gpointer data)
   GSwatGdbDebugger *self = GSWAT_GDB_DEBUGGER (data);
   GError *error=NULL;
 
-  if (!read_next_gdb_line (self, &error))
+  /* Everything gdb has written so far is queued and then processed
+   * in a single idle pass */
+  if (!read_gdb_output (self, FALSE, &error))
     {
       g_signal_emit (self,
 		     gswat_gdb_debugger_signals[GDB_IO_ERROR],
@@ -859,6 +1336,7 @@ gdb_stderr_watcher (GIOChannel* io, GIOCondition cond, gpointer data)
   //GSwatGdbDebugger *self = GSWAT_GDB_DEBUGGER (data);
   GIOStatus status;
   GString *line;
+  gchar *message;
 
   line = g_string_new ("");
 
@@ -867,479 +1345,710 @@ gdb_stderr_watcher (GIOChannel* io, GIOCondition cond, gpointer data)
 					  NULL,
 					  NULL);
 
-  g_warning ("gdb error: %s\n", line->str);
+  /* With raw I/O the line is just bytes */
+  message = gdbmi_literal_dup_utf8 (line->str, line->len);
+  g_warning ("gdb error: %s\n", message);
+  g_free (message);
 
   g_string_free (line, TRUE);
 
   return TRUE;
 }
 
-static gboolean
-read_next_gdb_line (GSwatGdbDebugger* self, GError **error)
+/* Waits up to timeout milliseconds, or forever if it's negative, for
+ * gdb to write something. Returns the same as poll () */
+static int
+poll_gdb_output (GSwatGdbDebugger *self, int timeout)
 {
-  GString *record_str = g_string_new (""), *tmp;
-  GIOCondition condition;
   struct pollfd poll_fds[1];
-  //struct pollfd poll_fds[2];
-  int poll_status;
-  GIOStatus gio_status;
-  GError *tmp_error = NULL;
-  gulong record_token;
-  gchar *remainder;
-  int gdb_io_timeout = self->priv->gdb_io_timeout;
-
-  g_return_val_if_fail  (error == NULL || *error == NULL, FALSE);
 
-  poll_fds[0].fd=self->priv->gdb_out_fd;
+  /* With threaded I/O we wait for the I/O thread instead */
+  if (self->priv->gdb_io_thread)
+    poll_fds[0].fd = self->priv->gdb_io_wakeup[0];
+  else
+    poll_fds[0].fd = self->priv->gdb_out_fd;
   poll_fds[0].events = POLLIN;
-  //poll_fds[1].fd=self->priv->gdb_err_fd;
-  //poll_fds[1].events = POLLIN;
 
-  condition = g_io_channel_get_buffer_condition (self->priv->gdb_out);
-  if (!condition&G_IO_IN)
-    {
-      do {
-	  poll_status = poll (poll_fds, 1, gdb_io_timeout);
-	  if (poll_status == 0)
-	    {
-	      /* Timeout */
-	      int prev_timeout = self->priv->gdb_io_timeout;
-	      g_signal_emit (self,
-			     gswat_gdb_debugger_signals[GDB_IO_TIMEOUT],
-			     0);
-	      if (self->priv->gdb_io_timeout != prev_timeout)
-		gdb_io_timeout = self->priv->gdb_io_timeout;
-	      else
-		gdb_io_timeout = 0;
-	    }
-	  else if (poll_status < 0)
-	    {
-	      g_set_error (error,
-			   GSWAT_GDB_DEBUGGER_ERROR,
-			   GSWAT_GDB_DEBUGGER_ERROR_GDB_IO,
-			   _ ("Poll error"));
-	      return FALSE;
-	    }
-	  else
-	    {
-	      break;
-	    }
-      }while (gdb_io_timeout);
+  return poll (poll_fds, 1, timeout);
+}
 
-      if (gdb_io_timeout == 0)
-	return FALSE;
-    }
+/* Waits for gdb to write something. If nothing arrives within
+ * gdb_io_timeout the GDB_IO_TIMEOUT signal is emitted, and we give up
+ * unless a handler changed the timeout. If limit isn't negative we
+ * also stop after that many milliseconds, returning FALSE without
+ * setting an error. */
+static gboolean
+wait_for_gdb_output (GSwatGdbDebugger* self, int limit, GError **error)
+{
+  int poll_status;
+  int gdb_io_timeout = self->priv->gdb_io_timeout;
 
-  gio_status = g_io_channel_read_line_string (self->priv->gdb_out,
-					      record_str,
-					      NULL,
-					      &tmp_error);
-  switch (gio_status)
-    {
-    case G_IO_STATUS_NORMAL:
-      /* Success */
-      break;
-    case G_IO_STATUS_ERROR:
-      g_propagate_error (error, tmp_error);
-      return FALSE;
-    case G_IO_STATUS_AGAIN:
-      /* We expect to be using blocking IO so I don't think we should
-       * ever see this */
-      g_error ("%s: Recieved unexpected G_IO_STATUS_AGAIN\n",
-	       __FUNCTION__);
-      break;
-    case G_IO_STATUS_EOF:
-      g_set_error (error,
-		   GSWAT_GDB_DEBUGGER_ERROR,
-		   GSWAT_GDB_DEBUGGER_ERROR_GDB_IO,
-		   _ ("EOF read from GDB"));
+  do {
+      gboolean limited =
+	limit >= 0 && (gdb_io_timeout < 0 || limit < gdb_io_timeout);
+
+      poll_status = poll_gdb_output (self, limited ? limit : gdb_io_timeout);
+      if (poll_status == 0 && limited)
 	{
-	  condition = g_io_channel_get_buffer_condition (self->priv->gdb_out);
-	  g_warning ("EOF read from GDB:");
-	  g_warning ("IO Condition:");
-	  g_warning ("> G_IO_IN  (data to read) =%d",condition&G_IO_IN);
-	  g_warning ("> G_IO_OUT  (non blocking write) =%d",condition&G_IO_OUT);
-	  g_warning ("> G_IO_ERR  (error condition) =%d",condition&G_IO_ERR);
-	  g_warning ("> G_IO_HUP  (connection broke) =%d",condition&G_IO_HUP);
-	  g_warning ("> G_IO_NVAL  (invalid; fd not open) =%d",condition&G_IO_NVAL);
+	  return FALSE;
 	}
-      return FALSE;
-    }
+      else if (poll_status == 0)
+	{
+	  /* Timeout */
+	  int prev_timeout = self->priv->gdb_io_timeout;
+	  g_signal_emit (self,
+			 gswat_gdb_debugger_signals[GDB_IO_TIMEOUT],
+			 0);
+	  if (limit >= 0)
+	    limit = MAX (limit - gdb_io_timeout, 0);
+	  if (self->priv->gdb_io_timeout != prev_timeout)
+	    gdb_io_timeout = self->priv->gdb_io_timeout;
+	  else
+	    gdb_io_timeout = 0;
+	}
+      else if (poll_status < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  g_set_error (error,
+		       GSWAT_GDB_DEBUGGER_ERROR,
+		       GSWAT_GDB_DEBUGGER_ERROR_GDB_IO,
+		       _ ("Poll error"));
+	  return FALSE;
+	}
+      else
+	{
+	  return TRUE;
+	}
+  }while (gdb_io_timeout);
+
+  g_set_error (error,
+	       GSWAT_GDB_DEBUGGER_ERROR,
+	       GSWAT_GDB_DEBUGGER_ERROR_GDB_IO,
+	       _ ("Timed out waiting for GDB"));
+  return FALSE;
+}
+
+/* Queues one line of gdb output, without its newline */
+static void
+queue_gdb_line (GSwatGdbDebugger *self, const gchar *line, gsize len)
+{
+  const gchar *end = line + len;
+  const gchar *p = line;
+  gulong token = 0;
+  gchar *text = NULL;
+  GdbPendingRecord *pending_record;
 
   if (gswat_debug_flags & GSWAT_DEBUG_GDB_TRACE)
     {
-      char *log_record = g_strdup_printf ("#%s", record_str->str);
+      char *log_record = g_strdup_printf ("#%.*s\n", (int)len, line);
       gswat_log (log_record);
       g_free (log_record);
     }
 
-  if (record_str->len >= 7
-      &&  (strncmp (record_str->str, "(gdb) \n", 7) == 0))
-    {
-      g_string_free (record_str, TRUE);
-      return TRUE;
-    }
-
-  /* remove the trailing newline */
-  record_str = g_string_truncate (record_str, record_str->len-1);
+  if (len == 0
+      || (len == 6 && strncmp (line, "(gdb) ", 6) == 0))
+    return;
 
   /* read any gdbmi "token" */
-  record_token = strtol (record_str->str, &remainder, 10);
-  if (! (record_token == 0 && record_str->str == remainder))
-    {
-      tmp = g_string_new (remainder);
-      g_string_free (record_str, TRUE);
-      record_str = tmp;
-    }
-  else
+  while (p < end && g_ascii_isdigit (*p))
+    token = token * 10 + (*p++ - '0');
+
+  if (p == line)
     {
       /* most gdb records should be associated with a token */
-      if (record_str->str[0] != '~' /* console-stream-output */
-	  && record_str->str[0] != '@' /* target-stream-output */
-	  && record_str->str[0] != '&' /* gdb log-stream-output */
-          && record_str->str[0] != '*' /* exec-async-output */
-          && record_str->str[0] != '+' /* status-async-output */
-          && record_str->str[0] != '=') /* notify-async-output */
+      if (*p != '~' /* console-stream-output */
+	  && *p != '@' /* target-stream-output */
+	  && *p != '&' /* gdb log-stream-output */
+	  && *p != '*' /* exec-async-output */
+	  && *p != '+' /* status-async-output */
+	  && *p != '=') /* notify-async-output */
 	{
 	  g_warning ("%s: failed to read a valid token value", __FUNCTION__);
 	}
     }
+  else if (p == end)
+    {
+      g_warning ("%s: record with no content after its token", __FUNCTION__);
+      return;
+    }
 
-  queue_pending_record (self, record_token, record_str);
-
-  return TRUE;
-}
-
-static void
-queue_pending_record (GSwatGdbDebugger *self, gulong token, GString *record_str)
-{
-  GdbPendingRecord *pending_record;
-
-  /* FIXME - tmp debug */
-#if 0
-  GSWAT_DEBUG (MISC, "queueing gdb record - token=\"%lu\", record=\"%s\"",
-	       token,
-	       record_str->str);
-#endif
+  if (self->priv->gdb_charset)
+    text = g_convert (p, end - p, "UTF-8", self->priv->gdb_charset,
+		      NULL, NULL, NULL);
+  if (!text)
+    text = g_strndup (p, end - p);
 
   pending_record = g_new (GdbPendingRecord, 1);
   pending_record->token = token;
-  pending_record->record_str = record_str;
+  pending_record->text = text;
+  pending_record->val = NULL;
 
-  g_queue_push_tail (self->priv->gdb_pending, pending_record);
+  /* The queue is only set up while the I/O thread is running, and
+   * then only the I/O thread gets here. Results are parsed here
+   * too, so all the main thread has left to do is dispatch them. */
+  if (self->priv->gdb_io_queue.tail)
+    {
+      if (text[0] == '^' && strchr (text, ','))
+	pending_record->val = gdbmi_value_parse_full (text, GDBMI_PARSE_EAGER);
+      gdb_io_queue_push (&self->priv->gdb_io_queue, pending_record);
+    }
+  else
+    queue_pending_record (self, pending_record);
 }
 
+/* Queues every complete line in the gdb_out_buffer, and moves any
+ * incomplete line left over to the start of the buffer */
 static void
-free_pending_record (GdbPendingRecord *pending_record)
-{
-  g_string_free (pending_record->record_str, TRUE);
-  g_free (pending_record);
-}
-
-static gboolean
-idle_process_gdb_pending (gpointer data)
+split_gdb_output (GSwatGdbDebugger *self)
 {
-  GSwatGdbDebugger *self = GSWAT_GDB_DEBUGGER (data);
+  gchar *line = self->priv->gdb_out_buffer;
+  gchar *end = line + self->priv->gdb_out_buffer_len;
+  gchar *newline;
 
-  self->priv->gdb_pending_idle_processor_queued = FALSE;
-
-  g_object_ref (G_OBJECT (self));
-  process_gdb_pending (self);
-  g_object_unref (G_OBJECT (self));
+  while ((newline = memchr (line, '\n', end - line)))
+    {
+      queue_gdb_line (self, line, newline - line);
+      line = newline + 1;
+    }
 
-  return FALSE;
+  self->priv->gdb_out_buffer_len = end - line;
+  if (line != self->priv->gdb_out_buffer)
+    memmove (self->priv->gdb_out_buffer, line,
+	     self->priv->gdb_out_buffer_len);
 }
 
-static void
-process_gdb_pending (GSwatGdbDebugger *self)
+/* Reads everything there is on gdb's stdout and queues all the
+ * complete records */
+static gboolean
+drain_gdb_stdout (GSwatGdbDebugger *self, GError **error)
 {
-  GdbPendingRecord *pending_record;
-  gint n;
-  GQueue *copy;
-  GList *tmp;
-
-  /* We have to be carefull since processing
-   * records can modify the queue: */
-  copy = g_queue_copy (self->priv->gdb_pending);
-
-#if 0
-  GSWAT_DEBUG (MISC, "Pending queue dump:");
-  for (n=0, tmp=copy->head; tmp!=NULL; n++, tmp=tmp->next)
+  while (TRUE)
     {
-      pending_record = tmp->data;
-      GSWAT_DEBUG (MISC, "index=%d: %s", n, pending_record->record_str->str);
-    }
-#endif
+      gsize space;
+      gssize n;
 
-  for (n=0, tmp=copy->head; tmp!=NULL; n++, tmp=tmp->next)
-    {
-      gboolean dont_un_queue = FALSE;
-      pending_record = tmp->data;
+      space = self->priv->gdb_out_buffer_size - self->priv->gdb_out_buffer_len;
+      if (space < GDB_OUT_MIN_READ)
+	{
+	  /* Only a single line longer than the buffer gets us here */
+	  self->priv->gdb_out_buffer_size *= 2;
+	  self->priv->gdb_out_buffer =
+	    g_realloc (self->priv->gdb_out_buffer,
+		       self->priv->gdb_out_buffer_size);
+	  space = (self->priv->gdb_out_buffer_size
+		   - self->priv->gdb_out_buffer_len);
+	}
 
-      /* if this is a result record... */
-      if (pending_record->record_str->str[0] == '^')
+      n = read (self->priv->gdb_out_fd,
+		self->priv->gdb_out_buffer + self->priv->gdb_out_buffer_len,
+		space);
+      if (n > 0)
 	{
-	  GSList *tmp2;
-	  GSwatGdbMIHandler *current_handler;
+	  self->priv->gdb_out_buffer_len += n;
+	  split_gdb_output (self);
 
-	  /* if it has a NULL result record callback we must not
-	   * handle it here. It will be manually handled via
-	   * gswat_gdb_debugger_get_mi_result_record
-	   */
-	  for (tmp2=self->priv->mi_handlers; tmp2!=NULL; tmp2=tmp2->next)
-	    {
-	      current_handler = tmp2->data;
-
-	      if (current_handler->token == pending_record->token){
-		  if (current_handler->result_callback == NULL)
-		    {
-		      dont_un_queue = TRUE;
-		    }
-		  break;
-	      }
-	    }
+	  /* A short read means the pipe has been drained */
+	  if (n < space)
+	    break;
 	}
-      else if (pending_record->record_str->str[0] == '*')
-        {
-          g_warning ("FIXME: Handle exec-asnyc-output %s",
-                     pending_record->record_str->str);
-        }
-      else if (pending_record->record_str->str[0] == '+')
-        {
-          g_warning ("FIXME: Handle status-asnyc-output %s",
-                     pending_record->record_str->str);
-        }
-      else if (pending_record->record_str->str[0] == '=')
-        {
-          g_warning ("FIXME: Handle notify-asnyc-output %s",
-                     pending_record->record_str->str);
-        }
-
-      if (!dont_un_queue)
+      else if (n == 0)
 	{
-	  g_queue_remove (self->priv->gdb_pending, pending_record);
-	  process_gdb_output_record (self, pending_record);
-	  free_pending_record (pending_record);
+	  g_set_error (error,
+		       GSWAT_GDB_DEBUGGER_ERROR,
+		       GSWAT_GDB_DEBUGGER_ERROR_GDB_IO,
+		       _ ("EOF read from GDB"));
+	  return FALSE;
+	}
+      else if (errno == EAGAIN || errno == EWOULDBLOCK)
+	break;
+      else if (errno != EINTR)
+	{
+	  g_set_error (error,
+		       GSWAT_GDB_DEBUGGER_ERROR,
+		       GSWAT_GDB_DEBUGGER_ERROR_GDB_IO,
+		       _ ("Error reading from GDB: %s"),
+		       g_strerror (errno));
+	  return FALSE;
 	}
     }
 
-  g_queue_free (copy);
+  return TRUE;
 }
 
 static void
-process_gdb_output_record (GSwatGdbDebugger *self, GdbPendingRecord *record)
+gdb_io_queue_push (GdbIOQueue *queue, GdbPendingRecord *record)
 {
-  GString *record_str;
-
-  g_return_if_fail (record != NULL);
-  g_return_if_fail (record->record_str != NULL);
-  g_return_if_fail (record->record_str->len > 0);
+  GdbIOQueueNode *node = g_slice_new (GdbIOQueueNode);
 
-  record_str = record->record_str;
-
-  /* result records... */
-  if (record_str->str[0] == '^')
-    {
-      process_gdb_mi_result_record (self, record->token, record_str);
-    }/* out-of-band records... */
-  else if (record_str->str[0] == '*' /* exec-async-output */
-	   || record_str->str[0] == '+' /* status-async-output */
-	   || record_str->str[0] == '=') /* notify-async-output */
-    {
-      process_gdb_mi_oob_record (self, record->token, record_str);
-    }/* stream records... */
-  else if (record_str->str[0] == '~' /* console-stream-output */
-	   || record_str->str[0] == '@' /* target-stream-output */
-	   || record_str->str[0] == '&') /* log-stream-output */
-    {
-      process_gdb_mi_stream_record (self, record->token, record_str);
-    }
+  node->record = record;
+  node->next = NULL;
 
-  return;
+  /* Publishes the record along with the node */
+  g_atomic_pointer_set ((volatile gpointer *)&queue->tail->next, node);
+  queue->tail = node;
 }
 
-static void
-process_gdb_mi_result_record (GSwatGdbDebugger *self,
-			      gulong token,
-			      GString *record_str)
+static GdbPendingRecord *
+gdb_io_queue_pop (GdbIOQueue *queue)
 {
-  GDBMIValue *val;
-  GSList *tmp;
-
-  val = NULL;
-  if (strchr (record_str->str, ','))
-    {
-      val = gdbmi_value_parse (record_str->str);
-      if (val)
-	{
-	  GString *string = g_string_new ("");
-	  gdbmi_value_dump (string, val, 0);
-	  g_message ("%s", string->str);
-	  g_string_free (string, TRUE);
-	}
-      else
-	{
-	  g_warning ("process_gdb_mi_result_record: error parsing record");
-	  return;
-	}
-    }
+  GdbIOQueueNode *next;
+  GdbPendingRecord *record;
 
+  next = g_atomic_pointer_get ((volatile gpointer *)&queue->head->next);
+  if (!next)
+    return NULL;
 
-  for (tmp=self->priv->mi_handlers; tmp!=NULL; tmp=tmp->next)
-    {
-      GSwatGdbMIHandler *current_handler;
-      current_handler =  (GSwatGdbMIHandler *)tmp->data;
-
-      if (current_handler->token == token
-	  && current_handler->result_callback != NULL)
-	{
-	  GSwatGdbMIRecord *record;
-
-	  record = g_new (GSwatGdbMIRecord, 1);
-	  record->type = gdb_mi_get_result_record_type (record_str);
-	  record->val = val;
+  /* next becomes the new dummy node */
+  record = next->record;
+  next->record = NULL;
+  g_slice_free (GdbIOQueueNode, queue->head);
+  queue->head = next;
 
-	  current_handler->result_callback (self,
-					    record,
-					    current_handler->data);
-	  g_free (record);
+  return record;
+}
 
-	  self->priv->mi_handlers =
-	    g_slist_remove (self->priv->mi_handlers,
-			    current_handler);
-	  g_free (current_handler);
+/* Called in the I/O thread after queueing records. There's only
+ * need to write to the wakeup pipe if the main thread hasn't already
+ * been woken up and not yet drained the queue. */
+static void
+wake_gdb_io_consumer (GSwatGdbDebugger *self)
+{
+  gchar byte = 0;
 
-	  break;
-	}
-    }
+  if (!g_atomic_int_compare_and_exchange (&self->priv->gdb_io_wakeup_pending,
+					  0, 1))
+    return;
 
-  if (val)
-    {
-      gdbmi_value_free (val);
-    }
+  while (write (self->priv->gdb_io_wakeup[1], &byte, 1) < 0
+	 && errno == EINTR)
+    ;
 }
 
-static GSwatGdbMIRecordType
-gdb_mi_get_result_record_type (GString *record_str)
+static gpointer
+gdb_io_thread (gpointer data)
 {
-  if (record_str->len >= 5
-      && strncasecmp (record_str->str, "^done", 5) == 0)
+  GSwatGdbDebugger *self = GSWAT_GDB_DEBUGGER (data);
+  GdbPendingRecord *done;
+  GError *error = NULL;
+  struct pollfd poll_fds[2];
+
+  poll_fds[0].fd = self->priv->gdb_out_fd;
+  poll_fds[0].events = POLLIN;
+  poll_fds[1].fd = self->priv->gdb_io_stop[0];
+  poll_fds[1].events = POLLIN;
+
+  while (TRUE)
     {
-      return GSWAT_GDB_MI_REC_TYPE_RESULT_DONE;
-    }else if (record_str->len >= 8
-	      && strncasecmp (record_str->str, "^running", 8) == 0)
-      {
-	return GSWAT_GDB_MI_REC_TYPE_RESULT_RUNNING;
-      }else if (record_str->len >= 10
-		&& strncasecmp (record_str->str, "^connected", 10) == 0)
+      if (poll (poll_fds, 2, -1) < 0)
 	{
-	  return GSWAT_GDB_MI_REC_TYPE_RESULT_CONNECTED;
-	}else if (record_str->len >= 6
-		  && strncasecmp (record_str->str, "^error", 6) == 0)
-	  {
-	    return GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR;
-	  }else if (record_str->len >= 5
-		    && strncasecmp (record_str->str, "^exit", 5) == 0)
-	    {
-	      return GSWAT_GDB_MI_REC_TYPE_RESULT_EXIT;
-	    }else
-	      {
-		return GSWAT_GDB_MI_REC_TYPE_UNKNOWN;
-		g_warning ("process_gdb_mi_recordord: unrecognised result record");
-	      }
-
-}
+	  if (errno == EINTR)
+	    continue;
+	  g_set_error (&error,
+		       GSWAT_GDB_DEBUGGER_ERROR,
+		       GSWAT_GDB_DEBUGGER_ERROR_GDB_IO,
+		       _ ("Poll error"));
+	  break;
+	}
 
-GFile *
-path_and_list_to_gfile (GFile *path, GList *components)
-{
-  GList *l;
-  GFile *tmp;
+      if (poll_fds[1].revents)
+	break;
 
-  g_object_ref (path);
+      if (!drain_gdb_stdout (self, &error))
+	break;
 
-  for (l = components; l; l = l->next)
-    {
-      char *child = l->data;
-      tmp = g_file_get_child (path, child);
-      g_object_unref (path);
-      path = tmp;
+      wake_gdb_io_consumer (self);
     }
 
-  return path;
-}
+  /* The record without any text lets the main thread know we are
+   * done, and it only looks at gdb_io_error after seeing it */
+  self->priv->gdb_io_error = error;
+  done = g_new0 (GdbPendingRecord, 1);
+  gdb_io_queue_push (&self->priv->gdb_io_queue, done);
+  wake_gdb_io_consumer (self);
 
-typedef gboolean (*ForachFuzzyFindCallback) (GFile *file,
-                                             void *user_data);
+  return NULL;
+}
 
-void
-foreach_fuzzy_find_option (GFile *path,
-                           const char *filename,
-                           ForachFuzzyFindCallback callback,
-                           void *user_data)
+static gboolean
+start_gdb_io_thread (GSwatGdbDebugger *self, GError **error)
 {
-  GFile *parent = g_file_new_for_path (filename);
-  GList *components = NULL;
-  GList *l;
-  gboolean cont;
-
-  do
+  if (pipe (self->priv->gdb_io_wakeup) < 0)
+    {
+      g_set_error (error,
+		   GSWAT_GDB_DEBUGGER_ERROR,
+		   GSWAT_GDB_DEBUGGER_ERROR_GDB_IO,
+		   "%s", g_strerror (errno));
+      return FALSE;
+    }
+  if (pipe (self->priv->gdb_io_stop) < 0)
     {
-      GFile *tmp;
-      char *basename = g_file_get_basename (parent);
-      components = g_list_prepend (components, basename);
-      tmp = g_file_get_parent (parent);
-      g_object_unref (parent);
-      parent = tmp;
+      g_set_error (error,
+		   GSWAT_GDB_DEBUGGER_ERROR,
+		   GSWAT_GDB_DEBUGGER_ERROR_GDB_IO,
+		   "%s", g_strerror (errno));
+      close (self->priv->gdb_io_wakeup[0]);
+      close (self->priv->gdb_io_wakeup[1]);
+      return FALSE;
     }
-  while (parent);
 
-  cont = TRUE;
-  for (l = components; l && cont; l = l->next)
+  /* We drain the wakeup pipe each time we are woken up */
+  fcntl (self->priv->gdb_io_wakeup[0], F_SETFL,
+	 fcntl (self->priv->gdb_io_wakeup[0], F_GETFL) | O_NONBLOCK);
+
+  self->priv->gdb_io_queue.head = g_slice_new0 (GdbIOQueueNode);
+  self->priv->gdb_io_queue.tail = self->priv->gdb_io_queue.head;
+  self->priv->gdb_io_wakeup_pending = 0;
+  self->priv->gdb_io_thread_done = FALSE;
+
+  self->priv->gdb_io_thread =
+    g_thread_create (gdb_io_thread, self, TRUE, error);
+  if (!self->priv->gdb_io_thread)
     {
-      GFile *file = path_and_list_to_gfile (path, l);
-      cont = callback (file, user_data);
-      g_object_unref (file);
+      g_slice_free (GdbIOQueueNode, self->priv->gdb_io_queue.head);
+      self->priv->gdb_io_queue.head = NULL;
+      self->priv->gdb_io_queue.tail = NULL;
+      close (self->priv->gdb_io_wakeup[0]);
+      close (self->priv->gdb_io_wakeup[1]);
+      close (self->priv->gdb_io_stop[0]);
+      close (self->priv->gdb_io_stop[1]);
+      return FALSE;
     }
 
-  g_list_foreach (components, (GFunc)g_free, NULL);
-  g_list_free (components);
+  self->priv->gdb_io_wakeup_channel =
+    g_io_channel_unix_new (self->priv->gdb_io_wakeup[0]);
+
+  return TRUE;
 }
 
-typedef struct
+static void
+stop_gdb_io_thread (GSwatGdbDebugger *self)
 {
-  char *uri;
-} FuzzyFindFileState;
+  GdbPendingRecord *pending_record;
+  gchar byte = 0;
+
+  while (write (self->priv->gdb_io_stop[1], &byte, 1) < 0
+	 && errno == EINTR)
+    ;
+  g_thread_join (self->priv->gdb_io_thread);
+  self->priv->gdb_io_thread = NULL;
+
+  while ((pending_record = gdb_io_queue_pop (&self->priv->gdb_io_queue)))
+    free_pending_record (pending_record);
+  g_slice_free (GdbIOQueueNode, self->priv->gdb_io_queue.head);
+  self->priv->gdb_io_queue.head = NULL;
+  self->priv->gdb_io_queue.tail = NULL;
+
+  g_io_channel_unref (self->priv->gdb_io_wakeup_channel);
+  self->priv->gdb_io_wakeup_channel = NULL;
+  close (self->priv->gdb_io_wakeup[0]);
+  close (self->priv->gdb_io_wakeup[1]);
+  close (self->priv->gdb_io_stop[0]);
+  close (self->priv->gdb_io_stop[1]);
+
+  if (self->priv->gdb_io_error)
+    g_clear_error (&self->priv->gdb_io_error);
+}
 
-gboolean
-find_file_cb (GFile *file, void *user_data)
+/* Takes everything the I/O thread has queued so far. n_records, if
+ * not NULL, is set to the number of records taken. */
+static gboolean
+drain_gdb_io_queue (GSwatGdbDebugger *self,
+		    guint *n_records,
+		    GError **error)
 {
-  FuzzyFindFileState *state = user_data;
-  if (g_file_query_exists (file, NULL))
+  GdbPendingRecord *pending_record;
+  gchar buffer[64];
+  guint n = 0;
+
+  /* The flag is cleared before the queue is drained, so anything
+   * queued after this point wakes us up again */
+  while (read (self->priv->gdb_io_wakeup[0], buffer, sizeof (buffer)) > 0)
+    ;
+  g_atomic_int_set (&self->priv->gdb_io_wakeup_pending, 0);
+
+  while ((pending_record = gdb_io_queue_pop (&self->priv->gdb_io_queue)))
+    {
+      if (pending_record->text == NULL)
+	{
+	  self->priv->gdb_io_thread_done = TRUE;
+	  free_pending_record (pending_record);
+	  continue;
+	}
+
+      queue_pending_record (self, pending_record);
+      n++;
+    }
+
+  if (n_records)
+    *n_records = n;
+
+  if (self->priv->gdb_io_thread_done && self->priv->gdb_io_error)
     {
-      state->uri = g_file_get_uri (file);
+      g_propagate_error (error, g_error_copy (self->priv->gdb_io_error));
       return FALSE;
     }
+
   return TRUE;
 }
 
-/* This iteratively reduces the filenames ancestry looking for a
- * relative match under the given path. E.g. given the filename
- * /build/foo/bar/test.c and path /src/bar it will try:
- *   /src/bar/build/foo/bar/test.c and
- *   /src/bar/foo/bar/test.c and
- *   /src/bar/bar/test.c
- *   /src/bar/test.c
- */
-static char *
-fuzzy_find_file_in_path (const char *filename, GFile *path)
+/* Reads everything gdb has written so far and queues all the complete
+ * records. If wait is TRUE and gdb hasn't written anything yet then
+ * we wait for it first. */
+static gboolean
+read_gdb_output (GSwatGdbDebugger* self, gboolean wait, GError **error)
+{
+  g_return_val_if_fail  (error == NULL || *error == NULL, FALSE);
+
+  if (self->priv->gdb_io_thread)
+    {
+      guint n_records;
+
+      /* The I/O thread may already have read something in */
+      if (!drain_gdb_io_queue (self, &n_records, error))
+	return FALSE;
+      if (n_records || !wait)
+	return TRUE;
+
+      if (!wait_for_gdb_output (self, -1, error))
+	return FALSE;
+      return drain_gdb_io_queue (self, NULL, error);
+    }
+
+  if (wait && !wait_for_gdb_output (self, -1, error))
+    return FALSE;
+
+  return drain_gdb_stdout (self, error);
+}
+
+static void
+queue_pending_record (GSwatGdbDebugger *self,
+		      GdbPendingRecord *pending_record)
+{
+
+  /* FIXME - tmp debug */
+#if 0
+  GSWAT_DEBUG (MISC, "queueing gdb record - token=\"%lu\", record=\"%s\"",
+	       pending_record->token,
+	       pending_record->text);
+#endif
+
+  /* Results that are waited for synchronously skip the queue */
+  if (pending_record->text[0] == '^')
+    {
+      GSwatGdbMIHandler *handler =
+	lookup_mi_handler (self, pending_record->token);
+
+      /* Anyone waiting on a future can have the result straight
+       * away, though it's still dispatched in order with the rest */
+      /* It's no longer in flight, which may make room for more */
+      if (handler && handler->in_flight)
+	mi_command_answered (self, handler);
+
+      if (handler && handler->discard)
+	{
+	  self->priv->command_stats.stale_discarded++;
+	  remove_mi_handler (self, handler);
+	  free_pending_record (pending_record);
+	  return;
+	}
+
+      if (!handler
+	  && g_hash_table_remove (self->priv->expired_tokens,
+				  GSIZE_TO_POINTER (pending_record->token)))
+	g_warning ("gdb answered command %lu after it had expired; "
+		   "the result was dropped",
+		   pending_record->token);
+
+      if (handler && handler->future && !handler->future->record)
+	handler->future->record = mi_record_take (pending_record);
+
+      if (handler && handler->result_callback == NULL)
+	{
+	  if (handler->result)
+	    free_pending_record (handler->result);
+	  handler->result = pending_record;
+	  return;
+	}
+    }
+
+  g_queue_push_tail (self->priv->gdb_pending, pending_record);
+}
+
+static void
+free_pending_record (GdbPendingRecord *pending_record)
+{
+  if (pending_record->val)
+    gdbmi_value_free (pending_record->val);
+  g_free (pending_record->text);
+  g_free (pending_record);
+}
+
+static gboolean
+idle_process_gdb_pending (gpointer data)
+{
+  GSwatGdbDebugger *self = GSWAT_GDB_DEBUGGER (data);
+
+  self->priv->gdb_pending_idle_processor_queued = FALSE;
+
+  g_object_ref (G_OBJECT (self));
+  process_gdb_pending (self);
+  g_object_unref (G_OBJECT (self));
+
+  return FALSE;
+}
+
+static void
+process_gdb_pending (GSwatGdbDebugger *self)
+{
+  GdbPendingRecord *pending_record;
+
+  /* Processing records can modify the queue, e.g. a callback
+   * waiting for a synchronous result reads more records in, so we
+   * always just take the first record. Any records read in while
+   * we're processing get handled in the same pass. */
+  while ((pending_record = g_queue_pop_head (self->priv->gdb_pending)))
+    {
+      if (!pending_record->text)
+	{
+	  process_gdb_mi_future_result (self, pending_record->token);
+	  free_pending_record (pending_record);
+	  continue;
+	}
+
+      if (pending_record->text[0] == '*')
+        {
+          g_warning ("FIXME: Handle exec-asnyc-output %s",
+                     pending_record->text);
+        }
+      else if (pending_record->text[0] == '+')
+        {
+          g_warning ("FIXME: Handle status-asnyc-output %s",
+                     pending_record->text);
+        }
+      else if (pending_record->text[0] == '=')
+        {
+          g_warning ("FIXME: Handle notify-asnyc-output %s",
+                     pending_record->text);
+        }
+
+      process_gdb_output_record (self, pending_record);
+      free_pending_record (pending_record);
+    }
+
+  expire_mi_handlers (self);
+}
+
+static void
+process_gdb_output_record (GSwatGdbDebugger *self, GdbPendingRecord *record)
+{
+  gchar *text;
+
+  g_return_if_fail (record != NULL);
+  g_return_if_fail (record->text != NULL);
+  g_return_if_fail (record->text[0] != '\0');
+
+  text = record->text;
+
+  /* result records... */
+  if (text[0] == '^')
+    {
+      process_gdb_mi_result_record (self, record);
+    }/* out-of-band records... */
+  else if (text[0] == '*' /* exec-async-output */
+	   || text[0] == '+' /* status-async-output */
+	   || text[0] == '=') /* notify-async-output */
+    {
+      process_gdb_mi_oob_record (self, record->token, text);
+    }/* stream records... */
+  else if (text[0] == '~' /* console-stream-output */
+	   || text[0] == '@' /* target-stream-output */
+	   || text[0] == '&') /* log-stream-output */
+    {
+      process_gdb_mi_stream_record (self, record->token, text);
+    }
+
+  return;
+}
+
+/* Dispatches a result whose record has been handed to its future,
+ * usually as it was read in, by queue_pending_record */
+static void
+process_gdb_mi_future_result (GSwatGdbDebugger *self, gulong token)
+{
+  GSwatGdbMIHandler *handler = lookup_mi_handler (self, token);
+  GSwatGdbMIRecordCallback result_callback;
+  GSwatGdbMIFuture *future;
+  gpointer data;
+
+  if (!handler || !handler->result_callback || !handler->future)
+    return;
+
+  result_callback = handler->result_callback;
+  data = handler->data;
+  future = handler->future;
+  remove_mi_handler (self, handler);
+
+  result_callback (self, future->record, data);
+}
+
+static void
+process_gdb_mi_result_record (GSwatGdbDebugger *self,
+			      GdbPendingRecord *pending_record)
 {
-  FuzzyFindFileState state;
+  gchar *text = pending_record->text;
+  GDBMIValue *val;
+  GSwatGdbMIHandler *handler;
+
+  /* The I/O thread may have parsed the record already */
+  val = pending_record->val;
+  pending_record->val = NULL;
+  if (!val && strchr (text, ','))
+    {
+      val = gdbmi_value_parse_full (text, GDBMI_PARSE_LAZY);
+      if (val)
+	debug_dump_mi_value (val);
+      else
+	{
+	  g_warning ("process_gdb_mi_result_record: error parsing record");
+	  return;
+	}
+    }
+
+
+  handler = lookup_mi_handler (self, pending_record->token);
+
+  /* A future that hasn't got its result yet takes over the text and
+   * the parsed value, rather than its callback copying them */
+  if (handler && handler->future && !handler->future->record)
+    {
+      pending_record->val = val;
+      handler->future->record = mi_record_take (pending_record);
+      process_gdb_mi_future_result (self, pending_record->token);
+      return;
+    }
+
+  if (handler && handler->result_callback != NULL)
+    {
+      GSwatGdbMIRecordCallback result_callback = handler->result_callback;
+      gpointer data = handler->data;
+      GSwatGdbMIRecord *record;
+
+      remove_mi_handler (self, handler);
+
+      record = g_new (GSwatGdbMIRecord, 1);
+      record->type = gswat_gdb_mi_decode_result_class (text);
+      record->val = val;
+      record->text = text;
+
+      result_callback (self, record, data);
+      g_free (record);
+    }
 
-  state.uri = NULL;
-  foreach_fuzzy_find_option (path, filename,
-                             find_file_cb, &state);
-  return state.uri;
+  if (val)
+    {
+      gdbmi_value_free (val);
+    }
 }
 
 static GList *
@@ -1368,10 +2077,18 @@ gswat_gdb_debugger_set_search_paths (GSwatDebuggable *object,
   self = GSWAT_GDB_DEBUGGER (object);
 
   if (self->priv->paths)
-    g_list_foreach (self->priv->paths, (GFunc)g_free, NULL);
+    {
+      g_list_foreach (self->priv->paths, (GFunc)g_free, NULL);
+      g_list_free (self->priv->paths);
+    }
   for (l = paths; l; l = l->next)
     copy = g_list_prepend (copy, g_strdup (l->data));
   self->priv->paths = copy;
+
+  /* Resolving file names is done for every frame of every stop, so
+   * rather than walking the paths each time they are indexed */
+  gswat_source_index_set_paths (self->priv->source_index,
+				self->priv->paths);
 }
 
 #if 0
@@ -1421,7 +2138,6 @@ gswat_gdb_debugger_get_uri_from_filename (GSwatDebuggable *object,
   GSwatGdbDebugger *self;
   gchar *uri;
   GFile *file;
-  GList *l;
 
   g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), NULL);
   self = GSWAT_GDB_DEBUGGER (object);
@@ -1429,20 +2145,9 @@ gswat_gdb_debugger_get_uri_from_filename (GSwatDebuggable *object,
   if (filename == NULL)
     return NULL;
 
-  file = g_file_new_for_path (filename);
-  if (g_file_query_exists (file, NULL))
-    {
-      uri = g_file_get_uri (file);
-      g_object_unref (file);
-      return uri;
-    }
-
-  for (l = self->priv->paths; l; l = l->next)
-    {
-      uri = fuzzy_find_file_in_path (filename, l->data);
-      if (uri)
-        return uri;
-    }
+  uri = gswat_source_index_lookup (self->priv->source_index, filename);
+  if (uri)
+    return uri;
 
   file = g_file_new_for_path  (filename);
   uri = g_file_get_uri  (file);
@@ -1450,105 +2155,39 @@ gswat_gdb_debugger_get_uri_from_filename (GSwatDebuggable *object,
   return uri;
 }
 
-static void
-process_frame (GSwatGdbDebugger *self,
-               const GDBMIValue *val,
-               GSwatDebuggableFrame *frame)
+/* Lets the MI decoders resolve source files the way we do */
+static gchar *
+decoder_uri_from_filename (const gchar *filename, gpointer data)
 {
-  const GDBMIValue *file_val, *line_val, *frame_val;
-  const GDBMIValue *level_val, *address_val, *func_val;
-  const gchar *file_str;
-
-  g_return_if_fail (val != NULL);
-
-  frame_val = gdbmi_value_hash_lookup (val, "frame");
-  if (!frame_val)
-    frame_val = val;
-
-  level_val = gdbmi_value_hash_lookup (frame_val, "level");
-  if (level_val)
-    {
-      const gchar *level_str;
-      level_str = gdbmi_value_literal_get (level_val);
-      frame->level = strtol (level_str, NULL, 10);
-    }
-  else
-    frame->level = 0;
-
-  file_val = gdbmi_value_hash_lookup (frame_val, "fullname");
-  if (!file_val)
-    {
-      file_val = gdbmi_value_hash_lookup (frame_val, "file");
-    }
-  if (file_val)
-    {
-      gchar *source_uri;
-      file_str = gdbmi_value_literal_get (file_val);
-      source_uri =
-        gswat_gdb_debugger_get_uri_from_filename (GSWAT_DEBUGGABLE (self),
-                                                  file_str);
-      frame->source_uri = source_uri;
-    }
-  else
-    frame->source_uri=NULL;
-
-
-  line_val = gdbmi_value_hash_lookup (frame_val, "line");
-  if (line_val)
-    {
-      const gchar *line_str;
-      line_str = gdbmi_value_literal_get (line_val);
-      frame->line = strtol (line_str, NULL, 10);
-    }
-  else
-    frame->line = 0;
-
-  address_val = gdbmi_value_hash_lookup (frame_val, "addr");
-  if (address_val)
-    {
-      const gchar *address_str;
-      address_str = gdbmi_value_literal_get (address_val);
-      frame->address = strtoul (address_str, NULL, 16);
-    }
-
-
-  func_val = gdbmi_value_hash_lookup (frame_val, "func");
-  if (func_val)
-    {
-      const gchar *func_str;
-      func_str = gdbmi_value_literal_get (func_val);
-      frame->function = g_strdup (func_str);
-    }
-
-  frame->arguments = NULL;
+  return gswat_gdb_debugger_get_uri_from_filename (GSWAT_DEBUGGABLE (data),
+                                                   filename);
 }
 
 static void
 process_gdb_mi_oob_record (GSwatGdbDebugger *self,
 			   gulong token,
-			   GString *record_str)
+			   gchar *text)
 {
-  GDBMIValue *val;
-  GString *string = g_string_new ("");
-
-  val = gdbmi_value_parse (record_str->str);
-  if (!val)
+  /* Out-of-band records are decoded straight from their text, so
+   * we only build a tree to dump when MI debugging is enabled */
+  if (gswat_debug_flags & GSWAT_DEBUG_GDBMI)
     {
-      g_warning ("process_gdb_mi_oob_record: error parsing record");
-      return;
+      GDBMIValue *val = gdbmi_value_parse (text);
+      if (val)
+	{
+	  debug_dump_mi_value (val);
+	  gdbmi_value_free (val);
+	}
     }
 
-  gdbmi_value_dump (string, val, 0);
-  g_message ("%s", string->str);
-  g_string_free (string, TRUE);
-
-  if (strncasecmp (record_str->str, "*stopped", 8) == 0)
+  if (strncasecmp (text, "*stopped", 8) == 0)
     {
       GSwatGdbMIRecord *record;
 
       record = g_new (GSwatGdbMIRecord, 1);
       record->type = GSWAT_GDB_MI_REC_TYPE_OOB_STOPPED;
-      record->val = val;
+      record->val = NULL;
+      record->text = text;
 
       process_gdb_mi_oob_stopped_record (self, record);
 
@@ -1571,7 +2210,7 @@ process_gdb_mi_oob_record (GSwatGdbDebugger *self,
 
 	    record = g_new (GSwatGdbMIResult, 1);
 
-	    if (strncasecmp (record_str->str, "*stopped", 8) == 0)
+	    if (strncasecmp (text, "*stopped", 8) == 0)
 	      {
 		record->type = GSWAT_GDB_MI_REC_TYPE_OOB_STOPPED;
 	      }else
@@ -1591,8 +2230,6 @@ process_gdb_mi_oob_record (GSwatGdbDebugger *self,
 	  }
       }
 #endif
-
-    gdbmi_value_free (val);
 }
 
 static void
@@ -1639,8 +2276,21 @@ static void
 _gswat_gdb_debugger_invalidate_stack (GSwatGdbDebugger *self)
 {
   self->priv->stack_valid = FALSE;
-  gswat_debuggable_stack_free (self->priv->stack);
+
+  /* If the last update never finished, the stack from before it is
+   * still the best guess at what the outer frames are */
+  if (self->priv->incremental_stack && self->priv->stack)
+    {
+      gswat_debuggable_stack_free (self->priv->previous_stack);
+      self->priv->previous_stack = self->priv->stack;
+      self->priv->previous_depth = self->priv->stack_depth;
+    }
+  else
+    gswat_debuggable_stack_free (self->priv->stack);
   self->priv->stack = NULL;
+  self->priv->stack_depth = 0;
+  drop_stack_snapshot (self);
+  g_hash_table_remove_all (self->priv->full_arguments);
   self->priv->frame_level = 0;
   g_object_notify (G_OBJECT (self), "frame");
 }
@@ -1649,96 +2299,78 @@ static void
 process_gdb_mi_oob_stopped_record (GSwatGdbDebugger *self,
 				   GSwatGdbMIRecord *record)
 {
-  GDBMIValue *val;
-  const GDBMIValue *reason;
-  const gchar *str = NULL;
-  GString *string = g_string_new ("");
-
-  val = record->val;
-
-  gdbmi_value_dump (string, val, 0);
-  g_message ("%s", string->str);
-  g_string_free (string, TRUE);
+  GSwatGdbMIStopReason reason;
+  GSwatDebuggableFrame *frame;
 
   /* Invalidate all variable objects */
   self->priv->interrupt_count++;
+  self->priv->stop_count++;
+  cancel_stale_mi_commands (self);
+
+  frame = g_new0 (GSwatDebuggableFrame, 1);
+  if (!gswat_gdb_mi_decode_stopped (record->text,
+				    &reason,
+				    frame,
+				    decoder_uri_from_filename,
+				    self))
+    {
+      g_warning ("process_gdb_mi_oob_stopped_record: error decoding record");
+    }
 
-  reason = gdbmi_value_hash_lookup (val, "reason");
-  if (reason){
-      str = gdbmi_value_literal_get (reason);
-  }
-
-  if (str == NULL)
+  switch (reason)
     {
+    case GSWAT_GDB_MI_STOP_REASON_NONE:
       g_warning ("process_gdb_mi_oob_stopped_record: no reason found");
       self->priv->state = GSWAT_DEBUGGABLE_INTERRUPTED;
-    }
-  else if  (strcmp (str, "exited-normally") == 0)
-    {
+      break;
+    case GSWAT_GDB_MI_STOP_REASON_EXITED_NORMALLY:
+    case GSWAT_GDB_MI_STOP_REASON_EXITED:
+    case GSWAT_GDB_MI_STOP_REASON_EXITED_SIGNALLED:
       gswat_gdb_debugger_disconnect (GSWAT_DEBUGGABLE (self));
+      break;
+    case GSWAT_GDB_MI_STOP_REASON_SIGNAL_RECEIVED:
+    case GSWAT_GDB_MI_STOP_REASON_BREAKPOINT_HIT:
+    case GSWAT_GDB_MI_STOP_REASON_FUNCTION_FINISHED:
+    case GSWAT_GDB_MI_STOP_REASON_END_STEPPING_RANGE:
+    case GSWAT_GDB_MI_STOP_REASON_LOCATION_REACHED:
+      self->priv->state = GSWAT_DEBUGGABLE_INTERRUPTED;
+      break;
+    default:
+      break;
     }
-  else if (strcmp (str, "exited") == 0)
+
+  if (self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
     {
-      gswat_gdb_debugger_disconnect (GSWAT_DEBUGGABLE (self));
-    }
-  else if (strcmp (str, "exited-signalled") == 0)
-    {
-      gswat_gdb_debugger_disconnect (GSWAT_DEBUGGABLE (self));
-    }
-  else if (strcmp (str, "signal-received") == 0)
-    {
-      self->priv->state = GSWAT_DEBUGGABLE_INTERRUPTED;
-    }
-  else if (strcmp (str, "breakpoint-hit") == 0)
-    {
-      self->priv->state = GSWAT_DEBUGGABLE_INTERRUPTED;
-    }
-  else if (strcmp (str, "function-finished") == 0)
-    {
-      self->priv->state = GSWAT_DEBUGGABLE_INTERRUPTED;
-    }
-  else if (strcmp (str, "end-stepping-range") == 0)
-    {
-      self->priv->state = GSWAT_DEBUGGABLE_INTERRUPTED;
-    }
-  else if (strcmp (str, "location-reached") == 0)
-    {
-      self->priv->state = GSWAT_DEBUGGABLE_INTERRUPTED;
-    }
-
-  if (self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
-    {
-      GSwatDebuggableFrame *frame;
-
-      /* The previous, stack is now invalid so delete it.
-       * Note we could quite easily re-use the old allocated
-       * GSwatDebuggableFrames as an optimisation if needed.
-       * We just free it all at the moment for simplicity */
+      /* The previous stack is now invalid, though its outer
+       * frames may be reused by the update */
       _gswat_gdb_debugger_invalidate_stack (self);
 
+      /* Send all the stack, variable object and locals updates to
+       * gdb in one write */
+      gswat_gdb_debugger_cork (self);
+
       kick_asynchronous_stack_update (self);
-      frame = g_new (GSwatDebuggableFrame, 1);
-      process_frame (self, val, frame);
       set_source_location (self, frame->source_uri, frame->line);
-      gswat_debuggable_frame_free (frame);
-
-
 
       gswat_gdb_variable_object_async_update_all (self);
 
       self->priv->locals_valid=FALSE;
       kick_asynchronous_locals_update (self);
 
+      gswat_gdb_debugger_uncork (self);
+
       g_object_notify (G_OBJECT (self), "state");
     }
+
+  gswat_debuggable_frame_free (frame);
 }
 
 static void
 process_gdb_mi_stream_record (GSwatGdbDebugger *self,
 			      gulong token,
-			      GString *record_str)
+			      gchar *text)
 {
-  GSWAT_DEBUG (MISC, "%s", record_str->str);
+  GSWAT_DEBUG (MISC, "%s", text);
 }
 
 /* TODO: Add a flush_ function that can take a locals_machine
@@ -1749,6 +2381,7 @@ static void
 kick_asynchronous_locals_update (GSwatGdbDebugger *self)
 {
   LocalsUpdateMachine *locals_machine;
+  GSwatGdbMIFuture *future;
   gchar *gdb_command;
 
   if (  (self->priv->state & GSWAT_DEBUGGABLE_RUNNING)
@@ -1770,18 +2403,22 @@ kick_asynchronous_locals_update (GSwatGdbDebugger *self)
   gdb_command = g_strdup_printf ("-stack-list-arguments 0 %d %d",
 				 self->priv->frame_level,
 				 self->priv->frame_level);
-  locals_machine->list_arguments_token =
-    gswat_gdb_debugger_send_mi_command (self,
-					gdb_command,
-					async_locals_update_list_args_mi_callback,
-					&self->priv->locals_machine);
+  future = gswat_gdb_debugger_send_mi_query (self,
+					     gdb_command,
+					     GSWAT_GDB_COMMAND_PRIORITY_REFRESH);
+  gswat_gdb_mi_future_then (future,
+			    async_locals_update_list_args_mi_callback,
+			    locals_machine);
+  gswat_gdb_mi_future_unref (future);
   g_free (gdb_command);
 
-  locals_machine->list_locals_token =
-    gswat_gdb_debugger_send_mi_command (self,
-					"-stack-list-locals 0",
-					async_locals_update_list_locals_mi_callback,
-					&self->priv->locals_machine);
+  future = gswat_gdb_debugger_send_mi_query (self,
+					     "-stack-list-locals 0",
+					     GSWAT_GDB_COMMAND_PRIORITY_REFRESH);
+  gswat_gdb_mi_future_then (future,
+			    async_locals_update_list_locals_mi_callback,
+			    locals_machine);
+  gswat_gdb_mi_future_unref (future);
 }
 
 static void
@@ -1791,7 +2428,13 @@ async_locals_update_list_args_mi_callback (GSwatGdbDebugger *self,
 {
   LocalsUpdateMachine *locals_machine;
   const GDBMIValue *stack, *frame, *args, *var;
-  guint i;
+  GDBMIIter iter;
+
+  /* The list-locals callback will be cancelled too, and cleans up */
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED)
+    {
+      return;
+    }
 
   locals_machine =  (LocalsUpdateMachine *)data;
   if (locals_machine->in_use == FALSE)
@@ -1806,25 +2449,23 @@ async_locals_update_list_args_mi_callback (GSwatGdbDebugger *self,
       return;
     }
 
-  stack = gdbmi_value_hash_lookup (record->val, "stack-args");
+  stack = gdbmi_value_hash_lookup_atom (record->val, GDBMI_ATOM_STACK_ARGS);
   if (stack)
     {
       frame = gdbmi_value_list_get_nth (stack, 0);
       if (frame)
 	{
-	  args = gdbmi_value_hash_lookup (frame, "args");
+	  args = gdbmi_value_hash_lookup_atom (frame, GDBMI_ATOM_ARGS);
 	  if (args)
 	    {
-	      for (i = 0; i < gdbmi_value_get_size (args); i++)
+	      gdbmi_value_iter_init (&iter, args);
+	      while ((var = gdbmi_value_iter_next (&iter)))
 		{
-		  var = gdbmi_value_list_get_nth (args, i);
-		  if (var)
-		    {
-		      const gchar *name;
-		      name = gdbmi_value_literal_get (var);
-		      locals_machine->names =
-			g_list_prepend (locals_machine->names, g_strdup (name));
-		    }
+		  const gchar *name;
+		  name = gdbmi_value_literal_get (var);
+		  locals_machine->names =
+		    g_list_prepend (locals_machine->names,
+				    gdbmi_literal_dup_utf8 (name, -1));
 		}
 
 	    }
@@ -1841,54 +2482,61 @@ async_locals_update_list_locals_mi_callback (GSwatGdbDebugger *self,
 {
   LocalsUpdateMachine *locals_machine;
   const GDBMIValue *local, *var;
-  guint i;
+  GDBMIIter iter;
 
   locals_machine =  (LocalsUpdateMachine *)data;
-  if (locals_machine->list_arguments_done != TRUE)
+  if (locals_machine->list_arguments_done != TRUE
+      && record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED)
     {
       g_warning ("%s: called out of order", __FUNCTION__);
     }
 
   /* If someone jumped in and did a synchronous update
-   * already then we can bomb out now. */
-  if (self->priv->locals_valid == TRUE)
+   * already, or the update was cancelled, then we can bomb out now. */
+  if (self->priv->locals_valid == TRUE
+      || record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED)
     {
       g_list_foreach (locals_machine->names,  (GFunc)g_free, NULL);
       g_list_free (locals_machine->names);
       locals_machine->names = NULL;
       locals_machine->in_use = FALSE;
+      if (!self->priv->cancelling_stale)
+	complete_locals_waiters (self);
       return;
     }
 
-  local = gdbmi_value_hash_lookup (record->val, "locals");
+  local = gdbmi_value_hash_lookup_atom (record->val, GDBMI_ATOM_LOCALS);
   if (local)
     {
-      for (i = 0; i < gdbmi_value_get_size (local); i++)
+      gdbmi_value_iter_init (&iter, local);
+      while ((var = gdbmi_value_iter_next (&iter)))
 	{
-	  var = gdbmi_value_list_get_nth (local, i);
-	  if (var)
-	    {
-	      const gchar *name;
-	      name = gdbmi_value_literal_get (var);
-	      locals_machine->names =
-		g_list_prepend (locals_machine->names, g_strdup (name));
-	    }
+	  const gchar *name;
+	  name = gdbmi_value_literal_get (var);
+	  locals_machine->names =
+	    g_list_prepend (locals_machine->names,
+			    gdbmi_literal_dup_utf8 (name, -1));
 	}
     }
 
+  /* This takes over the names, and the machine stays in use until
+   * the update has finished */
   update_locals_list_from_name_list (self, locals_machine->names);
-  g_list_foreach (locals_machine->names,  (GFunc)g_free, NULL);
-  g_list_free (locals_machine->names);
   locals_machine->names = NULL;
-
-  locals_machine->in_use = FALSE;
 }
 
+/* Brings the locals list in line with the list of names, which it
+ * takes ownership of. Variable objects for any new locals are
+ * created asynchronously, and the update is finished off in
+ * finish_locals_update. */
 static void
 update_locals_list_from_name_list (GSwatGdbDebugger *self, GList *names)
 {
-  GList *tmp, *tmp2, *locals_copy;
-  gboolean list_changed = FALSE;
+  GList *tmp, *tmp2;
+  GList *new_names = NULL;
+  LocalsCreateState *state;
+  GSwatGdbMIFuture *future;
+  gboolean out_of_date = FALSE;
 
   for (tmp=names; tmp!=NULL; tmp=tmp->next)
     {
@@ -1905,19 +2553,12 @@ update_locals_list_from_name_list (GSwatGdbDebugger *self, GList *names)
 
 	  if (strcmp (tmp->data, current_name) == 0)
 	    {
-	      gchar *tmp_value;
-
-	      /* We retrieve the value here, to make sure the
-	       * variable object state is is in synch with the
-	       * current debugger state */
-	      /* Alternativly; perhaps we could have the variable
-	       * object code set up a callback for our state
-	       * updates, so this is done automatically. The
-	       * problem with that is, here, we want the update
-	       * to be synchronous. */
-	      tmp_value =
-		gswat_variable_object_get_value (variable_object, NULL);
-	      g_free (tmp_value);
+	      /* The variable object's state has to be in synch with
+	       * the current debugger state before the update
+	       * finishes */
+	      if (!gswat_gdb_variable_object_is_current (
+		    GSWAT_GDB_VARIABLE_OBJECT (variable_object)))
+		out_of_date = TRUE;
 
 	      found = TRUE;
 	      g_free (current_name);
@@ -1928,25 +2569,114 @@ update_locals_list_from_name_list (GSwatGdbDebugger *self, GList *names)
 
       if (!found)
 	{
-	  GSwatVariableObject *variable_object;
+	  new_names = g_list_prepend (new_names, tmp->data);
+	}
+    }
 
-	  variable_object =
-	    gswat_gdb_variable_object_new (self,
-					   (char *)tmp->data,
-					   NULL,
-					   GSWAT_VARIABLE_OBJECT_ANY_FRAME);
+  state = g_new0 (LocalsCreateState, 1);
+  state->self = self;
+  state->names = names;
+  state->new_names = g_list_reverse (new_names);
+  state->interrupt_count = self->priv->interrupt_count;
 
-	  g_signal_connect (variable_object,
-			    "notify::valid",
-			    G_CALLBACK (on_local_variable_object_invalidated),
-			    self
-	  );
+  /* The update for the stop is normally sent ahead of this one, but
+   * it may have been dropped as stale, in which case we send
+   * another rather than evaluating the locals one at a time */
+  if (out_of_date)
+    {
+      future = gswat_gdb_variable_object_send_update_all (self);
+      gswat_gdb_mi_future_then (future, locals_updated_mi_callback, state);
+      gswat_gdb_mi_future_unref (future);
+      return;
+    }
 
-	  self->priv->locals =
-	    g_list_prepend (self->priv->locals, variable_object);
-	  list_changed = TRUE;
-	}
+  create_new_locals (self, state);
+}
+
+static void
+locals_updated_mi_callback (GSwatGdbDebugger *self,
+			    const GSwatGdbMIRecord *record,
+			    void *data)
+{
+  LocalsCreateState *state = data;
+
+  if (!self)
+    {
+      g_list_free (state->new_names);
+      state->new_names = NULL;
+      finish_locals_update (state->self, state);
+      return;
+    }
+
+  create_new_locals (self, state);
+}
+
+static void
+create_new_locals (GSwatGdbDebugger *self, LocalsCreateState *state)
+{
+  GSwatGdbMIFuture *future;
+
+  if (!state->new_names)
+    {
+      finish_locals_update (self, state);
+      return;
+    }
+
+  /* The variable objects for new locals are all created in one go */
+  future =
+    gswat_gdb_variable_object_send_create_list (self,
+						state->new_names,
+						GSWAT_VARIABLE_OBJECT_ANY_FRAME,
+						&state->new_locals);
+  g_list_free (state->new_names);
+  state->new_names = NULL;
+  gswat_gdb_mi_future_then (future, locals_created_mi_callback, state);
+  gswat_gdb_mi_future_unref (future);
+}
+
+static void
+locals_created_mi_callback (GSwatGdbDebugger *self,
+			    const GSwatGdbMIRecord *record,
+			    void *data)
+{
+  LocalsCreateState *state = data;
+
+  /* The future loses track of the debugger as it's finalized, but
+   * it still gets to clean up */
+  finish_locals_update (state->self, state);
+}
+
+static void
+finish_locals_update (GSwatGdbDebugger *self, LocalsCreateState *state)
+{
+  GList *tmp, *tmp2, *locals_copy;
+  GList *names = state->names;
+  GList *new_locals;
+  gboolean list_changed = FALSE;
+
+  /* Nothing here blocks, since the replies have all arrived */
+  new_locals = gswat_gdb_variable_object_finish_create_list (state->new_locals);
+
+  if (!self->priv->gdb_connected)
+    {
+      g_list_foreach (new_locals, (GFunc)g_object_unref, NULL);
+      g_list_free (new_locals);
+      goto done;
+    }
+
+  for (tmp=new_locals; tmp!=NULL; tmp=tmp->next)
+    {
+      g_signal_connect (tmp->data,
+			"notify::valid",
+			G_CALLBACK (on_local_variable_object_invalidated),
+			self
+      );
+
+      self->priv->locals =
+	g_list_prepend (self->priv->locals, tmp->data);
+      list_changed = TRUE;
     }
+  g_list_free (new_locals);
 
   /* prune, extra variable objects from self->priv->locals */
   locals_copy=g_list_copy (self->priv->locals);
@@ -1980,20 +2710,151 @@ update_locals_list_from_name_list (GSwatGdbDebugger *self, GList *names)
     }
   g_list_free (locals_copy);
 
-  /* Update this before notification so that if a listener
-   * decides to call gswat_debuggable_get_locals_list, we
-   * wont go recursive */
-  self->priv->locals_valid = TRUE;
+  /* If the frame changed while the variable objects were being
+   * created, then these aren't the right locals after all; the
+   * list is brought up to date with another update below */
+  if (state->interrupt_count == self->priv->interrupt_count)
+    {
+      /* Update this before notification so that if a listener
+       * decides to call gswat_debuggable_get_locals_list, we
+       * wont go recursive */
+      self->priv->locals_valid = TRUE;
+    }
+
+done:
+  g_list_foreach (names,  (GFunc)g_free, NULL);
+  g_list_free (names);
+  g_free (state);
+
+  self->priv->locals_machine.in_use = FALSE;
+
+  if (!self->priv->gdb_connected)
+    {
+      complete_locals_waiters (self);
+      return;
+    }
+
   if (list_changed)
     {
       g_object_notify (G_OBJECT (self), "locals");
     }
+
+  if (self->priv->locals_valid
+      || self->priv->state & GSWAT_DEBUGGABLE_RUNNING)
+    {
+      complete_locals_waiters (self);
+    }
+  else
+    {
+      kick_asynchronous_locals_update (self);
+    }
+}
+
+/* The print-values argument of -stack-list-arguments for the
+ * session's choice of argument values */
+static gint
+stack_arguments_print_values (GSwatGdbDebugger *self)
+{
+  switch (gswat_session_get_argument_values (self->priv->session))
+    {
+    case GSWAT_SESSION_ARGUMENT_VALUES_NONE:
+      return 0;
+    case GSWAT_SESSION_ARGUMENT_VALUES_ALL:
+      return 1;
+    case GSWAT_SESSION_ARGUMENT_VALUES_SIMPLE:
+    default:
+      return 2;
+    }
+}
+
+/* Has gdb stop printing strings and arrays after max_length
+ * elements, or never if it's 0, so long argument values are cut
+ * short before they are formatted and sent to us rather than after.
+ * An element can take more than a byte to print, so
+ * limit_argument_values still has the last word. */
+static void
+send_print_elements (GSwatGdbDebugger *self, guint max_length)
+{
+  gchar *command;
+
+  if (!self->priv->gdb_connected)
+    return;
+
+  command = g_strdup_printf ("-gdb-set print elements %u", max_length);
+  gswat_gdb_debugger_send_mi_command (self,
+				      command,
+				      gswat_gdb_debugger_nop_mi_callback,
+				      NULL);
+  g_free (command);
+}
+
+static void
+on_max_argument_value_length_changed (GObject *object,
+				      GParamSpec *property,
+				      gpointer data)
+{
+  GSwatGdbDebugger *self = GSWAT_GDB_DEBUGGER (data);
+
+  send_print_elements (self,
+		       gswat_session_get_max_argument_value_length (
+			 GSWAT_SESSION (object)));
+}
+
+/* Cuts short any argument values in the stack that are longer than
+ * the session allows, so they end with "..." and are no longer than
+ * the maximum, which leaves them alone the next time round. gdb has
+ * already been asked to stop short, see send_print_elements, so
+ * this only catches values that print more than a byte an element. */
+static void
+limit_argument_values (GSwatGdbDebugger *self, GQueue *stack)
+{
+  guint max_length;
+  GList *tmp, *tmp2;
+
+  max_length =
+    gswat_session_get_max_argument_value_length (self->priv->session);
+  if (max_length == 0)
+    return;
+
+  for (tmp=stack->head; tmp!=NULL; tmp=tmp->next)
+    {
+      GSwatDebuggableFrame *frame = tmp->data;
+
+      for (tmp2=frame->arguments; tmp2!=NULL; tmp2=tmp2->next)
+	{
+	  GSwatDebuggableFrameArgument *arg = tmp2->data;
+	  const gchar *end;
+	  gchar *value;
+
+	  if (!arg->value || strlen (arg->value) <= max_length)
+	    continue;
+
+	  if (max_length <= 3)
+	    end = arg->value + max_length;
+	  else
+	    end = arg->value + max_length - 3;
+	  /* Don't split a UTF-8 character */
+	  while (end > arg->value && (*end & 0xc0) == 0x80)
+	    end--;
+
+	  value = g_strndup (arg->value, end - arg->value);
+	  g_free (arg->value);
+	  if (max_length > 3)
+	    {
+	      arg->value = g_strconcat (value, "...", NULL);
+	      g_free (value);
+	    }
+	  else
+	    arg->value = value;
+	}
+    }
 }
 
 static void
 kick_asynchronous_stack_update (GSwatGdbDebugger *self)
 {
   StackUpdateMachine *stack_machine;
+  GSwatGdbMIFuture *future;
 
   if (  (self->priv->state & GSWAT_DEBUGGABLE_RUNNING)
       || self->priv->stack_valid
@@ -2012,17 +2873,127 @@ kick_asynchronous_stack_update (GSwatGdbDebugger *self)
 
   stack_machine->new_stack = g_queue_new ();
 
-  stack_machine->list_frames_token =
-    gswat_gdb_debugger_send_mi_command (self,
-					"-stack-list-frames",
-					async_stack_update_list_frames_mi_callback,
-					stack_machine);
+  /* We need the depth to know when we have fetched enough, and to
+   * line the top of the new stack up with the previous one */
+  future = send_stack_depth_query (self, GSWAT_GDB_COMMAND_PRIORITY_REFRESH);
+  gswat_gdb_mi_future_then (future,
+			    async_stack_update_depth_mi_callback,
+			    stack_machine);
+  gswat_gdb_mi_future_unref (future);
+
+  if (self->priv->incremental_stack
+      && self->priv->previous_stack
+      && !g_queue_is_empty (self->priv->previous_stack))
+    {
+      stack_machine->incremental = TRUE;
+      stack_machine->window_size = STACK_WINDOW;
+    }
+  else
+    stack_machine->window_size = STACK_PAGE;
+  send_stack_list_queries (self,
+			   stack_machine,
+			   0,
+			   stack_machine->window_size);
+}
 
-  stack_machine->list_args_token =
-    gswat_gdb_debugger_send_mi_command (self,
-					"-stack-list-arguments 1",
-					async_stack_update_list_args_mi_callback,
-					stack_machine);
+static GSwatGdbMIFuture *
+send_stack_depth_query (GSwatGdbDebugger *self,
+			GSwatGdbCommandPriority priority)
+{
+  GSwatGdbMIFuture *future;
+  gchar *command;
+
+  /* Counting the frames is much cheaper than listing them, but
+   * gdb still has to unwind the whole stack to do it */
+  command = g_strdup_printf ("-stack-info-depth %d", STACK_DEPTH_LIMIT);
+  future = gswat_gdb_debugger_send_mi_query (self, command, priority);
+  g_free (command);
+
+  return future;
+}
+
+/* Asks gdb for the frames from low up to, but not including, high
+ * and their arguments, or for the whole stack if high is 0 */
+static void
+send_stack_list_queries (GSwatGdbDebugger *self,
+			 StackUpdateMachine *stack_machine,
+			 guint low,
+			 guint high)
+{
+  GSwatGdbMIFuture *future;
+  gchar *range;
+  gchar *command;
+
+  if (high)
+    range = g_strdup_printf (" %u %u", low, high - 1);
+  else
+    range = g_strdup ("");
+  stack_machine->window_start = low;
+  stack_machine->window_end = high;
+  stack_machine->list_frames_done = FALSE;
+
+  command = g_strdup_printf ("-stack-list-frames%s", range);
+  future = gswat_gdb_debugger_send_mi_query (self,
+					     command,
+					     GSWAT_GDB_COMMAND_PRIORITY_REFRESH);
+  gswat_gdb_mi_future_then (future,
+			    async_stack_update_list_frames_mi_callback,
+			    stack_machine);
+  gswat_gdb_mi_future_unref (future);
+  g_free (command);
+  g_free (range);
+
+  send_stack_args_query (self, stack_machine, low, high);
+}
+
+/* Asks gdb for the arguments of the frames from low up to, but not
+ * including, high, or of the whole stack if high is 0 */
+static void
+send_stack_args_query (GSwatGdbDebugger *self,
+		       StackUpdateMachine *stack_machine,
+		       guint low,
+		       guint high)
+{
+  GSwatGdbMIFuture *future;
+  gchar *command;
+
+  if (high)
+    command = g_strdup_printf ("-stack-list-arguments %d %u %u",
+			       stack_arguments_print_values (self),
+			       low,
+			       high - 1);
+  else
+    command = g_strdup_printf ("-stack-list-arguments %d",
+			       stack_arguments_print_values (self));
+  future = gswat_gdb_debugger_send_mi_query (self,
+					     command,
+					     GSWAT_GDB_COMMAND_PRIORITY_REFRESH);
+  gswat_gdb_mi_future_then (future,
+			    async_stack_update_list_args_mi_callback,
+			    stack_machine);
+  gswat_gdb_mi_future_unref (future);
+  g_free (command);
+}
+
+static void
+async_stack_update_depth_mi_callback (GSwatGdbDebugger *self,
+				      const GSwatGdbMIRecord *record,
+				      void *data)
+{
+  StackUpdateMachine *stack_machine = (StackUpdateMachine *)data;
+
+  /* Without the depth the update falls back to listing the whole
+   * stack */
+  if (record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_DONE)
+    return;
+
+  if (!gswat_gdb_mi_decode_stack_depth (record->text,
+					&stack_machine->depth))
+    {
+      g_warning ("%s: error decoding stack depth", __FUNCTION__);
+      return;
+    }
+  stack_machine->depth_known = TRUE;
 }
 
 static void
@@ -2031,8 +3002,14 @@ async_stack_update_list_frames_mi_callback (GSwatGdbDebugger *self,
 					    void *data)
 {
   StackUpdateMachine *stack_machine;
-  const GDBMIValue *stack_val, *frame_val;
-  int n;
+  GList *tmp;
+  guint n;
+
+  /* The list-arguments callback will be cancelled too, and cleans up */
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED)
+    {
+      return;
+    }
 
   stack_machine = (StackUpdateMachine *)data;
   if (stack_machine->in_use == FALSE)
@@ -2063,27 +3040,20 @@ async_stack_update_list_frames_mi_callback (GSwatGdbDebugger *self,
       return;
     }
 
-  stack_val = gdbmi_value_hash_lookup (record->val, "stack");
-
-  n=0;
-  while (1)
+  if (!gswat_gdb_mi_decode_stack (record->text,
+				  stack_machine->new_stack,
+				  decoder_uri_from_filename,
+				  self))
     {
-      GSwatDebuggableFrame *frame;
-
-      frame_val = gdbmi_value_list_get_nth (stack_val, n);
-      if (!frame_val)
-	{
-	  break;
-	}
-
-      frame = g_new0 (GSwatDebuggableFrame, 1);
-      g_queue_push_tail (stack_machine->new_stack, frame);
-
-      process_frame (self, frame_val, frame);
+      g_warning ("%s: error decoding frames", __FUNCTION__);
+      stack_machine->in_use = FALSE;
+      return;
+    }
 
+  for (tmp=stack_machine->new_stack->head, n=0; tmp!=NULL; tmp=tmp->next, n++)
+    {
+      GSwatDebuggableFrame *frame = tmp->data;
       g_assert (frame->level == n);
-
-      n++;
     }
 
   stack_machine->list_frames_done = TRUE;
@@ -2094,20 +3064,56 @@ async_stack_update_list_args_mi_callback (GSwatGdbDebugger *self,
 					  const GSwatGdbMIRecord *record,
 					  void *data)
 {
-  StackUpdateMachine *stack_machine;
-  GList *tmp;
-  GSwatDebuggableFrame *current_frame = NULL;
-  const GDBMIValue *frame_val;
-  const GDBMIValue *stackargs_val, *args_val, *arg_val, *literal_val;
-  GSwatDebuggableFrameArgument *arg;
+  StackUpdateMachine *stack_machine = (StackUpdateMachine *)data;
+
+  if (!add_stack_args (self, record, stack_machine))
+    {
+      /* However that went, the update is over; unless it was
+       * cancelled to make way for a newer one */
+      if (!self->priv->cancelling_stale)
+	complete_stack_waiters (self);
+      return;
+    }
+
+  /* Still waiting on more frames */
+  if (!continue_stack_update (self, stack_machine))
+    return;
+
+  install_new_stack (self, stack_machine);
+  fill_stack_for_waiters (self);
+}
+
+/* Anyone waiting wants the whole stack, not just the top of it */
+static void
+fill_stack_for_waiters (GSwatGdbDebugger *self)
+{
+  if (self->priv->stack_waiters
+      && self->priv->stack->length < self->priv->stack_depth)
+    kick_stack_fill (self);
+  else
+    complete_stack_waiters (self);
+}
+
+/* Returns FALSE, having freed the new stack, if the update has
+ * to be abandoned */
+static gboolean
+add_stack_args (GSwatGdbDebugger *self,
+		const GSwatGdbMIRecord *record,
+		StackUpdateMachine *stack_machine)
+{
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED)
+    {
+      gswat_debuggable_stack_free (stack_machine->new_stack);
+      stack_machine->in_use = FALSE;
+      return FALSE;
+    }
 
-  stack_machine = (StackUpdateMachine *)data;
   if (stack_machine->list_frames_done != TRUE)
     {
       g_warning ("%s: called out of order", __FUNCTION__);
       gswat_debuggable_stack_free (stack_machine->new_stack);
       stack_machine->in_use = FALSE;
-      return;
+      return FALSE;
     }
 
   /* If someone jumped in and did a synchronous update
@@ -2116,7 +3122,7 @@ async_stack_update_list_args_mi_callback (GSwatGdbDebugger *self,
     {
       gswat_debuggable_stack_free (stack_machine->new_stack);
       stack_machine->in_use = FALSE;
-      return;
+      return FALSE;
     }
 
   if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR)
@@ -2124,7 +3130,7 @@ async_stack_update_list_args_mi_callback (GSwatGdbDebugger *self,
       g_warning ("%s: error listing frames", __FUNCTION__);
       gswat_debuggable_stack_free (stack_machine->new_stack);
       stack_machine->in_use = FALSE;
-      return;
+      return FALSE;
     }
 
   if (record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_DONE)
@@ -2132,55 +3138,189 @@ async_stack_update_list_args_mi_callback (GSwatGdbDebugger *self,
       g_warning ("%s: unexpected result type", __FUNCTION__);
       gswat_debuggable_stack_free (stack_machine->new_stack);
       stack_machine->in_use = FALSE;
-      return;
+      return FALSE;
     }
 
-  stackargs_val = gdbmi_value_hash_lookup (record->val,
-					   "stack-args");
-
-  for (tmp=stack_machine->new_stack->head; tmp!=NULL; tmp=tmp->next)
+  if (!gswat_gdb_mi_decode_stack_args (record->text,
+				       stack_machine->new_stack))
     {
-      guint a;
-      current_frame =  (GSwatDebuggableFrame *)tmp->data;
+      g_warning ("%s: error decoding frame arguments", __FUNCTION__);
+    }
+  limit_argument_values (self, stack_machine->new_stack);
 
-      frame_val = gdbmi_value_list_get_nth (stackargs_val,
-					    current_frame->level);
-      args_val = gdbmi_value_hash_lookup (frame_val, "args");
+  return TRUE;
+}
 
-      a=0;
-      while (TRUE)
-	{
-	  arg_val = gdbmi_value_list_get_nth (args_val, a);
-	  if (!arg_val)
-	    {
-	      break;
-	    }
+/* Returns TRUE if the frames of the last window fetched line up with
+ * the frames at the same depth in the previous stack, and there are
+ * at least STACK_MATCH_FRAMES of them to go by. Frame 0's address is
+ * wherever the program stopped rather than a return address, so it is
+ * left out of the comparison in either stack. */
+static gboolean
+outer_frames_match (StackUpdateMachine *stack_machine,
+		    GQueue *previous_stack,
+		    gint level_change)
+{
+  GQueue *new_stack = stack_machine->new_stack;
+  GList *link, *previous_link;
+  guint n_matched = 0;
+
+  link = new_stack->tail;
+  previous_link =
+    g_queue_peek_nth_link (previous_stack,
+			   ((GSwatDebuggableFrame *)link->data)->level
+			   + level_change);
+  for (; link && previous_link;
+       link = link->prev, previous_link = previous_link->prev)
+    {
+      GSwatDebuggableFrame *frame = link->data;
+      GSwatDebuggableFrame *previous_frame = previous_link->data;
 
-	  arg = g_new0 (GSwatDebuggableFrameArgument, 1);
+      if (frame->level < stack_machine->window_start
+	  || frame->level == 0
+	  || previous_frame->level == 0)
+	break;
 
-	  literal_val = gdbmi_value_hash_lookup (arg_val, "name");
-	  arg->name = g_strdup (gdbmi_value_literal_get (literal_val));
+      if (previous_frame->address != frame->address
+	  || g_strcmp0 (previous_frame->function, frame->function) != 0)
+	return FALSE;
+      n_matched++;
+    }
+
+  return n_matched >= STACK_MATCH_FRAMES;
+}
+
+/* For an incremental update, once the frames fetched so far reach
+ * as far down as the previous stack, the last window of frames
+ * fetched is compared against the frames at the same depth in the
+ * previous stack. If they all match, the frames below them are taken
+ * from the previous stack rather than being fetched again, so
+ * stepping deep inside a program only has to fetch the frames at the
+ * top. Their arguments may have changed though, so those are fetched
+ * again, which is much cheaper than unwinding the frames. Returns
+ * TRUE if the new stack is ready, or FALSE if more has been asked
+ * for. */
+static gboolean
+continue_stack_update (GSwatGdbDebugger *self,
+		       StackUpdateMachine *stack_machine)
+{
+  GQueue *new_stack = stack_machine->new_stack;
+  GQueue *previous_stack = self->priv->previous_stack;
+  GSwatDebuggableFrame *frame;
+  gint level_change = 0;
+  gint previous_level;
+  guint low;
+
+  if (stack_machine->refreshing_arguments)
+    return TRUE;
+
+  /* A short window means we have reached the outermost frame */
+  if (!stack_machine->window_end
+      || new_stack->length < stack_machine->window_end)
+    return TRUE;
+
+  if (!stack_machine->depth_known)
+    {
+      g_queue_foreach (new_stack, (GFunc)gswat_debuggable_frame_free, NULL);
+      g_queue_clear (new_stack);
+      stack_machine->incremental = FALSE;
+      send_stack_list_queries (self, stack_machine, 0, 0);
+      return FALSE;
+    }
+
+  if (new_stack->length >= stack_machine->depth)
+    return TRUE;
+
+  /* The levels can't be lined up if either stack was deeper than
+   * we count */
+  frame = g_queue_peek_tail (new_stack);
+  if (stack_machine->incremental
+      && previous_stack
+      && self->priv->previous_depth < STACK_DEPTH_LIMIT
+      && stack_machine->depth < STACK_DEPTH_LIMIT)
+    {
+      level_change = (gint)self->priv->previous_depth - stack_machine->depth;
+      previous_level = (gint)frame->level + level_change;
+    }
+  else
+    previous_level = -1;
 
-	  literal_val = gdbmi_value_hash_lookup (arg_val, "value");
-	  arg->value = g_strdup (gdbmi_value_literal_get (literal_val));
+  if (previous_level >= 0
+      && previous_level + 1 < previous_stack->length
+      && outer_frames_match (stack_machine, previous_stack, level_change))
+    {
+      GList *link, *next;
 
-	  current_frame->arguments =
-	    g_list_prepend (current_frame->arguments, arg);
+      low = new_stack->length;
+      link = g_queue_peek_nth_link (previous_stack, previous_level + 1);
+      for (; link != NULL; link = next)
+	{
+	  GSwatDebuggableFrame *previous_frame = link->data;
 
-	  a++;
+	  next = link->next;
+	  g_queue_unlink (previous_stack, link);
+	  previous_frame->level -= level_change;
+	  g_queue_push_tail_link (new_stack, link);
 	}
+
+      /* Without values there is nothing about the arguments that
+       * could have changed */
+      if (stack_arguments_print_values (self) == 0)
+	return TRUE;
+
+      stack_machine->refreshing_arguments = TRUE;
+      send_stack_args_query (self, stack_machine, low, new_stack->length);
+      return FALSE;
     }
 
+  /* The rest are fetched when they're asked for */
+  if (new_stack->length >= STACK_PAGE)
+    return TRUE;
+
+  /* Each window is twice the size of the last, so a stack that has
+   * changed all the way down is fetched in a few round trips */
+  low = new_stack->length;
+  stack_machine->window_size *= 2;
+  send_stack_list_queries (self,
+			   stack_machine,
+			   low,
+			   MIN (low + stack_machine->window_size,
+				MIN (stack_machine->depth, STACK_PAGE)));
+  return FALSE;
+}
+
+static void
+install_new_stack (GSwatGdbDebugger *self,
+		   StackUpdateMachine *stack_machine)
+{
+  GSwatDebuggableFrame *current_frame = NULL;
+
   gswat_debuggable_stack_free (self->priv->stack);
   self->priv->stack = stack_machine->new_stack;
   self->priv->stack_valid = TRUE;
   stack_machine->in_use = FALSE;
+  drop_stack_snapshot (self);
+
+  /* Unless the frames ran out first */
+  if (stack_machine->depth_known
+      && stack_machine->window_end
+      && self->priv->stack->length >= stack_machine->window_end)
+    self->priv->stack_depth = MAX (stack_machine->depth,
+				   self->priv->stack->length);
+  else
+    self->priv->stack_depth = self->priv->stack->length;
+
+  gswat_debuggable_stack_free (self->priv->previous_stack);
+  self->priv->previous_stack = NULL;
 
   /* lookup frame 0 */
-  current_frame = self->priv->stack->head->data;
-  set_source_location (self,
-		       current_frame->source_uri,
-		       current_frame->line);
+  if (self->priv->stack->head)
+    {
+      current_frame = self->priv->stack->head->data;
+      set_source_location (self,
+			   current_frame->source_uri,
+			   current_frame->line);
+    }
 
   g_object_notify (G_OBJECT (self), "stack");
 }
@@ -2208,621 +3348,2198 @@ on_local_variable_object_invalidated (GObject *object,
   g_object_unref (variable_object);
 }
 
-gulong
-gswat_gdb_debugger_send_mi_command (GSwatGdbDebugger* object,
-				    const gchar* command,
-				    GSwatGdbMIRecordCallback result_callback,
-				    void *data)
+static GSwatGdbMIHandler *
+lookup_mi_handler (GSwatGdbDebugger *self, gulong token)
 {
-  GSwatGdbDebugger *self;
   GSwatGdbMIHandler *handler;
-  gchar *complete_command = NULL;
-  gsize len;
-  gsize remaining;
-
-  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), 0);
-  self = GSWAT_GDB_DEBUGGER (object);
 
-  if (!self->priv->gdb_connected)
-    {
-      return 0;
-    }
+  if (token < self->priv->mi_handlers_oldest
+      || token - self->priv->mi_handlers_oldest >= self->priv->mi_handlers_size)
+    return NULL;
 
-  handler = g_new0 (GSwatGdbMIHandler, 1);
-  handler->token = self->priv->gdb_sequence;
-  handler->result_callback = result_callback;
-  handler->data = data;
+  handler =
+    &self->priv->mi_handlers[token & (self->priv->mi_handlers_size - 1)];
 
-  complete_command = g_strdup_printf ("%ld%s\n", self->priv->gdb_sequence, command);
-
-  len = strlen (complete_command);
-  remaining = len;
-  do{
-      gsize written;
-      GIOStatus status;
-      status = g_io_channel_write_chars (self->priv->gdb_in,
-					 &complete_command[len-remaining],
-					 remaining,
-					 &written,
-					 NULL);
-      if (status != G_IO_STATUS_NORMAL)
-	{
-	  g_warning (_ ("Couldn't send command '%s' to gdb"), command);
-	  g_free (handler);
-	  g_free (complete_command);
-	  return 0;
-	}
-      remaining -= written;
-  }while (remaining);
+  return handler->token == token ? handler : NULL;
+}
 
-  g_io_channel_flush (self->priv->gdb_in, NULL);
+static void
+add_mi_handler (GSwatGdbDebugger *self,
+		gulong token,
+		GSwatGdbMIRecordCallback result_callback,
+		gpointer data)
+{
+  GSwatGdbMIHandler *handler;
 
-  if (gswat_debug_flags & GSWAT_DEBUG_GDB_TRACE)
+  /* Grow the ring if the commands in flight no longer fit */
+  if (token - self->priv->mi_handlers_oldest >= self->priv->mi_handlers_size)
     {
-      char *escaped_command = g_strescape  (command, "");
-      char *log_command =
-	g_strdup_printf ("interpreter-exec mi '%ld%s'\n",
-			 self->priv->gdb_sequence,
-			 escaped_command);
-      g_free  (escaped_command);
-      gswat_log (log_command);
-      g_free  (log_command);
+      GSwatGdbMIHandler *old_handlers = self->priv->mi_handlers;
+      guint old_size = self->priv->mi_handlers_size;
+      guint size = old_size;
+      guint i;
+
+      while (token - self->priv->mi_handlers_oldest >= size)
+	size *= 2;
+
+      self->priv->mi_handlers = g_new0 (GSwatGdbMIHandler, size);
+      self->priv->mi_handlers_size = size;
+      for (i = 0; i < old_size; i++)
+	if (old_handlers[i].token)
+	  self->priv->mi_handlers[old_handlers[i].token & (size - 1)] =
+	    old_handlers[i];
+      g_free (old_handlers);
     }
 
-  self->priv->mi_handlers = g_slist_prepend (self->priv->mi_handlers, handler);
+  handler =
+    &self->priv->mi_handlers[token & (self->priv->mi_handlers_size - 1)];
+  handler->token = token;
+  handler->result_callback = result_callback;
+  handler->data = data;
+  handler->result = NULL;
+  handler->deadline = G_MAXDOUBLE;
 
-  GSWAT_DEBUG (MISC, "gdb mi command:%s",complete_command);
-  g_free (complete_command);
+  self->priv->n_mi_handlers++;
+}
 
-  return self->priv->gdb_sequence++;
+/* Frees up a handler's slot, and moves mi_handlers_oldest on past
+ * any free slots at the old end of the ring */
+static void
+remove_mi_handler (GSwatGdbDebugger *self, GSwatGdbMIHandler *handler)
+{
+  if (handler->in_flight)
+    mi_command_answered (self, handler);
+  if (handler->result)
+    free_pending_record (handler->result);
+  memset (handler, 0, sizeof (GSwatGdbMIHandler));
+  self->priv->n_mi_handlers--;
+
+  while (self->priv->mi_handlers_oldest < self->priv->gdb_sequence
+	 && !lookup_mi_handler (self, self->priv->mi_handlers_oldest))
+    self->priv->mi_handlers_oldest++;
 }
 
-void
-gswat_gdb_debugger_send_cli_command (GSwatGdbDebugger* object,
-				     gchar const* command)
+/* Gives up on a command. Its callback gets a
+ * GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED record, so it can clean up */
+static void
+cancel_mi_handler (GSwatGdbDebugger *self, GSwatGdbMIHandler *handler)
 {
-  GSwatGdbDebugger *self;
-  gchar *complete_command = NULL;
-  gsize len;
-  gsize remaining;
+  GSwatGdbMIRecordCallback result_callback = handler->result_callback;
+  gpointer data = handler->data;
 
-  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
-  self = GSWAT_GDB_DEBUGGER (object);
+  remove_mi_handler (self, handler);
 
-  complete_command = g_strdup_printf ("%s\n", command);
-
-  len = strlen (complete_command);
-  remaining = len;
-  do{
-      gsize written;
-      GIOStatus status;
-      status = g_io_channel_write_chars (self->priv->gdb_in,
-					 &complete_command[len-remaining],
-					 remaining,
-					 &written,
-					 NULL);
-      if (status != G_IO_STATUS_NORMAL)
-	{
-	  g_warning (_ ("Couldn't send command '%s' to gdb"), command);
-	  g_free (complete_command);
-	  return;
-	}
-      remaining -= written;
-  }while (remaining);
+  if (result_callback)
+    {
+      GSwatGdbMIRecord record;
 
-  g_io_channel_flush (self->priv->gdb_in, NULL);
+      record.type = GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED;
+      record.val = NULL;
+      record.text = NULL;
+      result_callback (self, &record, data);
+    }
+}
 
-  if (gswat_debug_flags & GSWAT_DEBUG_GDB_TRACE)
-    gswat_log (complete_command);
+/* The in-flight command that expires first, if any. Commands that
+ * have been answered or cancelled since they were sent are dropped
+ * from the front of mi_deadlines on the way. */
+static GSwatGdbMIHandler *
+first_expiring_mi_handler (GSwatGdbDebugger *self)
+{
+  GQueue *deadlines = &self->priv->mi_deadlines;
 
-  GSWAT_DEBUG (MISC, "gdb cli command:%s", complete_command);
+  while (!g_queue_is_empty (deadlines))
+    {
+      gulong token = GPOINTER_TO_SIZE (g_queue_peek_head (deadlines));
+      GSwatGdbMIHandler *handler = lookup_mi_handler (self, token);
 
-  g_free (complete_command);
+      if (handler && handler->in_flight)
+	return handler;
+      g_queue_pop_head (deadlines);
+    }
 
-  return;
+  return NULL;
 }
 
-static GSwatGdbMIRecord *
-find_pending_result_record_for_token (GSwatGdbDebugger *self, gulong token)
+/* Commands get their deadlines as they are sent, so the deadlines
+ * pass in the order of mi_deadlines, unless the timeout has been
+ * changed in between, and we can stop at the first command that
+ * hasn't expired. Commands that are held back aren't in
+ * mi_deadlines, so they don't get in the way. */
+static void
+expire_mi_handlers (GSwatGdbDebugger *self)
 {
-  int n;
-  GdbPendingRecord *pending_record;
+  GSwatGdbMIHandler *handler;
+  gdouble now = g_timer_elapsed (self->priv->mi_handler_clock, NULL);
 
-  for (n=0;
-       (pending_record = g_queue_peek_nth (self->priv->gdb_pending, n));
-       n++)
+  while ((handler = first_expiring_mi_handler (self))
+	 && handler->deadline <= now)
     {
-      /* if this is a result record */
-      if (pending_record->record_str->str[0] == '^'
-	  && pending_record->token == token)
-	{
-	  GSwatGdbMIRecord *record;
+      g_queue_pop_head (&self->priv->mi_deadlines);
+      g_warning ("gdb didn't respond to command %lu in time",
+		 handler->token);
+      g_hash_table_insert (self->priv->expired_tokens,
+			   GSIZE_TO_POINTER (handler->token),
+			   GSIZE_TO_POINTER (handler->token));
+      cancel_mi_handler (self, handler);
+    }
+}
 
-	  record = g_new (GSwatGdbMIRecord, 1);
-	  record->val = gdbmi_value_parse (pending_record->record_str->str);
-	  record->type =
-            gdb_mi_get_result_record_type (pending_record->record_str);
+/* How many milliseconds until expire_mi_handlers next has anything
+ * to do, or -1 if nothing is due to expire */
+static int
+next_mi_handler_expiry (GSwatGdbDebugger *self)
+{
+  GSwatGdbMIHandler *handler;
+  gdouble now;
 
-	  pending_record = g_queue_pop_nth (self->priv->gdb_pending, n);
-	  free_pending_record (pending_record);
+  handler = first_expiring_mi_handler (self);
+  if (!handler)
+    return -1;
 
-	  return record;
-	}
-    }
+  now = g_timer_elapsed (self->priv->mi_handler_clock, NULL);
+  if (handler->deadline <= now)
+    return 0;
+  return (int)MIN ((handler->deadline - now) * 1000 + 1, G_MAXINT);
+}
 
-  return NULL;
+static void
+cancel_all_mi_handlers (GSwatGdbDebugger *self)
+{
+  GSwatGdbMIHandler *handler;
+
+  while ((handler = lookup_mi_handler (self, self->priv->mi_handlers_oldest)))
+    cancel_mi_handler (self, handler);
 }
 
-GSwatGdbMIRecord *
-gswat_gdb_debugger_get_mi_result_record (GSwatGdbDebugger *object,
-					 gulong token)
+static gboolean
+mi_handler_is_stale (GSwatGdbDebugger *self, GSwatGdbMIHandler *handler)
 {
-  GSwatGdbDebugger *self;
-  GSwatGdbMIRecord *pending_record;
+  return handler->priority == GSWAT_GDB_COMMAND_PRIORITY_REFRESH
+    && handler->epoch != self->priv->interrupt_count
+    && !(handler->frame_independent
+	 && handler->stop_epoch == self->priv->stop_count)
+    && !handler->discard;
+}
 
-  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), NULL);
-  self = GSWAT_GDB_DEBUGGER (object);
+/* Called when the debugger stops or changes frame, before the new
+ * refreshes are kicked off. Refreshes for the previous state that
+ * are still held back are cancelled without ever being sent. Those
+ * already sent that are queries have their callbacks cancelled now,
+ * and their results are dropped without being parsed when they
+ * arrive. Other commands in flight, such as -var-update, change
+ * gdb's state, so their results are still applied. */
+static void
+cancel_stale_mi_commands (GSwatGdbDebugger *self)
+{
+  GQueue *held = &self->priv->held_commands[GSWAT_GDB_COMMAND_PRIORITY_REFRESH];
+  GArray *stale;
+  GList *l, *next;
+  gulong token;
+  guint i;
+
+  stale = g_array_new (FALSE, FALSE, sizeof (gulong));
 
-  g_io_channel_flush (self->priv->gdb_in, NULL);
+  for (l = held->head; l != NULL; l = next)
+    {
+      GdbHeldCommand *held_command = l->data;
+      GSwatGdbMIHandler *handler;
 
+      next = l->next;
+      handler = lookup_mi_handler (self, held_command->token);
+      if (handler && !mi_handler_is_stale (self, handler))
+	continue;
 
-  pending_record = find_pending_result_record_for_token (self, token);
-  if (pending_record)
+      if (handler)
+	{
+	  g_array_append_val (stale, held_command->token);
+	  self->priv->command_stats.stale_dropped++;
+	}
+      g_free (held_command->command);
+      g_free (held_command);
+      g_queue_delete_link (held, l);
+    }
+
+  for (token = self->priv->mi_handlers_oldest;
+       token < self->priv->gdb_sequence;
+       token++)
     {
-      return pending_record;
+      GSwatGdbMIHandler *handler = lookup_mi_handler (self, token);
+
+      if (handler && handler->in_flight && handler->query
+	  && mi_handler_is_stale (self, handler))
+	g_array_append_val (stale, token);
     }
 
-  while (TRUE)
+  /* The callbacks may send more commands, so the handlers are looked
+   * up again as we go */
+  self->priv->cancelling_stale = TRUE;
+  for (i = 0; i < stale->len; i++)
     {
-      GError *error=NULL;
-      if (!read_next_gdb_line (self, &error))
+      GSwatGdbMIHandler *handler =
+	lookup_mi_handler (self, g_array_index (stale, gulong, i));
+      GSwatGdbMIRecordCallback result_callback;
+      gpointer data;
+      GSwatGdbMIRecord record;
+
+      if (!handler)
+	continue;
+
+      if (!handler->in_flight)
 	{
-	  g_signal_emit (self,
-			 gswat_gdb_debugger_signals[GDB_IO_ERROR],
-			 0,
-			 error->message);
-	  g_error_free (error);
-	  return NULL;
+	  cancel_mi_handler (self, handler);
+	  continue;
 	}
 
-      pending_record = find_pending_result_record_for_token (self, token);
-      if (pending_record)
+      result_callback = handler->result_callback;
+      data = handler->data;
+      handler->result_callback = NULL;
+      handler->data = NULL;
+      handler->future = NULL;
+      handler->discard = TRUE;
+
+      if (result_callback)
 	{
-	  return pending_record;
+	  record.type = GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED;
+	  record.val = NULL;
+	  record.text = NULL;
+	  result_callback (self, &record, data);
 	}
     }
+  self->priv->cancelling_stale = FALSE;
 
-  g_assert_not_reached ();
-  return NULL;
+  g_array_free (stale, TRUE);
 }
 
-void
-gswat_gdb_debugger_free_mi_record (GSwatGdbMIRecord *record)
+/* The number of commands sent to gdb that we are still waiting on a
+ * result for */
+guint
+gswat_gdb_debugger_get_pending_command_count (GSwatGdbDebugger *self)
 {
-  g_return_if_fail (record != NULL);
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (self), 0);
 
-  if (record->val)
-    {
-      gdbmi_value_free (record->val);
-    }
-  g_free (record);
+  return self->priv->n_mi_handlers;
 }
 
-static void
-basic_runner_mi_callback (GSwatGdbDebugger *self,
-			  const GSwatGdbMIRecord *record,
-			  void *data)
+/* If gdb hasn't answered a command after timeout milliseconds we give
+ * up on it, and its callback is passed a record of type
+ * GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED. Commands sent while the
+ * target is running never expire, since gdb may not answer them
+ * until it stops. A timeout of 0, the default, means we wait
+ * forever. The timeout applies to commands sent after it is set. */
+void
+gswat_gdb_debugger_set_command_timeout (GSwatGdbDebugger *self,
+					guint timeout)
 {
-  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR)
-    {
-      g_warning ("basic_runner_mi_callback: recieved an error");
-      return;
-    }
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (self));
 
-  if (record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_RUNNING)
-    {
-      g_warning ("basic_runner_mi_callback: unexpected result type");
-      return;
-    }
+  self->priv->mi_command_timeout = timeout;
+}
 
-  self->priv->state = GSWAT_DEBUGGABLE_RUNNING;
-  g_object_notify (G_OBJECT (self), "state");
+guint
+gswat_gdb_debugger_get_command_timeout (GSwatGdbDebugger *self)
+{
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (self), 0);
 
+  return self->priv->mi_command_timeout;
 }
 
+/* Commands below GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE are held
+ * back while this many commands are waiting on gdb, so that anything
+ * more urgent issued in the meantime gets to gdb first. 0 means there
+ * is no limit. */
 void
-gswat_gdb_debugger_request_line_breakpoint (GSwatDebuggable *object,
-					    gchar *uri,
-					    guint line)
+gswat_gdb_debugger_set_max_commands_in_flight (GSwatGdbDebugger *self,
+					       guint max_commands)
 {
-  GSwatGdbDebugger *self;
-  gchar *gdb_command;
-  gchar *filename;
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (self));
 
-  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
-  self = GSWAT_GDB_DEBUGGER (object);
+  self->priv->max_in_flight = max_commands;
+  send_held_mi_commands (self, FALSE);
+}
 
-  if (self->priv->gdb_connected)
-    {
-      GFile *file;
+guint
+gswat_gdb_debugger_get_max_commands_in_flight (GSwatGdbDebugger *self)
+{
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (self), 0);
 
-      /* FIXME - hacky bolt on of gio */
-      file = g_file_new_for_uri  (uri);
-      filename = g_file_get_path  (file);
-      g_object_unref  (file);
+  return self->priv->max_in_flight;
+}
 
-      g_assert (filename);
+/* Fills in the scheduler's counters */
+void
+gswat_gdb_debugger_get_command_stats (GSwatGdbDebugger *self,
+				      GSwatGdbCommandStats *stats)
+{
+  gint priority;
 
-      gdb_command = g_strdup_printf ("-break-insert %s:%d", filename, line);
-      gswat_gdb_debugger_send_mi_command (self,
-					  gdb_command,
-					  break_insert_mi_callback,
-					  NULL);
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (self));
+  g_return_if_fail (stats != NULL);
 
-      g_free (gdb_command);
-      g_free (filename);
-    }
+  *stats = self->priv->command_stats;
+  stats->in_flight = self->priv->n_in_flight;
+  for (priority = 0; priority < GSWAT_GDB_COMMAND_PRIORITY_COUNT; priority++)
+    stats->held[priority] = self->priv->held_commands[priority].length;
 }
 
-static void
-break_insert_mi_callback (GSwatGdbDebugger *self,
-			  const GSwatGdbMIRecord *record,
-			  void *data)
+/* With threaded I/O, gdb's output is read and parsed in a thread of
+ * its own and the main loop is only left to dispatch the records,
+ * so a large reply doesn't hold up the UI. Callbacks are still only
+ * ever called in the main thread. This takes effect the next time
+ * the debugger connects. */
+void
+gswat_gdb_debugger_set_threaded_io (GSwatGdbDebugger *self,
+				    gboolean threaded_io)
 {
-  GSwatDebuggableBreakpoint *breakpoint;
-  GDBMIValue *val;
-  const GDBMIValue *bkpt_val, *literal_val;
-  const char *literal;
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (self));
+  g_return_if_fail (!threaded_io || g_thread_supported ());
 
-  /*
-     {
-     bkpt = {
-     addr = "0x08048397",
-     times = "0",
-     func = "function2",
-     type = "breakpoint",
-     number = "2",
-     file = "test.c",
-     disp = "keep",
-     enabled = "y",
-     fullname = "/home/rob/local/gswat/bin/test.c",
-     line = "16",
-     },
-     },
-     */
+  self->priv->threaded_io = threaded_io;
+}
 
-  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR)
-    {
-      g_warning ("break_insert_mi_callback: error inserting break point");
-      return;
-    }
+gboolean
+gswat_gdb_debugger_get_threaded_io (GSwatGdbDebugger *self)
+{
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (self), FALSE);
 
-  if (record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_DONE)
-    {
-      g_warning ("break_insert_mi_callback: unexpected result type");
-      return;
-    }
+  return self->priv->threaded_io;
+}
 
-  val = record->val;
-  bkpt_val = gdbmi_value_hash_lookup (val, "bkpt");
-  g_assert (bkpt_val);
+/* With raw I/O, gdb is asked to write UTF-8 whatever the locale's
+ * charset, and nothing read from or written to gdb is passed through
+ * iconv. Only the strings handed on by the record decoders are
+ * checked, and then only if they aren't plain ASCII; any bytes that
+ * aren't valid UTF-8 are given as octal escapes. Without it, when the
+ * locale's charset isn't UTF-8, every record is converted from it as
+ * it's read. This takes effect the next time the debugger
+ * connects. */
+void
+gswat_gdb_debugger_set_raw_io (GSwatGdbDebugger *self, gboolean raw_io)
+{
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (self));
 
-  breakpoint = g_new0 (GSwatDebuggableBreakpoint, 1);
+  self->priv->raw_io = raw_io;
+}
 
-  literal_val = gdbmi_value_hash_lookup (bkpt_val, "fullname");
-  literal = gdbmi_value_literal_get (literal_val);
-  breakpoint->source_uri =
-    gswat_gdb_debugger_get_uri_from_filename (GSWAT_DEBUGGABLE (self),
-                                              literal);
+gboolean
+gswat_gdb_debugger_get_raw_io (GSwatGdbDebugger *self)
+{
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (self), FALSE);
 
-  literal_val = gdbmi_value_hash_lookup (bkpt_val, "line");
-  literal = gdbmi_value_literal_get (literal_val);
-  breakpoint->line = strtol (literal, NULL, 10);
+  return self->priv->raw_io;
+}
 
-  self->priv->breakpoints =
-    g_list_prepend (self->priv->breakpoints, breakpoint);
+/* An incremental stack update first asks gdb for the frames at the
+ * top of the stack, and only carries on down while they don't line
+ * up with the stack from the last stop. Frames below that are taken
+ * from the last stop's stack, with only their arguments fetched
+ * again. The frames are matched by their return addresses, so if
+ * the callers below the frames compared changed while everything
+ * from there up returned to the same places, the old callers are
+ * shown until the next full update. Without it every stop lists the
+ * top page of the stack again. */
+void
+gswat_gdb_debugger_set_incremental_stack (GSwatGdbDebugger *self,
+					  gboolean incremental_stack)
+{
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (self));
 
-  g_object_notify (G_OBJECT (self), "breakpoints");
+  self->priv->incremental_stack = incremental_stack;
+  if (!incremental_stack)
+    {
+      gswat_debuggable_stack_free (self->priv->previous_stack);
+      self->priv->previous_stack = NULL;
+    }
+}
 
-  return;
+gboolean
+gswat_gdb_debugger_get_incremental_stack (GSwatGdbDebugger *self)
+{
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (self), FALSE);
+
+  return self->priv->incremental_stack;
 }
 
-/* TODO The following requestor functions and control
- * flow operations should probably return a cookie so
- * that users can optionally choose to block until
- * things are complete. Also what amount of error
- * information is usefull to users, without over
- * complicating the API. */
+/* The program's output, which is read in separately from gdb's so
+ * however much it prints doesn't slow down the handling of gdb's MI
+ * output. This is NULL until the debugger first connects, or if no
+ * pseudo terminal could be opened for the program; then it writes to
+ * gdb's stdout as before. The stream is closed on disconnect but
+ * stays around so any remaining output can be read. */
+GSwatInferiorStream *
+gswat_gdb_debugger_get_inferior_stream (GSwatGdbDebugger *self)
+{
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (self), NULL);
+
+  return self->priv->inferior_stream;
+}
+
+/* Writes out all the commands in the gdb_in_buffer */
+static gboolean
+flush_gdb_input (GSwatGdbDebugger *self)
+{
+  GString *buffer = self->priv->gdb_in_buffer;
+  gsize written = 0;
+
+  while (written < buffer->len)
+    {
+      gssize n = write (self->priv->gdb_in_fd,
+			buffer->str + written,
+			buffer->len - written);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  g_warning (_ ("Couldn't send commands to gdb: %s"),
+		     g_strerror (errno));
+	  g_string_truncate (buffer, 0);
+	  return FALSE;
+	}
+      written += n;
+    }
+
+  g_string_truncate (buffer, 0);
+  return TRUE;
+}
 
+/* Appends a command to the gdb_in_buffer, converting it to the
+ * charset gdb expects */
 static void
-gswat_gdb_debugger_request_function_breakpoint (GSwatDebuggable *object,
-						gchar *function)
+append_gdb_input (GSwatGdbDebugger *self,
+		  const gchar *prefix,
+		  const gchar *command)
 {
-  GSwatGdbDebugger *self;
-  GString *gdb_command = g_string_new ("");
+  gchar *converted = NULL;
 
-  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
-  self = GSWAT_GDB_DEBUGGER (object);
+  if (self->priv->gdb_charset)
+    converted = g_convert (command, -1, self->priv->gdb_charset, "UTF-8",
+			   NULL, NULL, NULL);
 
-  if (self->priv->gdb_connected)
-    {
-      g_string_printf (gdb_command, "-break-insert %s", function);
+  g_string_append (self->priv->gdb_in_buffer, prefix);
+  g_string_append (self->priv->gdb_in_buffer,
+		   converted ? converted : command);
+  g_string_append_c (self->priv->gdb_in_buffer, '\n');
 
-      gswat_gdb_debugger_send_mi_command (self,
-					  gdb_command->str,
-					  break_insert_mi_callback,
-					  NULL);
+  g_free (converted);
+}
 
-      g_string_free (gdb_command, TRUE);
-    }
+/* While the debugger is corked commands are collected up instead of
+ * being sent to gdb as they are issued, and are then written out
+ * together by the matching call to gswat_gdb_debugger_uncork().
+ * Calls can be nested. Waiting for a result with
+ * gswat_gdb_debugger_get_mi_result_record() sends anything collected
+ * so far. */
+void
+gswat_gdb_debugger_cork (GSwatGdbDebugger *self)
+{
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (self));
+
+  self->priv->gdb_cork_count++;
 }
 
 void
-gswat_gdb_debugger_request_address_breakpoint (GSwatDebuggable *object,
-					       unsigned long address)
+gswat_gdb_debugger_uncork (GSwatGdbDebugger *self)
 {
-  GSwatGdbDebugger *self;
-  gchar *gdb_command;
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (self));
+  g_return_if_fail (self->priv->gdb_cork_count > 0);
 
-  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
-  self = GSWAT_GDB_DEBUGGER (object);
+  if (--self->priv->gdb_cork_count == 0
+      && self->priv->gdb_connected)
+    flush_gdb_input (self);
+}
 
-  if (self->priv->gdb_connected)
+/* Formats the command into the gdb_in_buffer and marks it in
+ * flight. Only its expiry starts from here if it had been held
+ * back. */
+static void
+write_mi_command (GSwatGdbDebugger *self,
+		  GSwatGdbMIHandler *handler,
+		  const gchar *command)
+{
+  gchar token[24];
+
+  g_snprintf (token, sizeof (token), "%lu", handler->token);
+  append_gdb_input (self, token, command);
+
+  if (gswat_debug_flags & GSWAT_DEBUG_GDB_TRACE)
     {
-      gdb_command = g_strdup_printf ("-break-insert 0x%lx", address);
-      gswat_gdb_debugger_send_mi_command (self,
-					  gdb_command,
-					  break_insert_mi_callback,
-					  NULL);
-      g_free (gdb_command);
+      char *escaped_command = g_strescape  (command, "");
+      char *log_command =
+	g_strdup_printf ("interpreter-exec mi '%ld%s'\n",
+			 handler->token,
+			 escaped_command);
+      g_free  (escaped_command);
+      gswat_log (log_command);
+      g_free  (log_command);
+    }
 
+  /* While the target runs gdb may not get round to a command until
+   * it stops, however long that takes */
+  if (self->priv->mi_command_timeout
+      && !(self->priv->state & GSWAT_DEBUGGABLE_RUNNING))
+    {
+      handler->deadline =
+	g_timer_elapsed (self->priv->mi_handler_clock, NULL)
+	+ self->priv->mi_command_timeout / 1000.0;
+      g_queue_push_tail (&self->priv->mi_deadlines,
+			 GSIZE_TO_POINTER (handler->token));
     }
+  else
+    handler->deadline = G_MAXDOUBLE;
+
+  handler->in_flight = TRUE;
+  self->priv->n_in_flight++;
+  self->priv->command_stats.sent[handler->priority]++;
+
+  GSWAT_DEBUG (MISC, "gdb mi command:%s%s", token, command);
+}
+
+static gboolean
+mi_scheduler_full (GSwatGdbDebugger *self)
+{
+  return self->priv->max_in_flight
+    && self->priv->n_in_flight >= self->priv->max_in_flight;
 }
 
+/* Sends on held back commands, highest priority first, for as long
+ * as there is room for them in flight; or all of them if force is
+ * set. */
 static void
-gswat_gdb_debugger_continue (GSwatDebuggable *object)
+send_held_mi_commands (GSwatGdbDebugger *self, gboolean force)
 {
-  GSwatGdbDebugger *self;
+  gboolean sent = FALSE;
+  gdouble now;
+  gint priority;
 
-  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
-  self = GSWAT_GDB_DEBUGGER (object);
+  if (!self->priv->gdb_connected)
+    return;
 
-  if (self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
+  now = g_timer_elapsed (self->priv->mi_handler_clock, NULL);
+  for (priority = 0; priority < GSWAT_GDB_COMMAND_PRIORITY_COUNT; priority++)
     {
-      gdb_debugger_set_frame (GSWAT_DEBUGGABLE (self), 0);
+      GQueue *held = &self->priv->held_commands[priority];
+      GSwatGdbCommandStats *stats = &self->priv->command_stats;
 
-      gswat_gdb_debugger_send_mi_command (self,
-					  "-exec-continue",
-					  basic_runner_mi_callback,
-					  NULL);
+      while (!g_queue_is_empty (held) && (force || !mi_scheduler_full (self)))
+	{
+	  GdbHeldCommand *held_command = g_queue_pop_head (held);
+	  GSwatGdbMIHandler *handler;
+
+	  /* The command may have been cancelled while it was held */
+	  handler = lookup_mi_handler (self, held_command->token);
+	  if (handler)
+	    {
+	      gdouble wait = now - held_command->held_since;
+
+	      stats->total_wait[priority] += wait;
+	      stats->max_wait[priority] = MAX (stats->max_wait[priority], wait);
+	      write_mi_command (self, handler, held_command->command);
+	      sent = TRUE;
+	    }
 
+	  g_free (held_command->command);
+	  g_free (held_command);
+	}
     }
+
+  if (sent && self->priv->gdb_cork_count == 0)
+    flush_gdb_input (self);
 }
 
 static void
-gswat_gdb_debugger_finish (GSwatDebuggable *object)
+drop_held_mi_commands (GSwatGdbDebugger *self)
+{
+  GdbHeldCommand *held_command;
+  gint priority;
+
+  for (priority = 0; priority < GSWAT_GDB_COMMAND_PRIORITY_COUNT; priority++)
+    while ((held_command =
+	    g_queue_pop_head (&self->priv->held_commands[priority])))
+      {
+	g_free (held_command->command);
+	g_free (held_command);
+      }
+}
+
+/* Called once gdb has answered a command, or we have given up on it */
+static void
+mi_command_answered (GSwatGdbDebugger *self, GSwatGdbMIHandler *handler)
+{
+  handler->in_flight = FALSE;
+  self->priv->n_in_flight--;
+
+  send_held_mi_commands (self, FALSE);
+}
+
+gulong
+gswat_gdb_debugger_send_mi_command (GSwatGdbDebugger* object,
+				    const gchar* command,
+				    GSwatGdbMIRecordCallback result_callback,
+				    void *data)
+{
+  return gswat_gdb_debugger_send_mi_command_full (object,
+						  command,
+						  GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE,
+						  result_callback,
+						  data);
+}
+
+/* Like gswat_gdb_debugger_send_mi_command, but for commands below
+ * interactive priority that may be held back by the scheduler; see
+ * gswat_gdb_debugger_set_max_commands_in_flight. Commands of the same
+ * priority are still sent in order. */
+gulong
+gswat_gdb_debugger_send_mi_command_full (GSwatGdbDebugger* object,
+					 const gchar* command,
+					 GSwatGdbCommandPriority priority,
+					 GSwatGdbMIRecordCallback result_callback,
+					 void *data)
 {
   GSwatGdbDebugger *self;
+  GSwatGdbMIHandler *handler;
+  gulong token;
 
-  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), 0);
+  g_return_val_if_fail (priority < GSWAT_GDB_COMMAND_PRIORITY_COUNT, 0);
   self = GSWAT_GDB_DEBUGGER (object);
 
-  if (self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
+  if (!self->priv->gdb_connected)
     {
-      gdb_debugger_set_frame (GSWAT_DEBUGGABLE (self), 0);
+      return 0;
+    }
 
-      gswat_gdb_debugger_send_mi_command (self,
-					  "-exec-finish",
-					  basic_runner_mi_callback,
-					  NULL);
+  expire_mi_handlers (self);
+
+  token = self->priv->gdb_sequence++;
+  add_mi_handler (self, token, result_callback, data);
+  handler = lookup_mi_handler (self, token);
+  handler->priority = priority;
+  handler->epoch = self->priv->interrupt_count;
+  handler->stop_epoch = self->priv->stop_count;
+
+  if (priority != GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE
+      && (mi_scheduler_full (self)
+	  || !g_queue_is_empty (&self->priv->held_commands[priority])))
+    {
+      GdbHeldCommand *held_command = g_new (GdbHeldCommand, 1);
+
+      held_command->token = token;
+      held_command->command = g_strdup (command);
+      held_command->held_since =
+	g_timer_elapsed (self->priv->mi_handler_clock, NULL);
+      g_queue_push_tail (&self->priv->held_commands[priority],
+			 held_command);
+      self->priv->command_stats.n_held[priority]++;
+
+      handler->deadline = G_MAXDOUBLE;
+
+      GSWAT_DEBUG (MISC, "gdb mi command held back:%lu%s", token, command);
+
+      return token;
+    }
+
+  write_mi_command (self, handler, command);
+
+  if (self->priv->gdb_cork_count == 0
+      && !flush_gdb_input (self))
+    {
+      g_warning (_ ("Couldn't send command '%s' to gdb"), command);
+      remove_mi_handler (self, handler);
+      return 0;
     }
+
+  return token;
 }
 
-static void
-gswat_gdb_debugger_step (GSwatDebuggable *object)
+void
+gswat_gdb_debugger_send_cli_command (GSwatGdbDebugger* object,
+				     gchar const* command)
 {
   GSwatGdbDebugger *self;
 
   g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
   self = GSWAT_GDB_DEBUGGER (object);
 
-  if (self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
+  if (!self->priv->gdb_connected)
     {
-      gdb_debugger_set_frame (GSWAT_DEBUGGABLE (self), 0);
+      return;
+    }
 
-      gswat_gdb_debugger_send_mi_command (self,
-					  "-exec-step",
-					  basic_runner_mi_callback,
-					  NULL);
+  append_gdb_input (self, "", command);
+
+  if (self->priv->gdb_cork_count == 0
+      && !flush_gdb_input (self))
+    {
+      g_warning (_ ("Couldn't send command '%s' to gdb"), command);
+      return;
+    }
+
+  if (gswat_debug_flags & GSWAT_DEBUG_GDB_TRACE)
+    {
+      gchar *log_command = g_strdup_printf ("%s\n", command);
+      gswat_log (log_command);
+      g_free (log_command);
     }
+
+  GSWAT_DEBUG (MISC, "gdb cli command:%s", command);
+
+  return;
 }
 
-static void
-gswat_gdb_debugger_next (GSwatDebuggable *object)
+static GSwatGdbMIRecord *
+find_pending_result_record_for_token (GSwatGdbDebugger *self, gulong token)
+{
+  GSwatGdbMIHandler *handler;
+  GdbPendingRecord *pending_record;
+  GSwatGdbMIRecord *record;
+
+  handler = lookup_mi_handler (self, token);
+  if (!handler || !handler->result)
+    return NULL;
+
+  pending_record = handler->result;
+  handler->result = NULL;
+  remove_mi_handler (self, handler);
+
+  record = g_new (GSwatGdbMIRecord, 1);
+  if (pending_record->val)
+    record->val = pending_record->val;
+  else
+    record->val =
+      gdbmi_value_parse_full (pending_record->text, GDBMI_PARSE_LAZY);
+  record->type =
+    gswat_gdb_mi_decode_result_class (pending_record->text);
+
+  /* The record keeps the text for decoding */
+  record->text = pending_record->text;
+  g_free (pending_record);
+
+  return record;
+}
+
+GSwatGdbMIRecord *
+gswat_gdb_debugger_get_mi_result_record (GSwatGdbDebugger *object,
+					 gulong token)
 {
   GSwatGdbDebugger *self;
+  GSwatGdbMIRecord *pending_record;
 
-  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), NULL);
   self = GSWAT_GDB_DEBUGGER (object);
 
-  if (self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
+  /* A token of 0 means the command was never sent */
+  if (token == 0)
+    return NULL;
+
+  /* gdb can't answer anything we haven't sent yet. The results
+   * aren't dispatched while we wait, so nothing would make room for
+   * held back commands either */
+  if (self->priv->gdb_connected)
     {
-      gdb_debugger_set_frame (GSWAT_DEBUGGABLE (self), 0);
+      send_held_mi_commands (self, TRUE);
+      flush_gdb_input (self);
+    }
 
-      gswat_gdb_debugger_send_mi_command (self,
-					  "-exec-next",
-					  basic_runner_mi_callback,
-					  NULL);
+  pending_record = find_pending_result_record_for_token (self, token);
+  if (pending_record)
+    {
+      return pending_record;
+    }
+
+  while (TRUE)
+    {
+      GError *error=NULL;
+      if (!read_gdb_output (self, TRUE, &error))
+	{
+	  g_signal_emit (self,
+			 gswat_gdb_debugger_signals[GDB_IO_ERROR],
+			 0,
+			 error->message);
+	  g_error_free (error);
+	  return NULL;
+	}
+
+      /* The pipe has been drained, so the stdout watcher won't wake
+       * up for anything else we just read in */
+      queue_idle_process_gdb_pending (self);
+
+      pending_record = find_pending_result_record_for_token (self, token);
+      if (pending_record)
+	{
+	  return pending_record;
+	}
+
+      /* Give up if the command has expired */
+      expire_mi_handlers (self);
+      if (!lookup_mi_handler (self, token))
+	return NULL;
+    }
+
+  g_assert_not_reached ();
+  return NULL;
+}
+
+void
+gswat_gdb_debugger_free_mi_record (GSwatGdbMIRecord *record)
+{
+  g_return_if_fail (record != NULL);
+
+  if (record->val)
+    {
+      gdbmi_value_free (record->val);
     }
+  g_free (record->text);
+  g_free (record);
+}
+
+/* Moves a result's text, and its parsed value if the I/O thread has
+ * already parsed it, into a new record. The text is only parsed here
+ * if it hasn't been already. */
+static GSwatGdbMIRecord *
+mi_record_take (GdbPendingRecord *pending_record)
+{
+  GSwatGdbMIRecord *record = g_new0 (GSwatGdbMIRecord, 1);
+
+  record->type = gswat_gdb_mi_decode_result_class (pending_record->text);
+  record->text = pending_record->text;
+  record->val = pending_record->val;
+  if (!record->val && strchr (record->text, ','))
+    record->val = gdbmi_value_parse_full (record->text, GDBMI_PARSE_LAZY);
+
+  pending_record->text = NULL;
+  pending_record->val = NULL;
+
+  return record;
+}
+
+static GSwatGdbMIRecord *
+mi_record_new (GSwatGdbMIRecordType type, const gchar *text)
+{
+  GSwatGdbMIRecord *record = g_new0 (GSwatGdbMIRecord, 1);
+
+  record->type = type;
+  if (text)
+    {
+      record->text = g_strdup (text);
+      if (strchr (text, ','))
+	record->val = gdbmi_value_parse_full (text, GDBMI_PARSE_LAZY);
+    }
+
+  return record;
+}
+
+static GSwatGdbMIFuture *
+mi_future_new (GSwatGdbDebugger *debugger)
+{
+  GSwatGdbMIFuture *future = g_new0 (GSwatGdbMIFuture, 1);
+
+  future->ref_count = 1;
+  future->debugger = debugger;
+  if (debugger)
+    g_object_add_weak_pointer (G_OBJECT (debugger),
+			       (gpointer *)&future->debugger);
+
+  return future;
+}
+
+/* Dispatches the result; the record has to be set first */
+static void
+mi_future_dispatch (GSwatGdbMIFuture *future)
+{
+  GList *callbacks, *l;
+
+  future->dispatched = TRUE;
+
+  /* Callbacks may drop the last reference to the future */
+  gswat_gdb_mi_future_ref (future);
+  callbacks = g_list_reverse (future->callbacks);
+  future->callbacks = NULL;
+  for (l = callbacks; l != NULL; l = l->next)
+    {
+      GSwatGdbMIFutureCallback *closure = l->data;
+
+      closure->callback (future->debugger, future->record, closure->data);
+      g_free (closure);
+    }
+  g_list_free (callbacks);
+  gswat_gdb_mi_future_unref (future);
+}
+
+static void
+mi_future_result_callback (GSwatGdbDebugger *self,
+			   const GSwatGdbMIRecord *record,
+			   void *data)
+{
+  GSwatGdbMIFuture *future = data;
+
+  /* Results are handed to the future before it's dispatched, see
+   * process_gdb_mi_result_record, so this is only left to make a
+   * record for commands that were cancelled, which has no text to
+   * parse */
+  if (!future->record)
+    future->record = mi_record_new (record->type, record->text);
+
+  mi_future_dispatch (future);
+
+  /* The reference held for the handler */
+  gswat_gdb_mi_future_unref (future);
+}
+
+/* Sends a command like gswat_gdb_debugger_send_mi_command, but
+ * returns a future for the result. Any number of commands can be
+ * sent before waiting on any of their results, so together they only
+ * cost a single round trip to gdb. If the command couldn't be sent
+ * the future completes straight away with a
+ * GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED record. */
+GSwatGdbMIFuture *
+gswat_gdb_debugger_send_mi_command_future (GSwatGdbDebugger *self,
+					   const gchar *command)
+{
+  return gswat_gdb_debugger_send_mi_command_future_full (self,
+							 command,
+							 GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE);
+}
+
+/* As gswat_gdb_debugger_send_mi_command_future, with a priority as
+ * for gswat_gdb_debugger_send_mi_command_full */
+GSwatGdbMIFuture *
+gswat_gdb_debugger_send_mi_command_future_full (GSwatGdbDebugger *self,
+						const gchar *command,
+						GSwatGdbCommandPriority priority)
+{
+  GSwatGdbMIFuture *future;
+
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (self), NULL);
+
+  future = mi_future_new (self);
+
+  /* The handler holds a reference until the result is dispatched */
+  future->token =
+    gswat_gdb_debugger_send_mi_command_full (self,
+					     command,
+					     priority,
+					     mi_future_result_callback,
+					     gswat_gdb_mi_future_ref (future));
+  if (future->token == 0)
+    {
+      future->record =
+	mi_record_new (GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED, NULL);
+      mi_future_dispatch (future);
+      gswat_gdb_mi_future_unref (future);
+      return future;
+    }
+
+  lookup_mi_handler (self, future->token)->future = future;
+
+  return future;
+}
+
+/* Moves a held back command up to a higher priority, or sends it
+ * straight away if that is interactive */
+static void
+promote_held_mi_command (GSwatGdbDebugger *self,
+			 gulong token,
+			 GSwatGdbCommandPriority priority)
+{
+  GSwatGdbMIHandler *handler;
+  GdbHeldCommand *held_command = NULL;
+  GQueue *held;
+  GList *l;
+
+  handler = lookup_mi_handler (self, token);
+  if (!handler || handler->in_flight || handler->priority <= priority)
+    return;
+
+  held = &self->priv->held_commands[handler->priority];
+  for (l = held->head; l != NULL; l = l->next)
+    {
+      held_command = l->data;
+      if (held_command->token == token)
+	break;
+    }
+  if (!l)
+    return;
+  g_queue_delete_link (held, l);
+
+  handler->priority = priority;
+  if (priority == GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE)
+    {
+      write_mi_command (self, handler, held_command->command);
+      if (self->priv->gdb_cork_count == 0)
+	flush_gdb_input (self);
+      g_free (held_command->command);
+      g_free (held_command);
+    }
+  else
+    {
+      g_queue_push_tail (&self->priv->held_commands[priority],
+			 held_command);
+      send_held_mi_commands (self, FALSE);
+    }
+}
+
+/* Sends a command that only reads state from gdb, such as
+ * -stack-list-frames, as gswat_gdb_debugger_send_mi_command_future_full.
+ * Until the inferior runs again or the frame changes, asking the same
+ * question again returns another reference to the same future, so
+ * identical queries already in flight are answered once, and those
+ * already answered aren't sent again at all. If the later query has
+ * the higher priority, the command is moved up while it's still being
+ * held back.
+ *
+ * Only use this for commands whose result depends on nothing but the
+ * stopped inferior and the selected frame. */
+GSwatGdbMIFuture *
+gswat_gdb_debugger_send_mi_query (GSwatGdbDebugger *self,
+				  const gchar *command,
+				  GSwatGdbCommandPriority priority)
+{
+  GSwatGdbMIFuture *future;
+
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (self), NULL);
+  g_return_val_if_fail (priority < GSWAT_GDB_COMMAND_PRIORITY_COUNT, NULL);
+
+  if (self->priv->mi_queries_epoch != self->priv->interrupt_count)
+    {
+      g_hash_table_remove_all (self->priv->mi_queries);
+      self->priv->mi_queries_epoch = self->priv->interrupt_count;
+    }
+
+  future = g_hash_table_lookup (self->priv->mi_queries, command);
+  if (future
+      && !(future->record
+	   && future->record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED))
+    {
+      self->priv->command_stats.queries_shared++;
+      if (!future->record)
+	promote_held_mi_command (self, future->token, priority);
+      return gswat_gdb_mi_future_ref (future);
+    }
+
+  future = gswat_gdb_debugger_send_mi_command_future_full (self,
+							   command,
+							   priority);
+  if (future->record
+      && future->record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED)
+    return future;
+
+  g_hash_table_replace (self->priv->mi_queries,
+			g_strdup (command),
+			gswat_gdb_mi_future_ref (future));
+  lookup_mi_handler (self, future->token)->query = TRUE;
+
+  return future;
+}
+
+static void
+mi_future_child_callback (GSwatGdbDebugger *self,
+			  const GSwatGdbMIRecord *record,
+			  void *data)
+{
+  GSwatGdbMIFuture *future = data;
+
+  /* The first failure is what the combined future reports */
+  if (future->children_type == GSWAT_GDB_MI_REC_TYPE_RESULT_DONE
+      && (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR
+	  || record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED))
+    future->children_type = record->type;
+
+  if (--future->n_children_pending == 0)
+    {
+      future->record = mi_record_new (future->children_type, NULL);
+      mi_future_dispatch (future);
+    }
+
+  gswat_gdb_mi_future_unref (future);
+}
+
+/* Combines futures, all for the same debugger, into one that
+ * completes once all of them have. Its record has no text or value;
+ * its type is GSWAT_GDB_MI_REC_TYPE_RESULT_DONE unless one of the
+ * results was an error or was cancelled, in which case it is the type
+ * of the first of those. The results themselves are in the
+ * individual futures. */
+GSwatGdbMIFuture *
+gswat_gdb_mi_future_all (GSwatGdbMIFuture **futures, guint n_futures)
+{
+  GSwatGdbMIFuture *future;
+  guint i;
+
+  g_return_val_if_fail (futures != NULL || n_futures == 0, NULL);
+
+  future = mi_future_new (n_futures ? futures[0]->debugger : NULL);
+  future->children = g_ptr_array_sized_new (n_futures);
+  future->children_type = GSWAT_GDB_MI_REC_TYPE_RESULT_DONE;
+
+  if (n_futures == 0)
+    {
+      future->record = mi_record_new (future->children_type, NULL);
+      mi_future_dispatch (future);
+      return future;
+    }
+
+  /* Set up front, since the callbacks for futures that have already
+   * been dispatched are called straight away */
+  future->n_children_pending = n_futures;
+  for (i = 0; i < n_futures; i++)
+    {
+      g_ptr_array_add (future->children, gswat_gdb_mi_future_ref (futures[i]));
+      gswat_gdb_mi_future_then (futures[i],
+				mi_future_child_callback,
+				gswat_gdb_mi_future_ref (future));
+    }
+
+  return future;
+}
+
+GSwatGdbMIFuture *
+gswat_gdb_mi_future_ref (GSwatGdbMIFuture *future)
+{
+  g_return_val_if_fail (future != NULL, NULL);
+
+  future->ref_count++;
+  return future;
+}
+
+void
+gswat_gdb_mi_future_unref (GSwatGdbMIFuture *future)
+{
+  GList *l;
+
+  g_return_if_fail (future != NULL);
+
+  if (--future->ref_count > 0)
+    return;
+
+  if (future->debugger)
+    g_object_remove_weak_pointer (G_OBJECT (future->debugger),
+				  (gpointer *)&future->debugger);
+  if (future->record)
+    gswat_gdb_debugger_free_mi_record (future->record);
+  for (l = future->callbacks; l != NULL; l = l->next)
+    g_free (l->data);
+  g_list_free (future->callbacks);
+  if (future->children)
+    {
+      g_ptr_array_foreach (future->children,
+			   (GFunc)gswat_gdb_mi_future_unref, NULL);
+      g_ptr_array_free (future->children, TRUE);
+    }
+  g_free (future);
+}
+
+/* Arranges for callback to be called with the result once it is
+ * dispatched, in order with the rest of gdb's output. Callbacks are
+ * called in the order they were added, or straight away if the
+ * result has already been dispatched. */
+void
+gswat_gdb_mi_future_then (GSwatGdbMIFuture *future,
+			  GSwatGdbMIRecordCallback callback,
+			  gpointer data)
+{
+  GSwatGdbMIFutureCallback *closure;
+
+  g_return_if_fail (future != NULL);
+  g_return_if_fail (callback != NULL);
+
+  if (future->dispatched)
+    {
+      callback (future->debugger, future->record, data);
+      return;
+    }
+
+  closure = g_new (GSwatGdbMIFutureCallback, 1);
+  closure->callback = callback;
+  closure->data = data;
+  future->callbacks = g_list_prepend (future->callbacks, closure);
+}
+
+/* Whether the result has arrived, even if it hasn't been dispatched
+ * yet */
+gboolean
+gswat_gdb_mi_future_is_ready (GSwatGdbMIFuture *future)
+{
+  guint i;
+
+  g_return_val_if_fail (future != NULL, FALSE);
+
+  if (future->record || !future->children)
+    return future->record != NULL;
+
+  for (i = 0; i < future->children->len; i++)
+    if (!gswat_gdb_mi_future_is_ready (g_ptr_array_index (future->children,
+							  i)))
+      return FALSE;
+
+  return TRUE;
+}
+
+/* The result, which belongs to the future, or NULL if it hasn't
+ * arrived yet. For a future made by gswat_gdb_mi_future_all this is
+ * only set once it has been dispatched. */
+const GSwatGdbMIRecord *
+gswat_gdb_mi_future_get_record (GSwatGdbMIFuture *future)
+{
+  g_return_val_if_fail (future != NULL, NULL);
+
+  return future->record;
+}
+
+/* Blocks until the result arrives, for at most timeout milliseconds
+ * or, if that is 0, until the command expires. Either way we give up
+ * if gdb goes quiet for longer than the gdb-io-timeout, after the
+ * GDB_IO_TIMEOUT signal has been emitted. Other records read in the
+ * meantime are left for the main loop to dispatch as usual. Returns
+ * FALSE if we timed out or couldn't read from gdb. */
+gboolean
+gswat_gdb_mi_future_wait (GSwatGdbMIFuture *future, guint timeout)
+{
+  GSwatGdbDebugger *self;
+  GTimer *timer;
+  gboolean ready;
+
+  g_return_val_if_fail (future != NULL, FALSE);
+
+  if (gswat_gdb_mi_future_is_ready (future))
+    return TRUE;
+
+  self = future->debugger;
+  if (!self || !self->priv->gdb_connected)
+    return FALSE;
+
+  /* gdb can't answer anything we haven't sent yet, see
+   * gswat_gdb_debugger_get_mi_result_record */
+  send_held_mi_commands (self, TRUE);
+  flush_gdb_input (self);
+
+  timer = g_timer_new ();
+  while (!(ready = gswat_gdb_mi_future_is_ready (future)))
+    {
+      GError *error = NULL;
+      int limit;
+
+      /* Wake up in time to expire the command, or to give up if the
+       * caller's timeout runs out first */
+      limit = next_mi_handler_expiry (self);
+      if (timeout)
+	{
+	  int remaining =
+	    timeout - (int)(g_timer_elapsed (timer, NULL) * 1000);
+	  if (remaining <= 0)
+	    break;
+	  if (limit < 0 || remaining < limit)
+	    limit = remaining;
+	}
+
+      /* Reading can fail and disconnect us, which cancels the
+       * command and so completes the future */
+      g_object_ref (self);
+      if (wait_for_gdb_output (self, limit, &error))
+	read_gdb_output (self, FALSE, &error);
+      if (error)
+	{
+	  g_signal_emit (self,
+			 gswat_gdb_debugger_signals[GDB_IO_ERROR],
+			 0,
+			 error->message);
+	  g_error_free (error);
+	  ready = gswat_gdb_mi_future_is_ready (future);
+	  g_object_unref (self);
+	  break;
+	}
+      queue_idle_process_gdb_pending (self);
+      g_object_unref (self);
+
+      if (!future->debugger || !self->priv->gdb_connected)
+	{
+	  ready = gswat_gdb_mi_future_is_ready (future);
+	  break;
+	}
+
+      expire_mi_handlers (self);
+    }
+  g_timer_destroy (timer);
+
+  return ready;
+}
+
+/* Gives up on the result if it hasn't arrived yet. The future
+ * completes with a GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED record, and
+ * whatever gdb replies is ignored. Cancelling a future made by
+ * gswat_gdb_mi_future_all cancels all of its futures. */
+void
+gswat_gdb_mi_future_cancel (GSwatGdbMIFuture *future)
+{
+  GSwatGdbMIHandler *handler;
+  guint i;
+
+  g_return_if_fail (future != NULL);
+
+  if (future->children)
+    {
+      for (i = 0; i < future->children->len; i++)
+	gswat_gdb_mi_future_cancel (g_ptr_array_index (future->children, i));
+      return;
+    }
+
+  if (future->record || !future->debugger)
+    return;
+
+  handler = lookup_mi_handler (future->debugger, future->token);
+  if (handler)
+    cancel_mi_handler (future->debugger, handler);
+}
+
+static void
+basic_runner_mi_callback (GSwatGdbDebugger *self,
+			  const GSwatGdbMIRecord *record,
+			  void *data)
+{
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED)
+    {
+      return;
+    }
+
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR)
+    {
+      g_warning ("basic_runner_mi_callback: recieved an error");
+      return;
+    }
+
+  if (record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_RUNNING)
+    {
+      g_warning ("basic_runner_mi_callback: unexpected result type");
+      return;
+    }
+
+  /* Nothing we've asked about still holds */
+  g_hash_table_remove_all (self->priv->mi_queries);
+
+  self->priv->state = GSWAT_DEBUGGABLE_RUNNING;
+  g_object_notify (G_OBJECT (self), "state");
+
+}
+
+void
+gswat_gdb_debugger_request_line_breakpoint (GSwatDebuggable *object,
+					    gchar *uri,
+					    guint line)
+{
+  GSwatGdbDebugger *self;
+  gchar *gdb_command;
+  gchar *filename;
+
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (self->priv->gdb_connected)
+    {
+      GFile *file;
+
+      /* FIXME - hacky bolt on of gio */
+      file = g_file_new_for_uri  (uri);
+      filename = g_file_get_path  (file);
+      g_object_unref  (file);
+
+      g_assert (filename);
+
+      gdb_command = g_strdup_printf ("-break-insert %s:%d", filename, line);
+      gswat_gdb_debugger_send_mi_command (self,
+					  gdb_command,
+					  break_insert_mi_callback,
+					  NULL);
+
+      g_free (gdb_command);
+      g_free (filename);
+    }
+}
+
+static void
+break_insert_mi_callback (GSwatGdbDebugger *self,
+			  const GSwatGdbMIRecord *record,
+			  void *data)
+{
+  GSwatDebuggableBreakpoint *breakpoint;
+
+  /*
+     {
+     bkpt = {
+     addr = "0x08048397",
+     times = "0",
+     func = "function2",
+     type = "breakpoint",
+     number = "2",
+     file = "test.c",
+     disp = "keep",
+     enabled = "y",
+     fullname = "/home/rob/local/gswat/bin/test.c",
+     line = "16",
+     },
+     },
+     */
+
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED)
+    {
+      return;
+    }
+
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR)
+    {
+      g_warning ("break_insert_mi_callback: error inserting break point");
+      return;
+    }
+
+  if (record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_DONE)
+    {
+      g_warning ("break_insert_mi_callback: unexpected result type");
+      return;
+    }
+
+  breakpoint = g_new0 (GSwatDebuggableBreakpoint, 1);
+  if (!gswat_gdb_mi_decode_breakpoint (record->text,
+				       breakpoint,
+				       decoder_uri_from_filename,
+				       self))
+    {
+      g_warning ("break_insert_mi_callback: error decoding break point");
+      g_free (breakpoint->source_uri);
+      g_free (breakpoint);
+      return;
+    }
+
+  self->priv->breakpoints =
+    g_list_prepend (self->priv->breakpoints, breakpoint);
+
+  g_object_notify (G_OBJECT (self), "breakpoints");
+
+  return;
+}
+
+/* TODO The following requestor functions and control
+ * flow operations should probably return a cookie so
+ * that users can optionally choose to block until
+ * things are complete. Also what amount of error
+ * information is usefull to users, without over
+ * complicating the API. */
+
+static void
+gswat_gdb_debugger_request_function_breakpoint (GSwatDebuggable *object,
+						gchar *function)
+{
+  GSwatGdbDebugger *self;
+  GString *gdb_command = g_string_new ("");
+
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (self->priv->gdb_connected)
+    {
+      g_string_printf (gdb_command, "-break-insert %s", function);
+
+      gswat_gdb_debugger_send_mi_command (self,
+					  gdb_command->str,
+					  break_insert_mi_callback,
+					  NULL);
+
+      g_string_free (gdb_command, TRUE);
+    }
+}
+
+void
+gswat_gdb_debugger_request_address_breakpoint (GSwatDebuggable *object,
+					       unsigned long address)
+{
+  GSwatGdbDebugger *self;
+  gchar *gdb_command;
+
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (self->priv->gdb_connected)
+    {
+      gdb_command = g_strdup_printf ("-break-insert 0x%lx", address);
+      gswat_gdb_debugger_send_mi_command (self,
+					  gdb_command,
+					  break_insert_mi_callback,
+					  NULL);
+      g_free (gdb_command);
+
+    }
+}
+
+static void
+gswat_gdb_debugger_continue (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
+    {
+      gdb_debugger_set_frame (GSWAT_DEBUGGABLE (self), 0);
+
+      gswat_gdb_debugger_send_mi_command (self,
+					  "-exec-continue",
+					  basic_runner_mi_callback,
+					  NULL);
+
+    }
+}
+
+static void
+gswat_gdb_debugger_finish (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
+    {
+      gdb_debugger_set_frame (GSWAT_DEBUGGABLE (self), 0);
+
+      gswat_gdb_debugger_send_mi_command (self,
+					  "-exec-finish",
+					  basic_runner_mi_callback,
+					  NULL);
+    }
+}
+
+static void
+gswat_gdb_debugger_step (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
+    {
+      gdb_debugger_set_frame (GSWAT_DEBUGGABLE (self), 0);
+
+      gswat_gdb_debugger_send_mi_command (self,
+					  "-exec-step",
+					  basic_runner_mi_callback,
+					  NULL);
+    }
+}
+
+static void
+gswat_gdb_debugger_next (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
+    {
+      gdb_debugger_set_frame (GSWAT_DEBUGGABLE (self), 0);
+
+      gswat_gdb_debugger_send_mi_command (self,
+					  "-exec-next",
+					  basic_runner_mi_callback,
+					  NULL);
+    }
+}
+
+static void
+gswat_gdb_debugger_interrupt (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  /* For a local process, just use kill (pid, SIGINT) */
+  if (self->priv->target_pid != -1)
+    {
+      if (self->priv->state == GSWAT_DEBUGGABLE_RUNNING)
+	{
+	  kill (self->priv->target_pid, SIGINT);
+	}
+    }
+}
+
+static void
+gswat_gdb_debugger_restart (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (self->priv->state == GSWAT_DEBUGGABLE_RUNNING
+      || self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
+    {
+      gswat_gdb_debugger_send_mi_command (self,
+					  "-exec-run",
+					  restart_running_mi_callback,
+					  NULL);
+    }
+}
+
+static void
+restart_running_mi_callback (GSwatGdbDebugger *self,
+			     const GSwatGdbMIRecord *record,
+			     void *data)
+{
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED)
+    {
+      return;
+    }
+
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR)
+    {
+      g_warning ("restart_running_mi_callback: recieved an error");
+      return;
+    }
+
+  if (record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_RUNNING)
+    {
+      g_warning ("restart_running_mi_callback: unexpected result type");
+      return;
+    }
+
+  g_hash_table_remove_all (self->priv->mi_queries);
+
+  self->priv->state = GSWAT_DEBUGGABLE_RUNNING;
+  g_object_notify (G_OBJECT (self), "state");
+}
+
+static gchar *
+gswat_gdb_debugger_get_source_uri (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), NULL);
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (self->priv->current_source_uri)
+    {
+      return g_strdup (self->priv->current_source_uri);
+    }
+  else
+    {
+      return NULL;
+    }
+}
+
+static gint
+gswat_gdb_debugger_get_source_line (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), 0);
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (!self->priv->current_source_uri)
+    {
+      return -1;
+    }
+
+  return self->priv->current_line;
+}
+
+static GSwatDebuggableState
+gswat_gdb_debugger_get_state (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), 0);
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  return self->priv->state;
+}
+
+guint
+gswat_gdb_debugger_get_interrupt_count (GSwatGdbDebugger *self)
+{
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (self), 0);
+
+  return self->priv->interrupt_count;
+}
+
+static GList *
+copy_arguments (GList *arguments)
+{
+  GSwatDebuggableFrameArgument *current_arg, *new_arg;
+  GList *tmp, *new_arguments = NULL;
+
+  for (tmp=arguments; tmp!=NULL; tmp=tmp->next)
+    {
+      current_arg =  (GSwatDebuggableFrameArgument *)tmp->data;
+
+      new_arg = g_new0 (GSwatDebuggableFrameArgument, 1);
+      new_arg->name = g_strdup (current_arg->name);
+      new_arg->value = g_strdup (current_arg->value);
+      new_arguments = g_list_prepend (new_arguments, new_arg);
+    }
+
+  return g_list_reverse (new_arguments);
+}
+
+static GSwatDebuggableFrame *
+copy_frame (const GSwatDebuggableFrame *current_frame)
+{
+  GSwatDebuggableFrame *new_frame;
+
+  new_frame = g_new (GSwatDebuggableFrame, 1);
+  new_frame->level = current_frame->level;
+  new_frame->address = current_frame->address;
+  new_frame->function = g_strdup (current_frame->function);
+  new_frame->source_uri = g_strdup (current_frame->source_uri);
+  new_frame->line = current_frame->line;
+
+  /* deep copy the arguments */
+  new_frame->arguments = copy_arguments (current_frame->arguments);
+
+  return new_frame;
+}
+
+static GQueue *
+copy_stack (GQueue *stack)
+{
+  GList *tmp;
+  GQueue *new_stack;
+
+  if (!stack)
+    return NULL;
+
+  new_stack = g_queue_new ();
+
+  /* FIXME: the frames should probably be represented as
+   * GObjects, contained in a parent stack object, then
+   * this can be reduced to a single ref of the stack
+   * object.
+   */
+
+  /* copy the stack list */
+  for (tmp=stack->head; tmp!=NULL; tmp=tmp->next)
+    g_queue_push_tail (new_stack, copy_frame (tmp->data));
+
+  return new_stack;
+}
+
+static GQueue *
+copy_stack_snapshot (GSwatStackSnapshot *snapshot)
+{
+  GQueue *new_stack;
+  guint i;
+
+  if (!snapshot)
+    return NULL;
+
+  new_stack = g_queue_new ();
+  for (i = 0; i < gswat_stack_snapshot_get_n_frames (snapshot); i++)
+    g_queue_push_tail (new_stack,
+		       copy_frame (gswat_stack_snapshot_get_frame (snapshot, i)));
+
+  return new_stack;
+}
+
+/* The snapshot of the stack is made the first time it's asked for
+ * after a stop, and again only if more frames have been fetched
+ * since. The stack must be valid. */
+static GSwatStackSnapshot *
+publish_stack_snapshot (GSwatGdbDebugger *self)
+{
+  if (self->priv->stack_snapshot
+      && (gswat_stack_snapshot_get_n_frames (self->priv->stack_snapshot)
+	  != self->priv->stack->length))
+    drop_stack_snapshot (self);
+
+  if (!self->priv->stack_snapshot)
+    self->priv->stack_snapshot =
+      gswat_stack_snapshot_new (self->priv->stack, self->priv->stack_depth);
+
+  return self->priv->stack_snapshot;
+}
+
+static void
+drop_stack_snapshot (GSwatGdbDebugger *self)
+{
+  if (self->priv->stack_snapshot)
+    {
+      gswat_stack_snapshot_unref (self->priv->stack_snapshot);
+      self->priv->stack_snapshot = NULL;
+    }
+}
+
+static GSwatStackSnapshot *
+gswat_gdb_debugger_get_stack_snapshot (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), NULL);
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (!self->priv->gdb_connected)
+    return NULL;
+
+  if (self->priv->state != GSWAT_DEBUGGABLE_INTERRUPTED)
+    return NULL;
+
+  /* Only the frames fetched so far go in the snapshot, which may
+   * just be the top of a deep stack; its depth says how many more
+   * there are, for gswat_debuggable_get_stack_range */
+  synchronous_update_stack (self);
+  if (!self->priv->stack_valid)
+    return NULL;
+
+  return gswat_stack_snapshot_ref (publish_stack_snapshot (self));
+}
+
+/* The stack may only have simple values for the arguments, cut
+ * short, so the full values of a frame's arguments are fetched when
+ * they are asked for, and kept until the next stop */
+static GList *
+gswat_gdb_debugger_get_frame_arguments (GSwatDebuggable *object,
+					guint level)
+{
+  GSwatGdbDebugger *self;
+  GSwatGdbMIFuture *future;
+  const GSwatGdbMIRecord *record;
+  GList *arguments;
+  gchar *command;
+  guint interrupt_count;
+  guint max_length;
+
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), NULL);
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (!self->priv->gdb_connected)
+    return NULL;
+
+  if (self->priv->state != GSWAT_DEBUGGABLE_INTERRUPTED)
+    return NULL;
+
+  if (g_hash_table_lookup_extended (self->priv->full_arguments,
+				    GUINT_TO_POINTER (level),
+				    NULL,
+				    (gpointer *)&arguments))
+    return copy_arguments (arguments);
+
+  interrupt_count = self->priv->interrupt_count;
+  max_length =
+    gswat_session_get_max_argument_value_length (self->priv->session);
+
+  /* The full values aren't limited to the session's length; the
+   * commands are all interactive, so gdb gets them in this order */
+  if (max_length)
+    send_print_elements (self, 0);
+  command = g_strdup_printf ("-stack-list-arguments 1 %u %u", level, level);
+  future =
+    gswat_gdb_debugger_send_mi_query (self,
+				      command,
+				      GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE);
+  g_free (command);
+  if (max_length)
+    send_print_elements (self, max_length);
+
+  if (!gswat_gdb_mi_future_wait (future, 0))
+    {
+      /* An IO error has occurred */
+      gswat_gdb_mi_future_unref (future);
+      return NULL;
+    }
+
+  record = gswat_gdb_mi_future_get_record (future);
+  if (record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_DONE
+      || !gswat_gdb_mi_decode_frame_arguments (record->text,
+					       level,
+					       &arguments))
+    {
+      g_warning ("%s: failed to list the arguments of frame %u",
+		 __FUNCTION__, level);
+      gswat_gdb_mi_future_unref (future);
+      return NULL;
+    }
+  gswat_gdb_mi_future_unref (future);
+
+  /* Unless the target has moved on while we were waiting */
+  if (interrupt_count == self->priv->interrupt_count)
+    g_hash_table_insert (self->priv->full_arguments,
+			 GUINT_TO_POINTER (level),
+			 copy_arguments (arguments));
+
+  return arguments;
+}
+
+static GQueue *
+gswat_gdb_debugger_get_stack (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), NULL);
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (!self->priv->gdb_connected)
+    return NULL;
+
+  if (self->priv->state != GSWAT_DEBUGGABLE_INTERRUPTED)
+    return NULL;
+
+  synchronous_fetch_stack_range (self, G_MAXUINT);
+
+  return copy_stack (self->priv->stack);
+}
+
+static GQueue *
+gswat_gdb_debugger_get_stack_range (GSwatDebuggable *object,
+				    guint first,
+				    guint count)
+{
+  GSwatGdbDebugger *self;
+  GQueue *range;
+  GList *tmp;
+  guint high;
+
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), NULL);
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (!self->priv->gdb_connected)
+    return NULL;
+
+  if (self->priv->state != GSWAT_DEBUGGABLE_INTERRUPTED)
+    return NULL;
+
+  high = first + MIN (count, G_MAXUINT - first);
+  synchronous_fetch_stack_range (self, high);
+  if (!self->priv->stack_valid)
+    return NULL;
+
+  /* Someone scrolling down the stack will probably want the next
+   * page too */
+  if (high < self->priv->stack_depth)
+    fetch_stack_range_async (self,
+			     high + MIN (STACK_PAGE, G_MAXUINT - high),
+			     GSWAT_GDB_COMMAND_PRIORITY_PREFETCH);
+
+  range = g_queue_new ();
+  for (tmp = g_queue_peek_nth_link (self->priv->stack, first);
+       tmp != NULL && range->length < count;
+       tmp = tmp->next)
+    g_queue_push_tail (range, copy_frame (tmp->data));
+
+  return range;
+}
+
+static guint
+gswat_gdb_debugger_get_stack_depth (GSwatDebuggable *object)
+{
+  GSwatGdbDebugger *self;
+
+  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), 0);
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  if (!self->priv->gdb_connected)
+    return 0;
+
+  if (self->priv->state != GSWAT_DEBUGGABLE_INTERRUPTED)
+    return 0;
+
+  synchronous_update_stack (self);
+  if (!self->priv->stack_valid)
+    return 0;
+
+  return self->priv->stack_depth;
+}
+
+static void
+free_object_list (GList *objects)
+{
+  g_list_foreach (objects, (GFunc)g_object_unref, NULL);
+  g_list_free (objects);
+}
+
+static GList *
+copy_object_list (GList *objects)
+{
+  g_list_foreach (objects, (GFunc)g_object_ref, NULL);
+  return g_list_copy (objects);
+}
+
+static void
+complete_cancelled_async_result (GSimpleAsyncResult *result)
+{
+  g_simple_async_result_set_error (result,
+				   G_IO_ERROR,
+				   G_IO_ERROR_CANCELLED,
+				   "%s",
+				   _("Operation was cancelled"));
+  g_simple_async_result_complete_in_idle (result);
+  g_object_unref (result);
 }
 
 static void
-gswat_gdb_debugger_interrupt (GSwatDebuggable *object)
+free_async_waiter (GdbAsyncWaiter *waiter)
 {
-  GSwatGdbDebugger *self;
-
-  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
-  self = GSWAT_GDB_DEBUGGER (object);
-
-  /* For a local process, just use kill (pid, SIGINT) */
-  if (self->priv->target_pid != -1)
+  if (waiter->cancellable)
     {
-      if (self->priv->state == GSWAT_DEBUGGABLE_RUNNING)
-	{
-	  kill (self->priv->target_pid, SIGINT);
-	}
+      g_signal_handler_disconnect (waiter->cancellable,
+				   waiter->cancelled_id);
+      g_object_unref (waiter->cancellable);
     }
+  g_free (waiter);
 }
 
 static void
-gswat_gdb_debugger_restart (GSwatDebuggable *object)
+on_async_waiter_cancelled (GCancellable *cancellable,
+			   gpointer data)
 {
-  GSwatGdbDebugger *self;
-
-  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
-  self = GSWAT_GDB_DEBUGGER (object);
+  GdbAsyncWaiter *waiter = data;
 
-  if (self->priv->state == GSWAT_DEBUGGABLE_RUNNING
-      || self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED)
-    {
-      gswat_gdb_debugger_send_mi_command (self,
-					  "-exec-run",
-					  restart_running_mi_callback,
-					  NULL);
-    }
+  *waiter->waiters = g_list_remove (*waiter->waiters, waiter);
+  complete_cancelled_async_result (waiter->result);
+  free_async_waiter (waiter);
 }
 
+/* Queues up an asynchronous request to be completed once the
+ * update it is waiting on has finished, taking over the result */
 static void
-restart_running_mi_callback (GSwatGdbDebugger *self,
-			     const GSwatGdbMIRecord *record,
-			     void *data)
+add_async_waiter (GList **waiters,
+		  GSimpleAsyncResult *result,
+		  GCancellable *cancellable)
 {
-  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR)
-    {
-      g_warning ("restart_running_mi_callback: recieved an error");
-      return;
-    }
+  GdbAsyncWaiter *waiter;
 
-  if (record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_RUNNING)
+  waiter = g_new0 (GdbAsyncWaiter, 1);
+  waiter->waiters = waiters;
+  waiter->result = result;
+  if (cancellable)
     {
-      g_warning ("restart_running_mi_callback: unexpected result type");
-      return;
+      waiter->cancellable = g_object_ref (cancellable);
+      waiter->cancelled_id =
+	g_signal_connect (cancellable,
+			  "cancelled",
+			  G_CALLBACK (on_async_waiter_cancelled),
+			  waiter);
     }
 
-  self->priv->state = GSWAT_DEBUGGABLE_RUNNING;
-  g_object_notify (G_OBJECT (self), "state");
+  *waiters = g_list_append (*waiters, waiter);
 }
 
-static gchar *
-gswat_gdb_debugger_get_source_uri (GSwatDebuggable *object)
+/* Completes all the waiters in the list, calling set_result for
+ * each of their results first */
+static void
+complete_async_waiters (GSwatGdbDebugger *self,
+			GList **waiters,
+			void (*set_result) (GSwatGdbDebugger *self,
+					    GSimpleAsyncResult *result))
 {
-  GSwatGdbDebugger *self;
-
-  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), NULL);
-  self = GSWAT_GDB_DEBUGGER (object);
+  GList *tmp, *list = *waiters;
 
-  if (self->priv->current_source_uri)
-    {
-      return g_strdup (self->priv->current_source_uri);
-    }
-  else
+  *waiters = NULL;
+  for (tmp=list; tmp!=NULL; tmp=tmp->next)
     {
-      return NULL;
+      GdbAsyncWaiter *waiter = tmp->data;
+
+      set_result (self, waiter->result);
+      g_simple_async_result_complete_in_idle (waiter->result);
+      g_object_unref (waiter->result);
+      free_async_waiter (waiter);
     }
+  g_list_free (list);
 }
 
-static gint
-gswat_gdb_debugger_get_source_line (GSwatDebuggable *object)
+/* As with gswat_gdb_debugger_get_stack, there is no stack unless
+ * we are connected and interrupted */
+static void
+set_stack_async_result (GSwatGdbDebugger *self, GSimpleAsyncResult *result)
 {
-  GSwatGdbDebugger *self;
-
-  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), 0);
-  self = GSWAT_GDB_DEBUGGER (object);
-
-  if (!self->priv->current_source_uri)
+  if (!self->priv->gdb_connected
+      || self->priv->state != GSWAT_DEBUGGABLE_INTERRUPTED)
     {
-      return -1;
+      return;
     }
 
-  return self->priv->current_line;
-}
-
-static GSwatDebuggableState
-gswat_gdb_debugger_get_state (GSwatDebuggable *object)
-{
-  GSwatGdbDebugger *self;
-
-  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), 0);
-  self = GSWAT_GDB_DEBUGGER (object);
+  if (!self->priv->stack_valid)
+    {
+      g_simple_async_result_set_error (result,
+				       GSWAT_DEBUGGABLE_ERROR,
+				       GSWAT_DEBUGGABLE_ERROR_QUERY_FAILED,
+				       "%s",
+				       _("Failed to list the stack frames"));
+      return;
+    }
 
-  return self->priv->state;
+  g_simple_async_result_set_op_res_gpointer (result,
+					     gswat_stack_snapshot_ref (publish_stack_snapshot (self)),
+					     (GDestroyNotify)gswat_stack_snapshot_unref);
 }
 
-guint
-gswat_gdb_debugger_get_interrupt_count (GSwatGdbDebugger *self)
+static void
+complete_stack_waiters (GSwatGdbDebugger *self)
 {
-  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (self), 0);
-
-  return self->priv->interrupt_count;
+  complete_async_waiters (self,
+			  &self->priv->stack_waiters,
+			  set_stack_async_result);
 }
 
-static GQueue *
-gswat_gdb_debugger_get_stack (GSwatDebuggable *object)
+static void
+gswat_gdb_debugger_get_stack_async (GSwatDebuggable *object,
+				    GCancellable *cancellable,
+				    GAsyncReadyCallback callback,
+				    gpointer user_data)
 {
   GSwatGdbDebugger *self;
-  GSwatDebuggableFrame *current_frame, *new_frame;
-  GList *tmp, *tmp2;
-  GQueue *new_stack;
-  GSwatDebuggableFrameArgument *current_arg, *new_arg;
+  GSimpleAsyncResult *result;
 
-  g_return_val_if_fail (GSWAT_IS_GDB_DEBUGGER (object), NULL);
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
   self = GSWAT_GDB_DEBUGGER (object);
 
-  if (!self->priv->gdb_connected)
-    return NULL;
-
-  if (self->priv->state != GSWAT_DEBUGGABLE_INTERRUPTED)
-    return NULL;
-
-  synchronous_update_stack (self);
+  result = g_simple_async_result_new (G_OBJECT (self),
+				      callback,
+				      user_data,
+				      gswat_gdb_debugger_get_stack_async);
 
-  new_stack = g_queue_new ();
+  if (cancellable && g_cancellable_is_cancelled (cancellable))
+    {
+      complete_cancelled_async_result (result);
+      return;
+    }
 
-  /* FIXME: the frames should probably be represented as
-   * GObjects, contained in a parent stack object, then
-   * this can be reduced to a single ref of the stack
-   * object.
-   */
+  if (self->priv->gdb_connected
+      && self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED
+      && !self->priv->stack_valid)
+    {
+      add_async_waiter (&self->priv->stack_waiters, result, cancellable);
+      kick_asynchronous_stack_update (self);
+      return;
+    }
 
-  /* copy the stack list */
-  for (tmp=self->priv->stack->head; tmp!=NULL; tmp=tmp->next)
+  /* Only the top of the stack has been fetched so far */
+  if (self->priv->gdb_connected
+      && self->priv->state == GSWAT_DEBUGGABLE_INTERRUPTED
+      && self->priv->stack->length < self->priv->stack_depth)
     {
-      current_frame =  (GSwatDebuggableFrame *)tmp->data;
+      add_async_waiter (&self->priv->stack_waiters, result, cancellable);
+      kick_stack_fill (self);
+      return;
+    }
 
-      new_frame = g_new (GSwatDebuggableFrame, 1);
-      new_frame->level = current_frame->level;
-      new_frame->address = current_frame->address;
-      new_frame->function = g_strdup (current_frame->function);
-      new_frame->source_uri = g_strdup (current_frame->source_uri);
-      new_frame->line = current_frame->line;
+  set_stack_async_result (self, result);
+  g_simple_async_result_complete_in_idle (result);
+  g_object_unref (result);
+}
 
-      /* deep copy the arguments */
-      new_frame->arguments = NULL;
-      for (tmp2=current_frame->arguments; tmp2!=NULL; tmp2=tmp2->next)
-	{
-	  current_arg =  (GSwatDebuggableFrameArgument *)tmp2->data;
+static GQueue *
+gswat_gdb_debugger_get_stack_finish (GSwatDebuggable *object,
+				     GAsyncResult *result,
+				     GError **error)
+{
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
 
-	  new_arg = g_new0 (GSwatDebuggableFrameArgument, 1);
-	  new_arg->name = g_strdup (current_arg->name);
-	  new_arg->value = g_strdup (current_arg->value);
-	  new_frame->arguments =
-	    g_list_prepend (new_frame->arguments, new_arg);
-	}
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (simple)
+			== gswat_gdb_debugger_get_stack_async,
+			NULL);
 
-      g_queue_push_tail (new_stack, new_frame);
-    }
+  if (g_simple_async_result_propagate_error (simple, error))
+    return NULL;
 
-  return new_stack;
+  return copy_stack_snapshot (g_simple_async_result_get_op_res_gpointer (simple));
 }
 
 static GList *
@@ -2870,6 +5587,94 @@ gswat_gdb_debugger_get_locals_list (GSwatDebuggable *object)
   return g_list_copy (self->priv->locals);
 }
 
+/* As with gswat_gdb_debugger_get_locals_list, though there are no
+ * locals while running */
+static void
+set_locals_async_result (GSwatGdbDebugger *self, GSimpleAsyncResult *result)
+{
+  if (!self->priv->gdb_connected
+      || self->priv->state & GSWAT_DEBUGGABLE_RUNNING)
+    {
+      return;
+    }
+
+  if (!self->priv->locals_valid)
+    {
+      g_simple_async_result_set_error (result,
+				       GSWAT_DEBUGGABLE_ERROR,
+				       GSWAT_DEBUGGABLE_ERROR_QUERY_FAILED,
+				       "%s",
+				       _("Failed to list the local variables"));
+      return;
+    }
+
+  g_simple_async_result_set_op_res_gpointer (result,
+					     copy_object_list (self->priv->locals),
+					     (GDestroyNotify)free_object_list);
+}
+
+static void
+complete_locals_waiters (GSwatGdbDebugger *self)
+{
+  complete_async_waiters (self,
+			  &self->priv->locals_waiters,
+			  set_locals_async_result);
+}
+
+static void
+gswat_gdb_debugger_get_locals_list_async (GSwatDebuggable *object,
+					  GCancellable *cancellable,
+					  GAsyncReadyCallback callback,
+					  gpointer user_data)
+{
+  GSwatGdbDebugger *self;
+  GSimpleAsyncResult *result;
+
+  g_return_if_fail (GSWAT_IS_GDB_DEBUGGER (object));
+  self = GSWAT_GDB_DEBUGGER (object);
+
+  result = g_simple_async_result_new (G_OBJECT (self),
+				      callback,
+				      user_data,
+				      gswat_gdb_debugger_get_locals_list_async);
+
+  if (cancellable && g_cancellable_is_cancelled (cancellable))
+    {
+      complete_cancelled_async_result (result);
+      return;
+    }
+
+  if (self->priv->gdb_connected
+      && !(self->priv->state & GSWAT_DEBUGGABLE_RUNNING)
+      && !self->priv->locals_valid)
+    {
+      add_async_waiter (&self->priv->locals_waiters, result, cancellable);
+      kick_asynchronous_locals_update (self);
+      return;
+    }
+
+  set_locals_async_result (self, result);
+  g_simple_async_result_complete_in_idle (result);
+  g_object_unref (result);
+}
+
+static GList *
+gswat_gdb_debugger_get_locals_list_finish (GSwatDebuggable *object,
+					   GAsyncResult *result,
+					   GError **error)
+{
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (simple)
+			== gswat_gdb_debugger_get_locals_list_async,
+			NULL);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    return NULL;
+
+  return copy_object_list (g_simple_async_result_get_op_res_gpointer (simple));
+}
+
 static void
 synchronous_update_locals_list (GSwatGdbDebugger *self)
 {
@@ -2926,8 +5731,8 @@ static void
 synchronous_update_stack (GSwatGdbDebugger *self)
 {
   StackUpdateMachine *stack_machine;
-  gulong token;
-  GSwatGdbMIRecord *record;
+  GSwatGdbMIFuture *depth_future, *frames_future, *args_future;
+  gchar *command;
 
   if (  (self->priv->state & GSWAT_DEBUGGABLE_RUNNING)
       ||  (self->priv->stack_valid == TRUE)
@@ -2944,45 +5749,241 @@ synchronous_update_stack (GSwatGdbDebugger *self)
   memset (stack_machine, 0, sizeof (StackUpdateMachine));
   stack_machine->new_stack = g_queue_new ();
   stack_machine->in_use = TRUE;
+  stack_machine->window_end = STACK_PAGE;
 
   gswat_debuggable_stack_free (self->priv->stack);
   self->priv->stack = NULL;
 
-  token =
-    gswat_gdb_debugger_send_mi_command (self,
-					"-stack-list-frames",
-					NULL,
-					NULL);
-  record = gswat_gdb_debugger_get_mi_result_record (self, token);
-  if (!record)
+  /* These are shared with any asynchronous update in flight, which
+   * will find the stack is already valid when its results arrive */
+  depth_future =
+    send_stack_depth_query (self, GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE);
+  command = g_strdup_printf ("-stack-list-frames 0 %d", STACK_PAGE - 1);
+  frames_future =
+    gswat_gdb_debugger_send_mi_query (self,
+				      command,
+				      GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE);
+  g_free (command);
+  command = g_strdup_printf ("-stack-list-arguments %d 0 %d",
+			     stack_arguments_print_values (self),
+			     STACK_PAGE - 1);
+  args_future =
+    gswat_gdb_debugger_send_mi_query (self,
+				      command,
+				      GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE);
+  g_free (command);
+
+  if (!gswat_gdb_mi_future_wait (depth_future, 0)
+      || !gswat_gdb_mi_future_wait (frames_future, 0)
+      || !gswat_gdb_mi_future_wait (args_future, 0))
     {
       /* An IO error has occurred */
+      gswat_debuggable_stack_free (stack_machine->new_stack);
       g_free (stack_machine);
+      gswat_gdb_mi_future_unref (depth_future);
+      gswat_gdb_mi_future_unref (frames_future);
+      gswat_gdb_mi_future_unref (args_future);
       return;
     }
+
+  async_stack_update_depth_mi_callback (self,
+					gswat_gdb_mi_future_get_record (depth_future),
+					stack_machine);
   async_stack_update_list_frames_mi_callback (self,
-					      record,
+					      gswat_gdb_mi_future_get_record (frames_future),
 					      stack_machine);
-  gswat_gdb_debugger_free_mi_record (record);
-
-  token =
-    gswat_gdb_debugger_send_mi_command (self,
-					"-stack-list-arguments 1",
-					NULL,
-					NULL);
-  record = gswat_gdb_debugger_get_mi_result_record (self, token);
-  if (!record)
+  if (add_stack_args (self,
+		      gswat_gdb_mi_future_get_record (args_future),
+		      stack_machine))
     {
-      /* An IO error has occurred */
-      gswat_debuggable_stack_free (stack_machine->new_stack);
-      g_free (stack_machine);
-      return;
+      install_new_stack (self, stack_machine);
+      fill_stack_for_waiters (self);
     }
-  async_stack_update_list_args_mi_callback (self,
-					    record,
-					    stack_machine);
-  gswat_gdb_debugger_free_mi_record (record);
+  else
+    complete_stack_waiters (self);
+
   g_free (stack_machine);
+  gswat_gdb_mi_future_unref (depth_future);
+  gswat_gdb_mi_future_unref (frames_future);
+  gswat_gdb_mi_future_unref (args_future);
+}
+
+/* Once the top of the stack has been fetched, the frames below it
+ * are fetched a range at a time and added to the end of the stack.
+ * The ranges can overlap, since a frame that is already there is
+ * just skipped. */
+static void
+stack_range_list_frames_mi_callback (GSwatGdbDebugger *self,
+				     const GSwatGdbMIRecord *record,
+				     void *data)
+{
+  GQueue frames = G_QUEUE_INIT;
+  GSwatDebuggableFrame *frame;
+
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR)
+    g_warning ("%s: error listing frames", __FUNCTION__);
+
+  if (record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_DONE
+      || !self->priv->stack_valid)
+    return;
+
+  if (!gswat_gdb_mi_decode_stack (record->text,
+				  &frames,
+				  decoder_uri_from_filename,
+				  self))
+    g_warning ("%s: error decoding frames", __FUNCTION__);
+
+  while ((frame = g_queue_pop_head (&frames)))
+    {
+      if (frame->level == self->priv->stack->length)
+	g_queue_push_tail (self->priv->stack, frame);
+      else
+	gswat_debuggable_frame_free (frame);
+    }
+}
+
+/* The data is the level the range ends before */
+static void
+stack_range_list_args_mi_callback (GSwatGdbDebugger *self,
+				   const GSwatGdbMIRecord *record,
+				   void *data)
+{
+  guint high = GPOINTER_TO_UINT (data);
+
+  /* Fills are only cancelled when the debugger stops again, and the
+   * update for the new stop will complete any waiters */
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED)
+    return;
+
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_DONE
+      && self->priv->stack_valid)
+    {
+      /* A snapshot may have been made before the arguments came */
+      drop_stack_snapshot (self);
+      if (!gswat_gdb_mi_decode_stack_args (record->text, self->priv->stack))
+	g_warning ("%s: error decoding frame arguments", __FUNCTION__);
+      limit_argument_values (self, self->priv->stack);
+    }
+
+  /* If this wasn't the range the waiters were after, the fill will
+   * finish later; unless the frames ran out before the end of the
+   * range, as they do if gdb can't unwind any further, since then
+   * no more are coming */
+  if (!self->priv->stack_valid
+      || record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_DONE
+      || self->priv->stack->length >= self->priv->stack_depth
+      || self->priv->stack->length < high)
+    complete_stack_waiters (self);
+}
+
+static void
+send_stack_range_queries (GSwatGdbDebugger *self,
+			  guint low,
+			  guint high,
+			  GSwatGdbCommandPriority priority,
+			  GSwatGdbMIFuture **frames_future,
+			  GSwatGdbMIFuture **args_future)
+{
+  gchar *command;
+
+  command = g_strdup_printf ("-stack-list-frames %u %u", low, high - 1);
+  *frames_future = gswat_gdb_debugger_send_mi_query (self, command, priority);
+  g_free (command);
+
+  command = g_strdup_printf ("-stack-list-arguments %d %u %u",
+			     stack_arguments_print_values (self),
+			     low,
+			     high - 1);
+  *args_future = gswat_gdb_debugger_send_mi_query (self, command, priority);
+  g_free (command);
+}
+
+static void
+mark_frame_independent (GSwatGdbDebugger *self, GSwatGdbMIFuture *future)
+{
+  GSwatGdbMIHandler *handler;
+
+  /* An answered query has no handler any more */
+  if (future->record)
+    return;
+
+  handler = lookup_mi_handler (self, future->token);
+  if (handler)
+    handler->frame_independent = TRUE;
+}
+
+static void
+fetch_stack_range_async (GSwatGdbDebugger *self,
+			 guint high,
+			 GSwatGdbCommandPriority priority)
+{
+  GSwatGdbMIFuture *frames_future, *args_future;
+
+  high = MIN (high, self->priv->stack_depth);
+  if (!self->priv->stack_valid || self->priv->stack->length >= high)
+    return;
+
+  send_stack_range_queries (self,
+			    self->priv->stack->length,
+			    high,
+			    priority,
+			    &frames_future,
+			    &args_future);
+  /* The frames don't depend on which one is selected, so the fill
+   * carries on if the user picks another frame meanwhile */
+  mark_frame_independent (self, frames_future);
+  mark_frame_independent (self, args_future);
+  gswat_gdb_mi_future_then (frames_future,
+			    stack_range_list_frames_mi_callback,
+			    NULL);
+  gswat_gdb_mi_future_then (args_future,
+			    stack_range_list_args_mi_callback,
+			    GUINT_TO_POINTER (high));
+  gswat_gdb_mi_future_unref (frames_future);
+  gswat_gdb_mi_future_unref (args_future);
+}
+
+/* Fetches the rest of the stack for whoever is waiting on it */
+static void
+kick_stack_fill (GSwatGdbDebugger *self)
+{
+  fetch_stack_range_async (self,
+			   self->priv->stack_depth,
+			   GSWAT_GDB_COMMAND_PRIORITY_REFRESH);
+}
+
+/* Makes sure the stack has all the frames above level high */
+static void
+synchronous_fetch_stack_range (GSwatGdbDebugger *self, guint high)
+{
+  GSwatGdbMIFuture *frames_future, *args_future;
+
+  synchronous_update_stack (self);
+
+  high = MIN (high, self->priv->stack_depth);
+  if (!self->priv->stack_valid || self->priv->stack->length >= high)
+    return;
+
+  send_stack_range_queries (self,
+			    self->priv->stack->length,
+			    high,
+			    GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE,
+			    &frames_future,
+			    &args_future);
+
+  if (gswat_gdb_mi_future_wait (frames_future, 0)
+      && gswat_gdb_mi_future_wait (args_future, 0))
+    {
+      stack_range_list_frames_mi_callback (self,
+					   gswat_gdb_mi_future_get_record (frames_future),
+					   NULL);
+      stack_range_list_args_mi_callback (self,
+					 gswat_gdb_mi_future_get_record (args_future),
+					 GUINT_TO_POINTER (high));
+    }
+
+  gswat_gdb_mi_future_unref (frames_future);
+  gswat_gdb_mi_future_unref (args_future);
 }
 
 static guint
@@ -3028,7 +6029,10 @@ gdb_debugger_set_frame (GSwatDebuggable* object, guint frame_level)
       synchronous_update_stack (self);
     }
 
-  if (frame_level == self->priv->stack->length)
+  /* The frame may be below the part of the stack fetched so far */
+  synchronous_fetch_stack_range (self, frame_level + 1);
+  if (!self->priv->stack_valid
+      || frame_level >= self->priv->stack->length)
     {
       g_warning ("%s: Frame level  (%d) is out of range!",
 		 __FUNCTION__,
@@ -3079,10 +6083,18 @@ gdb_debugger_set_frame (GSwatDebuggable* object, guint frame_level)
   /* invalidate all variable objects..
    * Note: "interrupt_count" is a bad name.*/
   self->priv->interrupt_count++;
+  cancel_stale_mi_commands (self);
 
   self->priv->locals_valid = FALSE;
 
+  /* The variable objects are brought up to date before the locals
+   * update looks at them, so that doesn't have to wait on gdb. A
+   * stack update for the old frame may have been cancelled too. */
+  gswat_gdb_debugger_cork (self);
+  gswat_gdb_variable_object_async_update_all (self);
+  kick_asynchronous_stack_update (self);
   kick_asynchronous_locals_update (self);
+  gswat_gdb_debugger_uncork (self);
 
   frame = g_queue_peek_nth (self->priv->stack,
 			    self->priv->frame_level);
@@ -29,6 +29,7 @@
 #include "gswat-gdbmi.h"
 #include "gswat-session.h"
 #include "gswat-gdb-variable-object.h"
+#include "gswat-inferior-stream.h"
 
 G_BEGIN_DECLS
 
@@ -90,6 +91,9 @@ typedef enum
   GSWAT_GDB_MI_REC_TYPE_RESULT_CONNECTED,
   GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR,
   GSWAT_GDB_MI_REC_TYPE_RESULT_EXIT,
+  /* not from gdb; passed to the result callback of a command that
+   * expired or was outstanding when gdb disconnected */
+  GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED,
 
   /* out of band record types */
   GSWAT_GDB_MI_REC_TYPE_OOB_STOPPED,
@@ -100,12 +104,50 @@ typedef enum
 typedef struct {
     GSwatGdbMIRecordType type;
     GDBMIValue *val;
+    /* The record as read from gdb, for decoding it directly */
+    gchar *text;
 }GSwatGdbMIRecord;
 
 typedef void (*GSwatGdbMIRecordCallback) (GSwatGdbDebugger *self,
 					  const GSwatGdbMIRecord *record,
 					  void *data);
 
+/* Commands are sent to gdb in priority order. Interactive commands
+ * are always sent straight away, while the others are held back
+ * whenever the maximum number of commands are already in flight. */
+typedef enum {
+    GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE,
+    GSWAT_GDB_COMMAND_PRIORITY_REFRESH,
+    GSWAT_GDB_COMMAND_PRIORITY_PREFETCH,
+    GSWAT_GDB_COMMAND_PRIORITY_COUNT
+}GSwatGdbCommandPriority;
+
+/* See gswat_gdb_debugger_get_command_stats */
+typedef struct {
+    /* Commands sent to gdb that haven't been answered yet */
+    guint in_flight;
+    /* Commands currently being held back */
+    guint held[GSWAT_GDB_COMMAND_PRIORITY_COUNT];
+    /* The rest are totals since the debugger was created */
+    guint64 sent[GSWAT_GDB_COMMAND_PRIORITY_COUNT];
+    guint64 n_held[GSWAT_GDB_COMMAND_PRIORITY_COUNT];
+    /* How long commands were held back for, in seconds */
+    gdouble total_wait[GSWAT_GDB_COMMAND_PRIORITY_COUNT];
+    gdouble max_wait[GSWAT_GDB_COMMAND_PRIORITY_COUNT];
+    /* Queries answered by an earlier identical query */
+    guint64 queries_shared;
+    /* Refresh commands from an earlier stop that were never sent */
+    guint64 stale_dropped;
+    /* Query results from an earlier stop that were thrown away */
+    guint64 stale_discarded;
+}GSwatGdbCommandStats;
+
+/* The result of a command that may not have arrived yet */
+#if !defined (GSWAT_GDB_MI_FUTURE_TYPEDEF)
+#define GSWAT_GDB_MI_FUTURE_TYPEDEF
+typedef struct _GSwatGdbMIFuture GSwatGdbMIFuture;
+#endif
+
 GType gswat_gdb_debugger_get_type (void);
 GQuark gswat_gdb_debugger_error_quark (void);
 
@@ -115,6 +157,11 @@ gulong gswat_gdb_debugger_send_mi_command (GSwatGdbDebugger* object,
 					   const gchar* command,
 					   GSwatGdbMIRecordCallback result_callback,
 					   void *data);
+gulong gswat_gdb_debugger_send_mi_command_full (GSwatGdbDebugger* object,
+						const gchar* command,
+						GSwatGdbCommandPriority priority,
+						GSwatGdbMIRecordCallback result_callback,
+						void *data);
 void gswat_gdb_debugger_nop_mi_callback (GSwatGdbDebugger *self,
 					 const GSwatGdbMIRecord *record,
 					 void *data);
@@ -123,6 +170,47 @@ GSwatGdbMIRecord *gswat_gdb_debugger_get_mi_result_record (GSwatGdbDebugger *obj
 void gswat_gdb_debugger_free_mi_record (GSwatGdbMIRecord *record);
 void gswat_gdb_debugger_send_cli_command (GSwatGdbDebugger* self,
 					  gchar const* command);
+void gswat_gdb_debugger_cork (GSwatGdbDebugger *self);
+void gswat_gdb_debugger_uncork (GSwatGdbDebugger *self);
+guint gswat_gdb_debugger_get_pending_command_count (GSwatGdbDebugger *self);
+void gswat_gdb_debugger_set_command_timeout (GSwatGdbDebugger *self,
+					     guint timeout);
+guint gswat_gdb_debugger_get_command_timeout (GSwatGdbDebugger *self);
+void gswat_gdb_debugger_set_max_commands_in_flight (GSwatGdbDebugger *self,
+						    guint max_commands);
+guint gswat_gdb_debugger_get_max_commands_in_flight (GSwatGdbDebugger *self);
+void gswat_gdb_debugger_get_command_stats (GSwatGdbDebugger *self,
+					   GSwatGdbCommandStats *stats);
+void gswat_gdb_debugger_set_threaded_io (GSwatGdbDebugger *self,
+					 gboolean threaded_io);
+gboolean gswat_gdb_debugger_get_threaded_io (GSwatGdbDebugger *self);
+void gswat_gdb_debugger_set_raw_io (GSwatGdbDebugger *self,
+				    gboolean raw_io);
+gboolean gswat_gdb_debugger_get_raw_io (GSwatGdbDebugger *self);
+void gswat_gdb_debugger_set_incremental_stack (GSwatGdbDebugger *self,
+					       gboolean incremental_stack);
+gboolean gswat_gdb_debugger_get_incremental_stack (GSwatGdbDebugger *self);
+GSwatInferiorStream *gswat_gdb_debugger_get_inferior_stream (GSwatGdbDebugger *self);
+
+GSwatGdbMIFuture *gswat_gdb_debugger_send_mi_command_future (GSwatGdbDebugger *self,
+							     const gchar *command);
+GSwatGdbMIFuture *gswat_gdb_debugger_send_mi_command_future_full (GSwatGdbDebugger *self,
+								  const gchar *command,
+								  GSwatGdbCommandPriority priority);
+GSwatGdbMIFuture *gswat_gdb_debugger_send_mi_query (GSwatGdbDebugger *self,
+						    const gchar *command,
+						    GSwatGdbCommandPriority priority);
+GSwatGdbMIFuture *gswat_gdb_mi_future_all (GSwatGdbMIFuture **futures,
+					   guint n_futures);
+GSwatGdbMIFuture *gswat_gdb_mi_future_ref (GSwatGdbMIFuture *future);
+void gswat_gdb_mi_future_unref (GSwatGdbMIFuture *future);
+void gswat_gdb_mi_future_then (GSwatGdbMIFuture *future,
+			       GSwatGdbMIRecordCallback callback,
+			       gpointer data);
+gboolean gswat_gdb_mi_future_is_ready (GSwatGdbMIFuture *future);
+const GSwatGdbMIRecord *gswat_gdb_mi_future_get_record (GSwatGdbMIFuture *future);
+gboolean gswat_gdb_mi_future_wait (GSwatGdbMIFuture *future, guint timeout);
+void gswat_gdb_mi_future_cancel (GSwatGdbMIFuture *future);
 
 /* internal, but shared with gswat-gdb-variable-object.c */
 void _gswat_gdb_debugger_register_variable_object (GSwatGdbDebugger* self,
@@ -0,0 +1,769 @@
+/*
+ * GSwat
+ *
+ * An object oriented debugger abstraction library
+ *
+ * Copyright (C) 2006-2009 Robert Bragg <robert@sixbynine.org>
+ *
+ * GSwat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * GSwat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with GSwat.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * For the format of the records see:
+ *   http://sourceware.org/gdb/onlinedocs/gdb_25.html
+ */
+#include <config.h>
+
+#include <string.h>
+
+#include "gswat-gdbmi.h"
+#include "gswat-gdb-mi-decoders.h"
+
+/* Keywords are dispatched through perfect hash tables of the form:
+ *
+ *   slot = (len + str[0] * A + str[len - 1] * B) & (table size - 1)
+ *
+ * A and B were found by trying every pair below 64 and keeping the
+ * first that gives each keyword its own slot in the smallest power of
+ * two sized table. A lookup is then one hash and one memcmp. When
+ * adding a keyword, redo the search; the tests check that every
+ * keyword still finds itself. */
+#define MI_KEYWORD_HASH(S, LEN, A, B) \
+  ((LEN) + (guchar)(S)[0] * (A) + (guchar)(S)[(LEN) - 1] * (B))
+
+typedef struct {
+    const gchar *name;
+    gsize len;
+    gint value;
+}MIKeyword;
+
+#define MI_KEYWORD(NAME, VALUE) { NAME, sizeof (NAME) - 1, VALUE }
+
+#define RESULT_CLASS_A 0
+#define RESULT_CLASS_B 1
+static const MIKeyword result_classes[8] = {
+  [0] = MI_KEYWORD ("exit", GSWAT_GDB_MI_REC_TYPE_RESULT_EXIT),
+  [1] = MI_KEYWORD ("done", GSWAT_GDB_MI_REC_TYPE_RESULT_DONE),
+  [5] = MI_KEYWORD ("connected", GSWAT_GDB_MI_REC_TYPE_RESULT_CONNECTED),
+  [6] = MI_KEYWORD ("running", GSWAT_GDB_MI_REC_TYPE_RESULT_RUNNING),
+  [7] = MI_KEYWORD ("error", GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR)
+};
+
+#define STOP_REASON_A 8
+#define STOP_REASON_B 10
+static const MIKeyword stop_reasons[32] = {
+  [0] = MI_KEYWORD ("exited-signalled",
+                    GSWAT_GDB_MI_STOP_REASON_EXITED_SIGNALLED),
+  [2] = MI_KEYWORD ("fork", GSWAT_GDB_MI_STOP_REASON_FORK),
+  [3] = MI_KEYWORD ("vfork", GSWAT_GDB_MI_STOP_REASON_VFORK),
+  [6] = MI_KEYWORD ("breakpoint-hit",
+                    GSWAT_GDB_MI_STOP_REASON_BREAKPOINT_HIT),
+  [9] = MI_KEYWORD ("function-finished",
+                    GSWAT_GDB_MI_STOP_REASON_FUNCTION_FINISHED),
+  [10] = MI_KEYWORD ("exec", GSWAT_GDB_MI_STOP_REASON_EXEC),
+  [11] = MI_KEYWORD ("solib-event", GSWAT_GDB_MI_STOP_REASON_SOLIB_EVENT),
+  [12] = MI_KEYWORD ("end-stepping-range",
+                     GSWAT_GDB_MI_STOP_REASON_END_STEPPING_RANGE),
+  [15] = MI_KEYWORD ("signal-received",
+                     GSWAT_GDB_MI_STOP_REASON_SIGNAL_RECEIVED),
+  [17] = MI_KEYWORD ("exited-normally",
+                     GSWAT_GDB_MI_STOP_REASON_EXITED_NORMALLY),
+  [18] = MI_KEYWORD ("syscall-return",
+                     GSWAT_GDB_MI_STOP_REASON_SYSCALL_RETURN),
+  [20] = MI_KEYWORD ("no-history", GSWAT_GDB_MI_STOP_REASON_NO_HISTORY),
+  [21] = MI_KEYWORD ("access-watchpoint-trigger",
+                     GSWAT_GDB_MI_STOP_REASON_ACCESS_WATCHPOINT_TRIGGER),
+  [22] = MI_KEYWORD ("exited", GSWAT_GDB_MI_STOP_REASON_EXITED),
+  [24] = MI_KEYWORD ("location-reached",
+                     GSWAT_GDB_MI_STOP_REASON_LOCATION_REACHED),
+  [26] = MI_KEYWORD ("watchpoint-scope",
+                     GSWAT_GDB_MI_STOP_REASON_WATCHPOINT_SCOPE),
+  [27] = MI_KEYWORD ("read-watchpoint-trigger",
+                     GSWAT_GDB_MI_STOP_REASON_READ_WATCHPOINT_TRIGGER),
+  [30] = MI_KEYWORD ("watchpoint-trigger",
+                     GSWAT_GDB_MI_STOP_REASON_WATCHPOINT_TRIGGER),
+  [31] = MI_KEYWORD ("syscall-entry",
+                     GSWAT_GDB_MI_STOP_REASON_SYSCALL_ENTRY)
+};
+
+static const MIKeyword *
+lookup_keyword (const MIKeyword *table,
+                guint size,
+                guint a,
+                guint b,
+                const gchar *str,
+                gsize len)
+{
+  const MIKeyword *keyword;
+
+  if (len == 0)
+    return NULL;
+
+  keyword = &table[MI_KEYWORD_HASH (str, len, a, b) & (size - 1)];
+  if (keyword->len == len && memcmp (keyword->name, str, len) == 0)
+    return keyword;
+
+  return NULL;
+}
+
+GSwatGdbMIRecordType
+gswat_gdb_mi_decode_result_class (const gchar *record)
+{
+  const MIKeyword *keyword;
+
+  g_return_val_if_fail (record != NULL, GSWAT_GDB_MI_REC_TYPE_UNKNOWN);
+
+  if (record[0] != '^')
+    return GSWAT_GDB_MI_REC_TYPE_UNKNOWN;
+  record++;
+
+  keyword = lookup_keyword (result_classes,
+                            G_N_ELEMENTS (result_classes),
+                            RESULT_CLASS_A, RESULT_CLASS_B,
+                            record, strcspn (record, ","));
+  if (!keyword)
+    return GSWAT_GDB_MI_REC_TYPE_UNKNOWN;
+
+  return keyword->value;
+}
+
+GSwatGdbMIStopReason
+gswat_gdb_mi_decode_stop_reason (const gchar *reason)
+{
+  const MIKeyword *keyword;
+
+  if (reason == NULL)
+    return GSWAT_GDB_MI_STOP_REASON_NONE;
+
+  keyword = lookup_keyword (stop_reasons,
+                            G_N_ELEMENTS (stop_reasons),
+                            STOP_REASON_A, STOP_REASON_B,
+                            reason, strlen (reason));
+  if (!keyword)
+    return GSWAT_GDB_MI_STOP_REASON_UNKNOWN;
+
+  return keyword->value;
+}
+
+/* Reads the frame tuple the reader is on into frame. Where gdb gives
+ * both, the full path to the source file is preferred. */
+static gboolean
+decode_frame (GDBMIReader *reader,
+              GSwatDebuggableFrame *frame,
+              GSwatGdbMIUriFunc uri_func,
+              gpointer data)
+{
+  gchar *file = NULL;
+  gchar *fullname = NULL;
+  const gchar *filename;
+
+  if (!gdbmi_reader_enter (reader))
+    return FALSE;
+
+  while (gdbmi_reader_next (reader) > GDBMI_TOKEN_END)
+    {
+      switch (gdbmi_reader_get_atom (reader))
+        {
+        case GDBMI_ATOM_LEVEL:
+          frame->level = gdbmi_reader_get_ulong (reader, 10);
+          break;
+        case GDBMI_ATOM_ADDR:
+          frame->address = gdbmi_reader_get_ulong (reader, 16);
+          break;
+        case GDBMI_ATOM_FUNC:
+          g_free (frame->function);
+          frame->function = gdbmi_reader_dup_literal (reader);
+          break;
+        case GDBMI_ATOM_FILE:
+          g_free (file);
+          file = gdbmi_reader_dup_literal (reader);
+          break;
+        case GDBMI_ATOM_FULLNAME:
+          g_free (fullname);
+          fullname = gdbmi_reader_dup_literal (reader);
+          break;
+        case GDBMI_ATOM_LINE:
+          frame->line = gdbmi_reader_get_long (reader, 10);
+          break;
+        default:
+          break;
+        }
+    }
+
+  filename = fullname ? fullname : file;
+  if (gdbmi_reader_leave (reader) && filename)
+    {
+      g_free (frame->source_uri);
+      if (uri_func)
+        frame->source_uri = uri_func (filename, data);
+      else
+        frame->source_uri = g_strdup (filename);
+    }
+
+  g_free (file);
+  g_free (fullname);
+
+  return !gdbmi_reader_failed (reader);
+}
+
+/* *stopped,reason="...",...,frame={...}
+ *
+ * The frame is left zeroed if the record doesn't have one, e.g. when
+ * the program exited. */
+gboolean
+gswat_gdb_mi_decode_stopped (const gchar *record,
+                             GSwatGdbMIStopReason *reason,
+                             GSwatDebuggableFrame *frame,
+                             GSwatGdbMIUriFunc uri_func,
+                             gpointer data)
+{
+  GDBMIReader reader;
+  gboolean ret;
+
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (reason != NULL, FALSE);
+  g_return_val_if_fail (frame != NULL, FALSE);
+
+  *reason = GSWAT_GDB_MI_STOP_REASON_NONE;
+
+  gdbmi_reader_init (&reader, record);
+  while (gdbmi_reader_next (&reader) > GDBMI_TOKEN_END)
+    {
+      switch (gdbmi_reader_get_atom (&reader))
+        {
+        case GDBMI_ATOM_REASON:
+          *reason =
+            gswat_gdb_mi_decode_stop_reason (gdbmi_reader_get_literal
+                                             (&reader));
+          break;
+        case GDBMI_ATOM_FRAME:
+          decode_frame (&reader, frame, uri_func, data);
+          break;
+        default:
+          break;
+        }
+    }
+  ret = !gdbmi_reader_failed (&reader);
+  gdbmi_reader_clear (&reader);
+
+  return ret;
+}
+
+/* ^done,stack=[frame={level="0",...},frame={level="1",...}]
+ *
+ * Appends a newly allocated frame to stack for each frame listed.
+ * On failure, the frames decoded so far are still appended. */
+gboolean
+gswat_gdb_mi_decode_stack (const gchar *record,
+                           GQueue *stack,
+                           GSwatGdbMIUriFunc uri_func,
+                           gpointer data)
+{
+  GDBMIReader reader;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (stack != NULL, FALSE);
+
+  gdbmi_reader_init (&reader, record);
+  if (gdbmi_reader_find (&reader, GDBMI_ATOM_STACK)
+      && gdbmi_reader_enter (&reader))
+    {
+      while (gdbmi_reader_next (&reader) == GDBMI_TOKEN_HASH)
+        {
+          GSwatDebuggableFrame *frame;
+
+          frame = g_new0 (GSwatDebuggableFrame, 1);
+          g_queue_push_tail (stack, frame);
+
+          if (!decode_frame (&reader, frame, uri_func, data))
+            break;
+        }
+      ret = !gdbmi_reader_failed (&reader);
+    }
+  gdbmi_reader_clear (&reader);
+
+  return ret;
+}
+
+static void
+free_arguments (GList *arguments)
+{
+  GList *tmp;
+
+  for (tmp=arguments; tmp!=NULL; tmp=tmp->next)
+    {
+      GSwatDebuggableFrameArgument *arg = tmp->data;
+
+      g_free (arg->name);
+      g_free (arg->value);
+      g_free (arg);
+    }
+  g_list_free (arguments);
+}
+
+/* args=[{name="a",value="1"},...]
+ *
+ * The arguments are returned in the order gdb lists them, which is
+ * the order they are declared in */
+static GList *
+decode_arguments (GDBMIReader *reader)
+{
+  GList *arguments = NULL;
+
+  if (!gdbmi_reader_enter (reader))
+    return NULL;
+
+  while (gdbmi_reader_next (reader) > GDBMI_TOKEN_END)
+    {
+      GSwatDebuggableFrameArgument *arg;
+
+      /* Without values, as with -stack-list-arguments 0, gdb just
+       * lists the names */
+      if (!gdbmi_reader_enter (reader))
+        continue;
+
+      arg = g_new0 (GSwatDebuggableFrameArgument, 1);
+      arguments = g_list_prepend (arguments, arg);
+
+      while (gdbmi_reader_next (reader) > GDBMI_TOKEN_END)
+        {
+          switch (gdbmi_reader_get_atom (reader))
+            {
+            case GDBMI_ATOM_NAME:
+              g_free (arg->name);
+              arg->name = gdbmi_reader_dup_literal (reader);
+              break;
+            case GDBMI_ATOM_VALUE:
+              g_free (arg->value);
+              arg->value = gdbmi_reader_dup_literal (reader);
+              break;
+            default:
+              break;
+            }
+        }
+      gdbmi_reader_leave (reader);
+    }
+  gdbmi_reader_leave (reader);
+
+  if (gdbmi_reader_failed (reader))
+    {
+      free_arguments (arguments);
+      return NULL;
+    }
+
+  return g_list_reverse (arguments);
+}
+
+/* ^done,stack-args=[frame={level="0",args=[...]},...]
+ *
+ * Fills in the arguments of the frames in stack, as previously
+ * decoded by gswat_gdb_mi_decode_stack(). */
+gboolean
+gswat_gdb_mi_decode_stack_args (const gchar *record, GQueue *stack)
+{
+  GDBMIReader reader;
+  GList *link = NULL;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (stack != NULL, FALSE);
+
+  gdbmi_reader_init (&reader, record);
+  if (gdbmi_reader_find (&reader, GDBMI_ATOM_STACK_ARGS)
+      && gdbmi_reader_enter (&reader))
+    {
+      while (gdbmi_reader_next (&reader) > GDBMI_TOKEN_END)
+        {
+          GSwatDebuggableFrame *frame;
+          GList *arguments = NULL;
+          guint level = 0;
+
+          if (!gdbmi_reader_enter (&reader))
+            continue;
+
+          while (gdbmi_reader_next (&reader) > GDBMI_TOKEN_END)
+            {
+              switch (gdbmi_reader_get_atom (&reader))
+                {
+                case GDBMI_ATOM_LEVEL:
+                  level = gdbmi_reader_get_ulong (&reader, 10);
+                  break;
+                case GDBMI_ATOM_ARGS:
+                  free_arguments (arguments);
+                  arguments = decode_arguments (&reader);
+                  break;
+                default:
+                  break;
+                }
+            }
+
+          /* gdb lists the frames in order, so rather than looking
+           * each one up we walk down the stack along with them */
+          if (!link
+              || ((GSwatDebuggableFrame *)link->data)->level > level)
+            link = stack->head;
+          while (link
+                 && ((GSwatDebuggableFrame *)link->data)->level < level)
+            link = link->next;
+          frame = link ? link->data : NULL;
+
+          if (!gdbmi_reader_leave (&reader)
+              || !frame || frame->level != level)
+            {
+              free_arguments (arguments);
+              continue;
+            }
+
+          free_arguments (frame->arguments);
+          frame->arguments = arguments;
+        }
+      ret = !gdbmi_reader_failed (&reader);
+    }
+  gdbmi_reader_clear (&reader);
+
+  return ret;
+}
+
+/* ^done,stack-args=[frame={level="3",args=[...]}]
+ *
+ * Sets *arguments to a newly allocated list of the arguments of the
+ * frame at the given level, in order. */
+gboolean
+gswat_gdb_mi_decode_frame_arguments (const gchar *record,
+                                     guint level,
+                                     GList **arguments)
+{
+  GDBMIReader reader;
+  gboolean found = FALSE;
+
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (arguments != NULL, FALSE);
+
+  *arguments = NULL;
+
+  gdbmi_reader_init (&reader, record);
+  if (gdbmi_reader_find (&reader, GDBMI_ATOM_STACK_ARGS)
+      && gdbmi_reader_enter (&reader))
+    {
+      while (!found && gdbmi_reader_next (&reader) > GDBMI_TOKEN_END)
+        {
+          GList *frame_arguments = NULL;
+          guint frame_level = G_MAXUINT;
+
+          if (!gdbmi_reader_enter (&reader))
+            continue;
+
+          while (gdbmi_reader_next (&reader) > GDBMI_TOKEN_END)
+            {
+              switch (gdbmi_reader_get_atom (&reader))
+                {
+                case GDBMI_ATOM_LEVEL:
+                  frame_level = gdbmi_reader_get_ulong (&reader, 10);
+                  break;
+                case GDBMI_ATOM_ARGS:
+                  free_arguments (frame_arguments);
+                  frame_arguments = decode_arguments (&reader);
+                  break;
+                default:
+                  break;
+                }
+            }
+
+          if (gdbmi_reader_leave (&reader) && frame_level == level)
+            {
+              *arguments = frame_arguments;
+              found = TRUE;
+            }
+          else
+            free_arguments (frame_arguments);
+        }
+    }
+  if (gdbmi_reader_failed (&reader))
+    {
+      free_arguments (*arguments);
+      *arguments = NULL;
+      found = FALSE;
+    }
+  gdbmi_reader_clear (&reader);
+
+  return found;
+}
+
+/* ^done,depth="12" */
+gboolean
+gswat_gdb_mi_decode_stack_depth (const gchar *record, guint *depth)
+{
+  GDBMIReader reader;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (depth != NULL, FALSE);
+
+  gdbmi_reader_init (&reader, record);
+  if (gdbmi_reader_find (&reader, GDBMI_ATOM_DEPTH))
+    {
+      *depth = gdbmi_reader_get_ulong (&reader, 10);
+      ret = !gdbmi_reader_failed (&reader);
+    }
+  gdbmi_reader_clear (&reader);
+
+  return ret;
+}
+
+/* ^done,bkpt={number="1",...,fullname="/path/file.c",line="68",...} */
+gboolean
+gswat_gdb_mi_decode_breakpoint (const gchar *record,
+                                GSwatDebuggableBreakpoint *breakpoint,
+                                GSwatGdbMIUriFunc uri_func,
+                                gpointer data)
+{
+  GDBMIReader reader;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (breakpoint != NULL, FALSE);
+
+  gdbmi_reader_init (&reader, record);
+  if (gdbmi_reader_find (&reader, GDBMI_ATOM_BKPT))
+    {
+      GSwatDebuggableFrame frame;
+
+      /* The location fields of a bkpt tuple are the same as a frame's */
+      memset (&frame, 0, sizeof (frame));
+      ret = decode_frame (&reader, &frame, uri_func, data);
+
+      g_free (frame.function);
+      breakpoint->source_uri = frame.source_uri;
+      breakpoint->line = frame.line;
+    }
+  gdbmi_reader_clear (&reader);
+
+  return ret;
+}
+
+static void
+decode_varobj_fields (GDBMIReader *reader, GSwatGdbMIVarobj *varobj)
+{
+  while (gdbmi_reader_next (reader) > GDBMI_TOKEN_END)
+    {
+      switch (gdbmi_reader_get_atom (reader))
+        {
+        case GDBMI_ATOM_NAME:
+          g_free (varobj->name);
+          varobj->name = gdbmi_reader_dup_literal (reader);
+          break;
+        case GDBMI_ATOM_EXP:
+          g_free (varobj->expression);
+          varobj->expression = gdbmi_reader_dup_literal (reader);
+          break;
+        case GDBMI_ATOM_VALUE:
+          g_free (varobj->value);
+          varobj->value = gdbmi_reader_dup_literal (reader);
+          break;
+        case GDBMI_ATOM_TYPE:
+          g_free (varobj->type);
+          varobj->type = gdbmi_reader_dup_literal (reader);
+          break;
+        case GDBMI_ATOM_NUMCHILD:
+          varobj->child_count = gdbmi_reader_get_long (reader, 10);
+          break;
+        default:
+          break;
+        }
+    }
+}
+
+/* ^done,name="var1",numchild="1",value="0x0",type="int *"
+ *
+ * Whatever was decoded should be released with
+ * gswat_gdb_mi_varobj_clear() even if this fails. */
+gboolean
+gswat_gdb_mi_decode_varobj (const gchar *record, GSwatGdbMIVarobj *varobj)
+{
+  GDBMIReader reader;
+  gboolean ret;
+
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (varobj != NULL, FALSE);
+
+  memset (varobj, 0, sizeof (GSwatGdbMIVarobj));
+  varobj->child_count = -1;
+
+  gdbmi_reader_init (&reader, record);
+  decode_varobj_fields (&reader, varobj);
+  ret = !gdbmi_reader_failed (&reader);
+  gdbmi_reader_clear (&reader);
+
+  return ret;
+}
+
+/* ^done,numchild="2",children=[child={name="var1.a",exp="a",...},...]
+ *
+ * Sets *children to a list of newly allocated GSwatGdbMIVarobjs,
+ * in order. */
+gboolean
+gswat_gdb_mi_decode_varobj_children (const gchar *record, GList **children)
+{
+  GDBMIReader reader;
+  GList *list = NULL;
+  gboolean ret;
+
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (children != NULL, FALSE);
+
+  gdbmi_reader_init (&reader, record);
+  if (gdbmi_reader_find (&reader, GDBMI_ATOM_CHILDREN)
+      && gdbmi_reader_enter (&reader))
+    {
+      while (gdbmi_reader_next (&reader) > GDBMI_TOKEN_END)
+        {
+          GSwatGdbMIVarobj *varobj;
+
+          if (!gdbmi_reader_enter (&reader))
+            continue;
+
+          varobj = g_new0 (GSwatGdbMIVarobj, 1);
+          varobj->child_count = -1;
+          list = g_list_prepend (list, varobj);
+
+          decode_varobj_fields (&reader, varobj);
+          gdbmi_reader_leave (&reader);
+        }
+    }
+
+  ret = !gdbmi_reader_failed (&reader);
+  if (!ret)
+    {
+      g_list_foreach (list, (GFunc)gswat_gdb_mi_varobj_free, NULL);
+      g_list_free (list);
+      list = NULL;
+    }
+  *children = g_list_reverse (list);
+
+  gdbmi_reader_clear (&reader);
+  return ret;
+}
+
+/* ^done,changelist=[{name="var1",value="3",in_scope="true",
+ *                    type_changed="false"},...]
+ *
+ * Sets *changes to a list of newly allocated GSwatGdbMIVarobjChanges,
+ * in order. */
+gboolean
+gswat_gdb_mi_decode_changelist (const gchar *record, GList **changes)
+{
+  GDBMIReader reader;
+  GList *list = NULL;
+  gboolean ret;
+
+  g_return_val_if_fail (record != NULL, FALSE);
+  g_return_val_if_fail (changes != NULL, FALSE);
+
+  gdbmi_reader_init (&reader, record);
+  if (gdbmi_reader_find (&reader, GDBMI_ATOM_CHANGELIST)
+      && gdbmi_reader_enter (&reader))
+    {
+      while (gdbmi_reader_next (&reader) > GDBMI_TOKEN_END)
+        {
+          GSwatGdbMIVarobjChange *change;
+          const gchar *literal;
+
+          if (!gdbmi_reader_enter (&reader))
+            continue;
+
+          change = g_new0 (GSwatGdbMIVarobjChange, 1);
+          change->new_child_count = -1;
+          change->in_scope = TRUE;
+          list = g_list_prepend (list, change);
+
+          while (gdbmi_reader_next (&reader) > GDBMI_TOKEN_END)
+            {
+              switch (gdbmi_reader_get_atom (&reader))
+                {
+                case GDBMI_ATOM_NAME:
+                  g_free (change->name);
+                  change->name = gdbmi_reader_dup_literal (&reader);
+                  break;
+                case GDBMI_ATOM_VALUE:
+                  g_free (change->value);
+                  change->value = gdbmi_reader_dup_literal (&reader);
+                  break;
+                case GDBMI_ATOM_NEW_TYPE:
+                  g_free (change->new_type);
+                  change->new_type = gdbmi_reader_dup_literal (&reader);
+                  break;
+                case GDBMI_ATOM_NEW_NUM_CHILDREN:
+                  change->new_child_count =
+                    gdbmi_reader_get_long (&reader, 10);
+                  break;
+                case GDBMI_ATOM_IN_SCOPE:
+                  literal = gdbmi_reader_get_literal (&reader);
+                  change->in_scope = g_strcmp0 (literal, "true") == 0;
+                  break;
+                case GDBMI_ATOM_TYPE_CHANGED:
+                  literal = gdbmi_reader_get_literal (&reader);
+                  change->type_changed = g_strcmp0 (literal, "true") == 0;
+                  break;
+                default:
+                  break;
+                }
+            }
+          gdbmi_reader_leave (&reader);
+        }
+    }
+
+  ret = !gdbmi_reader_failed (&reader);
+  if (!ret)
+    {
+      g_list_foreach (list, (GFunc)gswat_gdb_mi_varobj_change_free, NULL);
+      g_list_free (list);
+      list = NULL;
+    }
+  *changes = g_list_reverse (list);
+
+  gdbmi_reader_clear (&reader);
+  return ret;
+}
+
+void
+gswat_gdb_mi_varobj_clear (GSwatGdbMIVarobj *varobj)
+{
+  g_return_if_fail (varobj != NULL);
+
+  g_free (varobj->name);
+  g_free (varobj->expression);
+  g_free (varobj->value);
+  g_free (varobj->type);
+  memset (varobj, 0, sizeof (GSwatGdbMIVarobj));
+  varobj->child_count = -1;
+}
+
+void
+gswat_gdb_mi_varobj_free (GSwatGdbMIVarobj *varobj)
+{
+  g_return_if_fail (varobj != NULL);
+
+  gswat_gdb_mi_varobj_clear (varobj);
+  g_free (varobj);
+}
+
+void
+gswat_gdb_mi_varobj_change_free (GSwatGdbMIVarobjChange *change)
+{
+  g_return_if_fail (change != NULL);
+
+  g_free (change->name);
+  g_free (change->value);
+  g_free (change->new_type);
+  g_free (change);
+}
@@ -0,0 +1,126 @@
+/*
+ * GSwat
+ *
+ * An object oriented debugger abstraction library
+ *
+ * Copyright (C) 2006-2009 Robert Bragg <robert@sixbynine.org>
+ *
+ * GSwat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * GSwat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with GSwat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Decoders for the MI records GSwat knows the shape of. These read
+ * the raw record text with a GDBMIReader and fill in structures
+ * directly, instead of going via a GDBMIValue tree. Not installed. */
+
+#ifndef GSWAT_GDB_MI_DECODERS_H
+#define GSWAT_GDB_MI_DECODERS_H
+
+#include <glib.h>
+
+#include "gswat-debuggable.h"
+#include "gswat-gdb-debugger.h"
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  /* The record didn't give a reason */
+  GSWAT_GDB_MI_STOP_REASON_NONE,
+  GSWAT_GDB_MI_STOP_REASON_UNKNOWN,
+
+  GSWAT_GDB_MI_STOP_REASON_BREAKPOINT_HIT,
+  GSWAT_GDB_MI_STOP_REASON_WATCHPOINT_TRIGGER,
+  GSWAT_GDB_MI_STOP_REASON_READ_WATCHPOINT_TRIGGER,
+  GSWAT_GDB_MI_STOP_REASON_ACCESS_WATCHPOINT_TRIGGER,
+  GSWAT_GDB_MI_STOP_REASON_FUNCTION_FINISHED,
+  GSWAT_GDB_MI_STOP_REASON_LOCATION_REACHED,
+  GSWAT_GDB_MI_STOP_REASON_WATCHPOINT_SCOPE,
+  GSWAT_GDB_MI_STOP_REASON_END_STEPPING_RANGE,
+  GSWAT_GDB_MI_STOP_REASON_EXITED_SIGNALLED,
+  GSWAT_GDB_MI_STOP_REASON_EXITED,
+  GSWAT_GDB_MI_STOP_REASON_EXITED_NORMALLY,
+  GSWAT_GDB_MI_STOP_REASON_SIGNAL_RECEIVED,
+  GSWAT_GDB_MI_STOP_REASON_SOLIB_EVENT,
+  GSWAT_GDB_MI_STOP_REASON_FORK,
+  GSWAT_GDB_MI_STOP_REASON_VFORK,
+  GSWAT_GDB_MI_STOP_REASON_SYSCALL_ENTRY,
+  GSWAT_GDB_MI_STOP_REASON_SYSCALL_RETURN,
+  GSWAT_GDB_MI_STOP_REASON_EXEC,
+  GSWAT_GDB_MI_STOP_REASON_NO_HISTORY
+}GSwatGdbMIStopReason;
+
+/* Turns a filename reported by gdb into a source uri */
+typedef gchar *(*GSwatGdbMIUriFunc) (const gchar *filename, gpointer data);
+
+/* A variable object as described by -var-create,
+ * -var-info-num-children or an entry of -var-list-children */
+typedef struct {
+    gchar *name;
+    gchar *expression;
+    gchar *value;
+    gchar *type;
+    /* -1 if gdb didn't say */
+    gint child_count;
+}GSwatGdbMIVarobj;
+
+/* An entry of a -var-update changelist */
+typedef struct {
+    gchar *name;
+    gchar *value;
+    /* Only set if the type of the variable object changed */
+    gchar *new_type;
+    /* -1 if gdb didn't say */
+    gint new_child_count;
+    gboolean in_scope;
+    gboolean type_changed;
+}GSwatGdbMIVarobjChange;
+
+GSwatGdbMIRecordType gswat_gdb_mi_decode_result_class (const gchar *record);
+GSwatGdbMIStopReason gswat_gdb_mi_decode_stop_reason (const gchar *reason);
+
+gboolean gswat_gdb_mi_decode_stopped (const gchar *record,
+                                      GSwatGdbMIStopReason *reason,
+                                      GSwatDebuggableFrame *frame,
+                                      GSwatGdbMIUriFunc uri_func,
+                                      gpointer data);
+gboolean gswat_gdb_mi_decode_stack (const gchar *record,
+                                    GQueue *stack,
+                                    GSwatGdbMIUriFunc uri_func,
+                                    gpointer data);
+gboolean gswat_gdb_mi_decode_stack_args (const gchar *record,
+                                         GQueue *stack);
+gboolean gswat_gdb_mi_decode_stack_depth (const gchar *record,
+                                          guint *depth);
+gboolean gswat_gdb_mi_decode_frame_arguments (const gchar *record,
+                                              guint level,
+                                              GList **arguments);
+gboolean gswat_gdb_mi_decode_breakpoint (const gchar *record,
+                                         GSwatDebuggableBreakpoint *breakpoint,
+                                         GSwatGdbMIUriFunc uri_func,
+                                         gpointer data);
+
+gboolean gswat_gdb_mi_decode_varobj (const gchar *record,
+                                     GSwatGdbMIVarobj *varobj);
+gboolean gswat_gdb_mi_decode_varobj_children (const gchar *record,
+                                              GList **children);
+gboolean gswat_gdb_mi_decode_changelist (const gchar *record,
+                                         GList **changes);
+
+void gswat_gdb_mi_varobj_clear (GSwatGdbMIVarobj *varobj);
+void gswat_gdb_mi_varobj_free (GSwatGdbMIVarobj *varobj);
+void gswat_gdb_mi_varobj_change_free (GSwatGdbMIVarobjChange *change);
+
+G_END_DECLS
+
+#endif /* GSWAT_GDB_MI_DECODERS_H */
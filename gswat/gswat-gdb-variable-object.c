@@ -33,6 +33,7 @@
 #include "gswat-utils.h"
 #include "gswat-gdb-debugger.h"
 #include "gswat-gdb-variable-object.h"
+#include "gswat-gdb-mi-decoders.h"
 
 static void gswat_gdb_variable_object_class_init (GSwatGdbVariableObjectClass *klass);
 static void gswat_gdb_variable_object_get_property (GObject *object,
@@ -49,6 +50,10 @@ gswat_gdb_variable_object_variable_object_interface_init (gpointer interface,
 static void gswat_gdb_variable_object_init (GSwatGdbVariableObject *self);
 static void gswat_gdb_variable_object_finalize (GObject *self);
 
+static GSwatGdbMIFuture *send_create_gdb_variable_object (GSwatGdbVariableObject *self,
+							  GSwatGdbCommandPriority priority);
+static gboolean finish_create_gdb_variable_object (GSwatGdbVariableObject *self,
+						   GSwatGdbMIFuture *future);
 static gboolean create_gdb_variable_object (GSwatGdbVariableObject *self);
 static GSwatGdbVariableObject *wrap_child_gdb_variable_object (GSwatGdbDebugger *debugger,
 							       GSwatGdbVariableObject *parent,
@@ -76,6 +81,28 @@ static gint
 count_gdb_variable_object_children (GSwatGdbVariableObject *self);
 static GList *
 gswat_gdb_variable_object_get_children (GSwatVariableObject *self);
+static void update_children_from_record (GSwatGdbVariableObject *self,
+					 const gchar *text);
+static void
+gswat_gdb_variable_object_get_value_async (GSwatVariableObject *self,
+					   GCancellable *cancellable,
+					   GAsyncReadyCallback callback,
+					   gpointer user_data);
+static gchar *
+gswat_gdb_variable_object_get_value_finish (GSwatVariableObject *self,
+					    GAsyncResult *result,
+					    GError **error);
+static void
+gswat_gdb_variable_object_get_children_async (GSwatVariableObject *self,
+					      GCancellable *cancellable,
+					      GAsyncReadyCallback callback,
+					      gpointer user_data);
+static GList *
+gswat_gdb_variable_object_get_children_finish (GSwatVariableObject *self,
+					       GAsyncResult *result,
+					       GError **error);
+static void continue_async_request (GSwatGdbVariableObject *self,
+				    GSimpleAsyncResult *result);
 static void synchronous_update_all (GSwatGdbDebugger *gdb_debugger);
 static void
 update_variable_objects_mi_callback (GSwatGdbDebugger *gdb_debugger,
@@ -168,6 +195,8 @@ struct _GSwatGdbVariableObjectPrivate
 
   /* The gdb side name for this variable object */
   gchar                   *gdb_name;
+  /* The reply to -var-create, while it's pending */
+  GSwatGdbMIFuture        *create_future;
 
 };
 
@@ -315,6 +344,12 @@ gswat_gdb_variable_object_variable_object_interface_init (gpointer interface,
   variable_object->get_value = gswat_gdb_variable_object_get_value;
   variable_object->get_child_count = gswat_gdb_variable_object_get_child_count;
   variable_object->get_children = gswat_gdb_variable_object_get_children;
+  variable_object->get_value_async = gswat_gdb_variable_object_get_value_async;
+  variable_object->get_value_finish = gswat_gdb_variable_object_get_value_finish;
+  variable_object->get_children_async =
+    gswat_gdb_variable_object_get_children_async;
+  variable_object->get_children_finish =
+    gswat_gdb_variable_object_get_children_finish;
 }
 
 static void
@@ -324,11 +359,11 @@ gswat_gdb_variable_object_init (GSwatGdbVariableObject *self)
 
 }
 
-GSwatGdbVariableObject *
-gswat_gdb_variable_object_new (GSwatGdbDebugger *debugger,
-			       const gchar *expression,
-			       const gchar *cached_value,
-			       gint frame)
+static GSwatGdbVariableObject *
+alloc_variable_object (GSwatGdbDebugger *debugger,
+		       const gchar *expression,
+		       const gchar *cached_value,
+		       gint frame)
 {
   GSwatGdbVariableObject *variable_object;
 
@@ -348,6 +383,20 @@ gswat_gdb_variable_object_new (GSwatGdbDebugger *debugger,
   variable_object->priv->gdb_interrupt_count =
     gswat_gdb_debugger_get_interrupt_count (debugger);
 
+  return variable_object;
+}
+
+GSwatGdbVariableObject *
+gswat_gdb_variable_object_new (GSwatGdbDebugger *debugger,
+			       const gchar *expression,
+			       const gchar *cached_value,
+			       gint frame)
+{
+  GSwatGdbVariableObject *variable_object;
+
+  variable_object =
+    alloc_variable_object (debugger, expression, cached_value, frame);
+
   if (!create_gdb_variable_object (variable_object))
     {
       g_object_unref (variable_object);
@@ -360,6 +409,98 @@ gswat_gdb_variable_object_new (GSwatGdbDebugger *debugger,
   return variable_object;
 }
 
+/* Creates a variable object for each of the expressions. All the
+ * -var-create commands are sent before waiting for any of the
+ * replies, so this only costs one round trip to gdb. Expressions
+ * gdb couldn't create an object for are skipped. */
+GList *
+gswat_gdb_variable_object_new_list (GSwatGdbDebugger *debugger,
+				    GList *expressions,
+				    gint frame)
+{
+  GList *objects;
+
+  gswat_gdb_mi_future_unref (
+    gswat_gdb_variable_object_send_create_list (debugger,
+						expressions,
+						frame,
+						&objects));
+
+  return gswat_gdb_variable_object_finish_create_list (objects);
+}
+
+/* The first half of gswat_gdb_variable_object_new_list, for callers
+ * that can't block. The new, not yet usable, objects are returned
+ * via @objects and the returned future completes once gdb has
+ * replied for all of them. @objects should then be passed to
+ * gswat_gdb_variable_object_finish_create_list. */
+GSwatGdbMIFuture *
+gswat_gdb_variable_object_send_create_list (GSwatGdbDebugger *debugger,
+					    GList *expressions,
+					    gint frame,
+					    GList **objects)
+{
+  GSwatGdbMIFuture **futures;
+  GSwatGdbMIFuture *all;
+  GList *tmp;
+  guint n_futures = 0;
+
+  futures = g_new (GSwatGdbMIFuture *, g_list_length (expressions));
+  *objects = NULL;
+
+  gswat_gdb_debugger_cork (debugger);
+  for (tmp=expressions; tmp!=NULL; tmp=tmp->next)
+    {
+      GSwatGdbVariableObject *variable_object;
+
+      variable_object =
+	alloc_variable_object (debugger, tmp->data, NULL, frame);
+      variable_object->priv->create_future =
+	send_create_gdb_variable_object (variable_object,
+					 GSWAT_GDB_COMMAND_PRIORITY_REFRESH);
+      futures[n_futures++] = variable_object->priv->create_future;
+      *objects = g_list_prepend (*objects, variable_object);
+    }
+  gswat_gdb_debugger_uncork (debugger);
+
+  all = gswat_gdb_mi_future_all (futures, n_futures);
+  g_free (futures);
+
+  *objects = g_list_reverse (*objects);
+
+  return all;
+}
+
+/* Picks up the replies for objects from
+ * gswat_gdb_variable_object_send_create_list, which only blocks if
+ * they haven't all arrived yet. The objects gdb couldn't create are
+ * unref'd and the list of the rest is returned. */
+GList *
+gswat_gdb_variable_object_finish_create_list (GList *objects)
+{
+  GList *tmp;
+
+  for (tmp=objects; tmp!=NULL; tmp=tmp->next)
+    {
+      GSwatGdbVariableObject *variable_object = tmp->data;
+      GSwatGdbMIFuture *future = variable_object->priv->create_future;
+
+      variable_object->priv->create_future = NULL;
+      if (!finish_create_gdb_variable_object (variable_object, future))
+	{
+	  g_object_unref (variable_object);
+	  tmp->data = NULL;
+	  continue;
+	}
+
+      register_variable_object (variable_object->priv->debugger,
+				variable_object);
+      variable_object->priv->valid = TRUE;
+    }
+
+  return g_list_remove_all (objects, NULL);
+}
+
 void
 gswat_gdb_variable_object_finalize (GObject *object)
 {
@@ -369,19 +510,28 @@ gswat_gdb_variable_object_finalize (GObject *object)
    * of view */
   delete_gdb_variable_object (self);
 
+  if (self->priv->create_future)
+    {
+      gswat_gdb_mi_future_unref (self->priv->create_future);
+    }
+
   g_free (self->priv->expression);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
-static gboolean
-create_gdb_variable_object (GSwatGdbVariableObject *self)
+/* Sends the -var-create command for a new variable object. Its
+ * gdb_name is set straight away, and the reply is picked up with
+ * finish_create_gdb_variable_object. */
+static GSwatGdbMIFuture *
+send_create_gdb_variable_object (GSwatGdbVariableObject *self,
+				 GSwatGdbCommandPriority priority)
 {
   gchar *command;
-  gulong token;
-  GSwatGdbMIRecord *result;
-  const GDBMIValue *numchild_val;
+  GSwatGdbMIFuture *future;
 
+  self->priv->gdb_name = g_strdup_printf ("v%d",
+					  global_variable_object_index);
 
   if (self->priv->frame == GSWAT_VARIABLE_OBJECT_ANY_FRAME)
     {
@@ -400,41 +550,55 @@ create_gdb_variable_object (GSwatGdbVariableObject *self)
       g_warning ("create_gdb_variable_object: doesn't currently "
 		 "support arbitrary frame choice");
     }
-  token = gswat_gdb_debugger_send_mi_command (self->priv->debugger,
-					      command,
-					      NULL,
-					      NULL);
+  future =
+    gswat_gdb_debugger_send_mi_command_future_full (self->priv->debugger,
+						    command,
+						    priority);
   g_free (command);
 
+  global_variable_object_index++;
+
+  return future;
+}
+
+static gboolean
+finish_create_gdb_variable_object (GSwatGdbVariableObject *self,
+				   GSwatGdbMIFuture *future)
+{
+  const GSwatGdbMIRecord *result;
+  GSwatGdbMIVarobj varobj;
+
   /* FIXME - make sure we can cope with junk expressions */
-  result=gswat_gdb_debugger_get_mi_result_record (self->priv->debugger, token);
-  if (!result)
+  if (!gswat_gdb_mi_future_wait (future, 0)
+      || !(result = gswat_gdb_mi_future_get_record (future))->text)
     {
       /* An IO error has occurred */
+      gswat_gdb_mi_future_unref (future);
+      g_free (self->priv->gdb_name);
+      self->priv->gdb_name = NULL;
       return FALSE;
     }
 
-  numchild_val=gdbmi_value_hash_lookup (result->val, "numchild");
-  if (numchild_val)
-    {
-      const char *child_count_str;
-      child_count_str = gdbmi_value_literal_get (numchild_val);
-      self->priv->child_count =  (gint)strtoul (child_count_str, NULL, 10);
-    }
-  else
-    {
-      /* Mark the child_count as "unknown" */
-      self->priv->child_count = -1;
-    }
+  /* If gdb didn't say, the child_count is marked as "unknown" (-1) */
+  gswat_gdb_mi_decode_varobj (result->text, &varobj);
+  self->priv->child_count = varobj.child_count;
+  gswat_gdb_mi_varobj_clear (&varobj);
 
-  gswat_gdb_debugger_free_mi_record (result);
+  gswat_gdb_mi_future_unref (future);
 
-  self->priv->gdb_name = g_strdup_printf ("v%d",
-					  global_variable_object_index);
+  return TRUE;
+}
 
-  global_variable_object_index++;
+static gboolean
+create_gdb_variable_object (GSwatGdbVariableObject *self)
+{
+  GSwatGdbMIFuture *future;
 
-  return TRUE;
+  future =
+    send_create_gdb_variable_object (self,
+				     GSWAT_GDB_COMMAND_PRIORITY_INTERACTIVE);
+
+  return finish_create_gdb_variable_object (self, future);
 }
 
 static GSwatGdbVariableObject *
@@ -701,12 +865,13 @@ evaluate_gdb_variable_object_expression (GSwatGdbVariableObject *self,
     }
   if (result && result->val)
     {
-      value = gdbmi_value_hash_lookup (result->val, "value");
+      value = gdbmi_value_hash_lookup_atom (result->val, GDBMI_ATOM_VALUE);
     }
 
   if (value)
     {
-      value_string = g_strdup (gdbmi_value_literal_get (value));
+      value_string =
+	gdbmi_literal_dup_utf8 (gdbmi_value_literal_get (value), -1);
     }
   else
     {
@@ -752,7 +917,7 @@ count_gdb_variable_object_children (GSwatGdbVariableObject *self)
   gchar *command;
   gulong token;
   GSwatGdbMIRecord *result;
-  const GDBMIValue *numchild_val;
+  GSwatGdbMIVarobj varobj;
   gint child_count;
 
   /* find out if this expression has any children */
@@ -769,33 +934,99 @@ count_gdb_variable_object_children (GSwatGdbVariableObject *self)
       /* An IO error has occurred */
       return 0;
     }
-  numchild_val=gdbmi_value_hash_lookup (result->val, "numchild");
-  if (numchild_val)
+  gswat_gdb_mi_decode_varobj (result->text, &varobj);
+  child_count = MAX (varobj.child_count, 0);
+  gswat_gdb_mi_varobj_clear (&varobj);
+  gswat_gdb_debugger_free_mi_record (result);
+
+  return child_count;
+}
+
+/* Wraps any children listed in a -var-list-children reply that we
+ * don't have a variable object for yet */
+static void
+update_children_from_record (GSwatGdbVariableObject *self,
+			     const gchar *text)
+{
+  GList *tmp;
+  GList *children, *l;
+  GSwatGdbVariableObject *variable_object;
+
+  if (!gswat_gdb_mi_decode_varobj_children (text, &children))
     {
-      const char *child_count_str;
-      child_count_str = gdbmi_value_literal_get (numchild_val);
-      child_count =  (gint)strtoul (child_count_str, NULL, 10);
+      g_warning ("update_children_from_record: error decoding "
+		 "children");
     }
-  else
+
+  for (l=children; l!=NULL; l=l->next)
     {
-      child_count = 0;
+      GSwatGdbMIVarobj *child = l->data;
+      gboolean child_already_exists = FALSE;
+      gint child_count;
+
+      if (!child->name)
+	{
+	  continue;
+	}
+
+      /* FIXME - gdb automatically creates variable objects
+       * the first time you list children, but the docs
+       * arn't clear about the frame number or expression
+       * that are used.
+       *
+       * It looks like the expression is just the name
+       * of the member  (i.e. not a valid expression
+       * in the scope of the parent expression)
+       *
+       * I need to find out about the frame number
+       */
+
+      for (tmp=self->priv->children; tmp!=NULL; tmp=tmp->next)
+	{
+	  variable_object = tmp->data;
+
+	  if (strcmp (variable_object->priv->gdb_name, child->name) == 0)
+	    {
+	      child_already_exists = TRUE;
+	    }
+	}
+      if (child_already_exists)
+	{
+	  continue;
+	}
+
+      /* complex types wont have a value */
+      child_count = child->child_count;
+      if (child_count == -1 && child->value)
+	{
+	  child_count = 0;
+	}
+
+      /* Note this function also adds the wrapped child to
+       * the parents list of children */
+      variable_object =
+	wrap_child_gdb_variable_object (self->priv->debugger,
+					self, /* parent */
+					child->name,
+					child->expression,
+					child->value,
+					self->priv->frame,
+					child_count);
     }
-  gswat_gdb_debugger_free_mi_record (result);
 
-  return child_count;
+  g_list_foreach (children, (GFunc)gswat_gdb_mi_varobj_free, NULL);
+  g_list_free (children);
+
+  self->priv->children_consistent = TRUE;
 }
 
 static GList *
 gswat_gdb_variable_object_get_children (GSwatVariableObject *object)
 {
   GSwatGdbVariableObject *self;
-  GList *tmp;
   gchar *command;
   gulong token;
   GSwatGdbMIRecord *result;
-  const GDBMIValue *children_val, *child_val;
-  int n;
-  GSwatGdbVariableObject *variable_object;
 
   g_return_val_if_fail (GSWAT_IS_GDB_VARIABLE_OBJECT (object), NULL);
   self = GSWAT_GDB_VARIABLE_OBJECT (object);
@@ -833,100 +1064,432 @@ gswat_gdb_variable_object_get_children (GSwatVariableObject *object)
       return NULL;
     }
 
-  children_val = gdbmi_value_hash_lookup (result->val, "children");
-  n=0;
-  while ( (child_val = gdbmi_value_list_get_nth (children_val, n)))
+  update_children_from_record (self, result->text);
+
+  gswat_gdb_debugger_free_mi_record (result);
+
+  return g_list_copy (self->priv->children);
+}
+
+static void
+free_object_list (GList *objects)
+{
+  g_list_foreach (objects, (GFunc)g_object_unref, NULL);
+  g_list_free (objects);
+}
+
+static GList *
+copy_object_list (GList *objects)
+{
+  g_list_foreach (objects, (GFunc)g_object_ref, NULL);
+  return g_list_copy (objects);
+}
+
+/* The asynchronous requests below are run as a series of steps,
+ * each of which either completes the result or sends a command
+ * whose reply calls back into the next step. A reference on the
+ * result is carried from step to step, and the result holds a
+ * reference on the variable object. Their commands are sent at
+ * prefetch priority, since views tend to issue them in bulk. */
+static void
+fail_async_request (GSimpleAsyncResult *result, const gchar *message)
+{
+  gint code;
+
+  if (g_simple_async_result_get_source_tag (result)
+      == gswat_gdb_variable_object_get_value_async)
     {
-      gboolean child_already_exists = FALSE;
-      const GDBMIValue *name_val, *expression_val, *value_val;
-      const GDBMIValue *numchild_val;
-      const gchar *name_str, *expression_str, *child_value_str;
-      const gchar *numchild_str;
-      gint child_count;
+      code = GSWAT_VARIABLE_OBJECT_ERROR_GET_VALUE_FAILED;
+    }
+  else
+    {
+      code = GSWAT_VARIABLE_OBJECT_ERROR_GET_CHILDREN_FAILED;
+    }
 
-      /* FIXME - gdb automatically creates variable objects
-       * the first time you list children, but the docs
-       * arn't clear about the frame number or expression
-       * that are used.
-       *
-       * It looks like the expression is just the name
-       * of the member  (i.e. not a valid expression
-       * in the scope of the parent expression)
-       *
-       * I need to find out about the frame number
-       */
+  g_simple_async_result_set_error (result,
+				   GSWAT_VARIABLE_OBJECT_ERROR,
+				   code,
+				   "%s",
+				   message);
+  g_simple_async_result_complete_in_idle (result);
+  g_object_unref (result);
+}
 
-      name_val = gdbmi_value_hash_lookup (child_val, "name");
-      name_str = gdbmi_value_literal_get (name_val);
+static void
+async_request_update_all_mi_callback (GSwatGdbDebugger *gdb_debugger,
+				      const GSwatGdbMIRecord *record,
+				      void *data)
+{
+  GSimpleAsyncResult *result = data;
+  GSwatGdbVariableObject *self;
 
-      for (tmp=self->priv->children; tmp!=NULL; tmp=tmp->next)
-	{
-	  variable_object = tmp->data;
+  if (!gdb_debugger || record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_DONE)
+    {
+      fail_async_request (result, _("Failed to update the variable object"));
+      return;
+    }
 
-	  if (strcmp (variable_object->priv->gdb_name, name_str) == 0)
-	    {
-	      child_already_exists = TRUE;
-	    }
-	}
-      if (child_already_exists)
-	{
-	  n++;
-	  continue;
-	}
+  update_variable_objects_mi_callback (gdb_debugger, record, NULL);
 
-      expression_val = gdbmi_value_hash_lookup (child_val, "exp");
-      expression_str = gdbmi_value_literal_get (expression_val);
+  self = GSWAT_GDB_VARIABLE_OBJECT (
+	    g_async_result_get_source_object (G_ASYNC_RESULT (result)));
 
-      /* complex types wont have a value */
-      value_val = gdbmi_value_hash_lookup (child_val, "value");
-      child_value_str=NULL;
-      if (value_val)
-	{
-	  child_value_str = gdbmi_value_literal_get (value_val);
-	  child_count = 0;
-	}
-      else
-	{
-	  child_count = -1;
-	}
+  /* Every registered object is brought up to date by the change
+   * list, so anything else would only loop */
+  if (self->priv->gdb_interrupt_count
+      < gswat_gdb_debugger_get_interrupt_count (gdb_debugger))
+    {
+      fail_async_request (result, _("Failed to update the variable object"));
+    }
+  else
+    {
+      continue_async_request (self, result);
+    }
+  g_object_unref (self);
+}
 
-      numchild_val = gdbmi_value_hash_lookup (child_val, "numchild");
-      numchild_str = NULL;
-      if (numchild_val)
-	{
-	  numchild_str = gdbmi_value_literal_get (numchild_val);
-	  child_count =  (gint)strtoul (numchild_str, NULL, 10);
-	}
+/* The asynchronous counterpart to validate_variable_object. If the
+ * object's state is out of date then a -var-update is sent and the
+ * request is continued once it's done. Returns FALSE if the caller
+ * should stop here. */
+static gboolean
+validate_variable_object_async (GSwatGdbVariableObject *self,
+				GSimpleAsyncResult *result,
+				GCancellable *cancellable)
+{
+  GSwatGdbMIFuture *future;
+  guint interrupt_count;
 
+  if (cancellable && g_cancellable_is_cancelled (cancellable))
+    {
+      g_simple_async_result_set_error (result,
+				       G_IO_ERROR,
+				       G_IO_ERROR_CANCELLED,
+				       "%s",
+				       _("Operation was cancelled"));
+      g_simple_async_result_complete_in_idle (result);
+      g_object_unref (result);
+      return FALSE;
+    }
 
-      /* Note this function also adds the wrapped child to
-       * the parents list of children */
-      variable_object =
-	wrap_child_gdb_variable_object (self->priv->debugger,
-					self, /* parent */
-					name_str,
-					expression_str,
-					child_value_str,
-					self->priv->frame,
-					child_count);
+  if (!self->priv->valid)
+    {
+      fail_async_request (result, _("The variable object is no longer valid"));
+      return FALSE;
+    }
 
-      n++;
+  interrupt_count
+    = gswat_gdb_debugger_get_interrupt_count (self->priv->debugger);
+  if (self->priv->gdb_interrupt_count < interrupt_count)
+    {
+      future =
+	gswat_gdb_debugger_send_mi_command_future_full (self->priv->debugger,
+							"-var-update --simple-values *",
+							GSWAT_GDB_COMMAND_PRIORITY_PREFETCH);
+      gswat_gdb_mi_future_then (future,
+				async_request_update_all_mi_callback,
+				result);
+      gswat_gdb_mi_future_unref (future);
+      return FALSE;
     }
 
-  self->priv->children_consistent = TRUE;
+  return TRUE;
+}
 
-  gswat_gdb_debugger_free_mi_record (result);
+static void
+async_get_value_evaluate_mi_callback (GSwatGdbDebugger *gdb_debugger,
+				      const GSwatGdbMIRecord *record,
+				      void *data)
+{
+  GSimpleAsyncResult *result = data;
+  GSwatGdbVariableObject *self;
+  const GDBMIValue *value = NULL;
 
-  return g_list_copy (self->priv->children);
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_DONE && record->val)
+    {
+      value = gdbmi_value_hash_lookup_atom (record->val, GDBMI_ATOM_VALUE);
+    }
+  if (!value)
+    {
+      fail_async_request (result,
+			  _("Failed to retrieve the variable object's "
+			    "expression value"));
+      return;
+    }
+
+  self = GSWAT_GDB_VARIABLE_OBJECT (
+	    g_async_result_get_source_object (G_ASYNC_RESULT (result)));
+  g_free (self->priv->cached_value);
+  self->priv->cached_value =
+    gdbmi_literal_dup_utf8 (gdbmi_value_literal_get (value), -1);
+  continue_async_request (self, result);
+  g_object_unref (self);
+}
+
+static void
+continue_get_value_async (GSwatGdbVariableObject *self,
+			  GSimpleAsyncResult *result,
+			  GCancellable *cancellable)
+{
+  GSwatGdbMIFuture *future;
+  gchar *command;
+
+  if (!validate_variable_object_async (self, result, cancellable))
+    {
+      return;
+    }
+
+  if (!self->priv->cached_value)
+    {
+      command = g_strdup_printf ("-var-evaluate-expression %s",
+				 self->priv->gdb_name);
+      future =
+	gswat_gdb_debugger_send_mi_command_future_full (self->priv->debugger,
+							command,
+							GSWAT_GDB_COMMAND_PRIORITY_PREFETCH);
+      g_free (command);
+      gswat_gdb_mi_future_then (future,
+				async_get_value_evaluate_mi_callback,
+				result);
+      gswat_gdb_mi_future_unref (future);
+      return;
+    }
+
+  g_simple_async_result_set_op_res_gpointer (result,
+					     g_strdup (self->priv->cached_value),
+					     g_free);
+  g_simple_async_result_complete_in_idle (result);
+  g_object_unref (result);
+}
+
+static void
+async_get_children_list_mi_callback (GSwatGdbDebugger *gdb_debugger,
+				     const GSwatGdbMIRecord *record,
+				     void *data)
+{
+  GSimpleAsyncResult *result = data;
+  GSwatGdbVariableObject *self;
+
+  if (!gdb_debugger || record->type != GSWAT_GDB_MI_REC_TYPE_RESULT_DONE)
+    {
+      fail_async_request (result, _("Failed to list the variable object's "
+				    "children"));
+      return;
+    }
+
+  self = GSWAT_GDB_VARIABLE_OBJECT (
+	    g_async_result_get_source_object (G_ASYNC_RESULT (result)));
+  update_children_from_record (self, record->text);
+
+  /* Completed here rather than by continuing, since an object
+   * without any children would otherwise be listed again */
+  g_simple_async_result_set_op_res_gpointer (result,
+					     copy_object_list (self->priv->children),
+					     (GDestroyNotify)free_object_list);
+  g_simple_async_result_complete_in_idle (result);
+  g_object_unref (result);
+  g_object_unref (self);
+}
+
+static void
+continue_get_children_async (GSwatGdbVariableObject *self,
+			     GSimpleAsyncResult *result,
+			     GCancellable *cancellable)
+{
+  GSwatGdbMIFuture *future;
+  gchar *command;
+
+  if (!validate_variable_object_async (self, result, cancellable))
+    {
+      return;
+    }
+
+  if (self->priv->children && self->priv->children_consistent)
+    {
+      g_simple_async_result_set_op_res_gpointer (result,
+						 copy_object_list (self->priv->children),
+						 (GDestroyNotify)free_object_list);
+      g_simple_async_result_complete_in_idle (result);
+      g_object_unref (result);
+      return;
+    }
+
+  command = g_strdup_printf ("-var-list-children --simple-values %s",
+			     self->priv->gdb_name);
+  future =
+    gswat_gdb_debugger_send_mi_command_future_full (self->priv->debugger,
+						    command,
+						    GSWAT_GDB_COMMAND_PRIORITY_PREFETCH);
+  g_free (command);
+  gswat_gdb_mi_future_then (future,
+			    async_get_children_list_mi_callback,
+			    result);
+  gswat_gdb_mi_future_unref (future);
+}
+
+static void
+continue_async_request (GSwatGdbVariableObject *self,
+			GSimpleAsyncResult *result)
+{
+  GCancellable *cancellable;
+
+  cancellable = g_object_get_data (G_OBJECT (result), "cancellable");
+
+  if (g_simple_async_result_get_source_tag (result)
+      == gswat_gdb_variable_object_get_value_async)
+    {
+      continue_get_value_async (self, result, cancellable);
+    }
+  else
+    {
+      continue_get_children_async (self, result, cancellable);
+    }
+}
+
+static GSimpleAsyncResult *
+new_async_request (GSwatGdbVariableObject *self,
+		   GCancellable *cancellable,
+		   GAsyncReadyCallback callback,
+		   gpointer user_data,
+		   gpointer source_tag)
+{
+  GSimpleAsyncResult *result;
+
+  result = g_simple_async_result_new (G_OBJECT (self),
+				      callback,
+				      user_data,
+				      source_tag);
+  if (cancellable)
+    {
+      g_object_set_data_full (G_OBJECT (result),
+			      "cancellable",
+			      g_object_ref (cancellable),
+			      g_object_unref);
+    }
+
+  return result;
+}
+
+static void
+gswat_gdb_variable_object_get_value_async (GSwatVariableObject *object,
+					   GCancellable *cancellable,
+					   GAsyncReadyCallback callback,
+					   gpointer user_data)
+{
+  GSwatGdbVariableObject *self;
+  GSimpleAsyncResult *result;
+
+  g_return_if_fail (GSWAT_IS_GDB_VARIABLE_OBJECT (object));
+  self = GSWAT_GDB_VARIABLE_OBJECT (object);
+
+  result = new_async_request (self,
+			      cancellable,
+			      callback,
+			      user_data,
+			      gswat_gdb_variable_object_get_value_async);
+  continue_get_value_async (self, result, cancellable);
+}
+
+static gchar *
+gswat_gdb_variable_object_get_value_finish (GSwatVariableObject *object,
+					    GAsyncResult *result,
+					    GError **error)
+{
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (simple)
+			== gswat_gdb_variable_object_get_value_async,
+			NULL);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    {
+      return NULL;
+    }
+
+  return g_strdup (g_simple_async_result_get_op_res_gpointer (simple));
+}
+
+static void
+gswat_gdb_variable_object_get_children_async (GSwatVariableObject *object,
+					      GCancellable *cancellable,
+					      GAsyncReadyCallback callback,
+					      gpointer user_data)
+{
+  GSwatGdbVariableObject *self;
+  GSimpleAsyncResult *result;
+
+  g_return_if_fail (GSWAT_IS_GDB_VARIABLE_OBJECT (object));
+  self = GSWAT_GDB_VARIABLE_OBJECT (object);
+
+  result = new_async_request (self,
+			      cancellable,
+			      callback,
+			      user_data,
+			      gswat_gdb_variable_object_get_children_async);
+  continue_get_children_async (self, result, cancellable);
+}
+
+static GList *
+gswat_gdb_variable_object_get_children_finish (GSwatVariableObject *object,
+					       GAsyncResult *result,
+					       GError **error)
+{
+  GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (result);
+
+  g_return_val_if_fail (g_simple_async_result_get_source_tag (simple)
+			== gswat_gdb_variable_object_get_children_async,
+			NULL);
+
+  if (g_simple_async_result_propagate_error (simple, error))
+    {
+      return NULL;
+    }
+
+  return copy_object_list (g_simple_async_result_get_op_res_gpointer (simple));
 }
 
 void
 gswat_gdb_variable_object_async_update_all (GSwatGdbDebugger *self)
 {
-  gswat_gdb_debugger_send_mi_command (self,
-				      "-var-update --simple-values *",
-				      update_variable_objects_mi_callback,
-				      NULL);
+  gswat_gdb_mi_future_unref (gswat_gdb_variable_object_send_update_all (self));
+}
+
+static void
+update_all_future_mi_callback (GSwatGdbDebugger *gdb_debugger,
+			       const GSwatGdbMIRecord *record,
+			       void *data)
+{
+  /* The debugger may have gone by the time the future completes */
+  if (gdb_debugger)
+    update_variable_objects_mi_callback (gdb_debugger, record, data);
+}
+
+/* Brings all the variable objects up to date without waiting on
+ * gdb. They have been updated by the time any callbacks added to the
+ * returned future run. */
+GSwatGdbMIFuture *
+gswat_gdb_variable_object_send_update_all (GSwatGdbDebugger *self)
+{
+  GSwatGdbMIFuture *future;
+
+  future =
+    gswat_gdb_debugger_send_mi_command_future_full (self,
+						    "-var-update --simple-values *",
+						    GSWAT_GDB_COMMAND_PRIORITY_REFRESH);
+  gswat_gdb_mi_future_then (future, update_all_future_mi_callback, NULL);
+
+  return future;
+}
+
+/* Whether the object has been brought up to date since the debugger
+ * last stopped or changed frame */
+gboolean
+gswat_gdb_variable_object_is_current (GSwatGdbVariableObject *self)
+{
+  g_return_val_if_fail (GSWAT_IS_GDB_VARIABLE_OBJECT (self), FALSE);
+
+  return self->priv->gdb_interrupt_count
+    == gswat_gdb_debugger_get_interrupt_count (self->priv->debugger);
 }
 
 static void
@@ -954,6 +1517,11 @@ update_variable_objects_mi_callback (GSwatGdbDebugger *gdb_debugger,
 				     const GSwatGdbMIRecord *record,
 				     void *data)
 {
+  if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_CANCELLED)
+    {
+      return;
+    }
+
   if (record->type == GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR)
     {
       g_warning ("update_variable_objects_mi_callback: error updating var "
@@ -978,33 +1546,33 @@ handle_changelist (GSwatGdbDebugger *gdb_debugger,
 		   const GSwatGdbMIRecord *record)
 {
   GList *all_variables, *all_variables_copy;
-  int i, changed_count;
+  GList *changes, *l;
   GList *tmp;
-  const GDBMIValue *val;
-  const GDBMIValue *changelist_val;
 
   all_variables = g_object_get_data (G_OBJECT (gdb_debugger),
 				     "all-gswat-gdb-variable-objects");
   all_variables_copy = g_list_copy (all_variables);
   g_list_foreach (all_variables_copy,  (GFunc)g_object_ref, NULL);
 
-  val = record->val;
-  changelist_val = gdbmi_value_hash_lookup (val, "changelist");
+  if (!gswat_gdb_mi_decode_changelist (record->text, &changes))
+    {
+      g_warning ("gswat_gdb_variable_object_handle_changelist: error "
+		 "decoding change list");
+    }
 
-  changed_count = gdbmi_value_get_size (changelist_val);
-  for (i=0; i<changed_count; i++)
+  for (l=changes; l!=NULL; l=l->next)
     {
-      const GDBMIValue *change_val;
-      const char *variable_gdb_name;
+      GSwatGdbMIVarobjChange *change = l->data;
+      const char *variable_gdb_name = change->name;
       GSwatGdbVariableObject *variable_object;
       gboolean found = FALSE;
       gboolean child_count_changed = FALSE;
       gboolean type_changed = FALSE;
 
-      change_val = gdbmi_value_list_get_nth (changelist_val, i);
-
-      val = gdbmi_value_hash_lookup (change_val, "name");
-      variable_gdb_name = gdbmi_value_literal_get (val);
+      if (!variable_gdb_name)
+	{
+	  continue;
+	}
 
       for (tmp=all_variables_copy; tmp!=NULL; tmp=tmp->next)
 	{
@@ -1030,8 +1598,7 @@ handle_changelist (GSwatGdbDebugger *gdb_debugger,
 	  continue;
 	}
 
-      val = gdbmi_value_hash_lookup (change_val, "in_scope");
-      if (strcmp (gdbmi_value_literal_get (val), "true") != 0)
+      if (!change->in_scope)
 	{
 	  delete_gdb_variable_object (variable_object);
 	  continue;
@@ -1046,8 +1613,7 @@ handle_changelist (GSwatGdbDebugger *gdb_debugger,
        *  (for our purposes that means just the children
        * have been deleted)
        */
-      val = gdbmi_value_hash_lookup (change_val, "new_type");
-      if (val)
+      if (change->new_type)
 	{
 	  if (variable_object->priv->children)
 	    {
@@ -1061,13 +1627,9 @@ handle_changelist (GSwatGdbDebugger *gdb_debugger,
 	  type_changed = TRUE;
 	}
 
-      val = gdbmi_value_hash_lookup (change_val, "new_num_children");
-      if (val)
+      if (change->new_child_count != -1)
 	{
-	  const gchar *child_count_str;
-	  child_count_str = gdbmi_value_literal_get (val);
-	  variable_object->priv->child_count =
-	    (gint)strtoul (child_count_str, NULL, 10);
+	  variable_object->priv->child_count = change->new_child_count;
 
 	  child_count_changed = TRUE;
 	}
@@ -1080,25 +1642,19 @@ handle_changelist (GSwatGdbDebugger *gdb_debugger,
 	    }
 	}
 
+      /* --simple-values leaves out the values of aggregates, which
+       * are evaluated when they are next asked for rather than
+       * waiting on gdb here, since this is reached from asynchronous
+       * updates */
       g_free (variable_object->priv->cached_value);
-      val = gdbmi_value_hash_lookup (change_val, "value");
-      if (val)
-	{
-	  const char *new_value;
-	  new_value = gdbmi_value_literal_get (val);
-	  variable_object->priv->cached_value=g_strdup (new_value);
-	}
-      else
-	{
-	  variable_object->priv->cached_value
-	    = evaluate_gdb_variable_object_expression (variable_object, NULL);
-	}
+      variable_object->priv->cached_value = g_strdup (change->value);
 
       /* #warning FIXME this workaround probably needs to be put
        * in more places */
       if (!GSWAT_GDB_DEBUGGER_CAN_INSPECT_NULL_VAROBJS)
 	{
-	  if (strcmp (variable_object->priv->cached_value, "0x0")==0)
+	  if (variable_object->priv->cached_value
+	      && strcmp (variable_object->priv->cached_value, "0x0")==0)
 	    {
 	      variable_object->priv->child_count = 0;
 	      child_count_changed = TRUE;
@@ -1121,6 +1677,9 @@ handle_changelist (GSwatGdbDebugger *gdb_debugger,
 
     }
 
+  g_list_foreach (changes, (GFunc)gswat_gdb_mi_varobj_change_free, NULL);
+  g_list_free (changes);
+
   /* Mark all variable objects as up to date
    * and remove our temporary reference */
   for (tmp=all_variables_copy; tmp!=NULL; tmp=tmp->next)
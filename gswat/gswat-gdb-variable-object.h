@@ -62,14 +62,29 @@ GType gswat_gdb_variable_object_get_type (void);
 typedef struct _GSwatGdbDebugger              GSwatGdbDebugger;
 #endif
 
+#if !defined (GSWAT_GDB_MI_FUTURE_TYPEDEF)
+#define GSWAT_GDB_MI_FUTURE_TYPEDEF
+typedef struct _GSwatGdbMIFuture              GSwatGdbMIFuture;
+#endif
+
 GSwatGdbVariableObject *gswat_gdb_variable_object_new (GSwatGdbDebugger *debugger,
                                                       const gchar *expression,
                                                       const gchar *cached_value,
                                                       int frame);
+GList *gswat_gdb_variable_object_new_list (GSwatGdbDebugger *debugger,
+                                           GList *expressions,
+                                           int frame);
+GSwatGdbMIFuture *gswat_gdb_variable_object_send_create_list (GSwatGdbDebugger *debugger,
+                                                             GList *expressions,
+                                                             int frame,
+                                                             GList **objects);
+GList *gswat_gdb_variable_object_finish_create_list (GList *objects);
 char *gswat_gdb_variable_object_get_name (GSwatGdbVariableObject *self);
 
 /* These should probably only be used by gswat-gdb-debugger.c */
 void gswat_gdb_variable_object_async_update_all (GSwatGdbDebugger *self);
+GSwatGdbMIFuture *gswat_gdb_variable_object_send_update_all (GSwatGdbDebugger *self);
+gboolean gswat_gdb_variable_object_is_current (GSwatGdbVariableObject *self);
 void gswat_gdb_variable_object_cleanup (GSwatGdbDebugger *gdb_debugger);
 
 G_END_DECLS
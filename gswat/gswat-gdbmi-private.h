@@ -0,0 +1,50 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * GSwat
+ *
+ * An object oriented debugger abstraction library
+ *
+ * Copyright (C) 2006-2009 Robert Bragg <robert@sixbynine.org>
+ *
+ * GSwat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or  (at your option)
+ * any later version.
+ *
+ * GSwat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with GSwat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* GDB MI parser internals, not installed */
+
+#ifndef __GDBMI_PRIVATE_H__
+#define __GDBMI_PRIVATE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+	GDBMI_SCANNER_AUTO,
+	GDBMI_SCANNER_SCALAR,
+	GDBMI_SCANNER_SSE2,
+	GDBMI_SCANNER_AVX2
+} GDBMIScanner;
+
+/* Forces the parser to use a particular literal scanner, which lets
+ * the tests check them against each other. Returns FALSE if the
+ * scanner isn't available on this build or CPU. */
+gboolean _gdbmi_set_scanner (GDBMIScanner scanner);
+
+/* The number of heap allocations the parser has made so far, counting
+ * arena blocks and parser stack growth. Used by the benchmark. */
+guint _gdbmi_get_allocation_count (void);
+
+G_END_DECLS
+
+#endif
@@ -22,29 +22,158 @@
  */
 
 /* GDB MI parser */
+#include <config.h>
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+
+#if defined (__GNUC__) && defined (__SSE2__)
+#define GDBMI_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+#ifdef HAVE_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
 #include "gswat-gdbmi.h"
+#include "gswat-gdbmi-private.h"
 
 #define GDBMI_DUMP_INDENT_SIZE 4
 
+/* Values created by the parser are carved out of a per-record arena
+ * instead of being individually malloc'd. Blocks are only ever
+ * appended, and the whole arena is released in one go when the root
+ * value of the record is freed. */
+#define GDBMI_ARENA_ALIGN		(2 * sizeof (gpointer))
+#define GDBMI_ARENA_ALIGN_SIZE(S)	(((S) + GDBMI_ARENA_ALIGN - 1) \
+					 & ~(GDBMI_ARENA_ALIGN - 1))
+#define GDBMI_ARENA_MIN_BLOCK_SIZE	4096
+/* Every block has this much slack at its end so the vectorized
+ * scanners can safely read a full vector past the record's NUL */
+#define GDBMI_ARENA_SCAN_PADDING	32
+
+/* Number of elements the parser can collect before it has to spill
+ * its scratch stack onto the heap */
+#define GDBMI_PARSER_STACK_PREALLOC	64
+
+/* Indexed by GDBMIAtom - 1, and sorted so we can bsearch it */
+static const gchar *gdbmi_atom_names[GDBMI_ATOM_LAST - 1] =
+{
+	"addr",
+	"args",
+	"bkpt",
+	"bkptno",
+	"changelist",
+	"children",
+	"depth",
+	"disp",
+	"enabled",
+	"exit-code",
+	"exp",
+	"file",
+	"frame",
+	"fullname",
+	"func",
+	"has_more",
+	"in_scope",
+	"level",
+	"line",
+	"locals",
+	"msg",
+	"name",
+	"new_num_children",
+	"new_type",
+	"number",
+	"numchild",
+	"original-location",
+	"reason",
+	"signal-meaning",
+	"signal-name",
+	"stack",
+	"stack-args",
+	"thread-id",
+	"times",
+	"type",
+	"type_changed",
+	"value",
+};
+
+typedef struct _GDBMIArenaBlock GDBMIArenaBlock;
+typedef struct _GDBMIArena GDBMIArena;
+
+struct _GDBMIArenaBlock
+{
+	GDBMIArenaBlock *next;
+	gsize size;
+	gsize used;
+};
+
+struct _GDBMIArena
+{
+	GDBMIArenaBlock *blocks;
+	gsize next_block_size;
+	/* The value that owns the arena; freeing it frees everything */
+	GDBMIValue *root;
+};
+
 struct _GDBMIValue
 {
 	GDBMIDataType type;
+	/* The interned form of name, or GDBMI_ATOM_NONE */
+	GDBMIAtom atom;
+	/* NULL for values created with gdbmi_value_new(). Otherwise the
+	 * arena this value, its name and its literal data live in. */
+	GDBMIArena *arena;
 	gchar *name;
 	union {
-		GHashTable *hash;
-		GQueue *list;
-		GString *literal;
+		/* The elements of both tuples and lists are kept in wire
+		 * order in an array, so lists can be indexed directly. Tuples
+		 * are small, so rather than hashing we find their fields by
+		 * a linear scan. Each field value carries its own key as its
+		 * name. Duplicate keys are kept (output of -thread-list-ids) */
+		struct {
+			GDBMIValue **elements;
+			guint n_elements;
+			guint n_allocated;
+		} array;
+		gchar *literal;
 	} data;
+	/* For containers parsed with GDBMI_PARSE_LAZY that haven't been
+	 * accessed yet, the start of their (already validated) elements
+	 * in the record buffer. NULL once the elements have been built */
+	gchar *lazy;
 };
 
-struct _GDBMIForeachHashData
+/* Builds the elements of a lazily parsed container on first access */
+#define GDBMI_VALUE_ENSURE(V) \
+	G_STMT_START { \
+		if (G_UNLIKELY ((V)->lazy != NULL)) \
+			gdbmi_value_materialize ((GDBMIValue *)(V)); \
+	} G_STMT_END
+
+typedef const gchar *(*GDBMIScanFunc) (const gchar *p);
+
+typedef struct
 {
-	GFunc user_callback;
-	gpointer user_data;
-};
+	GDBMIArena *arena;
+	/* Cursor into the arena's private, writable, copy of the record.
+	 * Names and literals are terminated (and if needed unescaped) in
+	 * place so the resulting values can point straight into it. */
+	gchar *ptr;
+	GDBMIParseMode mode;
+	/* Finds the first '"', '\\' or NUL at or after p */
+	GDBMIScanFunc scan;
+
+	/* The elements of the tuples and lists currently being parsed
+	 * are collected on this stack so that each container ends up
+	 * with an exactly sized array once it is complete. */
+	GDBMIValue **stack;
+	guint stack_len;
+	guint stack_size;
+	GDBMIValue *stack_prealloc[GDBMI_PARSER_STACK_PREALLOC];
+} GDBMIParser;
 
 struct _GDBMIDumpState
 {
@@ -52,60 +181,264 @@ struct _GDBMIDumpState
         int indent_level;
 };
 
-static guint GDBMI_deleted_hash_value = 0;
+static GDBMIValue *gdbmi_parse_value (GDBMIParser *parser);
+static void gdbmi_value_materialize (GDBMIValue *val);
 
-void
-gdbmi_value_free (GDBMIValue *val)
+/* The literal scanner used for arena buffers. This is where the
+ * parser spends most of its time, so it is picked at runtime
+ * according to what the CPU supports. */
+static GDBMIScanFunc gdbmi_scan_literal = NULL;
+
+/* Heap allocations made while parsing, see _gdbmi_get_allocation_count() */
+static volatile gint gdbmi_n_allocations = 0;
+
+static int
+gdbmi_atom_compare (const void *key, const void *name)
 {
-	g_return_if_fail (val != NULL);
+	return strcmp (key, *(const gchar * const *)name);
+}
 
-	if (val->type == GDBMI_DATA_LITERAL)
+GDBMIAtom
+gdbmi_atom_from_string (const gchar *name)
+{
+	const gchar **match;
+
+	g_return_val_if_fail (name != NULL, GDBMI_ATOM_NONE);
+
+	match = bsearch (name, gdbmi_atom_names,
+					 G_N_ELEMENTS (gdbmi_atom_names),
+					 sizeof (gdbmi_atom_names[0]),
+					 gdbmi_atom_compare);
+	if (match == NULL)
+		return GDBMI_ATOM_NONE;
+
+	return match - gdbmi_atom_names + 1;
+}
+
+typedef struct
+{
+	const gchar *name;
+	gsize len;
+} GDBMIAtomKey;
+
+static int
+gdbmi_atom_compare_len (const void *key, const void *name)
+{
+	const GDBMIAtomKey *k = key;
+	const gchar *n = *(const gchar * const *)name;
+	int ret = strncmp (k->name, n, k->len);
+
+	if (ret == 0 && n[k->len] != '\0')
+		return -1;
+	return ret;
+}
+
+/* Like gdbmi_atom_from_string() but for a name that isn't terminated */
+static GDBMIAtom
+gdbmi_atom_from_string_len (const gchar *name, gsize len)
+{
+	GDBMIAtomKey key = { name, len };
+	const gchar **match;
+
+	match = bsearch (&key, gdbmi_atom_names,
+					 G_N_ELEMENTS (gdbmi_atom_names),
+					 sizeof (gdbmi_atom_names[0]),
+					 gdbmi_atom_compare_len);
+	if (match == NULL)
+		return GDBMI_ATOM_NONE;
+
+	return match - gdbmi_atom_names + 1;
+}
+
+const gchar*
+gdbmi_atom_to_string (GDBMIAtom atom)
+{
+	g_return_val_if_fail (atom > GDBMI_ATOM_NONE
+						  && atom < GDBMI_ATOM_LAST, NULL);
+
+	return gdbmi_atom_names[atom - 1];
+}
+
+static GDBMIArenaBlock *
+gdbmi_arena_block_new (gsize size)
+{
+	GDBMIArenaBlock *block;
+
+	block = g_malloc (GDBMI_ARENA_ALIGN_SIZE (sizeof (GDBMIArenaBlock))
+					  + size + GDBMI_ARENA_SCAN_PADDING);
+	g_atomic_int_inc (&gdbmi_n_allocations);
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+
+	return block;
+}
+
+static gpointer
+gdbmi_arena_alloc (GDBMIArena *arena, gsize size)
+{
+	GDBMIArenaBlock *block = arena->blocks;
+	gchar *mem;
+
+	size = GDBMI_ARENA_ALIGN_SIZE (size);
+	if (block->size - block->used < size)
 	{
-		g_string_free (val->data.literal, TRUE);
+		gsize block_size = MAX (arena->next_block_size, size);
+
+		block = gdbmi_arena_block_new (block_size);
+		block->next = arena->blocks;
+		arena->blocks = block;
+		arena->next_block_size = block_size * 2;
 	}
-	else if (val->type == GDBMI_DATA_LIST)
+
+	mem = (gchar *)block + GDBMI_ARENA_ALIGN_SIZE (sizeof (GDBMIArenaBlock));
+	mem += block->used;
+	block->used += size;
+
+	return mem;
+}
+
+/* size_hint should be enough to hold the record text along with a
+ * reasonable estimate of the values it will be split into, so that
+ * typical records fit into a single block. */
+static GDBMIArena *
+gdbmi_arena_new (gsize size_hint)
+{
+	GDBMIArenaBlock *block;
+	GDBMIArena *arena;
+	gsize size;
+
+	size = GDBMI_ARENA_ALIGN_SIZE (sizeof (GDBMIArena)) + size_hint;
+	size = MAX (size, GDBMI_ARENA_MIN_BLOCK_SIZE);
+	block = gdbmi_arena_block_new (size);
+
+	/* The arena bookkeeping lives at the start of its own first block */
+	arena = (GDBMIArena *)((gchar *)block
+			       + GDBMI_ARENA_ALIGN_SIZE (sizeof (GDBMIArenaBlock)));
+	block->used = GDBMI_ARENA_ALIGN_SIZE (sizeof (GDBMIArena));
+	arena->blocks = block;
+	arena->next_block_size = size;
+	arena->root = NULL;
+
+	return arena;
+}
+
+static void
+gdbmi_arena_free (GDBMIArena *arena)
+{
+	GDBMIArenaBlock *block, *next;
+
+	/* Note the arena itself lives in the last block of the chain */
+	for (block = arena->blocks; block; block = next)
 	{
-		gdbmi_value_foreach (val, (GFunc)gdbmi_value_free, NULL);
-		g_queue_free (val->data.list);
+		next = block->next;
+		g_free (block);
 	}
+}
+
+static gchar *
+gdbmi_arena_strdup (GDBMIArena *arena, const gchar *str)
+{
+	gsize len = strlen (str);
+	gchar *copy = gdbmi_arena_alloc (arena, len + 1);
+
+	memcpy (copy, str, len + 1);
+	return copy;
+}
+
+/* Duplicates str into whatever storage val lives in */
+static gchar *
+gdbmi_value_strdup (GDBMIValue *val, const gchar *str)
+{
+	if (val->arena)
+		return gdbmi_arena_strdup (val->arena, str);
 	else
-	{
-		g_hash_table_destroy (val->data.hash);
-	}
-	g_free (val->name);
-	g_free (val);
+		return g_strdup (str);
 }
 
-GDBMIValue *
-gdbmi_value_new (GDBMIDataType data_type, const gchar *name)
+static GDBMIValue *
+gdbmi_value_new_real (GDBMIArena *arena, GDBMIDataType data_type)
 {
-	GDBMIValue *val = g_new0 (GDBMIValue, 1);
+	GDBMIValue *val;
+
+	if (arena)
+	{
+		val = gdbmi_arena_alloc (arena, sizeof (GDBMIValue));
+		memset (val, 0, sizeof (GDBMIValue));
+		val->arena = arena;
+	}
+	else
+		val = g_new0 (GDBMIValue, 1);
 
 	val->type = data_type;
-	if (name)
-		val->name = g_strdup (name);
 
 	switch (data_type)
 	{
 		case GDBMI_DATA_HASH:
-			val->data.hash =
-				g_hash_table_new_full (g_str_hash, g_str_equal,
-									   (GDestroyNotify)g_free,
-									   (GDestroyNotify)gdbmi_value_free);
-			break;
 		case GDBMI_DATA_LIST:
-			val->data.list = g_queue_new ();
+			val->data.array.elements = NULL;
+			val->data.array.n_elements = 0;
+			val->data.array.n_allocated = 0;
 			break;
 		case GDBMI_DATA_LITERAL:
-			val->data.literal = g_string_new (NULL);
+			val->data.literal = NULL;
 			break;
 		default:
 			g_warning ("Unknow MI data type. Should not reach here");
+			if (!arena)
+				g_free (val);
 			return NULL;
 	}
 	return val;
 }
 
+void
+gdbmi_value_free (GDBMIValue *val)
+{
+	g_return_if_fail (val != NULL);
+
+	if (val->arena)
+	{
+		GDBMIArena *arena = val->arena;
+
+		/* The values of a parsed record can only be freed as a
+		 * whole, via the root value. Everything they reference
+		 * lives in the arena too. */
+		g_return_if_fail (arena->root == val);
+
+		gdbmi_arena_free (arena);
+		return;
+	}
+
+	if (val->type == GDBMI_DATA_LITERAL)
+	{
+		g_free (val->data.literal);
+	}
+	else
+	{
+		gdbmi_value_foreach (val, (GFunc)gdbmi_value_free, NULL);
+		g_free (val->data.array.elements);
+	}
+	g_free (val->name);
+	g_free (val);
+}
+
+GDBMIValue *
+gdbmi_value_new (GDBMIDataType data_type, const gchar *name)
+{
+	GDBMIValue *val = gdbmi_value_new_real (NULL, data_type);
+
+	if (val == NULL)
+		return NULL;
+
+	if (name)
+		gdbmi_value_set_name (val, name);
+	if (data_type == GDBMI_DATA_LITERAL)
+		val->data.literal = g_strdup ("");
+
+	return val;
+}
+
 GDBMIValue*
 gdbmi_value_literal_new (const gchar *name, const gchar *data)
 {
@@ -122,6 +455,13 @@ gdbmi_value_get_name (const GDBMIValue *val)
 	return val->name;
 }
 
+GDBMIAtom
+gdbmi_value_get_atom (const GDBMIValue *val)
+{
+	g_return_val_if_fail (val != NULL, GDBMI_ATOM_NONE);
+	return val->atom;
+}
+
 GDBMIDataType
 gdbmi_value_get_type (const GDBMIValue *val)
 {
@@ -133,8 +473,10 @@ gdbmi_value_set_name (GDBMIValue *val, const gchar *name)
 {
 	g_return_if_fail (val != NULL);
 	g_return_if_fail (name != NULL);
-	g_free (val->name);
-	val->name = g_strdup (name);
+	if (!val->arena)
+		g_free (val->name);
+	val->name = gdbmi_value_strdup (val, name);
+	val->atom = gdbmi_atom_from_string (name);
 }
 
 gint
@@ -142,26 +484,16 @@ gdbmi_value_get_size (const GDBMIValue* val)
 {
 	g_return_val_if_fail (val != NULL, 0);
 
+	GDBMI_VALUE_ENSURE (val);
 	if (val->type == GDBMI_DATA_LITERAL)
 	{
-		if (val->data.literal->str)
+		if (val->data.literal)
 			return 1;
 		else
 			return 0;
 	}
-	else if (val->type == GDBMI_DATA_LIST)
-		return g_queue_get_length (val->data.list);
-	else if (val->type == GDBMI_DATA_HASH)
-		return g_hash_table_size (val->data.hash);
 	else
-		return 0;
-}
-
-static void
-gdbmi_value_hash_foreach (const gchar *key, GDBMIValue* val,
-						  struct _GDBMIForeachHashData *hash_data)
-{
-	hash_data->user_callback (val, hash_data->user_data);
+		return val->data.array.n_elements;
 }
 
 void
@@ -170,18 +502,13 @@ gdbmi_value_foreach (const GDBMIValue* val, GFunc func, gpointer user_data)
 	g_return_if_fail (val != NULL);
 	g_return_if_fail (func != NULL);
 
-	if (val->type == GDBMI_DATA_LIST)
-	{
-		g_queue_foreach (val->data.list, func, user_data);
-	}
-	else if (val->type == GDBMI_DATA_HASH)
+	GDBMI_VALUE_ENSURE (val);
+	if (val->type == GDBMI_DATA_LIST || val->type == GDBMI_DATA_HASH)
 	{
-		struct _GDBMIForeachHashData hash_data = {NULL, NULL};
+		guint i;
 
-		hash_data.user_callback = func;
-		hash_data.user_data = user_data;
-		g_hash_table_foreach (val->data.hash, (GHFunc)gdbmi_value_hash_foreach,
-							  &hash_data);
+		for (i = 0; i < val->data.array.n_elements; i++)
+			func (val->data.array.elements[i], user_data);
 	}
 	else
 	{
@@ -195,7 +522,9 @@ gdbmi_value_literal_set (GDBMIValue* val, const gchar *data)
 {
 	g_return_if_fail (val != NULL);
 	g_return_if_fail (val->type == GDBMI_DATA_LITERAL);
-	g_string_assign (val->data.literal, data);
+	if (!val->arena)
+		g_free (val->data.literal);
+	val->data.literal = gdbmi_value_strdup (val, data);
 }
 
 const gchar*
@@ -203,46 +532,156 @@ gdbmi_value_literal_get (const GDBMIValue* val)
 {
 	g_return_val_if_fail (val != NULL, NULL);
 	g_return_val_if_fail (val->type == GDBMI_DATA_LITERAL, NULL);
-	return val->data.literal->str;
+	return val->data.literal;
+}
+
+static gboolean
+gdbmi_is_ascii (const gchar *str, gsize len)
+{
+	const gchar *end = str + len;
+	guint64 word;
+
+	for (; end - str >= 8; str += 8)
+	{
+		memcpy (&word, str, 8);
+		if (word & G_GUINT64_CONSTANT (0x8080808080808080))
+			return FALSE;
+	}
+	for (; str < end; str++)
+		if (*str & 0x80)
+			return FALSE;
+
+	return TRUE;
+}
+
+/* Literals hold whatever bytes gdb sent, and octal escapes can put any
+ * byte in them, so they aren't necessarily valid UTF-8. This returns
+ * a copy of the literal that is, with each byte that isn't part of a
+ * valid sequence written out as an octal escape the way gdb would.
+ * Nearly every literal is plain ASCII, which is checked for a word at
+ * a time first, so the check is only paid for in full by literals
+ * that are passed on and aren't ASCII. */
+gchar*
+gdbmi_literal_dup_utf8 (const gchar *literal, gssize len)
+{
+	const gchar *p = literal;
+	const gchar *invalid;
+	GString *out;
+
+	g_return_val_if_fail (literal != NULL, NULL);
+
+	if (len < 0)
+		len = strlen (literal);
+
+	if (gdbmi_is_ascii (literal, len)
+		|| g_utf8_validate (literal, len, NULL))
+		return g_strndup (literal, len);
+
+	out = g_string_sized_new (len + 16);
+	while (!g_utf8_validate (p, len, &invalid))
+	{
+		g_string_append_len (out, p, invalid - p);
+		g_string_append_printf (out, "\\%03o", (guchar)*invalid);
+		len -= invalid - p + 1;
+		p = invalid + 1;
+	}
+	g_string_append_len (out, p, len);
+
+	return g_string_free (out, FALSE);
+}
+
+static void
+gdbmi_value_array_append (GDBMIValue *val, GDBMIValue *value)
+{
+	if (val->data.array.n_elements == val->data.array.n_allocated)
+	{
+		guint n_allocated = MAX (val->data.array.n_allocated * 2, 4);
+
+		if (val->arena)
+		{
+			GDBMIValue **elements;
+
+			/* The old array is simply left behind in the arena */
+			elements = gdbmi_arena_alloc (val->arena,
+										  n_allocated * sizeof (GDBMIValue *));
+			if (val->data.array.n_elements)
+				memcpy (elements, val->data.array.elements,
+						val->data.array.n_elements * sizeof (GDBMIValue *));
+			val->data.array.elements = elements;
+		}
+		else
+			val->data.array.elements = g_renew (GDBMIValue *,
+												val->data.array.elements,
+												n_allocated);
+		val->data.array.n_allocated = n_allocated;
+	}
+
+	val->data.array.elements[val->data.array.n_elements++] = value;
 }
 
 /* Hash operations */
 void
 gdbmi_value_hash_insert (GDBMIValue* val, const gchar *key, GDBMIValue *value)
 {
-	gpointer orig_key;
-	gpointer orig_value;
-
 	g_return_if_fail (val != NULL);
 	g_return_if_fail (key != NULL);
 	g_return_if_fail (value != NULL);
 	g_return_if_fail (val->type == GDBMI_DATA_HASH);
+	g_return_if_fail (value->arena == val->arena);
 
-	/* GDBMI hash table could contains several data with the same
-	 * key (output of -thread-list-ids)
-	 * Keep old value under a random name, we get them using
-	 * foreach function */
-	if (g_hash_table_lookup_extended (val->data.hash, key, &orig_key, &orig_value))
-	{
-		/* Key already exist, remove it and insert value with
-		 * another name */
-		g_hash_table_steal (val->data.hash, key);
-		g_free (orig_key);
-		gchar *new_key = g_strdup_printf("[%d]", GDBMI_deleted_hash_value++);
-		g_hash_table_insert (val->data.hash, new_key, orig_value);
+	GDBMI_VALUE_ENSURE (val);
 
-	}
-	g_hash_table_insert (val->data.hash, g_strdup (key), value);
+	/* The field is found by its name, so it takes the key as its name */
+	if (value->name == NULL || strcmp (value->name, key) != 0)
+		gdbmi_value_set_name (value, key);
+
+	/* GDBMI hash could contain several values with the same key
+	 * (output of -thread-list-ids). They are all kept, in order, and
+	 * can be reached using the foreach function */
+	gdbmi_value_array_append (val, value);
 }
 
 const GDBMIValue*
 gdbmi_value_hash_lookup (const GDBMIValue* val, const gchar *key)
 {
+	guint i;
+
 	g_return_val_if_fail (val != NULL, NULL);
 	g_return_val_if_fail (key != NULL, NULL);
 	g_return_val_if_fail (val->type == GDBMI_DATA_HASH, NULL);
 
-	return g_hash_table_lookup (val->data.hash, key);
+	GDBMI_VALUE_ENSURE (val);
+
+	/* If a key is duplicated the last value inserted wins */
+	for (i = val->data.array.n_elements; i > 0; i--)
+	{
+		GDBMIValue *field = val->data.array.elements[i - 1];
+
+		if (strcmp (field->name, key) == 0)
+			return field;
+	}
+	return NULL;
+}
+
+const GDBMIValue*
+gdbmi_value_hash_lookup_atom (const GDBMIValue* val, GDBMIAtom atom)
+{
+	guint i;
+
+	g_return_val_if_fail (val != NULL, NULL);
+	g_return_val_if_fail (atom > GDBMI_ATOM_NONE
+						  && atom < GDBMI_ATOM_LAST, NULL);
+	g_return_val_if_fail (val->type == GDBMI_DATA_HASH, NULL);
+
+	GDBMI_VALUE_ENSURE (val);
+	for (i = val->data.array.n_elements; i > 0; i--)
+	{
+		GDBMIValue *field = val->data.array.elements[i - 1];
+
+		if (field->atom == atom)
+			return field;
+	}
+	return NULL;
 }
 
 /* List operations */
@@ -252,8 +691,10 @@ gdbmi_value_list_append (GDBMIValue* val, GDBMIValue *value)
 	g_return_if_fail (val != NULL);
 	g_return_if_fail (value != NULL);
 	g_return_if_fail (val->type == GDBMI_DATA_LIST);
+	g_return_if_fail (value->arena == val->arena);
 
-	g_queue_push_tail (val->data.list, value);
+	GDBMI_VALUE_ENSURE (val);
+	gdbmi_value_array_append (val, value);
 }
 
 const GDBMIValue*
@@ -262,10 +703,42 @@ gdbmi_value_list_get_nth (const GDBMIValue* val, gint idx)
 	g_return_val_if_fail (val != NULL, NULL);
 	g_return_val_if_fail (val->type == GDBMI_DATA_LIST, NULL);
 
-	if (idx >= 0)
-		return g_queue_peek_nth (val->data.list, idx);
-	else
-		return g_queue_peek_tail (val->data.list);
+	GDBMI_VALUE_ENSURE (val);
+	if (val->data.array.n_elements == 0)
+		return NULL;
+	if (idx < 0)
+		return val->data.array.elements[val->data.array.n_elements - 1];
+	if ((guint)idx >= val->data.array.n_elements)
+		return NULL;
+	return val->data.array.elements[idx];
+}
+
+/* Iterates over the elements of a tuple or list in order, which unlike
+ * gdbmi_value_foreach() lets the caller stop early. The container must
+ * not be modified while it is being iterated. */
+void
+gdbmi_value_iter_init (GDBMIIter *iter, const GDBMIValue *val)
+{
+	g_return_if_fail (iter != NULL);
+
+	iter->element = iter->end = NULL;
+
+	g_return_if_fail (val != NULL);
+	g_return_if_fail (val->type != GDBMI_DATA_LITERAL);
+
+	GDBMI_VALUE_ENSURE (val);
+	iter->element = val->data.array.elements;
+	iter->end = val->data.array.elements + val->data.array.n_elements;
+}
+
+const GDBMIValue*
+gdbmi_value_iter_next (GDBMIIter *iter)
+{
+	g_return_val_if_fail (iter != NULL, NULL);
+
+	if (iter->element == iter->end)
+		return NULL;
+	return *iter->element++;
 }
 
 static void
@@ -293,7 +766,7 @@ gdbmi_value_dump (GString *string, const GDBMIValue *val, gint indent_level)
 	{
 		gchar *v;
 
-		v = g_strescape (val->data.literal->str, NULL);
+		v = g_strescape (val->data.literal, NULL);
 		if (val->name)
 			g_string_append_printf (string, "%s = \"%s\",\n",
 						val->name, v);
@@ -327,191 +800,589 @@ gdbmi_value_dump (GString *string, const GDBMIValue *val, gint indent_level)
 	}
 }
 
-static GDBMIValue*
-gdbmi_value_parse_real (gchar **ptr)
+static const gchar *
+gdbmi_scan_literal_scalar (const gchar *p)
 {
-	GDBMIValue *val = NULL;
+	while (*p != '"' && *p != '\\' && *p != '\0')
+		p++;
+	return p;
+}
+
+/* Never reads past the NUL, so unlike the scanners below this is safe
+ * on any string, which is what the GDBMIReader works on */
+static const gchar *
+gdbmi_scan_literal_cspn (const gchar *p)
+{
+	return p + strcspn (p, "\"\\");
+}
+
+/* The vectorized scanners may read up to a vector's worth of bytes
+ * past the terminating NUL, which is why they must only be used on
+ * buffers allocated from an arena. */
+#ifdef GDBMI_HAVE_SSE2
+static const gchar *
+gdbmi_scan_literal_sse2 (const gchar *p)
+{
+	const __m128i quote = _mm_set1_epi8 ('"');
+	const __m128i backslash = _mm_set1_epi8 ('\\');
+	const __m128i nul = _mm_setzero_si128 ();
 
-	if (**ptr == '\0')
+	for (;; p += 16)
 	{
-		/* End of stream */
-		g_warning ("Parse error: Reached end of stream");
+		__m128i chunk = _mm_loadu_si128 ((const __m128i *)p);
+		__m128i match;
+		guint mask;
+
+		match = _mm_or_si128 (_mm_cmpeq_epi8 (chunk, quote),
+							  _mm_cmpeq_epi8 (chunk, backslash));
+		match = _mm_or_si128 (match, _mm_cmpeq_epi8 (chunk, nul));
+		mask = _mm_movemask_epi8 (match);
+		if (mask)
+			return p + __builtin_ctz (mask);
 	}
-	else if (**ptr == '"')
+}
+#endif
+
+#ifdef HAVE_AVX2_DISPATCH
+__attribute__ ((target ("avx2")))
+static const gchar *
+gdbmi_scan_literal_avx2 (const gchar *p)
+{
+	const __m256i quote = _mm256_set1_epi8 ('"');
+	const __m256i backslash = _mm256_set1_epi8 ('\\');
+	const __m256i nul = _mm256_setzero_si256 ();
+
+	for (;; p += 32)
 	{
-		/* Value is literal */
-		gboolean escaped;
-		GString *buff;
-		gchar *p;
-		gchar *value, *compressed_value;
-		gint i;
-
-		*ptr = g_utf8_next_char (*ptr);
-		escaped = FALSE;
-		buff = g_string_new ("");
-		while (escaped || **ptr != '"')
-		{
-			if (**ptr == '\0')
-			{
-				g_warning ("Parse error: Invalid literal value");
-				return NULL;
-			}
-			if (escaped)
-			{
-				escaped = FALSE;
-			}
-			else if (**ptr == '\\')
-			{
-				escaped = TRUE;
-			}
-			p = g_utf8_next_char (*ptr);
-			for (i = 0; i < (p - *ptr); i++)
-				g_string_append_c (buff, *(*ptr + i));
-			*ptr = p;
-		}
-		/* Get pass the closing quote */
-		*ptr = g_utf8_next_char (*ptr);
+		__m256i chunk = _mm256_loadu_si256 ((const __m256i *)p);
+		__m256i match;
+		guint mask;
 
-		value = g_string_free (buff, FALSE);
-		compressed_value = g_strcompress (value);
-		val = gdbmi_value_literal_new (NULL, compressed_value);
-		g_free (value);
-		g_free (compressed_value);
+		match = _mm256_or_si256 (_mm256_cmpeq_epi8 (chunk, quote),
+								 _mm256_cmpeq_epi8 (chunk, backslash));
+		match = _mm256_or_si256 (match, _mm256_cmpeq_epi8 (chunk, nul));
+		mask = _mm256_movemask_epi8 (match);
+		if (mask)
+			return p + __builtin_ctz (mask);
 	}
-	else if (isalpha (**ptr))
+}
+#endif
+
+static GDBMIScanFunc
+gdbmi_scanner_lookup (GDBMIScanner scanner)
+{
+	switch (scanner)
 	{
-		/* Value is assignment */
-		gchar *name;
-		gchar *p;
+		case GDBMI_SCANNER_AUTO:
+#ifdef HAVE_AVX2_DISPATCH
+			if (__builtin_cpu_supports ("avx2"))
+				return gdbmi_scan_literal_avx2;
+#endif
+#ifdef GDBMI_HAVE_SSE2
+			return gdbmi_scan_literal_sse2;
+#else
+			return gdbmi_scan_literal_scalar;
+#endif
+		case GDBMI_SCANNER_SCALAR:
+			return gdbmi_scan_literal_scalar;
+		case GDBMI_SCANNER_SSE2:
+#ifdef GDBMI_HAVE_SSE2
+			return gdbmi_scan_literal_sse2;
+#else
+			return NULL;
+#endif
+		case GDBMI_SCANNER_AVX2:
+#ifdef HAVE_AVX2_DISPATCH
+			if (__builtin_cpu_supports ("avx2"))
+				return gdbmi_scan_literal_avx2;
+#endif
+			return NULL;
+	}
+	return NULL;
+}
 
-		/* Get assignment name */
-		p = *ptr;
-		while (**ptr != '=')
-		{
-			if (**ptr == '\0')
-			{
-				g_warning ("Parse error: Invalid assignment name");
-				return NULL;
-			}
-			*ptr = g_utf8_next_char (*ptr);
-		}
-		name = g_strndup (p, *ptr - p);
+gboolean
+_gdbmi_set_scanner (GDBMIScanner scanner)
+{
+	GDBMIScanFunc func = gdbmi_scanner_lookup (scanner);
 
-		/* Skip pass assignment operator */
-		*ptr = g_utf8_next_char (*ptr);
+	if (func == NULL)
+		return FALSE;
 
-		/* Retrieve assignment value */
-		val = gdbmi_value_parse_real (ptr);
-		if (val)
+	gdbmi_scan_literal = func;
+	return TRUE;
+}
+
+guint
+_gdbmi_get_allocation_count (void)
+{
+	return g_atomic_int_get (&gdbmi_n_allocations);
+}
+
+/* Unescapes the remainder of a literal in place, starting from the
+ * first backslash. This handles the same escapes as g_strcompress().
+ * On success *end is set to the closing quote and the unescaped
+ * literal's terminator is returned. */
+static gchar *
+gdbmi_parse_unescape_literal (gchar *p, gchar **end, GDBMIScanFunc scan)
+{
+	gchar *q = p;
+
+	while (*p != '"')
+	{
+		if (*p == '\0')
+			return NULL;
+
+		if (*p != '\\')
 		{
-			gdbmi_value_set_name (val, name);
+			/* Move the whole run up to the next escape at once */
+			gchar *next = (gchar *)scan (p);
+
+			memmove (q, p, next - p);
+			q += next - p;
+			p = next;
+			continue;
 		}
-		else
+
+		p++;
+		switch (*p)
 		{
-			g_warning ("Parse error: From parent");
-		}
-		g_free (name);
-	}
-	else if (**ptr == '{')
-	{
-		/* Value is hash */
-		gboolean error = FALSE;
-
-		*ptr = g_utf8_next_char (*ptr);
-		val = gdbmi_value_new (GDBMI_DATA_HASH, NULL);
-		while (**ptr != '}')
-		{
-			GDBMIValue *element;
-			element = gdbmi_value_parse_real (ptr);
-			if (element == NULL)
+			case '\0':
+				return NULL;
+			case '0': case '1': case '2': case '3':
+			case '4': case '5': case '6': case '7':
 			{
-				g_warning ("Parse error: From parent");
-				error = TRUE;
-				break;
+				gchar *e = p + 3;
+
+				*q = 0;
+				while (p < e && *p >= '0' && *p <= '7')
+				{
+					*q = (*q * 8) + (*p - '0');
+					p++;
+				}
+				q++;
+				continue;
 			}
-			if (gdbmi_value_get_name == NULL)
-			{
-				g_warning ("Parse error: Hash element has no name => '%s'",
-						   *ptr);
-				error = TRUE;
-				gdbmi_value_free (element);
+			case 'b':
+				*q++ = '\b';
 				break;
-			}
-			if (**ptr != ',' && **ptr != '}')
-			{
-				g_warning ("Parse error: Invalid element separator => '%s'",
-						   *ptr);
-				error = TRUE;
-				gdbmi_value_free (element);
+			case 'f':
+				*q++ = '\f';
 				break;
-			}
-			gdbmi_value_hash_insert (val, gdbmi_value_get_name (element),
-									 element);
+			case 'n':
+				*q++ = '\n';
+				break;
+			case 'r':
+				*q++ = '\r';
+				break;
+			case 't':
+				*q++ = '\t';
+				break;
+			case 'v':
+				*q++ = '\v';
+				break;
+			default:
+				*q++ = *p;
+				break;
+		}
+		p++;
+	}
+
+	*end = p;
+	return q;
+}
+
+static GDBMIValue *
+gdbmi_parse_literal (GDBMIParser *parser)
+{
+	GDBMIValue *val;
+	gchar *start, *p;
+
+	/* Skip the opening quote */
+	start = p = parser->ptr + 1;
+
+	/* Most literals don't contain any escapes, so we only fall back
+	 * to unescaping if we hit a backslash before the closing quote */
+	p = (gchar *)parser->scan (p);
+
+	if (*p == '\\')
+	{
+		gchar *end;
+		gchar *terminator = gdbmi_parse_unescape_literal (p, &end,
+														   parser->scan);
+
+		if (terminator == NULL)
+		{
+			g_warning ("Parse error: Invalid literal value");
+			return NULL;
+		}
+		*terminator = '\0';
+		p = end;
+	}
+	else if (*p == '\0')
+	{
+		g_warning ("Parse error: Invalid literal value");
+		return NULL;
+	}
+	else
+		*p = '\0';
+
+	/* Get pass the closing quote */
+	parser->ptr = p + 1;
 
-			/* Get pass the comma separator */
-			if (**ptr == ',')
-				*ptr = g_utf8_next_char (*ptr);
+	val = gdbmi_value_new_real (parser->arena, GDBMI_DATA_LITERAL);
+	val->data.literal = start;
+	return val;
+}
+
+static void
+gdbmi_parser_push_element (GDBMIParser *parser, GDBMIValue *element)
+{
+	if (parser->stack_len == parser->stack_size)
+	{
+		g_atomic_int_inc (&gdbmi_n_allocations);
+		parser->stack_size *= 2;
+		if (parser->stack == parser->stack_prealloc)
+		{
+			parser->stack = g_new (GDBMIValue *, parser->stack_size);
+			memcpy (parser->stack, parser->stack_prealloc,
+					sizeof (parser->stack_prealloc));
 		}
-		if (error)
+		else
+			parser->stack = g_renew (GDBMIValue *, parser->stack,
+									 parser->stack_size);
+	}
+	parser->stack[parser->stack_len++] = element;
+}
+
+/* Validates a literal without building it or modifying the buffer */
+static gboolean
+gdbmi_skip_literal (GDBMIParser *parser)
+{
+	const gchar *p = parser->ptr + 1;
+
+	while (*(p = parser->scan (p)) != '"')
+	{
+		if (*p == '\\')
+			p++;
+		if (*p == '\0')
 		{
-			gdbmi_value_free (val);
-			val = NULL;
+			g_warning ("Parse error: Invalid literal value");
+			return FALSE;
 		}
-		/* Get pass the closing hash */
-		*ptr = g_utf8_next_char (*ptr);
+		p++;
 	}
-	else if (**ptr == '[')
+	parser->ptr = (gchar *)p + 1;
+	return TRUE;
+}
+
+static gboolean gdbmi_skip_value (GDBMIParser *parser);
+
+/* The read only counterpart of gdbmi_parse_container_elements(),
+ * this finds the end of a container while checking it exactly as
+ * strictly as the eager parser would. */
+static gboolean
+gdbmi_skip_container_elements (GDBMIParser *parser,
+							   GDBMIDataType type,
+							   gchar close)
+{
+	while (*parser->ptr != close)
 	{
-		/* Value is list */
-		gboolean error = FALSE;
+		/* Only assignments give their value a name */
+		gboolean named = isalpha (*parser->ptr);
 
-		*ptr = g_utf8_next_char (*ptr);
-		val = gdbmi_value_new (GDBMI_DATA_LIST, NULL);
-		while (**ptr != ']')
+		if (!gdbmi_skip_value (parser))
 		{
-			GDBMIValue *element;
-			element = gdbmi_value_parse_real (ptr);
-			if (element == NULL)
-			{
-				g_warning ("Parse error: From parent");
-				error = TRUE;
-				break;
-			}
-			if (**ptr != ',' && **ptr != ']')
-			{
-				g_warning ("Parse error: Invalid element separator => '%s'",
-						   *ptr);
-				error = TRUE;
-				gdbmi_value_free (element);
-				break;
-			}
-			gdbmi_value_list_append (val, element);
+			g_warning ("Parse error: From parent");
+			return FALSE;
+		}
+		if (type == GDBMI_DATA_HASH && !named)
+		{
+			g_warning ("Parse error: Hash element has no name => '%s'",
+					   parser->ptr);
+			return FALSE;
+		}
+		if (*parser->ptr != ',' && *parser->ptr != close)
+		{
+			g_warning ("Parse error: Invalid element separator => '%s'",
+					   parser->ptr);
+			return FALSE;
+		}
+		if (*parser->ptr == ',')
+			parser->ptr++;
+	}
+	parser->ptr++;
+	return TRUE;
+}
 
-			/* Get pass the comma separator */
-			if (**ptr == ',')
-				*ptr = g_utf8_next_char (*ptr);
+static gboolean
+gdbmi_skip_value (GDBMIParser *parser)
+{
+	gchar *p = parser->ptr;
+
+	if (*p == '\0')
+	{
+		g_warning ("Parse error: Reached end of stream");
+		return FALSE;
+	}
+	else if (*p == '"')
+		return gdbmi_skip_literal (parser);
+	else if (isalpha (*p))
+	{
+		p = strchr (p, '=');
+		if (p == NULL)
+		{
+			g_warning ("Parse error: Invalid assignment name");
+			return FALSE;
+		}
+		parser->ptr = p + 1;
+		if (!gdbmi_skip_value (parser))
+		{
+			g_warning ("Parse error: From parent");
+			return FALSE;
+		}
+		return TRUE;
+	}
+	else if (*p == '{')
+	{
+		parser->ptr++;
+		return gdbmi_skip_container_elements (parser, GDBMI_DATA_HASH, '}');
+	}
+	else if (*p == '[')
+	{
+		parser->ptr++;
+		return gdbmi_skip_container_elements (parser, GDBMI_DATA_LIST, ']');
+	}
+
+	g_warning ("Parse error: Should not be here => '%s'", p);
+	return FALSE;
+}
+
+/* Parses the elements of a hash or list into val up to and including
+ * the given closing character, which may be '\0' for the top level
+ * tuple of a record which isn't explicitly bracketed. */
+static gboolean
+gdbmi_parse_container_elements (GDBMIParser *parser,
+								GDBMIValue *val,
+								gchar close)
+{
+	GDBMIDataType type = val->type;
+	gboolean error = FALSE;
+	guint stack_base = parser->stack_len;
+
+	while (*parser->ptr != close)
+	{
+		GDBMIValue *element;
+		element = gdbmi_parse_value (parser);
+		if (element == NULL)
+		{
+			g_warning ("Parse error: From parent");
+			error = TRUE;
+			break;
+		}
+		if (type == GDBMI_DATA_HASH && element->name == NULL)
+		{
+			g_warning ("Parse error: Hash element has no name => '%s'",
+					   parser->ptr);
+			error = TRUE;
+			break;
+		}
+		if (*parser->ptr != ',' && *parser->ptr != close)
+		{
+			g_warning ("Parse error: Invalid element separator => '%s'",
+					   parser->ptr);
+			error = TRUE;
+			break;
+		}
+		gdbmi_parser_push_element (parser, element);
+
+		/* Get pass the comma separator */
+		if (*parser->ptr == ',')
+			parser->ptr++;
+	}
+	if (error)
+	{
+		/* The elements are left behind in the arena */
+		parser->stack_len = stack_base;
+		return FALSE;
+	}
+
+	if (parser->stack_len > stack_base)
+	{
+		guint n_elements = parser->stack_len - stack_base;
+
+		val->data.array.elements =
+			gdbmi_arena_alloc (parser->arena,
+							   n_elements * sizeof (GDBMIValue *));
+		memcpy (val->data.array.elements, parser->stack + stack_base,
+				n_elements * sizeof (GDBMIValue *));
+		val->data.array.n_elements = n_elements;
+		val->data.array.n_allocated = n_elements;
+		parser->stack_len = stack_base;
+	}
+
+	/* Get pass the closing bracket */
+	if (close != '\0')
+		parser->ptr++;
+
+	return TRUE;
+}
+
+static GDBMIValue *
+gdbmi_parse_container (GDBMIParser *parser,
+					   GDBMIDataType type,
+					   gchar close)
+{
+	GDBMIValue *val;
+
+	if (parser->mode == GDBMI_PARSE_LAZY)
+	{
+		gchar *start = parser->ptr;
+
+		/* Just check the elements and remember where they are */
+		if (!gdbmi_skip_container_elements (parser, type, close))
+			return NULL;
+		val = gdbmi_value_new_real (parser->arena, type);
+		val->lazy = start;
+		return val;
+	}
+
+	val = gdbmi_value_new_real (parser->arena, type);
+	if (!gdbmi_parse_container_elements (parser, val, close))
+		return NULL;
+	return val;
+}
+
+static GDBMIValue*
+gdbmi_parse_value (GDBMIParser *parser)
+{
+	GDBMIValue *val = NULL;
+	gchar *p = parser->ptr;
+
+	if (*p == '\0')
+	{
+		/* End of stream */
+		g_warning ("Parse error: Reached end of stream");
+	}
+	else if (*p == '"')
+	{
+		/* Value is literal */
+		val = gdbmi_parse_literal (parser);
+	}
+	else if (isalpha (*p))
+	{
+		/* Value is assignment */
+		gchar *name = p;
+
+		/* Get assignment name */
+		p = strchr (p, '=');
+		if (p == NULL)
+		{
+			g_warning ("Parse error: Invalid assignment name");
+			return NULL;
+		}
+		/* Terminate the name in place and skip pass the
+		 * assignment operator */
+		*p = '\0';
+		parser->ptr = p + 1;
+
+		/* Retrieve assignment value */
+		val = gdbmi_parse_value (parser);
+		if (val)
+		{
+			val->name = name;
+			val->atom = gdbmi_atom_from_string (name);
 		}
-		if (error)
+		else
 		{
-			gdbmi_value_free (val);
-			val = NULL;
+			g_warning ("Parse error: From parent");
 		}
-		/* Get pass the closing list */
-		*ptr = g_utf8_next_char (*ptr);
+	}
+	else if (*p == '{')
+	{
+		/* Value is hash */
+		parser->ptr++;
+		val = gdbmi_parse_container (parser, GDBMI_DATA_HASH, '}');
+	}
+	else if (*p == '[')
+	{
+		/* Value is list */
+		parser->ptr++;
+		val = gdbmi_parse_container (parser, GDBMI_DATA_LIST, ']');
 	}
 	else
 	{
 		/* Should not be here -- Error */
-		g_warning ("Parse error: Should not be here => '%s'", *ptr);
+		g_warning ("Parse error: Should not be here => '%s'", p);
 	}
 	return val;
 }
 
+static void
+gdbmi_parser_init (GDBMIParser *parser,
+				   GDBMIArena *arena,
+				   gchar *buffer,
+				   GDBMIParseMode mode)
+{
+	parser->arena = arena;
+	parser->ptr = buffer;
+	parser->mode = mode;
+	/* Racing threads will simply come to the same conclusion */
+	if (G_UNLIKELY (gdbmi_scan_literal == NULL))
+		gdbmi_scan_literal = gdbmi_scanner_lookup (GDBMI_SCANNER_AUTO);
+	parser->scan = gdbmi_scan_literal;
+	parser->stack = parser->stack_prealloc;
+	parser->stack_len = 0;
+	parser->stack_size = GDBMI_PARSER_STACK_PREALLOC;
+}
+
+static void
+gdbmi_parser_clear (GDBMIParser *parser)
+{
+	if (parser->stack != parser->stack_prealloc)
+		g_free (parser->stack);
+}
+
+/* Builds one level of a lazily parsed container. Its own containers
+ * are in turn left to be built when they are first accessed. */
+static void
+gdbmi_value_materialize (GDBMIValue *val)
+{
+	GDBMIParser parser;
+	gboolean success;
+
+	gdbmi_parser_init (&parser, val->arena, val->lazy, GDBMI_PARSE_LAZY);
+	val->lazy = NULL;
+	success = gdbmi_parse_container_elements (&parser, val,
+											  val->type == GDBMI_DATA_HASH
+											  ? '}' : ']');
+	gdbmi_parser_clear (&parser);
+
+	/* The elements were already validated when the record was parsed */
+	if (!success)
+		g_warning ("Failed to build lazily parsed MI value");
+}
+
 GDBMIValue*
 gdbmi_value_parse (const gchar *message)
 {
+	return gdbmi_value_parse_full (message, GDBMI_PARSE_EAGER);
+}
+
+/* With GDBMI_PARSE_LAZY the whole record is still validated up front,
+ * but the elements of nested tuples and lists are only built the
+ * first time they are accessed. The resulting values are the same,
+ * though note that accessing a lazy value may modify it, so values
+ * shouldn't be shared between threads. */
+GDBMIValue*
+gdbmi_value_parse_full (const gchar *message, GDBMIParseMode mode)
+{
+	GDBMIParser parser;
+	GDBMIArena *arena;
 	GDBMIValue *val;
-	gchar *msg, *ptr;
+	const gchar *results;
+	gsize len;
+	gchar *buffer;
 
 	g_return_val_if_fail (message != NULL, NULL);
 
@@ -521,14 +1392,362 @@ gdbmi_value_parse (const gchar *message)
 		return NULL; /* No message */
 	}
 
-	val = NULL;
-	if (strchr (message, ','))
+	results = strchr (message, ',');
+	if (!results)
+		return NULL;
+	results++;
+
+	/* The results of the record are copied once into the arena and
+	 * then parsed as the body of an un-bracketed tuple. We allow
+	 * roughly one value per 8 bytes of input up front. */
+	len = strlen (results);
+	arena = gdbmi_arena_new (len + 1 + len / 8 * sizeof (GDBMIValue));
+	buffer = gdbmi_arena_alloc (arena, len + 1);
+	memcpy (buffer, results, len + 1);
+	gdbmi_parser_init (&parser, arena, buffer, mode);
+
+	/* The top level is always built */
+	val = gdbmi_value_new_real (arena, GDBMI_DATA_HASH);
+	if (!gdbmi_parse_container_elements (&parser, val, '\0'))
+		val = NULL;
+	gdbmi_parser_clear (&parser);
+	if (!val)
 	{
-		msg = g_strconcat ("{", strchr (message, ',') + 1, "}", NULL);
-		ptr = msg;
-		val = gdbmi_value_parse_real (&ptr);
-		g_free (msg);
+		gdbmi_arena_free (arena);
+		return NULL;
 	}
+
+	arena->root = val;
 	return val;
 }
 
+/* Pull reader */
+
+static GDBMIToken
+gdbmi_reader_fail (GDBMIReader *reader)
+{
+	reader->in_value = FALSE;
+	reader->token = GDBMI_TOKEN_ERROR;
+	return GDBMI_TOKEN_ERROR;
+}
+
+/* The record belongs to the caller, so nothing here may use the
+ * vectorized scanners which read past the NUL */
+static gboolean
+gdbmi_reader_skip_value (GDBMIReader *reader)
+{
+	GDBMIParser parser;
+
+	parser.ptr = (gchar *)reader->ptr;
+	parser.scan = gdbmi_scan_literal_cspn;
+	reader->in_value = FALSE;
+	if (!gdbmi_skip_value (&parser))
+	{
+		gdbmi_reader_fail (reader);
+		return FALSE;
+	}
+	reader->ptr = parser.ptr;
+	return TRUE;
+}
+
+void
+gdbmi_reader_init (GDBMIReader *reader, const gchar *message)
+{
+	const gchar *results;
+
+	g_return_if_fail (reader != NULL);
+	g_return_if_fail (message != NULL);
+
+	/* Like gdbmi_value_parse() we start after the result class,
+	 * so a record without any results is just an empty tuple */
+	results = strchr (message, ',');
+	reader->ptr = results ? results + 1 : message + strlen (message);
+	reader->name = NULL;
+	reader->name_len = 0;
+	reader->atom = GDBMI_ATOM_NONE;
+	reader->token = GDBMI_TOKEN_END;
+	reader->in_value = FALSE;
+	reader->need_separator = FALSE;
+	reader->depth = 1;
+	reader->close[0] = '\0';
+	reader->scratch = NULL;
+}
+
+void
+gdbmi_reader_clear (GDBMIReader *reader)
+{
+	g_return_if_fail (reader != NULL);
+
+	if (reader->scratch)
+		g_string_free (reader->scratch, TRUE);
+	reader->scratch = NULL;
+}
+
+/* Moves on to the next element of the current tuple or list, skipping
+ * whatever is left of the previous one. Returns GDBMI_TOKEN_END once
+ * the container has no more elements, after which
+ * gdbmi_reader_leave() returns to its parent. Errors are sticky. */
+GDBMIToken
+gdbmi_reader_next (GDBMIReader *reader)
+{
+	const gchar *p;
+	gchar close;
+
+	g_return_val_if_fail (reader != NULL, GDBMI_TOKEN_ERROR);
+
+	if (reader->token == GDBMI_TOKEN_ERROR)
+		return GDBMI_TOKEN_ERROR;
+
+	close = reader->close[reader->depth - 1];
+	if (reader->in_value && !gdbmi_reader_skip_value (reader))
+		return GDBMI_TOKEN_ERROR;
+
+	if (reader->need_separator)
+	{
+		if (*reader->ptr == ',')
+			reader->ptr++;
+		else if (*reader->ptr != close)
+		{
+			g_warning ("Parse error: Invalid element separator => '%s'",
+					   reader->ptr);
+			return gdbmi_reader_fail (reader);
+		}
+	}
+
+	reader->name = NULL;
+	reader->name_len = 0;
+	reader->atom = GDBMI_ATOM_NONE;
+
+	if (*reader->ptr == close)
+		return reader->token = GDBMI_TOKEN_END;
+	reader->need_separator = TRUE;
+
+	/* As with the parser, the outermost name of a=b=... wins */
+	p = reader->ptr;
+	while (isalpha (*p))
+	{
+		const gchar *eq = strchr (p, '=');
+
+		if (eq == NULL)
+		{
+			g_warning ("Parse error: Invalid assignment name");
+			return gdbmi_reader_fail (reader);
+		}
+		if (reader->name == NULL)
+		{
+			reader->name = p;
+			reader->name_len = eq - p;
+		}
+		p = eq + 1;
+	}
+	if (reader->name == NULL && close != ']')
+	{
+		g_warning ("Parse error: Hash element has no name => '%s'", p);
+		return gdbmi_reader_fail (reader);
+	}
+
+	switch (*p)
+	{
+		case '"':
+			reader->token = GDBMI_TOKEN_LITERAL;
+			break;
+		case '{':
+			reader->token = GDBMI_TOKEN_HASH;
+			break;
+		case '[':
+			reader->token = GDBMI_TOKEN_LIST;
+			break;
+		case '\0':
+			g_warning ("Parse error: Reached end of stream");
+			return gdbmi_reader_fail (reader);
+		default:
+			g_warning ("Parse error: Should not be here => '%s'", p);
+			return gdbmi_reader_fail (reader);
+	}
+
+	if (reader->name)
+		reader->atom = gdbmi_atom_from_string_len (reader->name,
+												   reader->name_len);
+	reader->ptr = p;
+	reader->in_value = TRUE;
+	return reader->token;
+}
+
+GDBMIAtom
+gdbmi_reader_get_atom (const GDBMIReader *reader)
+{
+	g_return_val_if_fail (reader != NULL, GDBMI_ATOM_NONE);
+
+	return reader->atom;
+}
+
+gboolean
+gdbmi_reader_failed (const GDBMIReader *reader)
+{
+	g_return_val_if_fail (reader != NULL, TRUE);
+
+	return reader->token == GDBMI_TOKEN_ERROR;
+}
+
+/* Skips forward to the next element of the current container with
+ * the given name. Elements before it can't be revisited. */
+gboolean
+gdbmi_reader_find (GDBMIReader *reader, GDBMIAtom atom)
+{
+	g_return_val_if_fail (reader != NULL, FALSE);
+
+	while (gdbmi_reader_next (reader) > GDBMI_TOKEN_END)
+	{
+		if (reader->atom == atom)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* Descends into the tuple or list the reader is on */
+gboolean
+gdbmi_reader_enter (GDBMIReader *reader)
+{
+	g_return_val_if_fail (reader != NULL, FALSE);
+
+	if (!reader->in_value
+		|| (reader->token != GDBMI_TOKEN_HASH
+			&& reader->token != GDBMI_TOKEN_LIST))
+		return FALSE;
+
+	if (reader->depth == GDBMI_READER_MAX_DEPTH)
+	{
+		g_warning ("Parse error: Values nested too deeply");
+		gdbmi_reader_fail (reader);
+		return FALSE;
+	}
+
+	reader->close[reader->depth++] =
+		reader->token == GDBMI_TOKEN_HASH ? '}' : ']';
+	reader->ptr++;
+	reader->in_value = FALSE;
+	reader->need_separator = FALSE;
+	return TRUE;
+}
+
+/* Skips the rest of the current container and returns to its parent */
+gboolean
+gdbmi_reader_leave (GDBMIReader *reader)
+{
+	g_return_val_if_fail (reader != NULL, FALSE);
+	g_return_val_if_fail (reader->depth > 1, FALSE);
+
+	while (gdbmi_reader_next (reader) > GDBMI_TOKEN_END)
+		;
+	if (reader->token == GDBMI_TOKEN_ERROR)
+		return FALSE;
+
+	/* Get pass the closing bracket */
+	reader->ptr++;
+	reader->depth--;
+	reader->need_separator = TRUE;
+	return TRUE;
+}
+
+/* Returns the unescaped literal the reader is on, or NULL if it isn't
+ * on a literal. The string is only valid until the next call. */
+const gchar*
+gdbmi_reader_get_literal (GDBMIReader *reader)
+{
+	const gchar *start, *p, *escape = NULL;
+	gsize len;
+
+	g_return_val_if_fail (reader != NULL, NULL);
+
+	if (!reader->in_value || reader->token != GDBMI_TOKEN_LITERAL)
+		return NULL;
+
+	start = p = reader->ptr + 1;
+	while (*(p = gdbmi_scan_literal_cspn (p)) != '"')
+	{
+		if (*p == '\\')
+		{
+			if (escape == NULL)
+				escape = p;
+			p++;
+		}
+		if (*p == '\0')
+		{
+			g_warning ("Parse error: Invalid literal value");
+			gdbmi_reader_fail (reader);
+			return NULL;
+		}
+		p++;
+	}
+	len = p - start;
+	reader->ptr = p + 1;
+	reader->in_value = FALSE;
+
+	if (reader->scratch == NULL)
+		reader->scratch = g_string_sized_new (MAX (len + 1, 64));
+
+	/* The closing quote is copied too since it is what stops the
+	 * unescaping */
+	g_string_truncate (reader->scratch, 0);
+	g_string_append_len (reader->scratch, start, len + 1);
+	if (escape)
+	{
+		gchar *end;
+		gchar *terminator =
+			gdbmi_parse_unescape_literal (reader->scratch->str
+										  + (escape - start),
+										  &end, gdbmi_scan_literal_cspn);
+
+		len = terminator - reader->scratch->str;
+	}
+	g_string_truncate (reader->scratch, len);
+
+	return reader->scratch->str;
+}
+
+/* Unlike gdbmi_reader_get_literal the copy is always valid UTF-8; see
+ * gdbmi_literal_dup_utf8 */
+gchar*
+gdbmi_reader_dup_literal (GDBMIReader *reader)
+{
+	const gchar *literal = gdbmi_reader_get_literal (reader);
+
+	if (literal == NULL)
+		return NULL;
+	return gdbmi_literal_dup_utf8 (literal, -1);
+}
+
+/* These convert the literal the reader is on straight from the
+ * record, like strtol() and strtoul(). Anything that isn't a literal
+ * reads as 0. */
+glong
+gdbmi_reader_get_long (GDBMIReader *reader, gint base)
+{
+	glong value;
+
+	g_return_val_if_fail (reader != NULL, 0);
+
+	if (!reader->in_value || reader->token != GDBMI_TOKEN_LITERAL)
+		return 0;
+
+	value = strtol (reader->ptr + 1, NULL, base);
+	if (!gdbmi_reader_skip_value (reader))
+		return 0;
+	return value;
+}
+
+gulong
+gdbmi_reader_get_ulong (GDBMIReader *reader, gint base)
+{
+	gulong value;
+
+	g_return_val_if_fail (reader != NULL, 0);
+
+	if (!reader->in_value || reader->token != GDBMI_TOKEN_LITERAL)
+		return 0;
+
+	value = strtoul (reader->ptr + 1, NULL, base);
+	if (!gdbmi_reader_skip_value (reader))
+		return 0;
+	return value;
+}
@@ -36,13 +36,104 @@ typedef enum {
 	GDBMI_DATA_LITERAL
 } GDBMIDataType;
 
+/* Interned names of the MI fields GSwat understands. The parser
+ * resolves each field name it reads to one of these, so they can be
+ * looked up with an integer compare instead of a string compare.
+ * NB: Keep this sorted in the same order as the names in gswat-gdbmi.c */
+typedef enum {
+	GDBMI_ATOM_NONE = 0,
+	GDBMI_ATOM_ADDR,
+	GDBMI_ATOM_ARGS,
+	GDBMI_ATOM_BKPT,
+	GDBMI_ATOM_BKPTNO,
+	GDBMI_ATOM_CHANGELIST,
+	GDBMI_ATOM_CHILDREN,
+	GDBMI_ATOM_DEPTH,
+	GDBMI_ATOM_DISP,
+	GDBMI_ATOM_ENABLED,
+	GDBMI_ATOM_EXIT_CODE,
+	GDBMI_ATOM_EXP,
+	GDBMI_ATOM_FILE,
+	GDBMI_ATOM_FRAME,
+	GDBMI_ATOM_FULLNAME,
+	GDBMI_ATOM_FUNC,
+	GDBMI_ATOM_HAS_MORE,
+	GDBMI_ATOM_IN_SCOPE,
+	GDBMI_ATOM_LEVEL,
+	GDBMI_ATOM_LINE,
+	GDBMI_ATOM_LOCALS,
+	GDBMI_ATOM_MSG,
+	GDBMI_ATOM_NAME,
+	GDBMI_ATOM_NEW_NUM_CHILDREN,
+	GDBMI_ATOM_NEW_TYPE,
+	GDBMI_ATOM_NUMBER,
+	GDBMI_ATOM_NUMCHILD,
+	GDBMI_ATOM_ORIGINAL_LOCATION,
+	GDBMI_ATOM_REASON,
+	GDBMI_ATOM_SIGNAL_MEANING,
+	GDBMI_ATOM_SIGNAL_NAME,
+	GDBMI_ATOM_STACK,
+	GDBMI_ATOM_STACK_ARGS,
+	GDBMI_ATOM_THREAD_ID,
+	GDBMI_ATOM_TIMES,
+	GDBMI_ATOM_TYPE,
+	GDBMI_ATOM_TYPE_CHANGED,
+	GDBMI_ATOM_VALUE,
+	GDBMI_ATOM_LAST
+} GDBMIAtom;
+
+/* How much of a record gdbmi_value_parse_full() builds up front */
+typedef enum {
+	GDBMI_PARSE_EAGER,
+	GDBMI_PARSE_LAZY
+} GDBMIParseMode;
+
 typedef struct _GDBMIValue GDBMIValue;
 
+/* For walking the elements of a tuple or list; all fields are private */
+typedef struct {
+	GDBMIValue **element;
+	GDBMIValue **end;
+} GDBMIIter;
+
+/* What gdbmi_reader_next() found */
+typedef enum {
+	GDBMI_TOKEN_ERROR = -1,
+	GDBMI_TOKEN_END,
+	GDBMI_TOKEN_LITERAL,
+	GDBMI_TOKEN_HASH,
+	GDBMI_TOKEN_LIST
+} GDBMIToken;
+
+#define GDBMI_READER_MAX_DEPTH 32
+
+/* Walks the results of a record one element at a time, without
+ * copying the record or building any GDBMIValues, so that records
+ * can be decoded straight into structures. It is meant to live on
+ * the stack; all of its fields are private. */
+typedef struct {
+	const gchar *ptr;
+	const gchar *name;
+	gsize name_len;
+	GDBMIAtom atom;
+	GDBMIToken token;
+	gboolean in_value;
+	gboolean need_separator;
+	guint depth;
+	gchar close[GDBMI_READER_MAX_DEPTH];
+	GString *scratch;
+} GDBMIReader;
+
+/* Atoms */
+GDBMIAtom gdbmi_atom_from_string (const gchar *name);
+const gchar* gdbmi_atom_to_string (GDBMIAtom atom);
+
 GDBMIValue *gdbmi_value_new (GDBMIDataType data_type, const gchar *name);
 GDBMIValue* gdbmi_value_literal_new (const gchar *name, const gchar *data);
 void gdbmi_value_free (GDBMIValue *val);
 
 const gchar* gdbmi_value_get_name (const GDBMIValue *val);
+GDBMIAtom gdbmi_value_get_atom (const GDBMIValue *val);
 void gdbmi_value_set_name (GDBMIValue *val, const gchar *name);
 GDBMIDataType gdbmi_value_get_type (const GDBMIValue* val);
 gint gdbmi_value_get_size (const GDBMIValue* val);
@@ -51,20 +142,43 @@ void gdbmi_value_foreach (const GDBMIValue* val, GFunc func, gpointer user_data)
 /* Literal operations */
 void gdbmi_value_literal_set (GDBMIValue* val, const gchar *data);
 const gchar* gdbmi_value_literal_get (const GDBMIValue* val);
+gchar* gdbmi_literal_dup_utf8 (const gchar *literal, gssize len);
 
 /* Hash operations */
 void gdbmi_value_hash_insert (GDBMIValue* val, const gchar *key,
 							  GDBMIValue *value);
 const GDBMIValue* gdbmi_value_hash_lookup (const GDBMIValue* val, const gchar *key);
+const GDBMIValue* gdbmi_value_hash_lookup_atom (const GDBMIValue* val,
+												GDBMIAtom atom);
 
 /* List operations */
 void gdbmi_value_list_append (GDBMIValue* val, GDBMIValue *value);
 const GDBMIValue* gdbmi_value_list_get_nth (const GDBMIValue* val, gint idx);
 
+/* Iterators */
+void gdbmi_value_iter_init (GDBMIIter *iter, const GDBMIValue *val);
+const GDBMIValue* gdbmi_value_iter_next (GDBMIIter *iter);
+
 /* Parser and dumper */
 GDBMIValue* gdbmi_value_parse (const gchar *message);
+GDBMIValue* gdbmi_value_parse_full (const gchar *message,
+									GDBMIParseMode mode);
 void gdbmi_value_dump (GString *string, const GDBMIValue *val, gint indent_level);
 
+/* Pull reader */
+void gdbmi_reader_init (GDBMIReader *reader, const gchar *message);
+void gdbmi_reader_clear (GDBMIReader *reader);
+GDBMIToken gdbmi_reader_next (GDBMIReader *reader);
+GDBMIAtom gdbmi_reader_get_atom (const GDBMIReader *reader);
+gboolean gdbmi_reader_failed (const GDBMIReader *reader);
+gboolean gdbmi_reader_find (GDBMIReader *reader, GDBMIAtom atom);
+gboolean gdbmi_reader_enter (GDBMIReader *reader);
+gboolean gdbmi_reader_leave (GDBMIReader *reader);
+const gchar* gdbmi_reader_get_literal (GDBMIReader *reader);
+gchar* gdbmi_reader_dup_literal (GDBMIReader *reader);
+glong gdbmi_reader_get_long (GDBMIReader *reader, gint base);
+gulong gdbmi_reader_get_ulong (GDBMIReader *reader, gint base);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,705 @@
+/*
+ * GSwat
+ *
+ * An object oriented debugger abstraction library
+ *
+ * Copyright (C) 2006-2009 Robert Bragg <robert@sixbynine.org>
+ *
+ * GSwat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or  (at your option)
+ * any later version.
+ *
+ * GSwat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with GSwat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* For posix_openpt, grantpt, unlockpt and ptsname */
+#define _GNU_SOURCE
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <glib/gi18n-lib.h>
+
+#include "gswat-inferior-stream.h"
+
+
+/* Macros and defines */
+#define GSWAT_INFERIOR_STREAM_GET_PRIVATE(object) \
+  (G_TYPE_INSTANCE_GET_PRIVATE ((object), \
+				GSWAT_TYPE_INFERIOR_STREAM, \
+				GSwatInferiorStreamPrivate))
+
+#define DEFAULT_MAX_BUFFERED  (256 * 1024)
+/* The most we read in one go before going back to the main loop */
+#define MAX_READ_PER_WAKEUP  (64 * 1024)
+/* output-available is emitted at most this often, in seconds */
+#define NOTIFY_INTERVAL  (0.1)
+/* How long to stop reading for once the rate limit is reached, in
+ * milliseconds */
+#define THROTTLE_INTERVAL  (50)
+
+enum {
+    OUTPUT_AVAILABLE,
+    LAST_SIGNAL
+};
+
+struct _GSwatInferiorStreamPrivate
+{
+  /* The pseudo terminal; we keep the slave side open too, so the
+   * master doesn't see a hang up each time the program closes it */
+  gint master_fd;
+  gint slave_fd;
+  gchar *tty_name;
+
+  GIOChannel *master;
+  guint master_event;
+  /* While reading is throttled, the timeout to start again */
+  guint resume_event;
+  guint notify_event;
+
+  /* Output that hasn't been read yet, oldest first */
+  GByteArray *buffer;
+  gsize max_buffered;
+  guint64 n_dropped;
+
+  /* The rate limit is a token bucket; allowance is how many bytes we
+   * may read now, which refills at max_rate bytes per second up to a
+   * second's worth. It refills for the time reading was throttled
+   * too, so last_refill is only reset as the allowance is topped up.
+   * A max_rate of 0 means no limit. */
+  gsize max_rate;
+  gdouble allowance;
+  gdouble last_refill;
+  gdouble last_notify;
+  GTimer *clock;
+};
+
+static void gswat_inferior_stream_class_init (GSwatInferiorStreamClass *klass);
+static void gswat_inferior_stream_init (GSwatInferiorStream *self);
+static void gswat_inferior_stream_finalize (GObject *self);
+static gboolean open_pty (GSwatInferiorStream *self, GError **error);
+static void start_reading (GSwatInferiorStream *self);
+static void close_pty (GSwatInferiorStream *self, gboolean flush);
+
+
+static GObjectClass *parent_class = NULL;
+static guint gswat_inferior_stream_signals[LAST_SIGNAL] = { 0 };
+
+
+GType
+gswat_inferior_stream_get_type (void)
+{
+  static GType self_type = 0;
+
+  if  (!self_type)
+    {
+      static const GTypeInfo object_info =
+	{
+	  sizeof (GSwatInferiorStreamClass),
+	  NULL, /* base class initializer */
+	  NULL, /* base class finalizer */
+	  (GClassInitFunc)gswat_inferior_stream_class_init,
+	  NULL, /* class finalizer */
+	  NULL, /* class data */
+	  sizeof (GSwatInferiorStream),
+	  0, /* preallocated instances */
+	  (GInstanceInitFunc)gswat_inferior_stream_init,
+	  NULL /* function table */
+	};
+
+      self_type = g_type_register_static (G_TYPE_OBJECT,
+					  "GSwatInferiorStream",
+					  &object_info,
+					  0 /* flags */
+      );
+    }
+
+  return self_type;
+}
+
+static void
+gswat_inferior_stream_class_init (GSwatInferiorStreamClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  parent_class = g_type_class_peek_parent (klass);
+
+  gobject_class->finalize = gswat_inferior_stream_finalize;
+
+  klass->output_available_signal = NULL;
+  gswat_inferior_stream_signals[OUTPUT_AVAILABLE] =
+    g_signal_new ("output-available", /* name */
+		  G_TYPE_FROM_CLASS (klass), /* object GType */
+		  G_SIGNAL_RUN_LAST, /* signal flags */
+		  G_STRUCT_OFFSET (GSwatInferiorStreamClass,
+				   output_available_signal),
+		  NULL, /* accumulator */
+		  NULL, /* accumulator data */
+		  g_cclosure_marshal_VOID__VOID, /* c marshaller */
+		  G_TYPE_NONE, /* return type */
+		  0 /* number of parameters */
+    );
+
+  g_type_class_add_private (klass, sizeof (GSwatInferiorStreamPrivate));
+}
+
+static void
+gswat_inferior_stream_init (GSwatInferiorStream *self)
+{
+  self->priv = GSWAT_INFERIOR_STREAM_GET_PRIVATE (self);
+
+  self->priv->master_fd = -1;
+  self->priv->slave_fd = -1;
+  self->priv->buffer = g_byte_array_new ();
+  self->priv->max_buffered = DEFAULT_MAX_BUFFERED;
+  self->priv->clock = g_timer_new ();
+  self->priv->last_refill = 0;
+  self->priv->last_notify = -NOTIFY_INTERVAL;
+}
+
+static void
+gswat_inferior_stream_finalize (GObject *object)
+{
+  GSwatInferiorStream *self = GSWAT_INFERIOR_STREAM (object);
+
+  close_pty (self, FALSE);
+
+  g_byte_array_free (self->priv->buffer, TRUE);
+  g_free (self->priv->tty_name);
+  g_timer_destroy (self->priv->clock);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+/**
+ * gswat_inferior_stream_new:
+ * @error: A location to return an error of type #GFileError
+ *
+ * Creates a new pseudo terminal for a program to be debugged in.
+ * Its name, from gswat_inferior_stream_get_tty_name(), is what the
+ * debugger should connect the program to.
+ *
+ * Returns: A new inferior stream, or %NULL if no pseudo terminal
+ *	    could be opened.
+ */
+GSwatInferiorStream *
+gswat_inferior_stream_new (GError **error)
+{
+  GSwatInferiorStream *self;
+
+  self = GSWAT_INFERIOR_STREAM (g_object_new (gswat_inferior_stream_get_type (),
+					      NULL));
+  if (!open_pty (self, error))
+    {
+      g_object_unref (self);
+      return NULL;
+    }
+
+  start_reading (self);
+
+  return self;
+}
+
+static gboolean
+set_pty_error (GError **error, const gchar *what)
+{
+  gint saved_errno = errno;
+
+  g_set_error (error,
+	       G_FILE_ERROR,
+	       g_file_error_from_errno (saved_errno),
+	       "%s: %s",
+	       what,
+	       g_strerror (saved_errno));
+  return FALSE;
+}
+
+static gboolean
+open_pty (GSwatInferiorStream *self, GError **error)
+{
+#ifdef HAVE_POSIX_OPENPT
+  struct termios attributes;
+  const gchar *name;
+
+  self->priv->master_fd = posix_openpt (O_RDWR | O_NOCTTY);
+  if (self->priv->master_fd < 0)
+    return set_pty_error (error, _("Could not open a pseudo terminal"));
+
+  if (grantpt (self->priv->master_fd) < 0
+      || unlockpt (self->priv->master_fd) < 0
+      || !(name = ptsname (self->priv->master_fd)))
+    return set_pty_error (error, _("Could not set up a pseudo terminal"));
+  self->priv->tty_name = g_strdup (name);
+
+  self->priv->slave_fd = open (self->priv->tty_name, O_RDWR | O_NOCTTY);
+  if (self->priv->slave_fd < 0)
+    return set_pty_error (error, _("Could not open a pseudo terminal"));
+
+  /* The output is passed on as it was written, without newlines
+   * being turned into "\r\n", and nothing written to the program is
+   * echoed back */
+  if (tcgetattr (self->priv->slave_fd, &attributes) == 0)
+    {
+      attributes.c_oflag &= ~OPOST;
+      attributes.c_lflag &= ~(ECHO | ECHONL);
+      tcsetattr (self->priv->slave_fd, TCSANOW, &attributes);
+    }
+
+  fcntl (self->priv->master_fd, F_SETFL,
+	 fcntl (self->priv->master_fd, F_GETFL) | O_NONBLOCK);
+  fcntl (self->priv->master_fd, F_SETFD, FD_CLOEXEC);
+  fcntl (self->priv->slave_fd, F_SETFD, FD_CLOEXEC);
+
+  self->priv->master = g_io_channel_unix_new (self->priv->master_fd);
+
+  return TRUE;
+#else
+  g_set_error (error,
+	       G_FILE_ERROR,
+	       G_FILE_ERROR_NOSYS,
+	       "%s",
+	       _("Pseudo terminals aren't supported on this system"));
+  return FALSE;
+#endif
+}
+
+/* Appends output to the buffer, dropping the oldest output once
+ * there is more than max_buffered */
+static void
+append_output (GSwatInferiorStream *self, const gchar *data, gsize len)
+{
+  GByteArray *buffer = self->priv->buffer;
+  gsize max_buffered = self->priv->max_buffered;
+
+  if (len > max_buffered)
+    {
+      self->priv->n_dropped += buffer->len + (len - max_buffered);
+      g_byte_array_set_size (buffer, 0);
+      data += len - max_buffered;
+      len = max_buffered;
+    }
+  else if (buffer->len + len > max_buffered)
+    {
+      gsize excess = buffer->len + len - max_buffered;
+
+      self->priv->n_dropped += excess;
+      g_byte_array_remove_range (buffer, 0, excess);
+    }
+
+  g_byte_array_append (buffer, (const guint8 *)data, len);
+}
+
+static gboolean
+emit_output_available (gpointer data)
+{
+  GSwatInferiorStream *self = GSWAT_INFERIOR_STREAM (data);
+
+  self->priv->notify_event = 0;
+  self->priv->last_notify = g_timer_elapsed (self->priv->clock, NULL);
+
+  if (self->priv->buffer->len)
+    g_signal_emit (self,
+		   gswat_inferior_stream_signals[OUTPUT_AVAILABLE],
+		   0);
+
+  return FALSE;
+}
+
+/* output-available is emitted once for any amount of output that
+ * arrives within NOTIFY_INTERVAL */
+static void
+queue_output_available (GSwatInferiorStream *self)
+{
+  gdouble delay;
+
+  if (self->priv->notify_event)
+    return;
+
+  delay = NOTIFY_INTERVAL
+    - (g_timer_elapsed (self->priv->clock, NULL) - self->priv->last_notify);
+  self->priv->notify_event =
+    g_timeout_add (delay > 0 ? (guint)(delay * 1000) : 0,
+		   emit_output_available,
+		   self);
+}
+
+static gboolean
+resume_reading (gpointer data)
+{
+  GSwatInferiorStream *self = GSWAT_INFERIOR_STREAM (data);
+
+  self->priv->resume_event = 0;
+  start_reading (self);
+
+  return FALSE;
+}
+
+static gboolean
+master_watcher (GIOChannel *io, GIOCondition cond, gpointer data)
+{
+  GSwatInferiorStream *self = GSWAT_INFERIOR_STREAM (data);
+  gchar chunk[4096];
+  gsize budget = MAX_READ_PER_WAKEUP;
+  gboolean got_output = FALSE;
+
+  if (self->priv->max_rate)
+    {
+      gdouble now = g_timer_elapsed (self->priv->clock, NULL);
+
+      self->priv->allowance += (now - self->priv->last_refill)
+	* self->priv->max_rate;
+      self->priv->allowance = MIN (self->priv->allowance,
+				   self->priv->max_rate);
+      self->priv->last_refill = now;
+      budget = MIN (budget, (gsize)self->priv->allowance);
+    }
+
+  while (budget > 0)
+    {
+      gssize n = read (self->priv->master_fd, chunk, MIN (sizeof (chunk), budget));
+
+      if (n > 0)
+	{
+	  append_output (self, chunk, n);
+	  budget -= n;
+	  self->priv->allowance -= n;
+	  got_output = TRUE;
+	}
+      else if (n < 0 && errno == EINTR)
+	continue;
+      else
+	break;
+    }
+
+  if (got_output)
+    queue_output_available (self);
+
+  /* Stop watching for a while once we've used up the allowance; the
+   * pty fills up in the meantime and the program blocks on it */
+  if (self->priv->max_rate && self->priv->allowance < 1)
+    {
+      self->priv->master_event = 0;
+      self->priv->resume_event =
+	g_timeout_add (THROTTLE_INTERVAL, resume_reading, self);
+      return FALSE;
+    }
+
+  if (cond & (G_IO_HUP | G_IO_ERR) && !got_output)
+    {
+      self->priv->master_event = 0;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static void
+start_reading (GSwatInferiorStream *self)
+{
+  if (!self->priv->master || self->priv->master_event)
+    return;
+
+  self->priv->master_event =
+    g_io_add_watch (self->priv->master,
+		    G_IO_IN | G_IO_HUP | G_IO_ERR,
+		    master_watcher,
+		    self);
+}
+
+/**
+ * gswat_inferior_stream_get_tty_name:
+ * @self: A GSwatInferiorStream
+ *
+ * Returns: The file name of the terminal the program should use.
+ */
+const gchar *
+gswat_inferior_stream_get_tty_name (GSwatInferiorStream *self)
+{
+  g_return_val_if_fail (GSWAT_IS_INFERIOR_STREAM (self), NULL);
+
+  return self->priv->tty_name;
+}
+
+/**
+ * gswat_inferior_stream_read:
+ * @self: A GSwatInferiorStream
+ * @buffer: Where to put the output
+ * @size: The size of @buffer
+ *
+ * Takes up to @size bytes of the program's output from the stream,
+ * oldest first. This never blocks.
+ *
+ * Returns: The number of bytes put in @buffer.
+ */
+gsize
+gswat_inferior_stream_read (GSwatInferiorStream *self,
+			    gchar *buffer,
+			    gsize size)
+{
+  gsize n;
+
+  g_return_val_if_fail (GSWAT_IS_INFERIOR_STREAM (self), 0);
+  g_return_val_if_fail (buffer != NULL || size == 0, 0);
+
+  n = MIN (size, self->priv->buffer->len);
+  memcpy (buffer, self->priv->buffer->data, n);
+  g_byte_array_remove_range (self->priv->buffer, 0, n);
+
+  return n;
+}
+
+/**
+ * gswat_inferior_stream_get_n_available:
+ * @self: A GSwatInferiorStream
+ *
+ * Returns: The number of bytes of output that can be read.
+ */
+gsize
+gswat_inferior_stream_get_n_available (GSwatInferiorStream *self)
+{
+  g_return_val_if_fail (GSWAT_IS_INFERIOR_STREAM (self), 0);
+
+  return self->priv->buffer->len;
+}
+
+/**
+ * gswat_inferior_stream_get_n_dropped:
+ * @self: A GSwatInferiorStream
+ *
+ * Returns: The number of bytes of output that were dropped because
+ *	    they weren't read before the buffer filled up.
+ */
+guint64
+gswat_inferior_stream_get_n_dropped (GSwatInferiorStream *self)
+{
+  g_return_val_if_fail (GSWAT_IS_INFERIOR_STREAM (self), 0);
+
+  return self->priv->n_dropped;
+}
+
+/**
+ * gswat_inferior_stream_write:
+ * @self: A GSwatInferiorStream
+ * @data: The input for the program
+ * @len: The length of @data
+ * @bytes_written: A location to return the number of bytes written,
+ *		   or %NULL
+ * @error: A location to return an error of type #GFileError
+ *
+ * Writes input for the program to its terminal. This never blocks,
+ * so if the program isn't reading its input and the terminal's
+ * buffer fills up, fewer than @len bytes are written and the rest
+ * should be written again later.
+ *
+ * Returns: %FALSE if an error occurred.
+ */
+gboolean
+gswat_inferior_stream_write (GSwatInferiorStream *self,
+			     const gchar *data,
+			     gsize len,
+			     gsize *bytes_written,
+			     GError **error)
+{
+  gsize written = 0;
+
+  g_return_val_if_fail (GSWAT_IS_INFERIOR_STREAM (self), FALSE);
+  g_return_val_if_fail (data != NULL || len == 0, FALSE);
+
+  if (bytes_written)
+    *bytes_written = 0;
+
+  if (self->priv->master_fd < 0)
+    {
+      g_set_error (error,
+		   G_FILE_ERROR,
+		   G_FILE_ERROR_BADF,
+		   "%s",
+		   _("The inferior stream is closed"));
+      return FALSE;
+    }
+
+  while (written < len)
+    {
+      gssize n = write (self->priv->master_fd,
+			data + written,
+			len - written);
+
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  if (errno == EAGAIN || errno == EWOULDBLOCK)
+	    break;
+	  if (bytes_written)
+	    *bytes_written = written;
+	  return set_pty_error (error, _("Could not write to the program"));
+	}
+      written += n;
+    }
+
+  if (bytes_written)
+    *bytes_written = written;
+
+  return TRUE;
+}
+
+/**
+ * gswat_inferior_stream_set_max_buffered:
+ * @self: A GSwatInferiorStream
+ * @max_buffered: The most output to keep, in bytes
+ *
+ * Sets how much output is kept for reading. Once there is more than
+ * that the oldest output is dropped.
+ */
+void
+gswat_inferior_stream_set_max_buffered (GSwatInferiorStream *self,
+					gsize max_buffered)
+{
+  GByteArray *buffer;
+
+  g_return_if_fail (GSWAT_IS_INFERIOR_STREAM (self));
+  g_return_if_fail (max_buffered > 0);
+
+  self->priv->max_buffered = max_buffered;
+
+  buffer = self->priv->buffer;
+  if (buffer->len > max_buffered)
+    {
+      self->priv->n_dropped += buffer->len - max_buffered;
+      g_byte_array_remove_range (buffer, 0, buffer->len - max_buffered);
+    }
+}
+
+/**
+ * gswat_inferior_stream_get_max_buffered:
+ * @self: A GSwatInferiorStream
+ *
+ * Returns: The most output that is kept for reading, in bytes.
+ */
+gsize
+gswat_inferior_stream_get_max_buffered (GSwatInferiorStream *self)
+{
+  g_return_val_if_fail (GSWAT_IS_INFERIOR_STREAM (self), 0);
+
+  return self->priv->max_buffered;
+}
+
+/**
+ * gswat_inferior_stream_set_max_rate:
+ * @self: A GSwatInferiorStream
+ * @bytes_per_second: The most output to read per second, or 0 for no
+ *		      limit
+ *
+ * Limits how fast the program's output is read. Beyond that the
+ * program blocks writing to its terminal, as it would with a slow
+ * terminal. There is no limit by default.
+ */
+void
+gswat_inferior_stream_set_max_rate (GSwatInferiorStream *self,
+				    gsize bytes_per_second)
+{
+  g_return_if_fail (GSWAT_IS_INFERIOR_STREAM (self));
+
+  self->priv->max_rate = bytes_per_second;
+  self->priv->allowance = bytes_per_second;
+  self->priv->last_refill = g_timer_elapsed (self->priv->clock, NULL);
+
+  if (self->priv->resume_event)
+    {
+      g_source_remove (self->priv->resume_event);
+      self->priv->resume_event = 0;
+      start_reading (self);
+    }
+}
+
+/**
+ * gswat_inferior_stream_get_max_rate:
+ * @self: A GSwatInferiorStream
+ *
+ * Returns: The most output that is read per second, or 0 if there is
+ *	    no limit.
+ */
+gsize
+gswat_inferior_stream_get_max_rate (GSwatInferiorStream *self)
+{
+  g_return_val_if_fail (GSWAT_IS_INFERIOR_STREAM (self), 0);
+
+  return self->priv->max_rate;
+}
+
+/**
+ * gswat_inferior_stream_close:
+ * @self: A GSwatInferiorStream
+ *
+ * Closes the terminal. Output that was already buffered can still be
+ * read, and if it hasn't been announced yet output-available is
+ * emitted for it now.
+ */
+void
+gswat_inferior_stream_close (GSwatInferiorStream *self)
+{
+  g_return_if_fail (GSWAT_IS_INFERIOR_STREAM (self));
+
+  close_pty (self, TRUE);
+}
+
+static void
+close_pty (GSwatInferiorStream *self, gboolean flush)
+{
+  gboolean announce = FALSE;
+
+  if (self->priv->master_event)
+    {
+      g_source_remove (self->priv->master_event);
+      self->priv->master_event = 0;
+    }
+  if (self->priv->resume_event)
+    {
+      g_source_remove (self->priv->resume_event);
+      self->priv->resume_event = 0;
+    }
+  if (self->priv->notify_event)
+    {
+      g_source_remove (self->priv->notify_event);
+      self->priv->notify_event = 0;
+      announce = flush;
+    }
+
+  if (self->priv->master)
+    {
+      g_io_channel_unref (self->priv->master);
+      self->priv->master = NULL;
+    }
+  if (self->priv->master_fd >= 0)
+    {
+      close (self->priv->master_fd);
+      self->priv->master_fd = -1;
+    }
+  if (self->priv->slave_fd >= 0)
+    {
+      close (self->priv->slave_fd);
+      self->priv->slave_fd = -1;
+    }
+
+  /* Output that arrived just before the close would otherwise never
+   * be announced */
+  if (announce)
+    {
+      g_object_ref (self);
+      emit_output_available (self);
+      g_object_unref (self);
+    }
+}
+
@@ -0,0 +1,94 @@
+/*
+ * GSwat
+ *
+ * An object oriented debugger abstraction library
+ *
+ * Copyright (C) 2006-2009 Robert Bragg <robert@sixbynine.org>
+ *
+ * GSwat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * GSwat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with GSwat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GSWAT_INFERIOR_STREAM_H
+#define GSWAT_INFERIOR_STREAM_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/**
+ * SECTION:gswat-inferior-stream
+ * @short_description: The terminal of a program being debugged
+ *
+ * An inferior stream is a pseudo terminal that a debugger connects the
+ * program being debugged to, so the program's output is kept apart
+ * from the debugger's own. Output is buffered up to a limit, beyond
+ * which the oldest output is dropped, and it can be read in at a
+ * limited rate so a program that prints a lot can't starve the rest
+ * of the main loop.
+ */
+
+#define GSWAT_INFERIOR_STREAM(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GSWAT_TYPE_INFERIOR_STREAM, GSwatInferiorStream))
+#define GSWAT_TYPE_INFERIOR_STREAM            (gswat_inferior_stream_get_type ())
+#define GSWAT_INFERIOR_STREAM_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GSWAT_TYPE_INFERIOR_STREAM, GSwatInferiorStreamClass))
+#define GSWAT_IS_INFERIOR_STREAM(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GSWAT_TYPE_INFERIOR_STREAM))
+#define GSWAT_IS_INFERIOR_STREAM_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GSWAT_TYPE_INFERIOR_STREAM))
+#define GSWAT_INFERIOR_STREAM_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GSWAT_TYPE_INFERIOR_STREAM, GSwatInferiorStreamClass))
+
+typedef struct _GSwatInferiorStream        GSwatInferiorStream;
+typedef struct _GSwatInferiorStreamClass   GSwatInferiorStreamClass;
+typedef struct _GSwatInferiorStreamPrivate GSwatInferiorStreamPrivate;
+
+struct _GSwatInferiorStream
+{
+  GObject parent;
+
+  /*< private > */
+  GSwatInferiorStreamPrivate *priv;
+};
+
+struct _GSwatInferiorStreamClass
+{
+  GObjectClass parent_class;
+
+  /* signals */
+  void (*output_available_signal) (GSwatInferiorStream *object);
+};
+
+GType gswat_inferior_stream_get_type (void);
+
+GSwatInferiorStream *gswat_inferior_stream_new (GError **error);
+const gchar *gswat_inferior_stream_get_tty_name (GSwatInferiorStream *self);
+gsize gswat_inferior_stream_read (GSwatInferiorStream *self,
+				  gchar *buffer,
+				  gsize size);
+gsize gswat_inferior_stream_get_n_available (GSwatInferiorStream *self);
+guint64 gswat_inferior_stream_get_n_dropped (GSwatInferiorStream *self);
+gboolean gswat_inferior_stream_write (GSwatInferiorStream *self,
+				      const gchar *data,
+				      gsize len,
+				      gsize *bytes_written,
+				      GError **error);
+void gswat_inferior_stream_set_max_buffered (GSwatInferiorStream *self,
+					     gsize max_buffered);
+gsize gswat_inferior_stream_get_max_buffered (GSwatInferiorStream *self);
+void gswat_inferior_stream_set_max_rate (GSwatInferiorStream *self,
+					 gsize bytes_per_second);
+gsize gswat_inferior_stream_get_max_rate (GSwatInferiorStream *self);
+void gswat_inferior_stream_close (GSwatInferiorStream *self);
+
+G_END_DECLS
+
+#endif /* GSWAT_INFERIOR_STREAM_H */
+
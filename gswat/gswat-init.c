@@ -221,6 +221,9 @@ gswat_init (int *argc, char ***argv)
   if (gswat_debug_flags & GSWAT_DEBUG_LOG)
     init_logging ();
 
+  /* GSwatGdbDebugger can read gdb's output in a thread */
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
   g_type_init ();
 
   initialised = TRUE;
@@ -374,6 +374,7 @@ parse_session (xmlDocPtr doc, xmlNodePtr cur)
   GSwatSession *session;
   xmlChar *name, *target_type, *target, *working_dir;
   xmlChar *access_time;
+  xmlChar *argument_values, *max_argument_value_length;
   gboolean name_set=FALSE, target_type_set=FALSE;
   gboolean target_set=FALSE, working_dir_set=FALSE;
   gboolean access_time_set=FALSE;
@@ -458,6 +459,36 @@ parse_session (xmlDocPtr doc, xmlNodePtr cur)
 	  xmlFree (access_time);
 	  access_time_set = TRUE;
 	}
+      /* Older sessions don't have these, and keep the defaults */
+      if (xmlStrcmp (cur->name,  (const xmlChar *)"argument_values") == 0)
+	{
+	  argument_values = xmlGetProp (cur,  (const xmlChar *)"value");
+	  if (!argument_values)
+	    {
+	      goto parse_error;
+	    }
+
+	  gswat_session_set_argument_values (session,
+					     CLAMP (strtol ((char *)argument_values,
+							    NULL, 10),
+						    GSWAT_SESSION_ARGUMENT_VALUES_NONE,
+						    GSWAT_SESSION_ARGUMENT_VALUES_ALL));
+	  xmlFree (argument_values);
+	}
+      if (xmlStrcmp (cur->name,
+		     (const xmlChar *)"max_argument_value_length") == 0)
+	{
+	  max_argument_value_length =
+	    xmlGetProp (cur,  (const xmlChar *)"value");
+	  if (!max_argument_value_length)
+	    {
+	      goto parse_error;
+	    }
+
+	  gswat_session_set_max_argument_value_length
+	    (session, strtoul ((char *)max_argument_value_length, NULL, 10));
+	  xmlFree (max_argument_value_length);
+	}
     }
 
   if (!name_set || !target_type_set || !target_set
@@ -487,11 +518,14 @@ save_session (xmlNodePtr parent, GSwatSession *session)
   xmlNodePtr target_node;
   xmlNodePtr working_dir_node;
   xmlNodePtr access_time_node;
+  xmlNodePtr argument_values_node;
+  xmlNodePtr max_argument_value_length_node;
   xmlNodePtr environment_node;
   xmlNodePtr variable_node;
   GList *tmp;
   GList *environment;
   gchar *access_time_str;
+  gchar *str;
 
   session_node = xmlNewChild (parent, NULL,  (const xmlChar *)"session", NULL);
 
@@ -528,6 +562,25 @@ save_session (xmlNodePtr parent, GSwatSession *session)
 	      (const xmlChar *)access_time_str);
   g_free (access_time_str);
 
+  str = g_strdup_printf ("%d", gswat_session_get_argument_values (session));
+  argument_values_node = xmlNewChild (session_node, NULL,
+				      (const xmlChar *)"argument_values",
+				      NULL);
+  xmlSetProp (argument_values_node,
+	      (const xmlChar *)"value",
+	      (const xmlChar *)str);
+  g_free (str);
+
+  str = g_strdup_printf ("%u",
+			 gswat_session_get_max_argument_value_length (session));
+  max_argument_value_length_node =
+    xmlNewChild (session_node, NULL,
+		 (const xmlChar *)"max_argument_value_length", NULL);
+  xmlSetProp (max_argument_value_length_node,
+	      (const xmlChar *)"value",
+	      (const xmlChar *)str);
+  g_free (str);
+
   environment = gswat_session_get_environment (session);
   if (environment)
     {
@@ -42,9 +42,13 @@ enum {
     PROP_TARGET,
     PROP_COMMAND,
     PROP_WORKING_DIR,
-    PROP_ACCESS_TIME
+    PROP_ACCESS_TIME,
+    PROP_ARGUMENT_VALUES,
+    PROP_MAX_ARGUMENT_VALUE_LENGTH
 };
 
+#define DEFAULT_MAX_ARGUMENT_VALUE_LENGTH (256)
+
 enum {
     SESSION_NAME_COMBO_STRING,
     SESSION_NAME_COMBO_N_COLUMNS
@@ -64,6 +68,10 @@ struct _GSwatSessionPrivate
   GList *environment;
 
   glong access_time;
+
+  /* How much of the frame arguments to fetch with the stack */
+  GSwatSessionArgumentValues argument_values;
+  guint max_argument_value_length;
 };
 
 static void gswat_session_class_init (GSwatSessionClass *klass);
@@ -180,6 +188,30 @@ gswat_session_class_init (GSwatSessionClass *klass)
 				   PROP_ACCESS_TIME,
 				   new_param);
 
+  new_param = g_param_spec_int ("argument-values",
+				"Argument values",
+				"Which argument values to fetch along with "
+				"the stack (a GSwatSessionArgumentValues)",
+				GSWAT_SESSION_ARGUMENT_VALUES_NONE,
+				GSWAT_SESSION_ARGUMENT_VALUES_ALL,
+				GSWAT_SESSION_ARGUMENT_VALUES_SIMPLE,
+				GSWAT_PARAM_READWRITE);
+  g_object_class_install_property (gobject_class,
+				   PROP_ARGUMENT_VALUES,
+				   new_param);
+
+  new_param = g_param_spec_uint ("max-argument-value-length",
+				 "Max argument value length",
+				 "How many bytes of an argument's value to "
+				 "keep with the stack, or 0 for all of it",
+				 0, /* minimum */
+				 G_MAXUINT,
+				 DEFAULT_MAX_ARGUMENT_VALUE_LENGTH,
+				 GSWAT_PARAM_READWRITE);
+  g_object_class_install_property (gobject_class,
+				   PROP_MAX_ARGUMENT_VALUE_LENGTH,
+				   new_param);
+
   g_type_class_add_private (klass, sizeof (GSwatSessionPrivate));
 }
 
@@ -208,6 +240,12 @@ gswat_session_get_property (GObject *object,
     case PROP_ACCESS_TIME:
       g_value_set_long (value, self->priv->access_time);
       break;
+    case PROP_ARGUMENT_VALUES:
+      g_value_set_int (value, self->priv->argument_values);
+      break;
+    case PROP_MAX_ARGUMENT_VALUE_LENGTH:
+      g_value_set_uint (value, self->priv->max_argument_value_length);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, id, pspec);
       break;
@@ -244,6 +282,13 @@ gswat_session_set_property (GObject *object,
     case PROP_ACCESS_TIME:
       gswat_session_set_access_time (self, g_value_get_long (value));
       break;
+    case PROP_ARGUMENT_VALUES:
+      gswat_session_set_argument_values (self, g_value_get_int (value));
+      break;
+    case PROP_MAX_ARGUMENT_VALUE_LENGTH:
+      gswat_session_set_max_argument_value_length (self,
+						   g_value_get_uint (value));
+      break;
     default:
       g_warning ("gswat_session_set_property on unknown property");
       return;
@@ -264,6 +309,9 @@ gswat_session_init (GSwatSession *self)
 
   g_get_current_time (&access_time);
   self->priv->access_time = access_time.tv_sec;
+
+  self->priv->argument_values = GSWAT_SESSION_ARGUMENT_VALUES_SIMPLE;
+  self->priv->max_argument_value_length = DEFAULT_MAX_ARGUMENT_VALUE_LENGTH;
 }
 
 GSwatSession*
@@ -551,3 +599,88 @@ gswat_session_set_access_time (GSwatSession *self, glong access_time)
   g_object_notify (G_OBJECT (self), "access-time");
 }
 
+/**
+ * gswat_session_get_argument_values:
+ * @self:  A GSwatSession.
+ *
+ * Fetches which values of the arguments of each frame are fetched
+ * along with the stack. With %GSWAT_SESSION_ARGUMENT_VALUES_SIMPLE,
+ * arguments of a struct, union or array type are listed without a
+ * value, so a deep stack doesn't cost much to fetch. The full values
+ * of a frame's arguments can always be fetched with
+ * gswat_debuggable_get_frame_arguments().
+ *
+ * Returns: Which argument values are fetched with the stack.
+ */
+GSwatSessionArgumentValues
+gswat_session_get_argument_values (GSwatSession *self)
+{
+  g_return_val_if_fail (GSWAT_IS_SESSION (self),
+			GSWAT_SESSION_ARGUMENT_VALUES_SIMPLE);
+
+  return self->priv->argument_values;
+}
+
+/**
+ * gswat_session_set_argument_values:
+ * @self:  A GSwatSession.
+ * @argument_values:  Which argument values to fetch.
+ *
+ * Sets which values of the arguments of each frame are fetched along
+ * with the stack. This takes effect the next time the stack is
+ * fetched.
+ */
+void
+gswat_session_set_argument_values (GSwatSession *self,
+				   GSwatSessionArgumentValues argument_values)
+{
+  g_return_if_fail (GSWAT_IS_SESSION (self));
+  g_return_if_fail (argument_values <= GSWAT_SESSION_ARGUMENT_VALUES_ALL);
+
+  if (self->priv->argument_values != argument_values)
+    {
+      self->priv->argument_values = argument_values;
+      g_object_notify (G_OBJECT (self), "argument-values");
+    }
+}
+
+/**
+ * gswat_session_get_max_argument_value_length:
+ * @self:  A GSwatSession.
+ *
+ * Fetches how many bytes of each argument value fetched along with
+ * the stack are kept. Anything longer is cut short and ends with
+ * "...".
+ *
+ * Returns: The length in bytes, or 0 if values are never cut short.
+ */
+guint
+gswat_session_get_max_argument_value_length (GSwatSession *self)
+{
+  g_return_val_if_fail (GSWAT_IS_SESSION (self), 0);
+
+  return self->priv->max_argument_value_length;
+}
+
+/**
+ * gswat_session_set_max_argument_value_length:
+ * @self:  A GSwatSession.
+ * @max_length:  The length in bytes, or 0 for no limit.
+ *
+ * Sets how many bytes of each argument value fetched along with the
+ * stack are kept. The debugger also has gdb stop printing strings and
+ * arrays after this many elements, which applies to the values of
+ * variable objects too.
+ */
+void
+gswat_session_set_max_argument_value_length (GSwatSession *self,
+					     guint max_length)
+{
+  g_return_if_fail (GSWAT_IS_SESSION (self));
+
+  if (self->priv->max_argument_value_length != max_length)
+    {
+      self->priv->max_argument_value_length = max_length;
+      g_object_notify (G_OBJECT (self), "max-argument-value-length");
+    }
+}
@@ -76,6 +76,14 @@ typedef enum {
     GSWAT_SESSION_TYPE_COUNT
 }GSwatSessionType;
 
+/* How much of the values of the arguments of each frame to fetch
+ * along with the stack */
+typedef enum {
+    GSWAT_SESSION_ARGUMENT_VALUES_NONE,
+    GSWAT_SESSION_ARGUMENT_VALUES_SIMPLE,
+    GSWAT_SESSION_ARGUMENT_VALUES_ALL
+}GSwatSessionArgumentValues;
+
 GType gswat_session_get_type (void);
 
 /**
@@ -107,6 +115,12 @@ void gswat_session_delete_environment_variable (GSwatSession *self,
 					       const gchar *name);
 glong gswat_session_get_access_time (GSwatSession *self);
 void gswat_session_set_access_time (GSwatSession *self, glong atime);
+GSwatSessionArgumentValues gswat_session_get_argument_values (GSwatSession *self);
+void gswat_session_set_argument_values (GSwatSession *self,
+					GSwatSessionArgumentValues argument_values);
+guint gswat_session_get_max_argument_value_length (GSwatSession *self);
+void gswat_session_set_max_argument_value_length (GSwatSession *self,
+						  guint max_length);
 
 G_END_DECLS
 
@@ -0,0 +1,985 @@
+/*
+ * GSwat
+ *
+ * An object oriented debugger abstraction library
+ *
+ * Copyright (C) 2006-2009 Robert Bragg <robert@sixbynine.org>
+ *
+ * GSwat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * GSwat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with GSwat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <string.h>
+#include <gio/gio.h>
+
+#include "gswat-source-index.h"
+
+
+/* Macros and defines */
+#define GSWAT_SOURCE_INDEX_GET_PRIVATE(object) \
+  (G_TYPE_INSTANCE_GET_PRIVATE ((object), \
+				GSWAT_TYPE_SOURCE_INDEX, \
+				GSwatSourceIndexPrivate))
+
+typedef struct
+{
+  /* The position of the search path the file is under, since files
+   * under earlier paths are preferred */
+  guint root;
+  /* Where the file is under that path, e.g. "foo/bar/test.c" */
+  gchar *relative;
+} IndexEntry;
+
+typedef struct
+{
+  GSwatSourceIndex *index;
+  guint root;
+  gchar *path;
+  gchar *relative;
+  /* NULL if the directory couldn't be monitored */
+  GFileMonitor *monitor;
+} DirectoryWatch;
+
+typedef struct
+{
+  guint root;
+  gchar *path;
+  /* "" for the search path itself */
+  gchar *relative;
+} ScanDirectory;
+
+/* The directories are walked in a thread, which hands what it found
+ * back to the main loop once it's done */
+typedef struct
+{
+  /* A weak pointer, which only the main loop looks at */
+  GSwatSourceIndex *index;
+  guint generation;
+  GCancellable *cancellable;
+  /* Whether this is a scan of all the search paths */
+  gboolean full;
+
+  /* Directories still to walk */
+  GList *pending;
+  /* What was found; IndexEntrys and the ScanDirectorys walked */
+  GList *entries;
+  GList *directories;
+} ScanJob;
+
+struct _GSwatSourceIndexPrivate
+{
+  /* The search paths, made absolute, in order */
+  GPtrArray *roots;
+
+  /* A GPtrArray of IndexEntrys for each base name */
+  GHashTable *entries;
+  /* A DirectoryWatch for each directory indexed, by its root and
+   * path; search paths can be nested, so the same directory can be
+   * indexed under more than one */
+  GHashTable *watches;
+
+  /* The results of earlier lookups; the uri each file name resolved
+   * to, and the names that couldn't be found anywhere */
+  GHashTable *found;
+  GHashTable *not_found;
+
+  /* Bumped whenever the search paths change, so the results of
+   * scans of the old paths are thrown away */
+  guint generation;
+  GCancellable *cancellable;
+  /* Whether the search paths have been indexed yet */
+  gboolean ready;
+};
+
+typedef gboolean (*ForachFuzzyFindCallback) (GFile *file,
+                                             void *user_data);
+
+typedef struct
+{
+  char *uri;
+} FuzzyFindFileState;
+
+static void gswat_source_index_class_init (GSwatSourceIndexClass *klass);
+static void gswat_source_index_init (GSwatSourceIndex *self);
+static void gswat_source_index_finalize (GObject *self);
+static void forget_index (GSwatSourceIndex *self);
+static void start_scan (GSwatSourceIndex *self,
+			gboolean full,
+			GList *directories);
+
+
+static GObjectClass *parent_class = NULL;
+
+
+GType
+gswat_source_index_get_type (void)
+{
+  static GType self_type = 0;
+
+  if  (!self_type)
+    {
+      static const GTypeInfo object_info =
+	{
+	  sizeof (GSwatSourceIndexClass),
+	  NULL, /* base class initializer */
+	  NULL, /* base class finalizer */
+	  (GClassInitFunc)gswat_source_index_class_init,
+	  NULL, /* class finalizer */
+	  NULL, /* class data */
+	  sizeof (GSwatSourceIndex),
+	  0, /* preallocated instances */
+	  (GInstanceInitFunc)gswat_source_index_init,
+	  NULL /* function table */
+	};
+
+      self_type = g_type_register_static (G_TYPE_OBJECT,
+					  "GSwatSourceIndex",
+					  &object_info,
+					  0 /* flags */
+      );
+    }
+
+  return self_type;
+}
+
+static void
+gswat_source_index_class_init (GSwatSourceIndexClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  parent_class = g_type_class_peek_parent (klass);
+
+  gobject_class->finalize = gswat_source_index_finalize;
+
+  g_type_class_add_private (klass, sizeof (GSwatSourceIndexPrivate));
+}
+
+static void
+index_entry_free (IndexEntry *entry)
+{
+  g_free (entry->relative);
+  g_slice_free (IndexEntry, entry);
+}
+
+static void
+free_entries (GPtrArray *entries)
+{
+  g_ptr_array_foreach (entries, (GFunc)index_entry_free, NULL);
+  g_ptr_array_free (entries, TRUE);
+}
+
+static void directory_changed_cb (GFileMonitor *monitor,
+				  GFile *file,
+				  GFile *other_file,
+				  GFileMonitorEvent event,
+				  gpointer data);
+
+static void
+directory_watch_free (DirectoryWatch *watch)
+{
+  if (watch->monitor)
+    {
+      g_signal_handlers_disconnect_by_func (watch->monitor,
+					    directory_changed_cb,
+					    watch);
+      g_file_monitor_cancel (watch->monitor);
+      g_object_unref (watch->monitor);
+    }
+  g_free (watch->path);
+  g_free (watch->relative);
+  g_slice_free (DirectoryWatch, watch);
+}
+
+static guint
+directory_watch_hash (gconstpointer key)
+{
+  const DirectoryWatch *watch = key;
+
+  return g_str_hash (watch->path) ^ watch->root;
+}
+
+static gboolean
+directory_watch_equal (gconstpointer a, gconstpointer b)
+{
+  const DirectoryWatch *watch_a = a;
+  const DirectoryWatch *watch_b = b;
+
+  return watch_a->root == watch_b->root
+    && strcmp (watch_a->path, watch_b->path) == 0;
+}
+
+static DirectoryWatch *
+lookup_watch (GSwatSourceIndex *self, guint root, const gchar *path)
+{
+  DirectoryWatch key;
+
+  key.root = root;
+  key.path = (gchar *)path;
+
+  return g_hash_table_lookup (self->priv->watches, &key);
+}
+
+static void
+gswat_source_index_init (GSwatSourceIndex *self)
+{
+  self->priv = GSWAT_SOURCE_INDEX_GET_PRIVATE (self);
+
+  self->priv->roots = g_ptr_array_new ();
+  self->priv->entries =
+    g_hash_table_new_full (g_str_hash,
+			   g_str_equal,
+			   g_free,
+			   (GDestroyNotify)free_entries);
+  self->priv->watches =
+    g_hash_table_new_full (directory_watch_hash,
+			   directory_watch_equal,
+			   NULL,
+			   (GDestroyNotify)directory_watch_free);
+  self->priv->found =
+    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  self->priv->not_found =
+    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->priv->cancellable = g_cancellable_new ();
+
+  /* With no search paths there is nothing to index */
+  self->priv->ready = TRUE;
+}
+
+static void
+gswat_source_index_finalize (GObject *object)
+{
+  GSwatSourceIndex *self = GSWAT_SOURCE_INDEX (object);
+
+  forget_index (self);
+
+  g_object_unref (self->priv->cancellable);
+  g_ptr_array_free (self->priv->roots, TRUE);
+  g_hash_table_destroy (self->priv->entries);
+  g_hash_table_destroy (self->priv->watches);
+  g_hash_table_destroy (self->priv->found);
+  g_hash_table_destroy (self->priv->not_found);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+GSwatSourceIndex *
+gswat_source_index_new (void)
+{
+  return GSWAT_SOURCE_INDEX (g_object_new (gswat_source_index_get_type (),
+					   NULL));
+}
+
+static gchar *
+build_relative (const gchar *relative, const gchar *name)
+{
+  if (relative[0] == '\0')
+    return g_strdup (name);
+  else
+    return g_strconcat (relative, G_DIR_SEPARATOR_S, name, NULL);
+}
+
+static const gchar *
+get_basename (const gchar *filename)
+{
+  const gchar *basename = strrchr (filename, G_DIR_SEPARATOR);
+
+  return basename ? basename + 1 : filename;
+}
+
+static ScanDirectory *
+scan_directory_new (guint root, const gchar *path, const gchar *relative)
+{
+  ScanDirectory *directory = g_slice_new (ScanDirectory);
+
+  directory->root = root;
+  directory->path = g_strdup (path);
+  directory->relative = g_strdup (relative);
+
+  return directory;
+}
+
+static void
+scan_directory_free (ScanDirectory *directory)
+{
+  g_free (directory->path);
+  g_free (directory->relative);
+  g_slice_free (ScanDirectory, directory);
+}
+
+/* Called in the scan thread */
+static void
+scan_directory (ScanJob *job, ScanDirectory *directory)
+{
+  GFile *file;
+  GFileEnumerator *children;
+  GFileInfo *info;
+
+  file = g_file_new_for_path (directory->path);
+  children =
+    g_file_enumerate_children (file,
+			       G_FILE_ATTRIBUTE_STANDARD_NAME ","
+			       G_FILE_ATTRIBUTE_STANDARD_TYPE,
+			       G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+			       job->cancellable,
+			       NULL);
+  g_object_unref (file);
+  if (!children)
+    return;
+
+  while ((info = g_file_enumerator_next_file (children,
+					      job->cancellable,
+					      NULL)))
+    {
+      const gchar *name = g_file_info_get_name (info);
+      gchar *relative = build_relative (directory->relative, name);
+
+      /* We don't follow links to directories, so we can't loop, and
+       * we skip hidden directories such as .git which are big and
+       * don't hold anything gdb would have built from */
+      if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
+	{
+	  if (name[0] != '.')
+	    {
+	      gchar *path =
+		g_build_filename (directory->path, name, NULL);
+	      job->pending =
+		g_list_prepend (job->pending,
+				scan_directory_new (directory->root,
+						    path,
+						    relative));
+	      g_free (path);
+	    }
+	  g_free (relative);
+	}
+      else
+	{
+	  IndexEntry *entry = g_slice_new (IndexEntry);
+	  entry->root = directory->root;
+	  entry->relative = relative;
+	  job->entries = g_list_prepend (job->entries, entry);
+	}
+
+      g_object_unref (info);
+    }
+
+  g_file_enumerator_close (children, NULL, NULL);
+  g_object_unref (children);
+}
+
+static void
+add_entry (GSwatSourceIndex *self, guint root, const gchar *relative)
+{
+  const gchar *basename = get_basename (relative);
+  GPtrArray *entries;
+  IndexEntry *entry;
+  guint i;
+
+  entries = g_hash_table_lookup (self->priv->entries, basename);
+  if (!entries)
+    {
+      entries = g_ptr_array_new ();
+      g_hash_table_insert (self->priv->entries,
+			   g_strdup (basename),
+			   entries);
+    }
+
+  /* A directory created while the search paths were being scanned
+   * may be found by both scans */
+  for (i = 0; i < entries->len; i++)
+    {
+      entry = g_ptr_array_index (entries, i);
+      if (entry->root == root && strcmp (entry->relative, relative) == 0)
+	return;
+    }
+
+  entry = g_slice_new (IndexEntry);
+  entry->root = root;
+  entry->relative = g_strdup (relative);
+  g_ptr_array_add (entries, entry);
+}
+
+static void
+remove_entry (GSwatSourceIndex *self, guint root, const gchar *relative)
+{
+  const gchar *basename = get_basename (relative);
+  GPtrArray *entries;
+  guint i;
+
+  entries = g_hash_table_lookup (self->priv->entries, basename);
+  if (!entries)
+    return;
+
+  for (i = 0; i < entries->len; i++)
+    {
+      IndexEntry *entry = g_ptr_array_index (entries, i);
+      if (entry->root == root && strcmp (entry->relative, relative) == 0)
+	{
+	  index_entry_free (g_ptr_array_remove_index_fast (entries, i));
+	  break;
+	}
+    }
+
+  if (entries->len == 0)
+    g_hash_table_remove (self->priv->entries, basename);
+}
+
+typedef struct
+{
+  guint root;
+  const gchar *relative;
+  /* The directory's relative path with a trailing separator */
+  gchar *prefix;
+  gsize prefix_len;
+} RemoveDirectoryState;
+
+static gboolean
+remove_entries_under_cb (gpointer key, gpointer value, gpointer data)
+{
+  GPtrArray *entries = value;
+  RemoveDirectoryState *state = data;
+  guint i = 0;
+
+  while (i < entries->len)
+    {
+      IndexEntry *entry = g_ptr_array_index (entries, i);
+      if (entry->root == state->root
+	  && strncmp (entry->relative,
+		      state->prefix,
+		      state->prefix_len) == 0)
+	index_entry_free (g_ptr_array_remove_index_fast (entries, i));
+      else
+	i++;
+    }
+
+  return entries->len == 0;
+}
+
+static gboolean
+remove_watches_under_cb (gpointer key, gpointer value, gpointer data)
+{
+  DirectoryWatch *watch = value;
+  RemoveDirectoryState *state = data;
+
+  return watch->root == state->root
+    && (strcmp (watch->relative, state->relative) == 0
+	|| strncmp (watch->relative,
+		    state->prefix,
+		    state->prefix_len) == 0);
+}
+
+/* Forgets everything we knew about a directory that has gone */
+static void
+remove_directory (GSwatSourceIndex *self, guint root, const gchar *relative)
+{
+  RemoveDirectoryState state;
+
+  state.root = root;
+  state.relative = relative;
+  state.prefix = g_strconcat (relative, G_DIR_SEPARATOR_S, NULL);
+  state.prefix_len = strlen (state.prefix);
+
+  g_hash_table_foreach_remove (self->priv->entries,
+			       remove_entries_under_cb,
+			       &state);
+  g_hash_table_foreach_remove (self->priv->watches,
+			       remove_watches_under_cb,
+			       &state);
+
+  g_free (state.prefix);
+}
+
+static void
+watch_directory (GSwatSourceIndex *self, ScanDirectory *directory)
+{
+  DirectoryWatch *watch;
+  GFile *file;
+
+  if (lookup_watch (self, directory->root, directory->path))
+    return;
+
+  watch = g_slice_new (DirectoryWatch);
+  watch->index = self;
+  watch->root = directory->root;
+  watch->path = g_strdup (directory->path);
+  watch->relative = g_strdup (directory->relative);
+
+  /* If we run out of inotify watches the index may go stale for
+   * this directory, but it is still rebuilt when the search paths
+   * are set again */
+  file = g_file_new_for_path (directory->path);
+  watch->monitor =
+    g_file_monitor_directory (file, G_FILE_MONITOR_NONE, NULL, NULL);
+  g_object_unref (file);
+  if (watch->monitor)
+    g_signal_connect (watch->monitor,
+		      "changed",
+		      G_CALLBACK (directory_changed_cb),
+		      watch);
+
+  g_hash_table_insert (self->priv->watches, watch, watch);
+}
+
+static gboolean
+result_has_basename_cb (gpointer key, gpointer value, gpointer data)
+{
+  return strcmp (get_basename (key), data) == 0;
+}
+
+/* Throws away the results of earlier lookups for files with the
+ * given base name, or all of them if it's NULL */
+static void
+forget_results (GSwatSourceIndex *self, const gchar *basename)
+{
+  if (!basename)
+    {
+      g_hash_table_remove_all (self->priv->found);
+      g_hash_table_remove_all (self->priv->not_found);
+      return;
+    }
+
+  g_hash_table_foreach_remove (self->priv->found,
+			       result_has_basename_cb,
+			       (gpointer)basename);
+  g_hash_table_foreach_remove (self->priv->not_found,
+			       result_has_basename_cb,
+			       (gpointer)basename);
+}
+
+static void
+directory_changed_cb (GFileMonitor *monitor,
+		      GFile *file,
+		      GFile *other_file,
+		      GFileMonitorEvent event,
+		      gpointer data)
+{
+  DirectoryWatch *watch = data;
+  GSwatSourceIndex *self = watch->index;
+  gchar *path;
+  gchar *name;
+  gchar *relative;
+
+  if (event != G_FILE_MONITOR_EVENT_CREATED
+      && event != G_FILE_MONITOR_EVENT_DELETED)
+    return;
+
+  /* A directory's monitor also tells us about the directory itself,
+   * which its parent's monitor deals with */
+  path = g_file_get_path (file);
+  if (!path || strcmp (path, watch->path) == 0)
+    {
+      g_free (path);
+      return;
+    }
+
+  name = g_file_get_basename (file);
+  relative = build_relative (watch->relative, name);
+
+  if (event == G_FILE_MONITOR_EVENT_CREATED)
+    {
+      GFileType type =
+	g_file_query_file_type (file,
+				G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				NULL);
+      if (type != G_FILE_TYPE_DIRECTORY)
+	{
+	  add_entry (self, watch->root, relative);
+	  forget_results (self, name);
+	}
+      else if (name[0] != '.')
+	start_scan (self,
+		    FALSE,
+		    g_list_prepend (NULL,
+				    scan_directory_new (watch->root,
+							path,
+							relative)));
+    }
+  else if (lookup_watch (self, watch->root, path))
+    {
+      remove_directory (self, watch->root, relative);
+      forget_results (self, NULL);
+    }
+  else
+    {
+      remove_entry (self, watch->root, relative);
+      forget_results (self, name);
+    }
+
+  g_free (relative);
+  g_free (name);
+  g_free (path);
+}
+
+static void
+scan_job_free (ScanJob *job)
+{
+  if (job->index)
+    g_object_remove_weak_pointer (G_OBJECT (job->index),
+				  (gpointer *)&job->index);
+  g_object_unref (job->cancellable);
+
+  g_list_foreach (job->pending, (GFunc)scan_directory_free, NULL);
+  g_list_free (job->pending);
+  g_list_foreach (job->entries, (GFunc)index_entry_free, NULL);
+  g_list_free (job->entries);
+  g_list_foreach (job->directories, (GFunc)scan_directory_free, NULL);
+  g_list_free (job->directories);
+
+  g_slice_free (ScanJob, job);
+}
+
+/* Called in the main loop once a scan has finished */
+static gboolean
+scan_job_done (gpointer data)
+{
+  ScanJob *job = data;
+  GSwatSourceIndex *self = job->index;
+  GList *l;
+
+  if (!self || job->generation != self->priv->generation)
+    return FALSE;
+
+  for (l = job->entries; l; l = l->next)
+    {
+      IndexEntry *entry = l->data;
+      add_entry (self, entry->root, entry->relative);
+    }
+
+  for (l = job->directories; l; l = l->next)
+    watch_directory (self, l->data);
+
+  /* Anything found before now may have been found by walking the
+   * search paths, or be out of date */
+  forget_results (self, NULL);
+
+  if (job->full)
+    self->priv->ready = TRUE;
+
+  return FALSE;
+}
+
+static gpointer
+scan_thread (gpointer data)
+{
+  ScanJob *job = data;
+
+  while (job->pending && !g_cancellable_is_cancelled (job->cancellable))
+    {
+      ScanDirectory *directory = job->pending->data;
+
+      job->pending = g_list_delete_link (job->pending, job->pending);
+      scan_directory (job, directory);
+      job->directories = g_list_prepend (job->directories, directory);
+    }
+
+  g_idle_add_full (G_PRIORITY_DEFAULT_IDLE,
+		   scan_job_done,
+		   job,
+		   (GDestroyNotify)scan_job_free);
+
+  return NULL;
+}
+
+static void
+start_scan (GSwatSourceIndex *self, gboolean full, GList *directories)
+{
+  ScanJob *job;
+  GError *error = NULL;
+
+  job = g_slice_new0 (ScanJob);
+  job->index = self;
+  g_object_add_weak_pointer (G_OBJECT (self), (gpointer *)&job->index);
+  job->generation = self->priv->generation;
+  job->cancellable = g_object_ref (self->priv->cancellable);
+  job->full = full;
+  job->pending = directories;
+
+  if (!g_thread_create (scan_thread, job, FALSE, &error))
+    {
+      /* Lookups keep walking the search paths instead */
+      g_warning ("%s: failed to start indexing the search paths: %s",
+		 __FUNCTION__, error->message);
+      g_error_free (error);
+      scan_job_free (job);
+    }
+}
+
+static void
+forget_index (GSwatSourceIndex *self)
+{
+  self->priv->generation++;
+  g_cancellable_cancel (self->priv->cancellable);
+  g_object_unref (self->priv->cancellable);
+  self->priv->cancellable = g_cancellable_new ();
+
+  g_ptr_array_foreach (self->priv->roots, (GFunc)g_free, NULL);
+  g_ptr_array_set_size (self->priv->roots, 0);
+  g_hash_table_remove_all (self->priv->entries);
+  g_hash_table_remove_all (self->priv->watches);
+  forget_results (self, NULL);
+
+  self->priv->ready = TRUE;
+}
+
+/* Sets the directories that gdb's file names are looked for under,
+ * in order of preference, and starts indexing them */
+void
+gswat_source_index_set_paths (GSwatSourceIndex *self,
+			      const GList *paths)
+{
+  const GList *l;
+  GList *directories = NULL;
+  guint root;
+
+  g_return_if_fail (GSWAT_IS_SOURCE_INDEX (self));
+
+  forget_index (self);
+
+  for (l = paths, root = 0; l; l = l->next, root++)
+    {
+      GFile *file = g_file_new_for_path (l->data);
+      gchar *path = g_file_get_path (file);
+
+      g_object_unref (file);
+      g_ptr_array_add (self->priv->roots, path);
+      directories = g_list_prepend (directories,
+				    scan_directory_new (root, path, ""));
+    }
+
+  if (directories)
+    {
+      self->priv->ready = FALSE;
+      start_scan (self, TRUE, directories);
+    }
+}
+
+/* Whether the search paths have been indexed, after which lookups
+ * no longer touch the file system for names they have seen before */
+gboolean
+gswat_source_index_is_ready (GSwatSourceIndex *self)
+{
+  g_return_val_if_fail (GSWAT_IS_SOURCE_INDEX (self), FALSE);
+
+  return self->priv->ready;
+}
+
+/* Of the files with the same base name, this picks the one under the
+ * earliest search path that matches the most trailing components of
+ * the file name. E.g. given /build/foo/bar/test.c, bar/test.c is
+ * preferred over test.c under the same search path. */
+static gchar *
+find_in_index (GSwatSourceIndex *self, GFile *file)
+{
+  GPtrArray *entries;
+  IndexEntry *best = NULL;
+  gsize best_len = 0;
+  gchar *basename;
+  gchar *path;
+  gsize path_len;
+  gchar *uri = NULL;
+  guint i;
+
+  basename = g_file_get_basename (file);
+  entries = g_hash_table_lookup (self->priv->entries, basename);
+  g_free (basename);
+  if (!entries)
+    return NULL;
+
+  path = g_file_get_path (file);
+  path_len = strlen (path);
+
+  for (i = 0; i < entries->len; i++)
+    {
+      IndexEntry *entry = g_ptr_array_index (entries, i);
+      gsize len = strlen (entry->relative);
+
+      if (len >= path_len
+	  || path[path_len - len - 1] != G_DIR_SEPARATOR
+	  || strcmp (path + path_len - len, entry->relative) != 0)
+	continue;
+
+      if (!best
+	  || entry->root < best->root
+	  || (entry->root == best->root && len > best_len))
+	{
+	  best = entry;
+	  best_len = len;
+	}
+    }
+
+  if (best)
+    {
+      gchar *found = g_build_filename (g_ptr_array_index (self->priv->roots,
+							  best->root),
+				       best->relative,
+				       NULL);
+      GFile *found_file = g_file_new_for_path (found);
+
+      uri = g_file_get_uri (found_file);
+      g_object_unref (found_file);
+      g_free (found);
+    }
+
+  g_free (path);
+  return uri;
+}
+
+static GFile *
+path_and_list_to_gfile (GFile *path, GList *components)
+{
+  GList *l;
+  GFile *tmp;
+
+  g_object_ref (path);
+
+  for (l = components; l; l = l->next)
+    {
+      char *child = l->data;
+      tmp = g_file_get_child (path, child);
+      g_object_unref (path);
+      path = tmp;
+    }
+
+  return path;
+}
+
+static void
+foreach_fuzzy_find_option (GFile *path,
+                           const char *filename,
+                           ForachFuzzyFindCallback callback,
+                           void *user_data)
+{
+  GFile *parent = g_file_new_for_path (filename);
+  GList *components = NULL;
+  GList *l;
+  gboolean cont;
+
+  do
+    {
+      GFile *tmp;
+      char *basename = g_file_get_basename (parent);
+      components = g_list_prepend (components, basename);
+      tmp = g_file_get_parent (parent);
+      g_object_unref (parent);
+      parent = tmp;
+    }
+  while (parent);
+
+  cont = TRUE;
+  for (l = components; l && cont; l = l->next)
+    {
+      GFile *file = path_and_list_to_gfile (path, l);
+      cont = callback (file, user_data);
+      g_object_unref (file);
+    }
+
+  g_list_foreach (components, (GFunc)g_free, NULL);
+  g_list_free (components);
+}
+
+static gboolean
+find_file_cb (GFile *file, void *user_data)
+{
+  FuzzyFindFileState *state = user_data;
+  if (g_file_query_exists (file, NULL))
+    {
+      state->uri = g_file_get_uri (file);
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* This iteratively reduces the filenames ancestry looking for a
+ * relative match under the given path. E.g. given the filename
+ * /build/foo/bar/test.c and path /src/bar it will try:
+ *   /src/bar/build/foo/bar/test.c and
+ *   /src/bar/foo/bar/test.c and
+ *   /src/bar/bar/test.c
+ *   /src/bar/test.c
+ *
+ * This is what we do until the search paths have been indexed.
+ */
+static char *
+fuzzy_find_file_in_path (const char *filename, GFile *path)
+{
+  FuzzyFindFileState state;
+
+  state.uri = NULL;
+  foreach_fuzzy_find_option (path, filename,
+                             find_file_cb, &state);
+  return state.uri;
+}
+
+static gchar *
+find_in_paths (GSwatSourceIndex *self, const gchar *filename)
+{
+  gchar *uri = NULL;
+  guint i;
+
+  for (i = 0; i < self->priv->roots->len && !uri; i++)
+    {
+      GFile *path =
+	g_file_new_for_path (g_ptr_array_index (self->priv->roots, i));
+      uri = fuzzy_find_file_in_path (filename, path);
+      g_object_unref (path);
+    }
+
+  return uri;
+}
+
+/* Returns the uri of the source file gdb calls @filename; either the
+ * file itself if it exists or the closest match under the search
+ * paths, or NULL if it can't be found. Results are kept until
+ * something with the same base name appears or goes away under the
+ * search paths. Files outside the search paths aren't monitored, so
+ * if one of those comes or goes we won't notice until the search
+ * paths are next set. */
+gchar *
+gswat_source_index_lookup (GSwatSourceIndex *self,
+			   const gchar *filename)
+{
+  GFile *file;
+  gchar *uri;
+
+  g_return_val_if_fail (GSWAT_IS_SOURCE_INDEX (self), NULL);
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  uri = g_hash_table_lookup (self->priv->found, filename);
+  if (uri)
+    return g_strdup (uri);
+  if (g_hash_table_lookup (self->priv->not_found, filename))
+    return NULL;
+
+  file = g_file_new_for_path (filename);
+  if (g_file_query_exists (file, NULL))
+    uri = g_file_get_uri (file);
+  else if (self->priv->ready)
+    uri = find_in_index (self, file);
+  else
+    uri = find_in_paths (self, filename);
+  g_object_unref (file);
+
+  if (uri)
+    g_hash_table_insert (self->priv->found,
+			 g_strdup (filename),
+			 g_strdup (uri));
+  else
+    {
+      gchar *key = g_strdup (filename);
+      g_hash_table_insert (self->priv->not_found, key, key);
+    }
+
+  return uri;
+}
+
@@ -0,0 +1,72 @@
+/*
+ * GSwat
+ *
+ * An object oriented debugger abstraction library
+ *
+ * Copyright (C) 2006-2009 Robert Bragg <robert@sixbynine.org>
+ *
+ * GSwat is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version.
+ *
+ * GSwat is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with GSwat.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GSWAT_SOURCE_INDEX_H
+#define GSWAT_SOURCE_INDEX_H
+
+#include <glib.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/* A source index maps the file names gdb reports, which are often
+ * where the program was built rather than where its source is now,
+ * onto files under a list of search paths. The search paths are
+ * indexed in a thread and the index is kept up to date by monitoring
+ * them, so resolving a name doesn't need to touch the file system. */
+
+#define GSWAT_SOURCE_INDEX(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), GSWAT_TYPE_SOURCE_INDEX, GSwatSourceIndex))
+#define GSWAT_TYPE_SOURCE_INDEX            (gswat_source_index_get_type ())
+#define GSWAT_SOURCE_INDEX_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), GSWAT_TYPE_SOURCE_INDEX, GSwatSourceIndexClass))
+#define GSWAT_IS_SOURCE_INDEX(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GSWAT_TYPE_SOURCE_INDEX))
+#define GSWAT_IS_SOURCE_INDEX_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), GSWAT_TYPE_SOURCE_INDEX))
+#define GSWAT_SOURCE_INDEX_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), GSWAT_TYPE_SOURCE_INDEX, GSwatSourceIndexClass))
+
+typedef struct _GSwatSourceIndex        GSwatSourceIndex;
+typedef struct _GSwatSourceIndexClass   GSwatSourceIndexClass;
+typedef struct _GSwatSourceIndexPrivate GSwatSourceIndexPrivate;
+
+struct _GSwatSourceIndex
+{
+  GObject parent;
+
+  /*< private > */
+  GSwatSourceIndexPrivate *priv;
+};
+
+struct _GSwatSourceIndexClass
+{
+  GObjectClass parent_class;
+};
+
+GType gswat_source_index_get_type (void);
+
+GSwatSourceIndex *gswat_source_index_new (void);
+void gswat_source_index_set_paths (GSwatSourceIndex *self,
+				   const GList *paths);
+gboolean gswat_source_index_is_ready (GSwatSourceIndex *self);
+gchar *gswat_source_index_lookup (GSwatSourceIndex *self,
+				  const gchar *filename);
+
+G_END_DECLS
+
+#endif /* GSWAT_SOURCE_INDEX_H */
+
@@ -160,6 +160,37 @@ gswat_variable_object_get_value (GSwatVariableObject *object, GError **error)
   return ret;
 }
 
+/* Like gswat_variable_object_get_value, but without blocking.
+ * callback is called from the main loop once the value is available,
+ * and should call gswat_variable_object_get_value_finish to get it. */
+void
+gswat_variable_object_get_value_async (GSwatVariableObject *object,
+				       GCancellable *cancellable,
+				       GAsyncReadyCallback callback,
+				       gpointer user_data)
+{
+  GSwatVariableObjectIface *variable_object;
+
+  g_return_if_fail (GSWAT_IS_VARIABLE_OBJECT (object));
+  variable_object = GSWAT_VARIABLE_OBJECT_GET_IFACE (object);
+
+  variable_object->get_value_async (object, cancellable, callback, user_data);
+}
+
+gchar *
+gswat_variable_object_get_value_finish (GSwatVariableObject *object,
+					GAsyncResult *result,
+					GError **error)
+{
+  GSwatVariableObjectIface *variable_object;
+
+  g_return_val_if_fail (GSWAT_IS_VARIABLE_OBJECT (object), NULL);
+  g_return_val_if_fail (G_IS_ASYNC_RESULT (result), NULL);
+  variable_object = GSWAT_VARIABLE_OBJECT_GET_IFACE (object);
+
+  return variable_object->get_value_finish (object, result, error);
+}
+
 guint
 gswat_variable_object_get_child_count (GSwatVariableObject *object)
 {
@@ -192,6 +223,40 @@ gswat_variable_object_get_children (GSwatVariableObject* object)
   return ret;
 }
 
+/* Like gswat_variable_object_get_children, but without blocking.
+ * callback is called from the main loop once the children are
+ * available, and should call gswat_variable_object_get_children_finish
+ * to get them. */
+void
+gswat_variable_object_get_children_async (GSwatVariableObject *object,
+					  GCancellable *cancellable,
+					  GAsyncReadyCallback callback,
+					  gpointer user_data)
+{
+  GSwatVariableObjectIface *variable_object;
+
+  g_return_if_fail (GSWAT_IS_VARIABLE_OBJECT (object));
+  variable_object = GSWAT_VARIABLE_OBJECT_GET_IFACE (object);
+
+  variable_object->get_children_async (object, cancellable, callback,
+				       user_data);
+}
+
+/* Returns a list of referenced child GSwatVariableObjects */
+GList *
+gswat_variable_object_get_children_finish (GSwatVariableObject *object,
+					   GAsyncResult *result,
+					   GError **error)
+{
+  GSwatVariableObjectIface *variable_object;
+
+  g_return_val_if_fail (GSWAT_IS_VARIABLE_OBJECT (object), NULL);
+  g_return_val_if_fail (G_IS_ASYNC_RESULT (result), NULL);
+  variable_object = GSWAT_VARIABLE_OBJECT_GET_IFACE (object);
+
+  return variable_object->get_children_finish (object, result, error);
+}
+
 GQuark
 gswat_variable_object_error_quark (void)
 {
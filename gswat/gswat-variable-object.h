@@ -23,6 +23,7 @@
 #define GSWAT_VARIABLE_OBJECT_H
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -33,7 +34,8 @@ G_BEGIN_DECLS
 
 #define GSWAT_VARIABLE_OBJECT_ERROR (gswat_variable_object_error_quark ())
 enum {
-    GSWAT_VARIABLE_OBJECT_ERROR_GET_VALUE_FAILED
+    GSWAT_VARIABLE_OBJECT_ERROR_GET_VALUE_FAILED,
+    GSWAT_VARIABLE_OBJECT_ERROR_GET_CHILDREN_FAILED
 };
 
 enum {
@@ -56,6 +58,20 @@ struct _GSwatVariableObjectIface
   gchar *(*get_value)(GSwatVariableObject *object, GError **error);
   guint  (*get_child_count)(GSwatVariableObject *object);
   GList *(*get_children)(GSwatVariableObject* object);
+  void (*get_value_async)(GSwatVariableObject *object,
+                          GCancellable *cancellable,
+                          GAsyncReadyCallback callback,
+                          gpointer user_data);
+  gchar *(*get_value_finish)(GSwatVariableObject *object,
+                             GAsyncResult *result,
+                             GError **error);
+  void (*get_children_async)(GSwatVariableObject *object,
+                             GCancellable *cancellable,
+                             GAsyncReadyCallback callback,
+                             gpointer user_data);
+  GList *(*get_children_finish)(GSwatVariableObject *object,
+                                GAsyncResult *result,
+                                GError **error);
 };
 
 GType gswat_variable_object_get_type (void);
@@ -65,8 +81,22 @@ GQuark gswat_variable_object_error_quark (void);
 gchar *gswat_variable_object_get_expression (GSwatVariableObject* self);
 gchar *gswat_variable_object_get_value (GSwatVariableObject *self,
 					GError **error);
+void gswat_variable_object_get_value_async (GSwatVariableObject *self,
+					    GCancellable *cancellable,
+					    GAsyncReadyCallback callback,
+					    gpointer user_data);
+gchar *gswat_variable_object_get_value_finish (GSwatVariableObject *self,
+					       GAsyncResult *result,
+					       GError **error);
 guint  gswat_variable_object_get_child_count (GSwatVariableObject *self);
 GList *gswat_variable_object_get_children (GSwatVariableObject* self);
+void gswat_variable_object_get_children_async (GSwatVariableObject *self,
+					       GCancellable *cancellable,
+					       GAsyncReadyCallback callback,
+					       gpointer user_data);
+GList *gswat_variable_object_get_children_finish (GSwatVariableObject *self,
+						  GAsyncResult *result,
+						  GError **error);
 
 G_END_DECLS
 
@@ -0,0 +1,435 @@
+/*
+ * Replays a corpus of GDB/MI records through the MI parser and reports
+ * the throughput, the time taken and the number of heap allocations
+ * made per record, for both the eager and lazy parse modes.
+ *
+ * The built in corpus covers the records GSwat sees most often along
+ * with some pathological ones; deep stacks, large -var-list-children
+ * replies, heavily escaped strings and -thread-info for 1000 threads.
+ * Captured gdb sessions can also be replayed by passing the files on
+ * the command line, in which case each result or async record found
+ * in them is timed separately. Prompts, stream records and anything
+ * else that doesn't look like a record are ignored.
+ *
+ * With --transport it instead compares what it costs to get each
+ * record's text to the parser: converting the whole record from the
+ * locale's charset with iconv, as the debugger does unless it's using
+ * raw I/O, against the UTF-8 check raw I/O leaves to the strings
+ * handed on to the API's users. The check is timed over the whole
+ * record, so it's an upper bound.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <gswat/gswat-gdbmi.h>
+#include <gswat/gswat-gdbmi-private.h>
+
+typedef struct {
+  gchar *name;
+  gchar *record;
+} BenchRecord;
+
+static gdouble min_time = 0.5;
+static gchar *scanner_name = NULL;
+static gboolean transport = FALSE;
+static gchar *charset = "ISO-8859-15";
+
+static GOptionEntry entries[] = {
+  { "time", 't', 0, G_OPTION_ARG_DOUBLE, &min_time,
+    "Minimum number of seconds to spend on each record and mode", "SECS" },
+  { "scanner", 's', 0, G_OPTION_ARG_STRING, &scanner_name,
+    "Literal scanner to use: auto, scalar, sse2 or avx2", "NAME" },
+  { "transport", 0, 0, G_OPTION_ARG_NONE, &transport,
+    "Compare iconv conversion with raw I/O's UTF-8 check", NULL },
+  { "charset", 'c', 0, G_OPTION_ARG_STRING, &charset,
+    "The charset to convert from with --transport", "CHARSET" },
+  { NULL }
+};
+
+static void
+append_frame (GString *out, gint level)
+{
+  g_string_append_printf (out,
+			  "frame={level=\"%d\",addr=\"0x%08x\","
+			  "func=\"recurse_%d\",file=\"recurse.c\","
+			  "fullname=\"/home/user/src/project/recurse.c\","
+			  "line=\"%d\"}",
+			  level, 0x80483f0 + level * 0x24, level % 7,
+			  100 + level % 50);
+}
+
+static gchar *
+make_deep_stack (gint depth)
+{
+  GString *out = g_string_new ("^done,stack=[");
+  gint i;
+
+  for (i = 0; i < depth; i++)
+    {
+      if (i)
+	g_string_append_c (out, ',');
+      append_frame (out, i);
+    }
+  g_string_append_c (out, ']');
+
+  return g_string_free (out, FALSE);
+}
+
+static gchar *
+make_stack_args (gint depth)
+{
+  GString *out = g_string_new ("^done,stack-args=[");
+  gint i;
+
+  for (i = 0; i < depth; i++)
+    {
+      if (i)
+	g_string_append_c (out, ',');
+      g_string_append_printf (out,
+			      "frame={level=\"%d\",args=["
+			      "{name=\"depth\",value=\"%d\"},"
+			      "{name=\"node\",value=\"0x%08x\"},"
+			      "{name=\"label\",value=\"0x8048600 \\\"node %d\\\"\"}"
+			      "]}",
+			      i, i, 0x804a000 + i * 16, i);
+    }
+  g_string_append_c (out, ']');
+
+  return g_string_free (out, FALSE);
+}
+
+static gchar *
+make_var_list_children (gint n_children)
+{
+  GString *out;
+  gint i;
+
+  out = g_string_new ("");
+  g_string_append_printf (out, "^done,numchild=\"%d\",children=[",
+			  n_children);
+  for (i = 0; i < n_children; i++)
+    {
+      if (i)
+	g_string_append_c (out, ',');
+      g_string_append_printf (out,
+			      "child={name=\"var1.%d\",exp=\"%d\","
+			      "numchild=\"0\",value=\"%d\",type=\"int\"}",
+			      i, i, i * 3);
+    }
+  g_string_append (out, "],has_more=\"0\"");
+
+  return g_string_free (out, FALSE);
+}
+
+static gchar *
+make_escaped_string (gint length)
+{
+  static const gchar *pieces[] = {
+    "\\\"", "\\\\", "\\n", "\\t", "\\302\\251", "abc", "\\000", " "
+  };
+  GString *out = g_string_new ("^done,value=\"0x804a0c0 \\\"");
+  gint i;
+
+  for (i = 0; out->len < length; i++)
+    g_string_append (out, pieces[i % G_N_ELEMENTS (pieces)]);
+  g_string_append (out, "\\\"...\"");
+
+  return g_string_free (out, FALSE);
+}
+
+static gchar *
+make_thread_info (gint n_threads)
+{
+  GString *out = g_string_new ("^done,threads=[");
+  gint i;
+
+  for (i = 1; i <= n_threads; i++)
+    {
+      if (i > 1)
+	g_string_append_c (out, ',');
+      g_string_append_printf (out,
+			      "{id=\"%d\",target-id=\"Thread 0x%08x (LWP %d)\","
+			      "name=\"worker-%d\","
+			      "frame={level=\"0\",addr=\"0x%08x\","
+			      "func=\"pthread_cond_wait\",args=["
+			      "{name=\"cond\",value=\"0x%08x\"},"
+			      "{name=\"mutex\",value=\"0x%08x\"}],"
+			      "from=\"/lib/libpthread.so.0\"},"
+			      "state=\"stopped\",core=\"%d\"}",
+			      i, 0xb7000000 + i * 0x1000, 4000 + i, i,
+			      0xb7f1c000 + i, 0x804c000 + i * 8,
+			      0x804d000 + i * 8, i % 8);
+    }
+  g_string_append (out, "],current-thread-id=\"1\"");
+
+  return g_string_free (out, FALSE);
+}
+
+static void
+add_record (GArray *records, const gchar *name, gchar *record)
+{
+  BenchRecord r;
+
+  r.name = g_strdup (name);
+  r.record = record;
+  g_array_append_val (records, r);
+}
+
+static void
+add_builtin_records (GArray *records)
+{
+  add_record (records, "evaluate", g_strdup ("^done,value=\"42\""));
+  add_record (records, "stopped",
+	      g_strdup ("*stopped,reason=\"breakpoint-hit\",disp=\"keep\","
+			"bkptno=\"1\",thread-id=\"1\",frame={"
+			"addr=\"0x08048564\",func=\"main\",args=["
+			"{name=\"argc\",value=\"1\"},"
+			"{name=\"argv\",value=\"0xbfc4d4d4\"}],"
+			"file=\"myprog.c\",fullname=\"/home/user/myprog.c\","
+			"line=\"68\"}"));
+  add_record (records, "break-insert",
+	      g_strdup ("^done,bkpt={number=\"1\",type=\"breakpoint\","
+			"disp=\"keep\",enabled=\"y\",addr=\"0x08048564\","
+			"func=\"main\",file=\"myprog.c\","
+			"fullname=\"/home/user/myprog.c\",line=\"68\","
+			"times=\"0\"}"));
+  add_record (records, "var-update",
+	      g_strdup ("^done,changelist=[{name=\"var1\",value=\"3\","
+			"in_scope=\"true\",type_changed=\"false\"},"
+			"{name=\"var2\",in_scope=\"false\","
+			"type_changed=\"false\"}]"));
+  add_record (records, "stack-16", make_deep_stack (16));
+  add_record (records, "stack-1000", make_deep_stack (1000));
+  add_record (records, "stack-args-1000", make_stack_args (1000));
+  add_record (records, "var-list-children-5000",
+	      make_var_list_children (5000));
+  add_record (records, "escaped-64k", make_escaped_string (64 * 1024));
+  add_record (records, "thread-info-1000", make_thread_info (1000));
+  add_record (records, "stack-utf8",
+	      g_strdup ("^done,stack=[frame={level=\"0\",addr=\"0x08048564\","
+			"func=\"r\303\251sum\303\251\",file=\"caf\303\251.c\","
+			"fullname=\"/home/j\303\274rgen/caf\303\251.c\","
+			"line=\"12\"}]"));
+}
+
+static gboolean
+load_records (GArray *records, const gchar *filename)
+{
+  GError *error = NULL;
+  gchar *contents;
+  gchar **lines;
+  gint i;
+
+  if (!g_file_get_contents (filename, &contents, NULL, &error))
+    {
+      fprintf (stderr, "%s\n", error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (i = 0; lines[i]; i++)
+    {
+      gchar *line = g_strchomp (lines[i]);
+      gchar *name;
+
+      /* Skip over any leading token */
+      while (g_ascii_isdigit (*line))
+	line++;
+      if (*line == '\0' || !strchr ("^*=+", *line))
+	continue;
+
+      name = g_strdup_printf ("%s:%d", filename, i + 1);
+      add_record (records, name, g_strdup (line));
+      g_free (name);
+    }
+  g_strfreev (lines);
+  g_free (contents);
+
+  return TRUE;
+}
+
+static void
+bench_record (const BenchRecord *r, GDBMIParseMode mode)
+{
+  gsize len = strlen (r->record);
+  GDBMIValue *val;
+  GTimer *timer;
+  guint allocations;
+  gulong iterations = 0;
+  gulong batch = 1;
+  gdouble elapsed;
+
+  /* Check the record parses at all and warm up */
+  val = gdbmi_value_parse_full (r->record, mode);
+  if (!val)
+    {
+      printf ("%-28s %-5s failed to parse\n", r->name,
+	      mode == GDBMI_PARSE_EAGER ? "eager" : "lazy");
+      return;
+    }
+  gdbmi_value_free (val);
+
+  timer = g_timer_new ();
+  allocations = _gdbmi_get_allocation_count ();
+  g_timer_start (timer);
+  do
+    {
+      gulong i;
+
+      for (i = 0; i < batch; i++)
+	gdbmi_value_free (gdbmi_value_parse_full (r->record, mode));
+      iterations += batch;
+      batch *= 2;
+      elapsed = g_timer_elapsed (timer, NULL);
+    }
+  while (elapsed < min_time);
+  allocations = _gdbmi_get_allocation_count () - allocations;
+  g_timer_destroy (timer);
+
+  printf ("%-28s %-5s %9" G_GSIZE_FORMAT " %10.1f %12.0f %10.2f\n",
+	  r->name,
+	  mode == GDBMI_PARSE_EAGER ? "eager" : "lazy",
+	  len,
+	  (len * (gdouble)iterations) / elapsed / (1024 * 1024),
+	  elapsed * 1e9 / iterations,
+	  (gdouble)allocations / iterations);
+}
+
+typedef void (*TransportFunc) (const gchar *record, gsize len);
+
+static void
+transport_iconv (const gchar *record, gsize len)
+{
+  g_free (g_convert (record, len, "UTF-8", charset, NULL, NULL, NULL));
+}
+
+static void
+transport_raw (const gchar *record, gsize len)
+{
+  g_free (gdbmi_literal_dup_utf8 (record, len));
+}
+
+static void
+bench_transport (const BenchRecord *r,
+		 const gchar *name,
+		 TransportFunc func)
+{
+  gsize len = strlen (r->record);
+  GTimer *timer;
+  gulong iterations = 0;
+  gulong batch = 1;
+  gdouble elapsed;
+
+  timer = g_timer_new ();
+  do
+    {
+      gulong i;
+
+      for (i = 0; i < batch; i++)
+	func (r->record, len);
+      iterations += batch;
+      batch *= 2;
+      elapsed = g_timer_elapsed (timer, NULL);
+    }
+  while (elapsed < min_time);
+  g_timer_destroy (timer);
+
+  printf ("%-28s %-5s %9" G_GSIZE_FORMAT " %10.1f %12.0f\n",
+	  r->name,
+	  name,
+	  len,
+	  (len * (gdouble)iterations) / elapsed / (1024 * 1024),
+	  elapsed * 1e9 / iterations);
+}
+
+static void
+ignore_log_handler (const gchar *log_domain,
+		    GLogLevelFlags log_level,
+		    const gchar *message,
+		    gpointer user_data)
+{
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GArray *records;
+  gint i;
+
+  context = g_option_context_new ("[FILE...] - benchmark the GDB/MI parser");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      fprintf (stderr, "%s\n", error->message);
+      return 1;
+    }
+  g_option_context_free (context);
+
+  if (scanner_name)
+    {
+      static const struct {
+	const gchar *name;
+	GDBMIScanner scanner;
+      } scanners[] = {
+	{ "auto", GDBMI_SCANNER_AUTO },
+	{ "scalar", GDBMI_SCANNER_SCALAR },
+	{ "sse2", GDBMI_SCANNER_SSE2 },
+	{ "avx2", GDBMI_SCANNER_AVX2 }
+      };
+
+      for (i = 0; i < G_N_ELEMENTS (scanners); i++)
+	if (strcmp (scanner_name, scanners[i].name) == 0)
+	  break;
+      if (i == G_N_ELEMENTS (scanners)
+	  || !_gdbmi_set_scanner (scanners[i].scanner))
+	{
+	  fprintf (stderr, "The %s scanner isn't available\n", scanner_name);
+	  return 1;
+	}
+    }
+
+  /* Captured sessions may well contain records the parser rejects */
+  g_log_set_handler ("GSwat", G_LOG_LEVEL_WARNING, ignore_log_handler, NULL);
+
+  records = g_array_new (FALSE, FALSE, sizeof (BenchRecord));
+  if (argc > 1)
+    {
+      for (i = 1; i < argc; i++)
+	if (!load_records (records, argv[i]))
+	  return 1;
+    }
+  else
+    add_builtin_records (records);
+
+  if (transport)
+    printf ("%-28s %-5s %9s %10s %12s\n",
+	    "record", "mode", "bytes", "MB/s", "ns/record");
+  else
+    printf ("%-28s %-5s %9s %10s %12s %10s\n",
+	    "record", "mode", "bytes", "MB/s", "ns/record", "allocs");
+  for (i = 0; i < records->len; i++)
+    {
+      BenchRecord *r = &g_array_index (records, BenchRecord, i);
+
+      if (transport)
+	{
+	  bench_transport (r, "iconv", transport_iconv);
+	  bench_transport (r, "raw", transport_raw);
+	}
+      else
+	{
+	  bench_record (r, GDBMI_PARSE_EAGER);
+	  bench_record (r, GDBMI_PARSE_LAZY);
+	}
+      g_free (r->name);
+      g_free (r->record);
+    }
+  g_array_free (records, TRUE);
+
+  return 0;
+}
@@ -0,0 +1,291 @@
+/*
+ * Fuzzing entry point for the GDB/MI parser, pull reader and record
+ * decoders. Each input is parsed with every available literal scanner
+ * in both the eager and lazy modes, the results are checked against
+ * each other and against the reader, and the input is fed through
+ * each of the record decoders.
+ *
+ * The input is treated as a single record, up to its first NUL.
+ *
+ * For libFuzzer build with -DGDBMI_FUZZ_LIBFUZZER and
+ * -fsanitize=fuzzer. Otherwise the program runs the entry point over
+ * each file named on the command line, or over stdin if there are
+ * none, which is what AFL expects and is handy for reproducing
+ * crashes.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <glib.h>
+#include <gswat/gswat-gdbmi.h>
+#include <gswat/gswat-gdbmi-private.h>
+#include <gswat/gswat-gdb-mi-decoders.h>
+
+int LLVMFuzzerTestOneInput (const guint8 *data, size_t size);
+
+static const GDBMIScanner scanners[] = {
+  GDBMI_SCANNER_SCALAR,
+  GDBMI_SCANNER_SSE2,
+  GDBMI_SCANNER_AVX2
+};
+
+static void walk (const GDBMIValue *val, GString *out);
+
+/* Also touches every accessor, which for lazy values builds the
+ * containers as it goes */
+static void
+walk (const GDBMIValue *val, GString *out)
+{
+  const GDBMIValue *element;
+  GDBMIIter iter;
+  gint i = 0;
+
+  if (gdbmi_value_get_name (val))
+    g_string_append_printf (out, "%s=", gdbmi_value_get_name (val));
+
+  if (gdbmi_value_get_type (val) == GDBMI_DATA_LITERAL)
+    {
+      gchar *escaped = g_strescape (gdbmi_value_literal_get (val), NULL);
+      g_string_append_printf (out, "\"%s\"", escaped);
+      g_free (escaped);
+      return;
+    }
+
+  g_string_append_c (out, gdbmi_value_get_type (val) == GDBMI_DATA_HASH
+		     ? '{' : '[');
+  gdbmi_value_iter_init (&iter, val);
+  while ((element = gdbmi_value_iter_next (&iter)))
+    {
+      const gchar *name = gdbmi_value_get_name (element);
+
+      if (i)
+	g_string_append_c (out, ',');
+      if (gdbmi_value_get_type (val) == GDBMI_DATA_LIST)
+	{
+	  if (gdbmi_value_list_get_nth (val, i) != element)
+	    abort ();
+	}
+      else if (name && !gdbmi_value_hash_lookup (val, name))
+	abort ();
+      i++;
+      walk (element, out);
+    }
+  if (gdbmi_value_get_size (val) != i)
+    abort ();
+  g_string_append_c (out, gdbmi_value_get_type (val) == GDBMI_DATA_HASH
+		     ? '}' : ']');
+}
+
+static gchar *
+parse (const gchar *message, GDBMIParseMode mode)
+{
+  GDBMIValue *val;
+  GString *out;
+
+  val = gdbmi_value_parse_full (message, mode);
+  if (!val)
+    return NULL;
+
+  out = g_string_new ("");
+  walk (val, out);
+  gdbmi_value_free (val);
+
+  return g_string_free (out, FALSE);
+}
+
+static gboolean
+read_all (GDBMIReader *reader)
+{
+  GDBMIToken token;
+
+  while ((token = gdbmi_reader_next (reader)) > GDBMI_TOKEN_END)
+    {
+      if (token == GDBMI_TOKEN_LITERAL)
+	{
+	  if (!gdbmi_reader_get_literal (reader))
+	    return FALSE;
+	  gdbmi_reader_get_long (reader, 0);
+	}
+      else if (!gdbmi_reader_enter (reader)
+	       || !read_all (reader)
+	       || !gdbmi_reader_leave (reader))
+	return FALSE;
+    }
+
+  return !gdbmi_reader_failed (reader);
+}
+
+static void
+free_stack (GQueue *stack)
+{
+  GSwatDebuggableFrame *frame;
+
+  while ((frame = g_queue_pop_head (stack)))
+    {
+      GList *l;
+
+      for (l = frame->arguments; l; l = l->next)
+	{
+	  GSwatDebuggableFrameArgument *arg = l->data;
+	  g_free (arg->name);
+	  g_free (arg->value);
+	  g_free (arg);
+	}
+      g_list_free (frame->arguments);
+      g_free (frame->function);
+      g_free (frame->source_uri);
+      g_free (frame);
+    }
+}
+
+static void
+decode (const gchar *message)
+{
+  GSwatDebuggableFrame frame = { 0, };
+  GSwatDebuggableBreakpoint breakpoint = { 0, };
+  GSwatGdbMIStopReason reason;
+  GSwatGdbMIVarobj varobj;
+  GQueue stack = G_QUEUE_INIT;
+  GList *list;
+  guint depth;
+
+  gswat_gdb_mi_decode_result_class (message);
+  gswat_gdb_mi_decode_stack_depth (message, &depth);
+
+  gswat_gdb_mi_decode_stack (message, &stack, NULL, NULL);
+  gswat_gdb_mi_decode_stack_args (message, &stack);
+  free_stack (&stack);
+
+  gswat_gdb_mi_decode_frame_arguments (message, 0, &list);
+  gswat_debuggable_free_frame_arguments (list);
+
+  gswat_gdb_mi_decode_stopped (message, &reason, &frame, NULL, NULL);
+  g_free (frame.function);
+  g_free (frame.source_uri);
+
+  gswat_gdb_mi_decode_breakpoint (message, &breakpoint, NULL, NULL);
+  g_free (breakpoint.source_uri);
+
+  gswat_gdb_mi_decode_varobj (message, &varobj);
+  gswat_gdb_mi_varobj_clear (&varobj);
+
+  if (!gswat_gdb_mi_decode_varobj_children (message, &list) && list)
+    abort ();
+  g_list_foreach (list, (GFunc)gswat_gdb_mi_varobj_free, NULL);
+  g_list_free (list);
+
+  if (!gswat_gdb_mi_decode_changelist (message, &list) && list)
+    abort ();
+  g_list_foreach (list, (GFunc)gswat_gdb_mi_varobj_change_free, NULL);
+  g_list_free (list);
+}
+
+static void
+ignore_log_handler (const gchar *log_domain,
+		    GLogLevelFlags log_level,
+		    const gchar *message,
+		    gpointer user_data)
+{
+}
+
+int
+LLVMFuzzerTestOneInput (const guint8 *data, size_t size)
+{
+  static gboolean initialized = FALSE;
+  gchar *message;
+  gchar *expected = NULL;
+  gboolean have_expected = FALSE;
+  GDBMIReader reader;
+  int i;
+
+  if (!initialized)
+    {
+      /* Rejecting bad input with a warning is fine, anything more
+       * severe is a bug */
+      g_log_set_always_fatal (G_LOG_LEVEL_CRITICAL | G_LOG_FATAL_MASK);
+      g_log_set_handler ("GSwat", G_LOG_LEVEL_WARNING,
+			 ignore_log_handler, NULL);
+      initialized = TRUE;
+    }
+
+  message = g_strndup ((const gchar *)data, size);
+
+  for (i = 0; i < G_N_ELEMENTS (scanners); i++)
+    {
+      gchar *eager, *lazy;
+
+      if (!_gdbmi_set_scanner (scanners[i]))
+	continue;
+
+      eager = parse (message, GDBMI_PARSE_EAGER);
+      lazy = parse (message, GDBMI_PARSE_LAZY);
+      if (g_strcmp0 (eager, lazy) != 0)
+	abort ();
+      if (have_expected && g_strcmp0 (eager, expected) != 0)
+	abort ();
+      g_free (expected);
+      g_free (lazy);
+      expected = eager;
+      have_expected = TRUE;
+    }
+  _gdbmi_set_scanner (GDBMI_SCANNER_AUTO);
+
+  /* The reader has to accept everything the parser does, though it
+   * treats a record without any results as an empty tuple, so only
+   * records with results are compared */
+  gdbmi_reader_init (&reader, message);
+  if (!read_all (&reader) && expected && strchr (message, ','))
+    abort ();
+  gdbmi_reader_clear (&reader);
+
+  decode (message);
+
+  g_free (expected);
+  g_free (message);
+
+  return 0;
+}
+
+#ifndef GDBMI_FUZZ_LIBFUZZER
+static void
+run_file (FILE *file)
+{
+  GString *input = g_string_new ("");
+  gchar buffer[4096];
+  size_t len;
+
+  while ((len = fread (buffer, 1, sizeof (buffer), file)) > 0)
+    g_string_append_len (input, buffer, len);
+
+  LLVMFuzzerTestOneInput ((const guint8 *)input->str, input->len);
+  g_string_free (input, TRUE);
+}
+
+int
+main (int argc, char **argv)
+{
+  int i;
+
+  if (argc < 2)
+    {
+      run_file (stdin);
+      return 0;
+    }
+
+  for (i = 1; i < argc; i++)
+    {
+      FILE *file = fopen (argv[i], "rb");
+
+      if (!file)
+	{
+	  perror (argv[i]);
+	  return 1;
+	}
+      run_file (file);
+      fclose (file);
+    }
+
+  return 0;
+}
+#endif
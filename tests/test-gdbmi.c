@@ -0,0 +1,809 @@
+/*
+ * Checks the GDB/MI parser against a straightforward reference
+ * implementation of the original GString and g_strcompress() based
+ * parser, using each of the available literal scanners and both the
+ * eager and lazy parse modes, along with the pull reader. Also checks
+ * the typed record decoders built on the reader.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <glib.h>
+#include <gswat/gswat-gdbmi.h>
+#include <gswat/gswat-gdbmi-private.h>
+#include <gswat/gswat-gdb-mi-decoders.h>
+
+static const gchar *corpus[] = {
+  "^done",
+  "^done,bkpt={number=\"1\",type=\"breakpoint\",disp=\"keep\",enabled=\"y\","
+    "addr=\"0x08048564\",func=\"main\",file=\"myprog.c\","
+    "fullname=\"/home/nickrob/myprog.c\",line=\"68\",times=\"0\"}",
+  "^done,stack=[frame={level=\"0\",addr=\"0x0001076c\",func=\"foo\","
+    "file=\"recurse.c\",fullname=\"/home/foo/bar/recurse.c\",line=\"11\"},"
+    "frame={level=\"1\",addr=\"0x000107a4\",func=\"foo\",file=\"recurse.c\","
+    "line=\"14\"}]",
+  "^done,stack-args=[frame={level=\"0\",args=[{name=\"a\",value=\"1\"},"
+    "{name=\"s\",value=\"0x8048600 \\\"hi\\\\n\\\\t\\\"\"}]},"
+    "frame={level=\"1\",args=[]}]",
+  "*stopped,reason=\"breakpoint-hit\",disp=\"keep\",bkptno=\"1\","
+    "thread-id=\"0\",frame={addr=\"0x08048564\",func=\"main\","
+    "args=[{name=\"argc\",value=\"1\"},{name=\"argv\",value=\"0xbfc4d4d4\"}],"
+    "file=\"myprog.c\",fullname=\"/home/nickrob/myprog.c\",line=\"68\"}",
+  "^done,name=\"var1\",numchild=\"1\",value=\"0x0\",type=\"int *\"",
+  "^done,numchild=\"2\",children=[child={name=\"var1.a\",exp=\"a\","
+    "numchild=\"0\",type=\"int\"},child={name=\"var1.b\",exp=\"b\","
+    "numchild=\"0\",type=\"char\"}]",
+  "^done,changelist=[{name=\"var1\",in_scope=\"true\","
+    "type_changed=\"false\"},{name=\"var2\",in_scope=\"false\","
+    "type_changed=\"false\"}]",
+  "^done,thread-ids={thread-id=\"3\",thread-id=\"2\",thread-id=\"1\"},"
+    "number-of-threads=\"3\"",
+  "^error,msg=\"No symbol \\\"foo\\\" in current context.\"",
+  "^done,value=\"\\\\\\\\ \\101\\102\\7777 \\0 tail\"",
+  "^done,locals=[name=\"a\",name=\"b\"],x=[\"1\",[\"2\",{}]],y={}",
+  "^done,value=\"caf\xc3\xa9 \xe2\x82\xac\"",
+  "^done,x=",
+  "^done,x=\"unterminated",
+  "^done,x={a=\"1\"",
+  "^done,x=[{\"1\"}]",
+  "^done,,",
+};
+
+/* Reference parser */
+
+static gboolean ref_parse_value (const gchar **ptr, GString *out,
+				 gboolean named);
+
+static gboolean
+ref_parse_container (const gchar **ptr, GString *out,
+		     gboolean is_hash, gchar close)
+{
+  gboolean first = TRUE;
+
+  g_string_append_c (out, is_hash ? '{' : '[');
+  while (**ptr != close)
+    {
+      gboolean named = isalpha (**ptr);
+
+      if (!first)
+	g_string_append_c (out, ',');
+      first = FALSE;
+
+      if (!ref_parse_value (ptr, out, FALSE))
+	return FALSE;
+      if (is_hash && !named)
+	return FALSE;
+      if (**ptr != ',' && **ptr != close)
+	return FALSE;
+      if (**ptr == ',')
+	(*ptr)++;
+    }
+  if (close != '\0')
+    (*ptr)++;
+  g_string_append_c (out, is_hash ? '}' : ']');
+  return TRUE;
+}
+
+/* When a value is assigned to more than once, as in a=b="1", the
+ * outermost name wins */
+static gboolean
+ref_parse_value (const gchar **ptr, GString *out, gboolean named)
+{
+  const gchar *p = *ptr;
+
+  if (*p == '"')
+    {
+      gchar *raw, *literal, *escaped;
+
+      for (p++; *p != '"'; p++)
+	{
+	  if (*p == '\\')
+	    p++;
+	  if (*p == '\0')
+	    return FALSE;
+	}
+      raw = g_strndup (*ptr + 1, p - *ptr - 1);
+      literal = g_strcompress (raw);
+      escaped = g_strescape (literal, NULL);
+      g_string_append_printf (out, "\"%s\"", escaped);
+      g_free (escaped);
+      g_free (literal);
+      g_free (raw);
+      *ptr = p + 1;
+      return TRUE;
+    }
+  else if (isalpha (*p))
+    {
+      const gchar *eq = strchr (p, '=');
+
+      if (!eq)
+	return FALSE;
+      if (!named)
+	{
+	  g_string_append_len (out, p, eq - p);
+	  g_string_append_c (out, '=');
+	}
+      *ptr = eq + 1;
+      return ref_parse_value (ptr, out, TRUE);
+    }
+  else if (*p == '{' || *p == '[')
+    {
+      (*ptr)++;
+      return ref_parse_container (ptr, out, *p == '{', *p == '{' ? '}' : ']');
+    }
+
+  return FALSE;
+}
+
+static gchar *
+ref_parse (const gchar *message)
+{
+  const gchar *p;
+  GString *out;
+
+  if (strcasecmp (message, "^error") == 0)
+    return NULL;
+  p = strchr (message, ',');
+  if (!p)
+    return NULL;
+  p++;
+
+  out = g_string_new ("");
+  if (!ref_parse_container (&p, out, TRUE, '\0'))
+    {
+      g_string_free (out, TRUE);
+      return NULL;
+    }
+  return g_string_free (out, FALSE);
+}
+
+/* Converts a parsed value into the same form as the reference parser */
+
+static void canonicalize (const GDBMIValue *val, GString *out);
+
+static void
+canonicalize_foreach (const GDBMIValue *val, gpointer data)
+{
+  GString *out = data;
+
+  if (out->str[out->len - 1] != '{' && out->str[out->len - 1] != '[')
+    g_string_append_c (out, ',');
+  canonicalize (val, out);
+}
+
+static void
+canonicalize (const GDBMIValue *val, GString *out)
+{
+  if (gdbmi_value_get_name (val))
+    g_string_append_printf (out, "%s=", gdbmi_value_get_name (val));
+
+  switch (gdbmi_value_get_type (val))
+    {
+    case GDBMI_DATA_LITERAL:
+	{
+	  gchar *escaped = g_strescape (gdbmi_value_literal_get (val), NULL);
+	  g_string_append_printf (out, "\"%s\"", escaped);
+	  g_free (escaped);
+	  break;
+	}
+    case GDBMI_DATA_HASH:
+      g_string_append_c (out, '{');
+      gdbmi_value_foreach (val, (GFunc)canonicalize_foreach, out);
+      g_string_append_c (out, '}');
+      break;
+    case GDBMI_DATA_LIST:
+	{
+	  const GDBMIValue *element;
+	  GDBMIIter iter;
+	  gint i = 0;
+
+	  g_string_append_c (out, '[');
+	  gdbmi_value_iter_init (&iter, val);
+	  while ((element = gdbmi_value_iter_next (&iter)))
+	    {
+	      g_assert (gdbmi_value_list_get_nth (val, i++) == element);
+	      canonicalize_foreach (element, out);
+	    }
+	  g_assert (gdbmi_value_list_get_nth (val, i) == NULL);
+	  g_assert_cmpint (gdbmi_value_get_size (val), ==, i);
+	  g_string_append_c (out, ']');
+	  break;
+	}
+    }
+}
+
+static gchar *
+parse (const gchar *message, GDBMIParseMode mode)
+{
+  GDBMIValue *val;
+  GString *out;
+
+  val = gdbmi_value_parse_full (message, mode);
+  if (!val)
+    return NULL;
+
+  out = g_string_new ("");
+  canonicalize (val, out);
+  gdbmi_value_free (val);
+
+  return g_string_free (out, FALSE);
+}
+
+/* Converts a record read with a GDBMIReader into the same form. The
+ * names of elements aren't part of the reader's API so we peek. */
+static gboolean
+canonicalize_reader (GDBMIReader *reader, GString *out, gboolean is_hash)
+{
+  GDBMIToken token;
+  gboolean first = TRUE;
+
+  g_string_append_c (out, is_hash ? '{' : '[');
+  while ((token = gdbmi_reader_next (reader)) > GDBMI_TOKEN_END)
+    {
+      if (!first)
+	g_string_append_c (out, ',');
+      first = FALSE;
+
+      if (reader->name)
+	{
+	  g_string_append_len (out, reader->name, reader->name_len);
+	  g_string_append_c (out, '=');
+	}
+
+      if (token == GDBMI_TOKEN_LITERAL)
+	{
+	  const gchar *literal = gdbmi_reader_get_literal (reader);
+	  gchar *escaped;
+
+	  if (!literal)
+	    return FALSE;
+	  escaped = g_strescape (literal, NULL);
+	  g_string_append_printf (out, "\"%s\"", escaped);
+	  g_free (escaped);
+	}
+      else
+	{
+	  if (!gdbmi_reader_enter (reader)
+	      || !canonicalize_reader (reader, out,
+				       token == GDBMI_TOKEN_HASH)
+	      || !gdbmi_reader_leave (reader))
+	    return FALSE;
+	}
+    }
+  g_string_append_c (out, is_hash ? '}' : ']');
+
+  return !gdbmi_reader_failed (reader);
+}
+
+static gchar *
+parse_reader (const gchar *message)
+{
+  GDBMIReader reader;
+  GString *out = g_string_new ("");
+  gboolean success;
+
+  gdbmi_reader_init (&reader, message);
+  success = canonicalize_reader (&reader, out, TRUE);
+  gdbmi_reader_clear (&reader);
+
+  return g_string_free (out, !success);
+}
+
+static const struct {
+  GDBMIScanner scanner;
+  const gchar *name;
+} scanners[] = {
+  { GDBMI_SCANNER_SCALAR, "scalar" },
+  { GDBMI_SCANNER_SSE2, "sse2" },
+  { GDBMI_SCANNER_AVX2, "avx2" }
+};
+
+/* Checks a record with every scanner and parse mode */
+static void
+check_record (const gchar *message)
+{
+  gchar *expected = ref_parse (message);
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (scanners); i++)
+    {
+      gchar *eager, *lazy;
+
+      if (!_gdbmi_set_scanner (scanners[i].scanner))
+	continue;
+
+      eager = parse (message, GDBMI_PARSE_EAGER);
+      lazy = parse (message, GDBMI_PARSE_LAZY);
+      if (g_strcmp0 (eager, expected) != 0
+	  || g_strcmp0 (lazy, expected) != 0)
+	{
+	  g_error ("Mismatch using the %s scanner parsing:\n%s\n"
+		   "expected: %s\neager: %s\nlazy: %s",
+		   scanners[i].name, message,
+		   expected ? expected : "(error)",
+		   eager ? eager : "(error)",
+		   lazy ? lazy : "(error)");
+	}
+      g_free (eager);
+      g_free (lazy);
+    }
+
+  _gdbmi_set_scanner (GDBMI_SCANNER_AUTO);
+
+  /* Unlike the parser the reader treats a record without any
+   * results as an empty tuple */
+  if (strchr (message, ','))
+    {
+      gchar *read = parse_reader (message);
+
+      if (g_strcmp0 (read, expected) != 0)
+	g_error ("Mismatch using the reader on:\n%s\n"
+		 "expected: %s\nread: %s",
+		 message,
+		 expected ? expected : "(error)",
+		 read ? read : "(error)");
+      g_free (read);
+    }
+
+  g_free (expected);
+}
+
+static void
+test_corpus (void)
+{
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (corpus); i++)
+    check_record (corpus[i]);
+}
+
+/* Every prefix of a valid record, along with single byte corruptions
+ * of it, must be rejected or accepted exactly like the reference */
+static void
+test_corrupted (void)
+{
+  static const gchar specials[] = "\"\\{}[],=a";
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (corpus); i++)
+    {
+      gchar *copy = g_strdup (corpus[i]);
+      gsize len = strlen (copy);
+      gsize pos;
+
+      for (pos = 0; pos < len; pos++)
+	{
+	  gchar saved = copy[pos];
+	  const gchar *s;
+
+	  copy[pos] = '\0';
+	  check_record (copy);
+
+	  for (s = specials; *s; s++)
+	    {
+	      copy[pos] = *s;
+	      check_record (copy);
+	    }
+	  copy[pos] = saved;
+	}
+      g_free (copy);
+    }
+}
+
+static void
+append_random_literal (GString *out)
+{
+  static const gchar *pieces[] = {
+    "\\\"", "\\\\", "\\n", "\\t", "\\101", "\\7", "\\0", "\xc3\xa9",
+    " ", "/", "=", ",", "{", "]"
+  };
+  gint len = g_test_rand_int_range (0, 80);
+  gint i;
+
+  g_string_append_c (out, '"');
+  for (i = 0; i < len; i++)
+    {
+      if (g_test_rand_int_range (0, 8) == 0)
+	g_string_append (out, pieces[g_test_rand_int_range
+				     (0, G_N_ELEMENTS (pieces))]);
+      else
+	g_string_append_c (out, g_test_rand_int_range ('a', 'z' + 1));
+    }
+  g_string_append_c (out, '"');
+}
+
+static void
+append_random_value (GString *out, gint depth)
+{
+  gint kind = g_test_rand_int_range (0, depth > 3 ? 1 : 3);
+  gint n, i;
+
+  if (kind == 0)
+    {
+      append_random_literal (out);
+      return;
+    }
+
+  n = g_test_rand_int_range (0, 6);
+  g_string_append_c (out, kind == 1 ? '{' : '[');
+  for (i = 0; i < n; i++)
+    {
+      if (i)
+	g_string_append_c (out, ',');
+      if (kind == 1 || g_test_rand_bit ())
+	g_string_append_printf (out, "field-%d=",
+				g_test_rand_int_range (0, 4));
+      append_random_value (out, depth + 1);
+    }
+  g_string_append_c (out, kind == 1 ? '}' : ']');
+}
+
+static void
+test_random (void)
+{
+  int i;
+
+  for (i = 0; i < 2000; i++)
+    {
+      GString *record = g_string_new ("^done");
+      gint n = g_test_rand_int_range (1, 5);
+      gint j;
+
+      for (j = 0; j < n; j++)
+	{
+	  g_string_append_printf (record, ",result-%d=", j);
+	  append_random_value (record, 0);
+	}
+      check_record (record->str);
+      g_string_free (record, TRUE);
+    }
+}
+
+static void
+test_decode_keywords (void)
+{
+  static const struct {
+    const gchar *record;
+    GSwatGdbMIRecordType type;
+  } classes[] = {
+    { "^done", GSWAT_GDB_MI_REC_TYPE_RESULT_DONE },
+    { "^done,value=\"1\"", GSWAT_GDB_MI_REC_TYPE_RESULT_DONE },
+    { "^running", GSWAT_GDB_MI_REC_TYPE_RESULT_RUNNING },
+    { "^connected", GSWAT_GDB_MI_REC_TYPE_RESULT_CONNECTED },
+    { "^error,msg=\"x\"", GSWAT_GDB_MI_REC_TYPE_RESULT_ERROR },
+    { "^exit", GSWAT_GDB_MI_REC_TYPE_RESULT_EXIT },
+    { "^", GSWAT_GDB_MI_REC_TYPE_UNKNOWN },
+    { "^dune", GSWAT_GDB_MI_REC_TYPE_UNKNOWN },
+    { "^donee", GSWAT_GDB_MI_REC_TYPE_UNKNOWN },
+    { "*stopped", GSWAT_GDB_MI_REC_TYPE_UNKNOWN }
+  };
+  static const struct {
+    const gchar *name;
+    GSwatGdbMIStopReason reason;
+  } reasons[] = {
+    { "breakpoint-hit", GSWAT_GDB_MI_STOP_REASON_BREAKPOINT_HIT },
+    { "watchpoint-trigger", GSWAT_GDB_MI_STOP_REASON_WATCHPOINT_TRIGGER },
+    { "read-watchpoint-trigger",
+      GSWAT_GDB_MI_STOP_REASON_READ_WATCHPOINT_TRIGGER },
+    { "access-watchpoint-trigger",
+      GSWAT_GDB_MI_STOP_REASON_ACCESS_WATCHPOINT_TRIGGER },
+    { "function-finished", GSWAT_GDB_MI_STOP_REASON_FUNCTION_FINISHED },
+    { "location-reached", GSWAT_GDB_MI_STOP_REASON_LOCATION_REACHED },
+    { "watchpoint-scope", GSWAT_GDB_MI_STOP_REASON_WATCHPOINT_SCOPE },
+    { "end-stepping-range", GSWAT_GDB_MI_STOP_REASON_END_STEPPING_RANGE },
+    { "exited-signalled", GSWAT_GDB_MI_STOP_REASON_EXITED_SIGNALLED },
+    { "exited", GSWAT_GDB_MI_STOP_REASON_EXITED },
+    { "exited-normally", GSWAT_GDB_MI_STOP_REASON_EXITED_NORMALLY },
+    { "signal-received", GSWAT_GDB_MI_STOP_REASON_SIGNAL_RECEIVED },
+    { "solib-event", GSWAT_GDB_MI_STOP_REASON_SOLIB_EVENT },
+    { "fork", GSWAT_GDB_MI_STOP_REASON_FORK },
+    { "vfork", GSWAT_GDB_MI_STOP_REASON_VFORK },
+    { "syscall-entry", GSWAT_GDB_MI_STOP_REASON_SYSCALL_ENTRY },
+    { "syscall-return", GSWAT_GDB_MI_STOP_REASON_SYSCALL_RETURN },
+    { "exec", GSWAT_GDB_MI_STOP_REASON_EXEC },
+    { "no-history", GSWAT_GDB_MI_STOP_REASON_NO_HISTORY },
+    { "", GSWAT_GDB_MI_STOP_REASON_UNKNOWN },
+    { "exite", GSWAT_GDB_MI_STOP_REASON_UNKNOWN },
+    { "breakpoint-hit ", GSWAT_GDB_MI_STOP_REASON_UNKNOWN }
+  };
+  int i;
+
+  for (i = 0; i < G_N_ELEMENTS (classes); i++)
+    g_assert_cmpint (gswat_gdb_mi_decode_result_class (classes[i].record),
+		     ==, classes[i].type);
+
+  for (i = 0; i < G_N_ELEMENTS (reasons); i++)
+    g_assert_cmpint (gswat_gdb_mi_decode_stop_reason (reasons[i].name),
+		     ==, reasons[i].reason);
+  g_assert_cmpint (gswat_gdb_mi_decode_stop_reason (NULL),
+		   ==, GSWAT_GDB_MI_STOP_REASON_NONE);
+}
+
+static void
+free_stack (GQueue *stack)
+{
+  GSwatDebuggableFrame *frame;
+
+  while ((frame = g_queue_pop_head (stack)))
+    {
+      GList *l;
+
+      for (l = frame->arguments; l; l = l->next)
+	{
+	  GSwatDebuggableFrameArgument *arg = l->data;
+	  g_free (arg->name);
+	  g_free (arg->value);
+	  g_free (arg);
+	}
+      g_list_free (frame->arguments);
+      g_free (frame->function);
+      g_free (frame->source_uri);
+      g_free (frame);
+    }
+}
+
+static void
+test_decode_records (void)
+{
+  GQueue stack = G_QUEUE_INIT;
+  GSwatDebuggableFrame *frame, stopped_frame = { 0, };
+  GSwatDebuggableFrameArgument *arg;
+  GSwatDebuggableBreakpoint breakpoint = { 0, };
+  GSwatGdbMIStopReason reason;
+  GSwatGdbMIVarobj varobj, *child;
+  GSwatGdbMIVarobjChange *change;
+  GList *list;
+  guint depth;
+
+  g_assert (gswat_gdb_mi_decode_stack (corpus[2], &stack, NULL, NULL));
+  g_assert_cmpint (stack.length, ==, 2);
+  frame = g_queue_peek_nth (&stack, 0);
+  g_assert_cmpuint (frame->level, ==, 0);
+  g_assert_cmpuint (frame->address, ==, 0x1076c);
+  g_assert_cmpstr (frame->function, ==, "foo");
+  g_assert_cmpstr (frame->source_uri, ==, "/home/foo/bar/recurse.c");
+  g_assert_cmpint (frame->line, ==, 11);
+  frame = g_queue_peek_nth (&stack, 1);
+  g_assert_cmpuint (frame->level, ==, 1);
+  g_assert_cmpstr (frame->source_uri, ==, "recurse.c");
+  g_assert_cmpint (frame->line, ==, 14);
+
+  g_assert (gswat_gdb_mi_decode_stack_args (corpus[3], &stack));
+  frame = g_queue_peek_nth (&stack, 0);
+  g_assert_cmpint (g_list_length (frame->arguments), ==, 2);
+  arg = frame->arguments->data;
+  g_assert_cmpstr (arg->name, ==, "a");
+  g_assert_cmpstr (arg->value, ==, "1");
+  arg = frame->arguments->next->data;
+  g_assert_cmpstr (arg->name, ==, "s");
+  g_assert_cmpstr (arg->value, ==, "0x8048600 \"hi\\n\\t\"");
+  frame = g_queue_peek_nth (&stack, 1);
+  g_assert (frame->arguments == NULL);
+  free_stack (&stack);
+
+  g_assert (gswat_gdb_mi_decode_stack_depth ("^done,depth=\"12\"", &depth));
+  g_assert_cmpuint (depth, ==, 12);
+  g_assert (!gswat_gdb_mi_decode_stack_depth (corpus[2], &depth));
+
+  g_assert (gswat_gdb_mi_decode_frame_arguments (corpus[3], 0, &list));
+  g_assert_cmpint (g_list_length (list), ==, 2);
+  arg = list->data;
+  g_assert_cmpstr (arg->name, ==, "a");
+  g_assert_cmpstr (arg->value, ==, "1");
+  gswat_debuggable_free_frame_arguments (list);
+  g_assert (gswat_gdb_mi_decode_frame_arguments (corpus[3], 1, &list));
+  g_assert (list == NULL);
+  g_assert (!gswat_gdb_mi_decode_frame_arguments (corpus[3], 2, &list));
+
+  g_assert (gswat_gdb_mi_decode_stopped (corpus[4], &reason,
+					 &stopped_frame, NULL, NULL));
+  g_assert_cmpint (reason, ==, GSWAT_GDB_MI_STOP_REASON_BREAKPOINT_HIT);
+  g_assert_cmpstr (stopped_frame.function, ==, "main");
+  g_assert_cmpstr (stopped_frame.source_uri, ==, "/home/nickrob/myprog.c");
+  g_assert_cmpint (stopped_frame.line, ==, 68);
+  g_assert (stopped_frame.arguments == NULL);
+  g_free (stopped_frame.function);
+  g_free (stopped_frame.source_uri);
+
+  g_assert (gswat_gdb_mi_decode_breakpoint (corpus[1], &breakpoint,
+					    NULL, NULL));
+  g_assert_cmpstr (breakpoint.source_uri, ==, "/home/nickrob/myprog.c");
+  g_assert_cmpint (breakpoint.line, ==, 68);
+  g_free (breakpoint.source_uri);
+
+  g_assert (gswat_gdb_mi_decode_varobj (corpus[5], &varobj));
+  g_assert_cmpstr (varobj.name, ==, "var1");
+  g_assert_cmpint (varobj.child_count, ==, 1);
+  g_assert_cmpstr (varobj.value, ==, "0x0");
+  g_assert_cmpstr (varobj.type, ==, "int *");
+  gswat_gdb_mi_varobj_clear (&varobj);
+  g_assert (gswat_gdb_mi_decode_varobj ("^done", &varobj));
+  g_assert_cmpint (varobj.child_count, ==, -1);
+
+  g_assert (gswat_gdb_mi_decode_varobj_children (corpus[6], &list));
+  g_assert_cmpint (g_list_length (list), ==, 2);
+  child = list->data;
+  g_assert_cmpstr (child->name, ==, "var1.a");
+  g_assert_cmpstr (child->expression, ==, "a");
+  g_assert_cmpstr (child->type, ==, "int");
+  g_assert_cmpint (child->child_count, ==, 0);
+  g_assert (child->value == NULL);
+  child = list->next->data;
+  g_assert_cmpstr (child->name, ==, "var1.b");
+  g_list_foreach (list, (GFunc)gswat_gdb_mi_varobj_free, NULL);
+  g_list_free (list);
+
+  g_assert (gswat_gdb_mi_decode_changelist (corpus[7], &list));
+  g_assert_cmpint (g_list_length (list), ==, 2);
+  change = list->data;
+  g_assert_cmpstr (change->name, ==, "var1");
+  g_assert (change->in_scope);
+  g_assert (!change->type_changed);
+  g_assert_cmpint (change->new_child_count, ==, -1);
+  g_assert (change->new_type == NULL);
+  change = list->next->data;
+  g_assert_cmpstr (change->name, ==, "var2");
+  g_assert (!change->in_scope);
+  g_list_foreach (list, (GFunc)gswat_gdb_mi_varobj_change_free, NULL);
+  g_list_free (list);
+}
+
+/* Decoding every prefix of the records must fail cleanly */
+static void
+test_decode_truncated (void)
+{
+  int i;
+
+  for (i = 1; i <= 7; i++)
+    {
+      gsize len = strlen (corpus[i]);
+      gsize pos;
+
+      for (pos = 0; pos < len; pos++)
+	{
+	  gchar *copy = g_strndup (corpus[i], pos);
+	  GSwatDebuggableFrame frame = { 0, };
+	  GSwatDebuggableBreakpoint breakpoint = { 0, };
+	  GSwatGdbMIStopReason reason;
+	  GSwatGdbMIVarobj varobj;
+	  GQueue stack = G_QUEUE_INIT;
+	  GList *list;
+
+	  gswat_gdb_mi_decode_stack (copy, &stack, NULL, NULL);
+	  gswat_gdb_mi_decode_stack_args (copy, &stack);
+	  free_stack (&stack);
+
+	  gswat_gdb_mi_decode_stopped (copy, &reason, &frame, NULL, NULL);
+	  g_free (frame.function);
+	  g_free (frame.source_uri);
+
+	  gswat_gdb_mi_decode_breakpoint (copy, &breakpoint, NULL, NULL);
+	  g_free (breakpoint.source_uri);
+
+	  gswat_gdb_mi_decode_varobj (copy, &varobj);
+	  gswat_gdb_mi_varobj_clear (&varobj);
+
+	  if (!gswat_gdb_mi_decode_varobj_children (copy, &list))
+	    g_assert (list == NULL);
+	  g_list_foreach (list, (GFunc)gswat_gdb_mi_varobj_free, NULL);
+	  g_list_free (list);
+
+	  if (!gswat_gdb_mi_decode_changelist (copy, &list))
+	    g_assert (list == NULL);
+	  g_list_foreach (list, (GFunc)gswat_gdb_mi_varobj_change_free, NULL);
+	  g_list_free (list);
+
+	  g_free (copy);
+	}
+    }
+}
+
+static void
+test_stack_snapshot (void)
+{
+  GQueue stack = G_QUEUE_INIT;
+  GSwatStackSnapshot *snapshot;
+  const GSwatDebuggableFrame *frame, *outer_frame;
+  GSwatDebuggableFrameArgument *arg;
+
+  g_assert (gswat_gdb_mi_decode_stack (corpus[2], &stack, NULL, NULL));
+  g_assert (gswat_gdb_mi_decode_stack_args (corpus[3], &stack));
+  snapshot = gswat_stack_snapshot_new (&stack, 5);
+  free_stack (&stack);
+
+  g_assert_cmpuint (gswat_stack_snapshot_get_n_frames (snapshot), ==, 2);
+  g_assert_cmpuint (gswat_stack_snapshot_get_depth (snapshot), ==, 5);
+  g_assert (gswat_stack_snapshot_get_frame (snapshot, 2) == NULL);
+
+  frame = gswat_stack_snapshot_get_frame (snapshot, 0);
+  g_assert_cmpuint (frame->level, ==, 0);
+  g_assert_cmpuint (frame->address, ==, 0x1076c);
+  g_assert_cmpstr (frame->source_uri, ==, "/home/foo/bar/recurse.c");
+  g_assert_cmpint (g_list_length (frame->arguments), ==, 2);
+  arg = frame->arguments->data;
+  g_assert_cmpstr (arg->name, ==, "a");
+  arg = frame->arguments->next->data;
+  g_assert_cmpstr (arg->name, ==, "s");
+  g_assert (frame->arguments->next->prev == frame->arguments);
+
+  /* Both frames are in foo, which is only stored once */
+  outer_frame = gswat_stack_snapshot_get_frame (snapshot, 1);
+  g_assert_cmpuint (outer_frame->level, ==, 1);
+  g_assert (outer_frame->function == frame->function);
+  g_assert (outer_frame->arguments == NULL);
+
+  g_assert (gswat_stack_snapshot_ref (snapshot) == snapshot);
+  gswat_stack_snapshot_unref (snapshot);
+  g_assert_cmpstr (frame->function, ==, "foo");
+  gswat_stack_snapshot_unref (snapshot);
+}
+
+static void
+test_literal_utf8 (void)
+{
+  GDBMIReader reader;
+  gchar *literal;
+
+  literal = gdbmi_literal_dup_utf8 ("plain ascii literal", -1);
+  g_assert_cmpstr (literal, ==, "plain ascii literal");
+  g_free (literal);
+
+  literal = gdbmi_literal_dup_utf8 ("\302\251 2009", -1);
+  g_assert_cmpstr (literal, ==, "\302\251 2009");
+  g_free (literal);
+
+  /* Bytes that aren't valid UTF-8 come back escaped */
+  literal = gdbmi_literal_dup_utf8 ("a\377b\302", -1);
+  g_assert_cmpstr (literal, ==, "a\\377b\\302");
+  g_free (literal);
+
+  literal = gdbmi_literal_dup_utf8 ("abc\377", 3);
+  g_assert_cmpstr (literal, ==, "abc");
+  g_free (literal);
+
+  gdbmi_reader_init (&reader,
+		     "^done,a=\"\\302\\251\",b=\"x\\377y\",c=\"z\"");
+  g_assert (gdbmi_reader_next (&reader) == GDBMI_TOKEN_LITERAL);
+  literal = gdbmi_reader_dup_literal (&reader);
+  g_assert_cmpstr (literal, ==, "\302\251");
+  g_free (literal);
+  g_assert (gdbmi_reader_next (&reader) == GDBMI_TOKEN_LITERAL);
+  literal = gdbmi_reader_dup_literal (&reader);
+  g_assert_cmpstr (literal, ==, "x\\377y");
+  g_free (literal);
+  g_assert (gdbmi_reader_next (&reader) == GDBMI_TOKEN_LITERAL);
+  literal = gdbmi_reader_dup_literal (&reader);
+  g_assert_cmpstr (literal, ==, "z");
+  g_free (literal);
+  gdbmi_reader_clear (&reader);
+}
+
+static void
+ignore_log_handler (const gchar *log_domain,
+		    GLogLevelFlags log_level,
+		    const gchar *message,
+		    gpointer user_data)
+{
+}
+
+int
+main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  /* Parse errors are expected and reported as warnings */
+  g_log_set_always_fatal (G_LOG_LEVEL_CRITICAL | G_LOG_FATAL_MASK);
+  g_log_set_handler ("GSwat", G_LOG_LEVEL_WARNING, ignore_log_handler, NULL);
+
+  g_test_add_func ("/gdbmi/corpus", test_corpus);
+  g_test_add_func ("/gdbmi/corrupted", test_corrupted);
+  g_test_add_func ("/gdbmi/random", test_random);
+  g_test_add_func ("/gdbmi/decode/keywords", test_decode_keywords);
+  g_test_add_func ("/gdbmi/decode/records", test_decode_records);
+  g_test_add_func ("/gdbmi/decode/truncated", test_decode_truncated);
+  g_test_add_func ("/gdbmi/literal-utf8", test_literal_utf8);
+  g_test_add_func ("/gdbmi/stack-snapshot", test_stack_snapshot);
+
+  return g_test_run ();
+}
@@ -0,0 +1,171 @@
+/*
+ * Checks the buffering and rate limiting of GSwatInferiorStream by
+ * writing to the program's side of its terminal, as the program
+ * would.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <glib-object.h>
+#include <gswat/gswat-inferior-stream.h>
+
+#define RATE  (32 * 1024)
+
+typedef struct
+{
+  GSwatInferiorStream *stream;
+  gint slave_fd;
+} Fixture;
+
+static void
+fixture_setup (Fixture *fixture, gconstpointer data)
+{
+  GError *error = NULL;
+
+  fixture->stream = gswat_inferior_stream_new (&error);
+  g_assert_no_error (error);
+
+  fixture->slave_fd =
+    open (gswat_inferior_stream_get_tty_name (fixture->stream),
+	  O_RDWR | O_NOCTTY | O_NONBLOCK);
+  g_assert_cmpint (fixture->slave_fd, >=, 0);
+}
+
+static void
+fixture_teardown (Fixture *fixture, gconstpointer data)
+{
+  close (fixture->slave_fd);
+  g_object_unref (fixture->stream);
+}
+
+static guint64
+n_received (GSwatInferiorStream *stream)
+{
+  return gswat_inferior_stream_get_n_available (stream)
+    + gswat_inferior_stream_get_n_dropped (stream);
+}
+
+/* Writes as the program and runs the main loop until the stream has
+ * read it all in */
+static void
+write_output (Fixture *fixture, const gchar *output)
+{
+  guint64 expected = n_received (fixture->stream) + strlen (output);
+  GTimer *timer = g_timer_new ();
+
+  g_assert_cmpint (write (fixture->slave_fd, output, strlen (output)),
+		   ==, strlen (output));
+
+  while (n_received (fixture->stream) < expected
+	 && g_timer_elapsed (timer, NULL) < 5)
+    if (!g_main_context_iteration (NULL, FALSE))
+      g_usleep (1000);
+  g_timer_destroy (timer);
+
+  g_assert_cmpuint (n_received (fixture->stream), ==, expected);
+}
+
+static void
+assert_buffered (GSwatInferiorStream *stream, const gchar *expected)
+{
+  gchar buffer[64];
+  gsize n;
+
+  n = gswat_inferior_stream_read (stream, buffer, sizeof (buffer) - 1);
+  buffer[n] = '\0';
+  g_assert_cmpstr (buffer, ==, expected);
+}
+
+static void
+test_buffer (Fixture *fixture, gconstpointer data)
+{
+  gswat_inferior_stream_set_max_buffered (fixture->stream, 10);
+
+  write_output (fixture, "0123456");
+  g_assert_cmpuint (gswat_inferior_stream_get_n_available (fixture->stream),
+		    ==, 7);
+  g_assert_cmpuint (gswat_inferior_stream_get_n_dropped (fixture->stream),
+		    ==, 0);
+
+  /* The oldest output makes room for the new */
+  write_output (fixture, "789abc");
+  g_assert_cmpuint (gswat_inferior_stream_get_n_dropped (fixture->stream),
+		    ==, 3);
+  assert_buffered (fixture->stream, "3456789abc");
+
+  /* Output bigger than the whole buffer only keeps its end */
+  write_output (fixture, "012");
+  write_output (fixture, "ABCDEFGHIJKLMNOP");
+  g_assert_cmpuint (gswat_inferior_stream_get_n_dropped (fixture->stream),
+		    ==, 12);
+  assert_buffered (fixture->stream, "GHIJKLMNOP");
+
+  /* Shrinking the buffer drops the oldest output too */
+  write_output (fixture, "0123456789");
+  gswat_inferior_stream_set_max_buffered (fixture->stream, 4);
+  g_assert_cmpuint (gswat_inferior_stream_get_n_dropped (fixture->stream),
+		    ==, 18);
+  assert_buffered (fixture->stream, "6789");
+}
+
+static gboolean
+keep_writing (gpointer data)
+{
+  Fixture *fixture = data;
+  gchar chunk[4096];
+
+  memset (chunk, 'x', sizeof (chunk));
+  while (write (fixture->slave_fd, chunk, sizeof (chunk)) > 0)
+    ;
+
+  return TRUE;
+}
+
+static gboolean
+quit_loop (gpointer data)
+{
+  g_main_loop_quit (data);
+  return FALSE;
+}
+
+static void
+test_rate (Fixture *fixture, gconstpointer data)
+{
+  GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+  guint writer;
+  guint64 received;
+
+  gswat_inferior_stream_set_max_buffered (fixture->stream, 16 * RATE);
+  gswat_inferior_stream_set_max_rate (fixture->stream, RATE);
+
+  /* The program never stops writing, so only the rate limit holds
+   * the reading back. Over a second that is the allowance we start
+   * with, a second's worth, and a second's worth more. */
+  writer = g_timeout_add (5, keep_writing, fixture);
+  g_timeout_add (1000, quit_loop, loop);
+  g_main_loop_run (loop);
+  g_source_remove (writer);
+  g_main_loop_unref (loop);
+
+  received = n_received (fixture->stream);
+  g_assert_cmpuint (received, <=, 2 * RATE + RATE / 4);
+  /* Time spent throttled counts towards the allowance, so reading
+   * keeps up with the limit rather than stalling */
+  g_assert_cmpuint (received, >=, RATE + RATE / 2);
+}
+
+int
+main (int argc, char **argv)
+{
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/inferior-stream/buffer", Fixture, NULL,
+	      fixture_setup, test_buffer, fixture_teardown);
+  g_test_add ("/inferior-stream/rate", Fixture, NULL,
+	      fixture_setup, test_rate, fixture_teardown);
+
+  return g_test_run ();
+}
@@ -0,0 +1,227 @@
+/*
+ * Checks how GSwatSourceIndex maps the file names gdb reports onto
+ * the files under its search paths, using a temporary directory
+ * tree, and that it notices files coming and going.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <gswat/gswat.h>
+#include <gswat/gswat-source-index.h>
+
+typedef struct
+{
+  gchar *root;
+  GSwatSourceIndex *index;
+} Fixture;
+
+static const gchar *tree[] = {
+  "src/a/test.c",
+  "src/b/bar/test.c",
+  "src/lib/util.c",
+};
+
+static void
+create_file (const gchar *root, const gchar *relative)
+{
+  gchar *path = g_build_filename (root, relative, NULL);
+  gchar *dir = g_path_get_dirname (path);
+
+  g_assert_cmpint (g_mkdir_with_parents (dir, 0755), ==, 0);
+  g_assert (g_file_set_contents (path, "", 0, NULL));
+
+  g_free (dir);
+  g_free (path);
+}
+
+static void
+remove_tree (const gchar *path)
+{
+  GDir *dir = g_dir_open (path, 0, NULL);
+  const gchar *name;
+
+  if (dir)
+    {
+      while ((name = g_dir_read_name (dir)))
+	{
+	  gchar *child = g_build_filename (path, name, NULL);
+	  remove_tree (child);
+	  g_free (child);
+	}
+      g_dir_close (dir);
+    }
+  g_remove (path);
+}
+
+static gchar *
+expected_uri (Fixture *fixture, const gchar *relative)
+{
+  gchar *path = g_build_filename (fixture->root, relative, NULL);
+  GFile *file = g_file_new_for_path (path);
+  gchar *uri = g_file_get_uri (file);
+
+  g_object_unref (file);
+  g_free (path);
+
+  return uri;
+}
+
+static void
+assert_lookup (Fixture *fixture, const gchar *filename, const gchar *relative)
+{
+  gchar *uri = gswat_source_index_lookup (fixture->index, filename);
+
+  if (relative)
+    {
+      gchar *expected = expected_uri (fixture, relative);
+      g_assert_cmpstr (uri, ==, expected);
+      g_free (expected);
+    }
+  else
+    g_assert_cmpstr (uri, ==, NULL);
+
+  g_free (uri);
+}
+
+/* Runs the main loop until the lookup gives the file, or nothing if
+ * relative is NULL, or gives up after a few seconds */
+static void
+wait_for_lookup (Fixture *fixture, const gchar *filename, const gchar *relative)
+{
+  gchar *expected = relative ? expected_uri (fixture, relative) : NULL;
+  GTimer *timer = g_timer_new ();
+  gchar *uri = NULL;
+
+  while (g_timer_elapsed (timer, NULL) < 5)
+    {
+      uri = gswat_source_index_lookup (fixture->index, filename);
+      if (g_strcmp0 (uri, expected) == 0)
+	break;
+      g_free (uri);
+      uri = NULL;
+
+      if (!g_main_context_iteration (NULL, FALSE))
+	g_usleep (10000);
+    }
+  g_timer_destroy (timer);
+
+  g_assert_cmpstr (uri, ==, expected);
+  g_free (uri);
+  g_free (expected);
+}
+
+static void
+fixture_setup (Fixture *fixture, gconstpointer data)
+{
+  GList *paths = NULL;
+  GTimer *timer;
+  guint i;
+
+  fixture->root = g_build_filename (g_get_tmp_dir (),
+				    "test-source-index-XXXXXX",
+				    NULL);
+  g_assert (mkdtemp (fixture->root) != NULL);
+  for (i = 0; i < G_N_ELEMENTS (tree); i++)
+    create_file (fixture->root, tree[i]);
+
+  /* The second search path is inside the first */
+  paths = g_list_append (paths,
+			 g_build_filename (fixture->root, "src", NULL));
+  paths = g_list_append (paths,
+			 g_build_filename (fixture->root, "src", "lib", NULL));
+
+  fixture->index = gswat_source_index_new ();
+  gswat_source_index_set_paths (fixture->index, paths);
+  g_list_foreach (paths, (GFunc)g_free, NULL);
+  g_list_free (paths);
+
+  timer = g_timer_new ();
+  while (!gswat_source_index_is_ready (fixture->index)
+	 && g_timer_elapsed (timer, NULL) < 5)
+    if (!g_main_context_iteration (NULL, FALSE))
+      g_usleep (10000);
+  g_timer_destroy (timer);
+  g_assert (gswat_source_index_is_ready (fixture->index));
+}
+
+static void
+fixture_teardown (Fixture *fixture, gconstpointer data)
+{
+  g_object_unref (fixture->index);
+  remove_tree (fixture->root);
+  g_free (fixture->root);
+}
+
+static void
+test_suffix (Fixture *fixture, gconstpointer data)
+{
+  /* The file under a search path whose relative path matches the
+   * most trailing components of the name wins */
+  assert_lookup (fixture, "/build/foo/bar/test.c", "src/b/bar/test.c");
+  assert_lookup (fixture, "/build/foo/a/test.c", "src/a/test.c");
+
+  /* Only whole components match, and a base name alone isn't enough
+   * for a file in a subdirectory of the search path */
+  assert_lookup (fixture, "/build/xb/bar/test.c", NULL);
+  assert_lookup (fixture, "/build/foo/test.c", NULL);
+  assert_lookup (fixture, "/build/foo/missing.c", NULL);
+
+  /* util.c is directly under the second search path, and as
+   * lib/util.c under the first */
+  assert_lookup (fixture, "/build/util.c", "src/lib/util.c");
+  assert_lookup (fixture, "/build/lib/util.c", "src/lib/util.c");
+}
+
+static void
+test_invalidation (Fixture *fixture, gconstpointer data)
+{
+  gchar *path, *from, *to;
+
+  /* Files that couldn't be found are remembered until a file with
+   * the same base name appears */
+  assert_lookup (fixture, "/build/foo/a/new.c", NULL);
+  create_file (fixture->root, "src/a/new.c");
+  wait_for_lookup (fixture, "/build/foo/a/new.c", "src/a/new.c");
+
+  /* This is only found by way of the second search path, which is
+   * also watched for the directory the first one shares with it */
+  assert_lookup (fixture, "/build/extra.c", NULL);
+  create_file (fixture->root, "src/lib/extra.c");
+  wait_for_lookup (fixture, "/build/extra.c", "src/lib/extra.c");
+
+  /* New directories are indexed too. This one is filled in before
+   * it's moved under the search path, so the file in it is there by
+   * the time the directory is scanned */
+  create_file (fixture->root, "staging/c/test.c");
+  from = g_build_filename (fixture->root, "staging", "c", NULL);
+  to = g_build_filename (fixture->root, "src", "c", NULL);
+  g_assert_cmpint (g_rename (from, to), ==, 0);
+  g_free (from);
+  g_free (to);
+  wait_for_lookup (fixture, "/build/c/test.c", "src/c/test.c");
+
+  /* And files that go away are forgotten */
+  assert_lookup (fixture, "/build/foo/bar/test.c", "src/b/bar/test.c");
+  path = g_build_filename (fixture->root, "src", "b", "bar", "test.c", NULL);
+  g_assert_cmpint (g_remove (path), ==, 0);
+  g_free (path);
+  wait_for_lookup (fixture, "/build/foo/bar/test.c", NULL);
+}
+
+int
+main (int argc, char **argv)
+{
+  gswat_init (&argc, &argv);
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/source-index/suffix", Fixture, NULL,
+	      fixture_setup, test_suffix, fixture_teardown);
+  g_test_add ("/source-index/invalidation", Fixture, NULL,
+	      fixture_setup, test_invalidation, fixture_teardown);
+
+  return g_test_run ();
+}